@@ -0,0 +1,55 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BENCH_BENCH_H__
+#define __BENCH_BENCH_H__
+
+#include <string>
+
+namespace bench {
+    typedef void (*Function)();
+
+    /*!
+     * Registers a benchmark to be run by bench_main.
+     * Use BENCH macro instead of instantiating this directly.
+     */
+    class Registrar {
+    public:
+        Registrar(const char *name, Function func);
+    };
+
+    /*!
+     * Returns monotonic time in microseconds.
+     */
+    double now();
+
+    /*!
+     * Prints a single result line.
+     * \param name Name of the measured case.
+     * \param value Measured value.
+     * \param unit Unit of the value.
+     */
+    void report(const std::string &name, double value, const std::string &unit);
+}
+
+#define BENCH(name) \
+    static void bench_##name(); \
+    static bench::Registrar bench_registrar_##name(#name, bench_##name); \
+    static void bench_##name()
+
+#endif // __BENCH_BENCH_H__
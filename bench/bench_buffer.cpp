@@ -0,0 +1,131 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include "bench.h"
+#include "../src/messageprocessor.h"
+#include "../src/networkmessage.h"
+
+namespace {
+    NETWORKMESSAGE(NetworkMessage, BenchMessage, 9)
+        std::string user, path;
+        uint32 token;
+        uint64 size;
+
+        MAKE
+            pack(user);
+            pack(token);
+            pack(path);
+            pack(size);
+        END_MAKE
+
+        PARSE
+            user = unpack_string();
+            token = unpack_int();
+            path = unpack_string();
+            size = unpack_off();
+        END_PARSE
+    END
+
+    /* Parses every message it receives, like the app's sockets do. */
+    class Parser : public NewNet::ClientSocket, public newsoul::MessageProcessor {
+    public:
+        Parser() : newsoul::MessageProcessor(4), parsed(0) {
+            messageReceivedEvent.connect(this, &Parser::onMessageReceived);
+        }
+
+        void onMessageReceived(const MessageData *data) {
+            BenchMessage msg;
+            msg.parse_network_packet(data->data);
+            parsed += msg.token;
+        }
+
+        unsigned long parsed;
+    };
+
+    /* Feed a stream of n messages through the receive buffer in 64 KiB
+       reads and parse them. */
+    void parse(const std::string &name, unsigned int n, size_t pathLength) {
+        BenchMessage out;
+        out.user = "somebody";
+        out.token = 1;
+        out.path = std::string(pathLength, 'x');
+        out.size = 31337;
+        const NewNet::Buffer &packet = out.make_network_packet();
+        std::string stream;
+        for(unsigned int i = 0; i < n; ++i) {
+            uint32 len = packet.count();
+            stream.append((const char *)&len, 4);
+            stream.append((const char *)packet.data(), len);
+        }
+
+        NewNet::RefPtr<Parser> parser = new Parser();
+        double start = bench::now();
+        for(size_t offset = 0; offset < stream.size();) {
+            struct iovec iov[8];
+            size_t want = std::min(stream.size() - offset, (size_t)65536);
+            int count = parser->receiveBuffer().reserve(want, iov, 8);
+            size_t done = 0;
+            for(int i = 0; i < count; ++i) {
+                memcpy(iov[i].iov_base, stream.data() + offset + done, iov[i].iov_len);
+                done += iov[i].iov_len;
+            }
+            parser->receiveBuffer().commit(done);
+            offset += done;
+            parser->onDataReceived(parser.ptr());
+        }
+        double elapsed = bench::now() - start;
+        bench::report(name, elapsed * 1000.0 / n, "ns/msg");
+        bench::report(name + " throughput", stream.size() / elapsed, "MB/s");
+    }
+}
+
+/* Parse small and large peer messages; then hand a transfer's buffers
+   over and queue a large message for sending. */
+BENCH(buffer_messages) {
+    parse("small messages", 200000, 64);
+    parse("64 KiB messages", 2000, 65536);
+
+    const unsigned int rounds = 100000;
+    std::string chunk(256 * 1024, 'x');
+    NewNet::Buffer from, to;
+
+    double start = bench::now();
+    for(unsigned int i = 0; i < rounds; ++i) {
+        from.append((const unsigned char *)chunk.data(), 64);
+        to.take(from);
+        from.take(to);
+    }
+    bench::report("take", (bench::now() - start) * 1000.0 / (rounds * 2), "ns/op");
+
+    from.clear();
+    from.append((const unsigned char *)chunk.data(), chunk.size());
+    start = bench::now();
+    for(unsigned int i = 0; i < rounds / 100; ++i) {
+        to.clear();
+        to.append(from.data(), from.count());
+    }
+    bench::report("256 KiB copy", (bench::now() - start) * 1000.0 / (rounds / 100), "ns/op");
+
+    start = bench::now();
+    for(unsigned int i = 0; i < rounds; ++i) {
+        to.clear();
+        to.append(from);
+    }
+    bench::report("256 KiB share", (bench::now() - start) * 1000.0 / rounds, "ns/op");
+}
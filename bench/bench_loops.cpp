@@ -0,0 +1,141 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <zlib.h>
+#include "bench.h"
+#include "../src/NewNet/nnclientsocket.h"
+#include "../src/NewNet/nnreactor.h"
+#include "../src/NewNet/nnreactorpool.h"
+#include "../src/NewNet/util.h"
+
+namespace {
+    const unsigned int PAIRS = 16;
+    const size_t TOTAL = 32 * 1024 * 1024; // per pair
+
+    /* Keeps its send buffer topped up, like UploadSocket does. */
+    class Source : public NewNet::ClientSocket {
+    public:
+        Source() : m_Left(TOTAL), m_Chunk(256 * 1024, 'x') {
+            setSendSize(262144);
+            dataSentEvent.connect(this, &Source::refill);
+        }
+
+        void refill(NewNet::ClientSocket * = 0) {
+            if(sendBuffer().count() < 65536 && m_Left > 0) {
+                size_t n = std::min(m_Left, m_Chunk.size());
+                send((const unsigned char *)m_Chunk.data(), n);
+                m_Left -= n;
+            }
+        }
+
+    private:
+        size_t m_Left;
+        std::string m_Chunk;
+    };
+
+    /* Checksums what it gets, like a download being verified, and tells
+       the main loop when it's done, like transfers tell their manager. */
+    class Sink : public NewNet::ClientSocket {
+    public:
+        Sink(NewNet::Reactor *main, unsigned int *done) : m_Main(main), m_Done(done), m_Received(0), m_Crc(crc32(0, 0, 0)) {
+            setReceiveSize(262144);
+            dataReceivedEvent.connect(this, &Sink::onDataReceived);
+        }
+
+    private:
+        void onDataReceived(NewNet::ClientSocket *) {
+            struct iovec iov[32];
+            int n = receiveBuffer().segments(iov, 32, receiveBuffer().count());
+            for(int i = 0; i < n; ++i) {
+                m_Crc = crc32(m_Crc, (const Bytef *)iov[i].iov_base, iov[i].iov_len);
+            }
+            m_Received += receiveBuffer().count();
+            receiveBuffer().clear();
+            if(m_Received >= TOTAL) {
+                NewNet::Reactor *main = m_Main;
+                unsigned int *done = m_Done;
+                main->post([main, done]() {
+                    if(++*done == PAIRS) {
+                        main->stop();
+                    }
+                });
+                m_Received = 0;
+            }
+        }
+
+        NewNet::Reactor *m_Main;
+        unsigned int *m_Done;
+        size_t m_Received;
+        uLong m_Crc;
+    };
+
+    NewNet::ClientSocket *wrap(NewNet::ClientSocket *socket, int fd) {
+        setnonblocking(fd);
+        socket->setDescriptor(fd);
+        socket->setSocketState(NewNet::Socket::SocketConnected);
+        return socket;
+    }
+}
+
+/* Moves 16 streams of 32 MiB each, checksummed on arrival, with the
+   sockets spread over 1 to 8 loops. Completion is posted back to the
+   main loop. */
+BENCH(reactor_pool_scaling) {
+    for(unsigned int loops : {1, 2, 4, 8}) {
+        NewNet::RefPtr<NewNet::Reactor> main = new NewNet::Reactor();
+        std::vector<int> fds;
+        unsigned int done = 0;
+        double elapsed;
+        {
+            NewNet::ReactorPool pool(main, loops);
+
+            for(unsigned int i = 0; i < PAIRS; ++i) {
+                int sv[2];
+                if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+                    bench::report("socketpair failed", 0, "");
+                    return;
+                }
+                fds.push_back(sv[0]);
+                fds.push_back(sv[1]);
+
+                Source *source = new Source();
+                source->refill();
+                NewNet::Reactor *loop = pool.loop(i % loops);
+                pool.assign(wrap(new Sink(main, &done), sv[1]), loop);
+                pool.assign(wrap(source, sv[0]), loop);
+            }
+
+            double start = bench::now();
+            pool.start();
+            main->run();
+            elapsed = bench::now() - start;
+            pool.stop();
+        }
+
+        bench::report(std::to_string(loops) + " loops", PAIRS * TOTAL / elapsed, "MB/s");
+
+        for(int fd : fds) {
+            close(fd);
+        }
+    }
+}
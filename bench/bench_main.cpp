@@ -0,0 +1,62 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <utility>
+#include <vector>
+#include "bench.h"
+#include "../src/NewNet/nnlog.h"
+
+static std::vector<std::pair<const char*, bench::Function>> &registry() {
+    static std::vector<std::pair<const char*, bench::Function>> benches;
+    return benches;
+}
+
+bench::Registrar::Registrar(const char *name, Function func) {
+    registry().push_back(std::make_pair(name, func));
+}
+
+double bench::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+void bench::report(const std::string &name, double value, const std::string &unit) {
+    printf("%-48s %14.3f %s\n", name.c_str(), value, unit.c_str());
+}
+
+int main(int argc, char *argv[]) {
+    NNLOG.disable("ALL");
+
+    for(auto &b : registry()) {
+        bool run = argc < 2;
+        for(int i = 1; i < argc; ++i) {
+            if(strcmp(argv[i], b.first) == 0) {
+                run = true;
+            }
+        }
+        if(run) {
+            printf("== %s\n", b.first);
+            b.second();
+        }
+    }
+    return 0;
+}
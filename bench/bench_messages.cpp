@@ -0,0 +1,328 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "bench.h"
+#include "../src/messagecodec.h"
+#include "../src/peermessages.h"
+#include "../src/servermessages.h"
+
+namespace {
+    const int SEARCHRESULTS = 200;
+    const int SEARCHROUNDS = 2000;
+    const int ROOMS = 2000;
+    const int ROOMROUNDS = 200;
+
+    /* PSearchReply payload as it was packed before message codecs,
+       field by field, without compression. */
+    NETWORKMESSAGE(NetworkMessage, LegacySearchReply, 9)
+        std::string user;
+        newsoul::FileList results;
+        uint ticket, avgspeed;
+        uint64 queuelen;
+        bool slotfree;
+
+        MAKE
+            pack(user);
+            pack(ticket);
+            pack((uint32)results.filesCount());
+            for(const auto &dir : results.dirs()) {
+                for(auto it = results.begin(dir); it != results.end(dir); ++it) {
+                    pack((uchar)1);
+                    pack(std::string(results.str(it->name)), true);
+                    pack(it->size);
+                    pack(std::string(results.str(it->ext)));
+                    pack((uint32)it->attrsCount);
+                    for(uint j = 0; j < it->attrsCount; ++j) {
+                        pack(j);
+                        pack(it->attrs[j]);
+                    }
+                }
+            }
+            pack((uchar)slotfree);
+            pack(avgspeed);
+            pack(queuelen);
+        END_MAKE
+
+        PARSE
+            user = unpack_string();
+            ticket = unpack_int();
+            uint n = unpack_int();
+            while(n) {
+                if(buffer.empty()) {
+                    break;
+                }
+                unpack_char();
+                std::string fn = unpack_string();
+                uint64 size = unpack_off();
+                results.addFile(fn, size, unpack_string());
+                int attrs = unpack_int();
+                while(attrs) {
+                    if(buffer.count() < 4) {
+                        break;
+                    }
+                    unpack_int();
+                    results.addAttr(unpack_int());
+                    attrs--;
+                }
+                n--;
+            }
+            slotfree = (unpack_char() != 0);
+            avgspeed = unpack_int();
+            if(buffer.count() >= 8) {
+                queuelen = unpack_off();
+            } else {
+                queuelen = unpack_int();
+            }
+        END_PARSE
+    END
+
+    /* Same payload, through PSearchReply's schema. */
+    NETWORKMESSAGE(NetworkMessage, CodecSearchReply, 9)
+        PSearchReply reply;
+
+        MAKE
+            newsoul::codec::encode(buffer, reply);
+        END_MAKE
+
+        PARSE
+            newsoul::codec::decode(buffer, reply);
+        END_PARSE
+    END
+
+    /* SRoomList as it was parsed before message codecs. */
+    NETWORKMESSAGE(NetworkMessage, LegacyRoomList, 64)
+        RoomList roomlist;
+        PrivRoomList privroomlist;
+
+        PARSE
+            uint32 n = unpack_int();
+            std::vector<std::string> rooms;
+            while(n) {
+                if(buffer.count() < 4) {
+                    break;
+                }
+                rooms.push_back(unpack_string());
+                n--;
+            }
+            unpack_int();
+            for(const auto &room : rooms) {
+                roomlist[room] = unpack_int();
+            }
+            uint32 no = unpack_int();
+            std::vector<std::string> owned;
+            while(no) {
+                if(buffer.count() < 4) {
+                    break;
+                }
+                owned.push_back(unpack_string());
+                no--;
+            }
+            unpack_int();
+            for(const auto &room : owned) {
+                privroomlist[room] = std::pair<uint32, uint32>(unpack_int(), 2);
+            }
+            uint32 nm = unpack_int();
+            std::vector<std::string> member;
+            while(nm) {
+                if(buffer.count() < 4) {
+                    break;
+                }
+                member.push_back(unpack_string());
+                nm--;
+            }
+            unpack_int();
+            for(const auto &room : member) {
+                privroomlist[room] = std::pair<uint32, uint32>(unpack_int(), 0);
+            }
+            uint32 np = unpack_int();
+            while(np) {
+                if(buffer.count() < 4) {
+                    break;
+                }
+                std::string room = unpack_string();
+                if(privroomlist.find(room) != privroomlist.end()) {
+                    privroomlist[room].second = 1;
+                }
+                np--;
+            }
+        END_PARSE
+    END
+
+    /* Makes room lists like the server sends them. */
+    NETWORKMESSAGE(NetworkMessage, RoomListMaker, 64)
+        SRoomList::Lists lists;
+
+        MAKE
+            newsoul::codec::encode(buffer, lists);
+        END_MAKE
+    END
+
+    newsoul::FileList makeResults() {
+        newsoul::FileList results;
+        char name[128];
+        for(int i = 0; i < SEARCHRESULTS; ++i) {
+            if(i % 20 == 0) {
+                snprintf(name, sizeof(name), "Music/Artist %d/Album %d", i / 100, i / 20);
+                results.addDir(name);
+            }
+            snprintf(name, sizeof(name), "Music/Artist %d/Album %d/%02d - Some track title %d.mp3", i / 100, i / 20, i % 20, i);
+            results.addFile(name, 4000000 + i * 1000, "mp3");
+            results.addAttr(320);
+            results.addAttr(240 + i % 60);
+            results.addAttr(0);
+        }
+        return results;
+    }
+
+    /* Strips the message type, as MessageProcessor does. */
+    NewNet::Buffer payload(const NewNet::Buffer &packet) {
+        NewNet::Buffer data(packet);
+        data.seek(4);
+        return data;
+    }
+
+    bool sameResults(const newsoul::FileList &a, const newsoul::FileList &b) {
+        if(a.filesCount() != b.filesCount() || a.dirs().empty() || b.dirs().empty()) {
+            return a.filesCount() == b.filesCount();
+        }
+        const newsoul::FileList::FileEntry *x = a.begin(a.dirs().front());
+        const newsoul::FileList::FileEntry *y = b.begin(b.dirs().front());
+        for(size_t i = 0; i < a.filesCount(); ++i, ++x, ++y) {
+            if(std::string(a.str(x->name)) != b.str(y->name) || x->size != y->size || x->attrsCount != y->attrsCount) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+BENCH(search_reply_codec) {
+    newsoul::FileList results = makeResults();
+
+    double start = bench::now();
+    size_t bytes = 0;
+    for(int i = 0; i < SEARCHROUNDS; ++i) {
+        LegacySearchReply msg;
+        msg.user = "someuser";
+        msg.ticket = i;
+        msg.results = results;
+        msg.avgspeed = 1000;
+        msg.queuelen = 3;
+        msg.slotfree = true;
+        bytes += msg.make_network_packet().count();
+    }
+    bench::report("search reply encode, legacy", (bench::now() - start) / SEARCHROUNDS, "us/msg");
+
+    start = bench::now();
+    size_t codecBytes = 0;
+    for(int i = 0; i < SEARCHROUNDS; ++i) {
+        CodecSearchReply msg;
+        msg.reply = PSearchReply(i, "someuser", results, 1000, 3, true);
+        codecBytes += msg.make_network_packet().count();
+    }
+    bench::report("search reply encode, codec", (bench::now() - start) / SEARCHROUNDS, "us/msg");
+    if(bytes != codecBytes) {
+        bench::report("search reply encode, size mismatch", (double)codecBytes - bytes, "bytes");
+    }
+
+    CodecSearchReply made;
+    made.reply = PSearchReply(1, "someuser", results, 1000, 3, true);
+    NewNet::Buffer data = payload(made.make_network_packet());
+    bench::report("search reply payload", data.count(), "bytes");
+
+    start = bench::now();
+    for(int i = 0; i < SEARCHROUNDS; ++i) {
+        LegacySearchReply msg;
+        msg.parse_network_packet(data);
+    }
+    bench::report("search reply decode, legacy", (bench::now() - start) / SEARCHROUNDS, "us/msg");
+
+    LegacySearchReply expected;
+    expected.parse_network_packet(data);
+
+    start = bench::now();
+    bool same = true;
+    for(int i = 0; i < SEARCHROUNDS; ++i) {
+        CodecSearchReply msg;
+        msg.parse_network_packet(data);
+        same = same && sameResults(msg.reply.results, expected.results);
+    }
+    bench::report("search reply decode, codec", (bench::now() - start) / SEARCHROUNDS, "us/msg");
+    if(!same) {
+        bench::report("search reply decode, results mismatch", 1, "");
+    }
+
+    // Whole message, including compression, as sent over the wire.
+    start = bench::now();
+    for(int i = 0; i < SEARCHROUNDS / 10; ++i) {
+        PSearchReply reply(i, "someuser", results, 1000, 3, true);
+        NewNet::Buffer packet = payload(reply.make_network_packet());
+        PSearchReply parsed;
+        parsed.parse_network_packet(packet);
+    }
+    bench::report("search reply make and parse, compressed", (bench::now() - start) / (SEARCHROUNDS / 10), "us/msg");
+}
+
+BENCH(room_list_codec) {
+    RoomListMaker maker;
+    char name[64];
+    for(int i = 0; i < ROOMS; ++i) {
+        snprintf(name, sizeof(name), "room number %d", i);
+        maker.lists.rooms.push_back(name);
+        maker.lists.users.push_back(i % 500);
+    }
+    for(int i = 0; i < ROOMS / 20; ++i) {
+        snprintf(name, sizeof(name), "private room %d", i);
+        if(i % 2) {
+            maker.lists.owned.push_back(name);
+            maker.lists.ownedUsers.push_back(i);
+        } else {
+            maker.lists.member.push_back(name);
+            maker.lists.memberUsers.push_back(i);
+            if(i % 4 == 0) {
+                maker.lists.operated.push_back(name);
+            }
+        }
+    }
+    NewNet::Buffer data = payload(maker.make_network_packet());
+    bench::report("room list payload", data.count(), "bytes");
+
+    double start = bench::now();
+    size_t legacyRooms = 0;
+    for(int i = 0; i < ROOMROUNDS; ++i) {
+        LegacyRoomList msg;
+        msg.parse_network_packet(data);
+        legacyRooms += msg.roomlist.size() + msg.privroomlist.size();
+    }
+    bench::report("room list decode, legacy", (bench::now() - start) / ROOMROUNDS, "us/msg");
+
+    start = bench::now();
+    size_t codecRooms = 0;
+    for(int i = 0; i < ROOMROUNDS; ++i) {
+        SRoomList msg;
+        msg.parse_network_packet(data);
+        codecRooms += msg.roomlist.size() + msg.privroomlist.size();
+    }
+    bench::report("room list decode, codec", (bench::now() - start) / ROOMROUNDS, "us/msg");
+    if(legacyRooms != codecRooms) {
+        bench::report("room list decode, rooms mismatch", (double)codecRooms - legacyRooms, "rooms");
+    }
+}
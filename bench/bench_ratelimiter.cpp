@@ -0,0 +1,86 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <vector>
+#include <unistd.h>
+#include "bench.h"
+#include "../src/NewNet/nnratelimiter.h"
+
+namespace {
+    typedef NewNet::RefPtr<NewNet::RateLimiter> Limiter;
+
+    /* Let greedy uploads take turns in a fixed order for a second, each
+       taking up to a 256 KiB window. Returns Jain's fairness index of what
+       they got (1 is perfectly even). */
+    double compete(std::vector<Limiter> &uploads) {
+        std::vector<double> got(uploads.size(), 0);
+        double start = bench::now();
+        while(bench::now() - start < 1000000) {
+            for(size_t i = 0; i < uploads.size(); ++i) {
+                ssize_t n = std::min(uploads[i]->available(), (ssize_t)262144);
+                if(n > 0) {
+                    uploads[i]->transferred(n);
+                    got[i] += n;
+                }
+            }
+            usleep(1000);
+        }
+
+        double sum = 0, squares = 0;
+        for(size_t i = 0; i < got.size(); ++i) {
+            sum += got[i];
+            squares += got[i] * got[i];
+        }
+        return sum * sum / (got.size() * squares);
+    }
+}
+
+/* Cost of the per-transfer bookkeeping at a high packet rate, and how
+   evenly 8 uploads to 4 users split a shared 4 MB/s limit. */
+BENCH(ratelimiter) {
+    const unsigned int n = 1000000;
+
+    Limiter global = new NewNet::RateLimiter();
+    global->setLimit(100 * 1000 * 1000);
+    Limiter user = new NewNet::RateLimiter(global);
+    Limiter transfer = new NewNet::RateLimiter(user);
+    double start = bench::now();
+    for(unsigned int i = 0; i < n; ++i) {
+        if(transfer->available() > 0)
+            transfer->transferred(100);
+        transfer->nextWindow();
+    }
+    bench::report("account", (bench::now() - start) * 1000.0 / n, "ns/op");
+
+    Limiter shared = new NewNet::RateLimiter();
+    shared->setLimit(4 * 1000 * 1000);
+    std::vector<Limiter> uploads(8, shared);
+    bench::report("shared limiter", compete(uploads), "fairness");
+
+    Limiter split = new NewNet::RateLimiter();
+    split->setLimit(4 * 1000 * 1000);
+    std::vector<Limiter> users;
+    uploads.clear();
+    for(unsigned int i = 0; i < 8; ++i) {
+        if(i % 2 == 0)
+            users.push_back(new NewNet::RateLimiter(split));
+        uploads.push_back(new NewNet::RateLimiter(users.back()));
+    }
+    bench::report("per-transfer limiters", compete(uploads), "fairness");
+}
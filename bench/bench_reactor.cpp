@@ -0,0 +1,97 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "bench.h"
+#include "../src/NewNet/nnclientsocket.h"
+#include "../src/NewNet/nnreactor.h"
+#include "../src/NewNet/util.h"
+
+namespace {
+    /* Bounces a single byte back and forth with its peer descriptor. */
+    class PingSocket : public NewNet::ClientSocket {
+    public:
+        PingSocket(int peer, unsigned int rounds) : m_Peer(peer), m_Rounds(rounds) {
+            dataReceivedEvent.connect(this, &PingSocket::onDataReceived);
+        }
+
+    private:
+        void onDataReceived(NewNet::ClientSocket *) {
+            receiveBuffer().clear();
+            if(--m_Rounds == 0) {
+                reactor()->stop();
+                return;
+            }
+            if(::write(m_Peer, "x", 1) != 1) {
+                reactor()->stop();
+            }
+        }
+
+        int m_Peer;
+        unsigned int m_Rounds;
+    };
+
+    NewNet::ClientSocket *wrap(NewNet::ClientSocket *socket, int fd) {
+        setnonblocking(fd);
+        socket->setDescriptor(fd);
+        socket->setSocketState(NewNet::Socket::SocketConnected);
+        return socket;
+    }
+}
+
+/* Per-event cost while N idle loopback sockets are watched. */
+BENCH(reactor_idle_sockets) {
+    const unsigned int rounds = 20000;
+
+    for(unsigned int n : {10, 100, 1000, 5000}) {
+        NewNet::RefPtr<NewNet::Reactor> reactor = new NewNet::Reactor();
+        std::vector<int> fds;
+
+        for(unsigned int i = 0; i < n; ++i) {
+            int sv[2];
+            if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+                bench::report("socketpair failed at " + std::to_string(i), 0, "");
+                break;
+            }
+            fds.push_back(sv[0]);
+            fds.push_back(sv[1]);
+            reactor->add(wrap(new NewNet::ClientSocket(), sv[0]));
+        }
+
+        int sv[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+        fds.push_back(sv[0]);
+        fds.push_back(sv[1]);
+        reactor->add(wrap(new PingSocket(sv[1], rounds), sv[0]));
+
+        double start = bench::now();
+        if(::write(sv[1], "x", 1) == 1) {
+            reactor->run();
+        }
+        double elapsed = bench::now() - start;
+
+        bench::report(std::to_string(n) + " idle sockets", elapsed * 1000 / rounds, "ns/event");
+
+        for(int fd : fds) {
+            close(fd);
+        }
+    }
+}
@@ -0,0 +1,106 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <thread>
+#include <vector>
+#include "bench.h"
+#include "../src/NewNet/nnobject.h"
+#include "../src/NewNet/nnrefptr.h"
+#include "../src/NewNet/nnweakrefptr.h"
+
+namespace {
+    const unsigned int N = 10000000;
+
+    /* Counted either way, whatever NN_PTR_ATOMIC says. */
+    template<class Counter> class Counted {
+    public:
+        Counter &refCounter() {
+            return this->counter;
+        }
+
+    private:
+        Counter counter;
+    };
+
+    typedef Counted<NewNet::RefCounter> Plain;
+    typedef Counted<NewNet::AtomicRefCounter> Atomic;
+
+    /* Keeps 64 pointers moving between two objects, like callbacks and
+       sockets being passed around. */
+    template<class Ptr, class T> double assign(T *a, T *b) {
+        std::vector<Ptr> slots(64);
+        double start = bench::now();
+        for(unsigned int i = 0; i < N; ++i) {
+            slots[i & 63] = (i & 64) ? a : b;
+        }
+        return (bench::now() - start) * 1000.0 / N;
+    }
+
+    /* Keeps the compiler from dropping loops that only make pointers. */
+    NewNet::Object * volatile sink;
+
+#ifdef NN_PTR_ATOMIC
+    const char *mode = " (atomic)";
+#else
+    const char *mode = " (plain)";
+#endif
+}
+
+/* What thread safe reference counting costs: RefPtr over both counters,
+   weak references and Objects as built (see NN_PTR_ATOMIC), and atomic
+   references copied by 4 threads at once. */
+BENCH(refptr) {
+    Plain *plainA = new Plain(), *plainB = new Plain();
+    NewNet::RefPtr<Plain> keepPlainA(plainA), keepPlainB(plainB);
+    bench::report("refptr assign (plain)", assign<NewNet::RefPtr<Plain> >(plainA, plainB), "ns/op");
+
+    Atomic *atomicA = new Atomic(), *atomicB = new Atomic();
+    NewNet::RefPtr<Atomic> keepAtomicA(atomicA), keepAtomicB(atomicB);
+    bench::report("refptr assign (atomic)", assign<NewNet::RefPtr<Atomic> >(atomicA, atomicB), "ns/op");
+
+    NewNet::RefPtr<NewNet::Object> a = new NewNet::Object(), b = new NewNet::Object();
+    bench::report(std::string("object refptr assign") + mode, assign<NewNet::RefPtr<NewNet::Object> >(a.ptr(), b.ptr()), "ns/op");
+    bench::report(std::string("weakrefptr assign") + mode, assign<NewNet::WeakRefPtr<NewNet::Object> >(a.ptr(), b.ptr()), "ns/op");
+
+    NewNet::WeakRefPtr<NewNet::Object> weak(a);
+    double start = bench::now();
+    for(unsigned int i = 0; i < N; ++i) {
+        NewNet::RefPtr<NewNet::Object> strong = weak.lock();
+        sink = strong;
+    }
+    bench::report(std::string("weakrefptr lock") + mode, (bench::now() - start) * 1000.0 / N, "ns/op");
+
+    start = bench::now();
+    for(unsigned int i = 0; i < N / 10; ++i) {
+        NewNet::RefPtr<NewNet::Object> object = new NewNet::Object();
+        sink = object;
+    }
+    bench::report(std::string("object lifetime") + mode, (bench::now() - start) * 10000.0 / N, "ns/op");
+
+    std::vector<std::thread> threads;
+    start = bench::now();
+    for(unsigned int t = 0; t < 4; ++t) {
+        threads.push_back(std::thread([atomicA, atomicB]() {
+            assign<NewNet::RefPtr<Atomic> >(atomicA, atomicB);
+        }));
+    }
+    for(std::thread &thread : threads) {
+        thread.join();
+    }
+    bench::report("refptr assign (atomic, 4 threads)", (bench::now() - start) * 1000.0 / (4 * N), "ns/op");
+}
@@ -0,0 +1,153 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "bench.h"
+#include "../src/NewNet/nnclientsocket.h"
+#include "../src/NewNet/nnreactor.h"
+#include "../src/NewNet/util.h"
+
+namespace {
+    const size_t fileSize = 256 * 1024 * 1024;
+
+    /* Uploads a whole file, either the way Upload used to (1 MiB reads
+       appended to the send buffer) or through ClientSocket::sendFile. */
+    class FileSource : public NewNet::ClientSocket {
+    public:
+        FileSource(int file, bool zeroCopy) : m_File(file), m_Offset(0) {
+            setSendSize(262144);
+            dataSentEvent.connect(this, &FileSource::onDataSent);
+            if(zeroCopy) {
+                sendFile(m_File, 0, fileSize);
+                m_Offset = fileSize;
+            }
+            else {
+                refill();
+            }
+        }
+
+    private:
+        void refill() {
+            if(sendBuffer().count() < 10240 && m_Offset < fileSize) {
+                char buf[1024 * 1024];
+                ssize_t n = pread(m_File, buf, sizeof(buf), m_Offset);
+                if(n > 0) {
+                    send((const unsigned char *)buf, n);
+                    m_Offset += n;
+                }
+            }
+        }
+
+        void onDataSent(NewNet::ClientSocket *) {
+            refill();
+            if(!dataWaiting()) {
+                reactor()->stop();
+            }
+        }
+
+        int m_File;
+        size_t m_Offset;
+    };
+
+    double cpuTime() {
+        struct rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+        return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e6 + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+    }
+
+    /* Drains the socket in a child process, so it doesn't count. */
+    pid_t drain(int fd, int peer) {
+        pid_t pid = fork();
+        if(pid == 0) {
+            close(peer);
+            std::vector<char> buf(262144);
+            while(read(fd, buf.data(), buf.size()) > 0);
+            _exit(0);
+        }
+        return pid;
+    }
+
+    bool tcpPair(int sv[2]) {
+        int listener = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if(bind(listener, (struct sockaddr *)&addr, len) != 0 ||
+           listen(listener, 1) != 0 ||
+           getsockname(listener, (struct sockaddr *)&addr, &len) != 0) {
+            close(listener);
+            return false;
+        }
+        sv[0] = socket(AF_INET, SOCK_STREAM, 0);
+        bool ok = connect(sv[0], (struct sockaddr *)&addr, len) == 0;
+        sv[1] = ok ? accept(listener, 0, 0) : -1;
+        close(listener);
+        return sv[1] >= 0;
+    }
+}
+
+/* Sender CPU time needed to upload a page cached file over loopback TCP. */
+BENCH(upload_sendfile) {
+    FILE *tmp = tmpfile();
+    std::string chunk(1024 * 1024, 'x');
+    for(size_t i = 0; i < fileSize; i += chunk.size()) {
+        fwrite(chunk.data(), 1, chunk.size(), tmp);
+    }
+    fflush(tmp);
+    int file = fileno(tmp);
+
+    for(bool zeroCopy : {false, true}) {
+        int sv[2];
+        if(!tcpPair(sv)) {
+            bench::report("loopback connection failed", 0, "");
+            break;
+        }
+        pid_t child = drain(sv[1], sv[0]);
+        close(sv[1]);
+
+        NewNet::RefPtr<NewNet::Reactor> reactor = new NewNet::Reactor();
+        NewNet::ClientSocket *source = new FileSource(file, zeroCopy);
+        setnonblocking(sv[0]);
+        source->setDescriptor(sv[0]);
+        source->setSocketState(NewNet::Socket::SocketConnected);
+        reactor->add(source);
+
+        double cpu = cpuTime();
+        double start = bench::now();
+        reactor->run();
+        double elapsed = bench::now() - start;
+        cpu = cpuTime() - cpu;
+
+        close(sv[0]);
+        waitpid(child, 0, 0);
+
+        std::string name = zeroCopy ? "sendfile" : "buffered reads";
+        bench::report(name + " CPU", cpu / 1e3 * 1024 * 1024 * 1024 / fileSize, "ms/GiB");
+        bench::report(name + " throughput", fileSize / elapsed, "MB/s");
+    }
+
+    fclose(tmp);
+}
@@ -0,0 +1,228 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "bench.h"
+#include "../src/sharesdb.h"
+
+namespace {
+    class BenchSharesDB : public newsoul::SharesDB {
+    public:
+        BenchSharesDB(const std::string &fn) : SharesDB(fn, []{}) { }
+
+        using newsoul::SharesDB::getAttrs;
+
+        sqlite3 *handle() { return this->db; }
+    };
+
+    /* isShared as it was before StatementCache, prepared on every call. */
+    bool isSharedUncached(sqlite3 *db, const std::string &fn) {
+        char *sql = sqlite3_mprintf(
+            "SELECT EXISTS(SELECT 1 FROM DIR WHERE path=%Q LIMIT 1);"
+            , fn.c_str()
+        );
+        sqlite3_stmt *stmt;
+
+        int value = 0;
+        sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+        if(sqlite3_step(stmt) == SQLITE_ROW) {
+            value = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+
+        sqlite3_free(sql);
+        return value;
+    }
+
+    /* Likewise for getAttrs. */
+    int getAttrsUncached(sqlite3 *db, const std::string &fn, newsoul::File *fe) {
+        char *sql = sqlite3_mprintf(
+            "SELECT * FROM FILE WHERE dirID=("
+            "SELECT ID FROM DIR WHERE path=%Q)"
+            "LIMIT 1;"
+            , fn.c_str()
+        );
+        sqlite3_stmt *stmt;
+
+        sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+        sqlite3_free(sql);
+        if(sqlite3_step(stmt) == SQLITE_ROW) {
+            fe->size = sqlite3_column_int(stmt, 1);
+            const unsigned char *ext = sqlite3_column_text(stmt, 2);
+            fe->ext = std::string(reinterpret_cast<const char*>(ext));
+            fe->mtime = sqlite3_column_int(stmt, 3);
+            fe->attrs = std::vector<unsigned int>({
+                (unsigned int)sqlite3_column_int(stmt, 4),
+                (unsigned int)sqlite3_column_int(stmt, 5),
+                (unsigned int)sqlite3_column_int(stmt, 6)
+            });
+            sqlite3_finalize(stmt);
+            return 0;
+        }
+        sqlite3_finalize(stmt);
+        return 1;
+    }
+
+    void populate(sqlite3 *db, unsigned int dirs, unsigned int files, std::vector<std::string> &paths) {
+        sqlite3_stmt *dir;
+        sqlite3_stmt *file;
+        sqlite3_stmt *attrs;
+
+        sqlite3_exec(db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+        sqlite3_prepare_v2(db,
+            "INSERT INTO DIR(path, parentID, type) VALUES(?, 0, 1);"
+        , -1, &dir, NULL);
+        sqlite3_prepare_v2(db,
+            "INSERT INTO DIR(path, parentID, type) VALUES(?, ?, 0);"
+        , -1, &file, NULL);
+        sqlite3_prepare_v2(db,
+            "INSERT INTO FILE(dirID, size, ext, mtime, bitrate, length, vbr) "
+            "VALUES(?, 4000000, 'mp3', 1400000000, 320, 240, 0);"
+        , -1, &attrs, NULL);
+        for(unsigned int i = 0; i < dirs; ++i) {
+            const std::string d = "/music/album " + std::to_string(i);
+            sqlite3_bind_text(dir, 1, d.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_step(dir);
+            sqlite3_reset(dir);
+            sqlite3_int64 parent = sqlite3_last_insert_rowid(db);
+            for(unsigned int j = 0; j < files; ++j) {
+                paths.push_back(d + "/track " + std::to_string(j) + ".mp3");
+                sqlite3_bind_text(file, 1, paths.back().c_str(), -1, SQLITE_TRANSIENT);
+                sqlite3_bind_int64(file, 2, parent);
+                sqlite3_step(file);
+                sqlite3_reset(file);
+                sqlite3_bind_int64(attrs, 1, sqlite3_last_insert_rowid(db));
+                sqlite3_step(attrs);
+                sqlite3_reset(attrs);
+            }
+        }
+        sqlite3_finalize(attrs);
+        sqlite3_finalize(file);
+        sqlite3_finalize(dir);
+        sqlite3_exec(db, "COMMIT TRANSACTION;", NULL, NULL, NULL);
+    }
+}
+
+/* Lookups done for every upload request (isShared, twice) and every
+   search hit without the index (getAttrs), on 20k files. */
+BENCH(sharesdb_lookups) {
+    const unsigned int n = 100000;
+
+    char tmpl[] = "/tmp/newsoul-bench-XXXXXX";
+    if(mkdtemp(tmpl) == NULL) {
+        bench::report("cannot create temporary directory", 0, "");
+        return;
+    }
+    const std::string dir(tmpl);
+    BenchSharesDB *db = new BenchSharesDB(dir);
+    std::vector<std::string> paths;
+    populate(db->handle(), 200, 100, paths);
+
+    unsigned int found = 0;
+    double start = bench::now();
+    for(unsigned int i = 0; i < n; ++i) {
+        found += isSharedUncached(db->handle(), paths[(i * 7919) % paths.size()]);
+    }
+    bench::report("isShared, prepared per call", (bench::now() - start) / n, "us/op");
+
+    start = bench::now();
+    for(unsigned int i = 0; i < n; ++i) {
+        found += db->isShared(paths[(i * 7919) % paths.size()]);
+    }
+    bench::report("isShared, cached statement", (bench::now() - start) / n, "us/op");
+
+    newsoul::File fe;
+    start = bench::now();
+    for(unsigned int i = 0; i < n; ++i) {
+        found += getAttrsUncached(db->handle(), paths[(i * 7919) % paths.size()], &fe) == 0;
+    }
+    bench::report("getAttrs, prepared per call", (bench::now() - start) / n, "us/op");
+
+    start = bench::now();
+    for(unsigned int i = 0; i < n; ++i) {
+        found += db->getAttrs(paths[(i * 7919) % paths.size()], &fe) == 0;
+    }
+    bench::report("getAttrs, cached statement", (bench::now() - start) / n, "us/op");
+
+    if(found != 4 * n) {
+        bench::report("missed lookups", 4 * n - found, "");
+    }
+
+    delete db;
+    unlink((dir + "/shares.db").c_str());
+    unlink((dir + "/shares.cache").c_str());
+    rmdir(dir.c_str());
+}
+
+/* Case repair of upload requests on a 1M rows DIR table,
+   compared to the LOWER(path) scan it used to be.
+   Filling the table takes about a minute. */
+BENCH(sharesdb_proper_case) {
+    const unsigned int n = 100000;
+
+    char tmpl[] = "/tmp/newsoul-bench-XXXXXX";
+    if(mkdtemp(tmpl) == NULL) {
+        bench::report("cannot create temporary directory", 0, "");
+        return;
+    }
+    const std::string dir(tmpl);
+    BenchSharesDB *db = new BenchSharesDB(dir);
+    std::vector<std::string> paths;
+    double start = bench::now();
+    populate(db->handle(), 10000, 99, paths);
+    bench::report("populate", (bench::now() - start) / 1e6, "s");
+
+    std::vector<std::string> upper;
+    for(const std::string &path : paths) {
+        upper.push_back(path);
+        std::transform(path.begin(), path.end(), upper.back().begin(), ::toupper);
+    }
+
+    unsigned int found = 0;
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(db->handle(), "SELECT path FROM DIR WHERE LOWER(path)=LOWER(?);", -1, &stmt, NULL);
+    start = bench::now();
+    for(unsigned int i = 0; i < 20; ++i) {
+        sqlite3_bind_text(stmt, 1, upper[(i * 7919) % upper.size()].c_str(), -1, SQLITE_STATIC);
+        found += sqlite3_step(stmt) == SQLITE_ROW;
+        sqlite3_reset(stmt);
+    }
+    bench::report("toProperCase, LOWER(path) scan", (bench::now() - start) / 20, "us/op");
+    sqlite3_finalize(stmt);
+
+    start = bench::now();
+    for(unsigned int i = 0; i < n; ++i) {
+        found += !db->toProperCase(upper[(i * 7919) % upper.size()]).empty();
+    }
+    bench::report("toProperCase, NOCASE index", (bench::now() - start) / n, "us/op");
+
+    if(found != 20 + n) {
+        bench::report("missed lookups", 20 + n - found, "");
+    }
+
+    delete db;
+    unlink((dir + "/shares.db").c_str());
+    unlink((dir + "/shares.cache").c_str());
+    rmdir(dir.c_str());
+}
@@ -0,0 +1,127 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "bench.h"
+#include "../src/NewNet/nnclientsocket.h"
+#include "../src/NewNet/nnreactor.h"
+#include "../src/NewNet/util.h"
+
+namespace {
+    const size_t total = 256 * 1024 * 1024;
+
+    /* Keeps its send buffer topped up, like UploadSocket does. */
+    class Source : public NewNet::ClientSocket {
+    public:
+        Source() : m_Left(total), m_Chunk(1024 * 1024, 'x') {
+            dataSentEvent.connect(this, &Source::refill);
+        }
+
+        void refill(NewNet::ClientSocket * = 0) {
+            if(sendBuffer().count() < 10240 && m_Left > 0) {
+                size_t n = std::min(m_Left, m_Chunk.size());
+                send((const unsigned char *)m_Chunk.data(), n);
+                m_Left -= n;
+            }
+        }
+
+    private:
+        size_t m_Left;
+        std::string m_Chunk;
+    };
+
+    /* Throws away what it gets, like DownloadSocket does after writing. */
+    class Sink : public NewNet::ClientSocket {
+    public:
+        Sink() : m_Received(0) {
+            dataReceivedEvent.connect(this, &Sink::onDataReceived);
+        }
+
+    private:
+        void onDataReceived(NewNet::ClientSocket *) {
+            m_Received += receiveBuffer().count();
+            receiveBuffer().clear();
+            if(m_Received >= total) {
+                reactor()->stop();
+            }
+        }
+
+        size_t m_Received;
+    };
+
+    NewNet::ClientSocket *wrap(NewNet::ClientSocket *socket, int fd) {
+        setnonblocking(fd);
+        socket->setDescriptor(fd);
+        socket->setSocketState(NewNet::Socket::SocketConnected);
+        return socket;
+    }
+
+    bool tcpPair(int sv[2]) {
+        int listener = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if(bind(listener, (struct sockaddr *)&addr, len) != 0 ||
+           listen(listener, 1) != 0 ||
+           getsockname(listener, (struct sockaddr *)&addr, &len) != 0) {
+            close(listener);
+            return false;
+        }
+        sv[0] = socket(AF_INET, SOCK_STREAM, 0);
+        bool ok = connect(sv[0], (struct sockaddr *)&addr, len) == 0;
+        sv[1] = ok ? accept(listener, 0, 0) : -1;
+        close(listener);
+        return sv[1] >= 0;
+    }
+}
+
+/* Pushes 256 MiB through a loopback TCP connection with different I/O
+   windows. 1 KiB is what ClientSocket used to do per wake up. */
+BENCH(clientsocket_throughput) {
+    for(size_t window : {1024, 65536, 262144}) {
+        int sv[2];
+        if(!tcpPair(sv)) {
+            bench::report("loopback connection failed", 0, "");
+            return;
+        }
+
+        NewNet::RefPtr<NewNet::Reactor> reactor = new NewNet::Reactor();
+        Source *source = new Source();
+        Sink *sink = new Sink();
+        source->setSendSize(window);
+        sink->setReceiveSize(window);
+        reactor->add(wrap(sink, sv[1]));
+        reactor->add(wrap(source, sv[0]));
+        source->refill();
+
+        double start = bench::now();
+        reactor->run();
+        double elapsed = bench::now() - start;
+
+        bench::report(std::to_string(window / 1024) + " KiB window", total / elapsed, "MB/s");
+
+        close(sv[0]);
+        close(sv[1]);
+    }
+}
@@ -0,0 +1,89 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdlib>
+#include <vector>
+#include "bench.h"
+#include "../src/NewNet/nnreactor.h"
+
+namespace {
+    typedef NewNet::Reactor::Timeout Timeout;
+
+    class Counter : public NewNet::Object {
+    public:
+        Counter() : fired(0) {}
+        void onTimeout(long) { ++fired; }
+
+        unsigned int fired;
+    };
+
+    /* Exposes timeout expiry, so it can be driven without a main loop. */
+    class TimerReactor : public NewNet::Reactor {
+    public:
+        bool expire() {
+            struct timeval timeout;
+            bool timeout_set = false;
+            return checkTimeouts(timeout, timeout_set);
+        }
+    };
+}
+
+/* Arm, rearm, cancel and expire 100k timeouts, spread like the app's
+   (from a second up to a few hours). */
+BENCH(reactor_timeouts) {
+    const unsigned int n = 100000;
+
+    NewNet::RefPtr<TimerReactor> reactor = new TimerReactor();
+    NewNet::RefPtr<Counter> counter = new Counter();
+    std::vector<NewNet::RefPtr<Timeout::Callback> > callbacks;
+    std::vector<long> delays;
+    srand(0);
+    for(unsigned int i = 0; i < n; ++i) {
+        callbacks.push_back(Timeout::bind(counter.ptr(), &Counter::onTimeout));
+        delays.push_back(1000 + rand() % (6 * 3600 * 1000));
+    }
+
+    double start = bench::now();
+    for(unsigned int i = 0; i < n; ++i) {
+        reactor->addTimeout(delays[i], callbacks[i]);
+    }
+    bench::report("arm", (bench::now() - start) * 1000 / n, "ns/op");
+
+    start = bench::now();
+    for(unsigned int i = 0; i < n; ++i) {
+        reactor->addTimeout(delays[n - i - 1], callbacks[i]);
+    }
+    bench::report("rearm", (bench::now() - start) * 1000 / n, "ns/op");
+
+    start = bench::now();
+    for(unsigned int i = 0; i < n; ++i) {
+        reactor->removeTimeout(callbacks[(i * 7919) % n]);
+    }
+    bench::report("cancel", (bench::now() - start) * 1000 / n, "ns/op");
+
+    for(unsigned int i = 0; i < n; ++i) {
+        reactor->addTimeout(0, callbacks[i]);
+    }
+    start = bench::now();
+    reactor->expire();
+    bench::report("expire", (bench::now() - start) * 1000 / n, "ns/op");
+
+    if(counter->fired != n) {
+        bench::report("missed timeouts", n - counter->fired, "");
+    }
+}
@@ -4,6 +4,11 @@ newoption {
     description = "Installation prefix"
 }
 
+newoption {
+    trigger = "atomic-refs",
+    description = "Thread safe reference counting, uploads and downloads then run on reactor loops of their own"
+}
+
 if not _OPTIONS["prefix"] then
     _OPTIONS["prefix"] = "/usr"
 end
@@ -31,7 +36,7 @@ newaction {
 }
 
 function link(tests)
-    links {"z", "event", "nettle", "json-c", "sqlite3", "pcrecpp", "pcre"}
+    links {"z", "event", "nettle", "json-c", "sqlite3", "pcrecpp", "pcre", "pthread"}
     if not tests then
         links {"tag"}
     else
@@ -51,6 +56,10 @@ solution "newsoul"
     flags {"ExtraWarnings"}
     buildoptions {"-std=c++11"}
 
+    if _OPTIONS["atomic-refs"] then
+        defines {"NN_PTR_ATOMIC"}
+    end
+
     configuration "debug"
         defines {"DEBUG"}
         flags {"Symbols"}
@@ -74,3 +83,9 @@ solution "newsoul"
             "-include CppUTest/MemoryLeakDetectorNewMacros.h",
             "-include CppUTest/MemoryLeakDetectorMallocMacros.h"
         }
+
+    project "newsoul-bench"
+        kind "ConsoleApp"
+        files {"../src/**.cpp", "../bench/**.cpp"}
+        excludes {"../src/main.cpp"}
+        link()
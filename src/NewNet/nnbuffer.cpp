@@ -19,54 +19,434 @@
  */
 
 #include "nnbuffer.h"
+#include <stddef.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
 
-#define CHUNK_SIZE 8192
+/* Size of the blocks that are recycled. Larger blocks are only allocated
+   for single pieces of data that don't fit. */
+#define BLOCK_SIZE 16384
+/* Maximum number of free blocks that are kept around for reuse. */
+#define POOL_SIZE 256
 
-NewNet::Buffer::Buffer() : m_Ptr(0), m_Pos(0), m_Count(0), m_Left(0)
+/* A block of memory that slices of one or more buffers point into. The
+   bytes below used have been handed out and never change again, only the
+   buffer whose data ends exactly at used may write behind it. */
+struct NewNet::Buffer::Block
 {
+  unsigned int refs;
+  size_t size, used;
+  unsigned char data[1];
+
+  /* Free blocks, one pool per thread so every reactor's loop recycles
+     its own. The pool goes away with its thread while buffers may outlive
+     it, so it's reached through a pointer that is reset by then. Blocks
+     released afterwards are freed right away. */
+  struct Pool
+  {
+    std::vector<Block *> blocks;
+
+    Pool()
+    {
+      current() = this;
+    }
+
+    ~Pool()
+    {
+      current() = 0;
+      drain();
+    }
+
+    void drain()
+    {
+      std::vector<Block *>::iterator it, end = blocks.end();
+      for(it = blocks.begin(); it != end; ++it)
+        free(*it);
+      std::vector<Block *>().swap(blocks);
+    }
+
+    static Pool * & current()
+    {
+      static thread_local Pool * pool = 0;
+      return pool;
+    }
+  };
+
+  static Pool * pool()
+  {
+    Pool * current = Pool::current();
+    if(! current)
+    {
+      /* First use on this thread (or its pool is gone already) */
+      static thread_local Pool pool;
+      current = Pool::current();
+    }
+    return current;
+  }
+
+  /* Get a block with room for at least size bytes. */
+  static Block * create(size_t size)
+  {
+    Block * block;
+    Pool * blocks = pool();
+    if((size <= BLOCK_SIZE) && blocks && ! blocks->blocks.empty())
+    {
+      block = blocks->blocks.back();
+      blocks->blocks.pop_back();
+    }
+    else
+    {
+      size = std::max(size, (size_t)BLOCK_SIZE);
+      block = (Block *)malloc(offsetof(Block, data) + size);
+      assert(block != 0);
+      block->size = size;
+    }
+    block->refs = 1;
+    block->used = 0;
+    return block;
+  }
+
+  /* Drop a reference, recycling the block when it was the last one. */
+  static void release(Block * block)
+  {
+    if(--block->refs > 0)
+      return;
+    Pool * blocks = pool();
+    if((block->size == BLOCK_SIZE) && blocks && (blocks->blocks.size() < POOL_SIZE))
+      blocks->blocks.push_back(block);
+    else
+      free(block);
+  }
+};
+
+NewNet::Buffer::Buffer() : m_Slices(&m_Inline), m_First(0), m_Last(0), m_Capacity(1), m_Count(0), m_Reserved(0)
+{
+}
+
+NewNet::Buffer::Buffer(const Buffer & that) : m_Slices(&m_Inline), m_First(0), m_Last(0), m_Capacity(1), m_Count(0), m_Reserved(0)
+{
+  append(that);
 }
 
-NewNet::Buffer::Buffer(const Buffer & that) : m_Ptr(0), m_Pos(0), m_Count(0), m_Left(0)
+NewNet::Buffer::Buffer(const Buffer & that, size_t offset, size_t n) : m_Slices(&m_Inline), m_First(0), m_Last(0), m_Capacity(1), m_Count(0), m_Reserved(0)
 {
-  append(that.data(), that.count());
+  assert(offset + n <= that.count());
+  for(size_t i = that.m_First; n > 0; ++i)
+  {
+    Slice slice = that.m_Slices[i];
+    if(offset >= slice.length)
+    {
+      offset -= slice.length;
+      continue;
+    }
+    slice.data += offset;
+    slice.length = std::min(slice.length - offset, n);
+    push(slice);
+    n -= slice.length;
+    offset = 0;
+  }
 }
 
 NewNet::Buffer &
 NewNet::Buffer::operator=(const Buffer & that)
 {
-  m_Left += m_Pos + m_Count;
-  m_Pos = m_Count = 0;
-  append(that.data(), that.count());
+  Buffer copy(that);
+  take(copy);
   return *this;
 }
 
 NewNet::Buffer::~Buffer()
 {
-  free(m_Ptr);
+  clear();
+  if(m_Slices != &m_Inline)
+    free(m_Slices);
+}
+
+const unsigned char *
+NewNet::Buffer::pullupSlices(size_t n) const
+{
+  if(m_First == m_Last)
+    return 0;
+
+  // Gather the bytes in a fresh block that replaces the slices they came from
+  Block * block = Block::create(n);
+  while(block->used < n)
+  {
+    Slice & slice = m_Slices[m_First];
+    size_t len = std::min(n - block->used, slice.length);
+    memcpy(block->data + block->used, slice.data, len);
+    block->used += len;
+    slice.data += len;
+    slice.length -= len;
+    if(slice.length == 0)
+      pop_front();
+  }
+  Slice slice = { block, block->data, n };
+  push_front(slice);
+  return block->data;
+}
+
+void
+NewNet::Buffer::copySlices(unsigned char * to, size_t n) const
+{
+  for(size_t i = m_First; n > 0; ++i)
+  {
+    const Slice & slice = m_Slices[i];
+    size_t len = std::min(n, slice.length);
+    memcpy(to, slice.data, len);
+    to += len;
+    n -= len;
+  }
+}
+
+void
+NewNet::Buffer::seekSlices(size_t n)
+{
+  m_Count -= n;
+  while(m_First < m_Last)
+  {
+    Slice & slice = m_Slices[m_First];
+    if(n < slice.length)
+    {
+      slice.data += n;
+      slice.length -= n;
+      break;
+    }
+    n -= slice.length;
+    pop_front();
+  }
 }
 
 void
 NewNet::Buffer::append(const unsigned char * data, size_t n)
 {
-  if(m_Left < n)
+  while(n > 0)
   {
-    if(m_Pos + m_Left >= n)
+    Block * block = writable();
+    if(! block)
     {
-      memmove(m_Ptr, m_Ptr + m_Pos, m_Count);
-      m_Left += m_Pos;
-      m_Pos = 0;
+      block = Block::create(n);
+      Slice slice = { block, block->data, 0 };
+      push_back(slice);
     }
-    else
+    size_t len = std::min(n, block->size - block->used);
+    memcpy(block->data + block->used, data, len);
+    block->used += len;
+    m_Slices[m_Last - 1].length += len;
+    m_Count += len;
+    data += len;
+    n -= len;
+  }
+}
+
+void
+NewNet::Buffer::append(const Buffer & that)
+{
+  if(&that == this)
+  {
+    Buffer copy(that);
+    append(copy);
+    return;
+  }
+
+  for(size_t i = that.m_First; i < that.m_Last; ++i)
+    push(that.m_Slices[i]);
+}
+
+void
+NewNet::Buffer::take(Buffer & that)
+{
+  if(&that == this)
+    return;
+  clear();
+  std::swap(m_Slices, that.m_Slices);
+  std::swap(m_First, that.m_First);
+  std::swap(m_Last, that.m_Last);
+  std::swap(m_Capacity, that.m_Capacity);
+  std::swap(m_Inline, that.m_Inline);
+  std::swap(m_Count, that.m_Count);
+  // The inline slices stay where they are
+  if(m_Slices == &that.m_Inline)
+    m_Slices = &m_Inline;
+  if(that.m_Slices == &m_Inline)
+    that.m_Slices = &that.m_Inline;
+}
+
+void
+NewNet::Buffer::releasePool()
+{
+  Block::Pool * blocks = Block::Pool::current();
+  if(blocks)
+    blocks->drain();
+}
+
+void
+NewNet::Buffer::unshare()
+{
+  for(size_t i = m_First; i < m_Last; ++i)
+  {
+    Slice & slice = m_Slices[i];
+    if(slice.block->refs == 1)
+      continue;
+    Block * block = Block::create(slice.length);
+    memcpy(block->data, slice.data, slice.length);
+    block->used = slice.length;
+    Block::release(slice.block);
+    slice.block = block;
+    slice.data = block->data;
+  }
+}
+
+int
+NewNet::Buffer::reserve(size_t n, struct iovec * iov, int max)
+{
+  assert(max > 0);
+  int count = 0;
+
+  // Start in the free space of the last block, unless that leaves too few
+  // entries to describe the rest
+  Block * block = writable();
+  if(block && ((max > 1) || (block->size - block->used >= n)))
+  {
+    iov[0].iov_base = block->data + block->used;
+    iov[0].iov_len = std::min(n, block->size - block->used);
+    n -= iov[0].iov_len;
+    count = 1;
+  }
+
+  while((n > 0) && (count < max))
+  {
+    block = Block::create((count == max - 1) ? n : std::min(n, (size_t)BLOCK_SIZE));
+    Slice slice = { block, block->data, 0 };
+    push_back(slice);
+    iov[count].iov_base = block->data;
+    iov[count].iov_len = std::min(n, block->size);
+    n -= iov[count].iov_len;
+    ++count;
+  }
+
+  // Every entry is the free space of one of the last slices
+  m_Reserved = m_Last - count;
+  return count;
+}
+
+void
+NewNet::Buffer::commit(size_t n)
+{
+  for(size_t i = m_Reserved; (i < m_Last) && (n > 0); ++i)
+  {
+    Slice & slice = m_Slices[i];
+    size_t len = std::min(n, slice.block->size - slice.block->used);
+    slice.block->used += len;
+    slice.length += len;
+    m_Count += len;
+    n -= len;
+  }
+  assert(n == 0);
+
+  while((m_First < m_Last) && (m_Slices[m_Last - 1].length == 0))
+    pop_back();
+}
+
+int
+NewNet::Buffer::segments(struct iovec * iov, int max, size_t n) const
+{
+  int count = 0;
+  for(size_t i = m_First; (i < m_Last) && (n > 0) && (count < max); ++i)
+  {
+    const Slice & slice = m_Slices[i];
+    iov[count].iov_base = slice.data;
+    iov[count].iov_len = std::min(n, slice.length);
+    n -= iov[count].iov_len;
+    ++count;
+  }
+  return count;
+}
+
+NewNet::Buffer::Block *
+NewNet::Buffer::writable() const
+{
+  if(m_First == m_Last)
+    return 0;
+  const Slice & slice = m_Slices[m_Last - 1];
+  if((slice.data + slice.length != slice.block->data + slice.block->used) || (slice.block->used == slice.block->size))
+    return 0;
+  return slice.block;
+}
+
+void
+NewNet::Buffer::push(const Slice & slice)
+{
+  if(slice.length == 0)
+    return;
+  ++slice.block->refs;
+  m_Count += slice.length;
+
+  // Join slices that continue each other
+  if(m_First < m_Last)
+  {
+    Slice & last = m_Slices[m_Last - 1];
+    if((last.block == slice.block) && (last.data + last.length == slice.data))
     {
-      int newSize = (((n + m_Count + m_Pos) / CHUNK_SIZE) + 1) * CHUNK_SIZE;
-      unsigned char * newPtr = (unsigned char *)realloc(m_Ptr, newSize);
-      assert(newPtr != 0);
-      m_Ptr = newPtr;
-      m_Left = newSize - m_Count - m_Pos;
+      last.length += slice.length;
+      Block::release(slice.block);
+      return;
     }
   }
+  push_back(slice);
+}
+
+void
+NewNet::Buffer::push_back(const Slice & slice)
+{
+  if(m_Last == m_Capacity)
+    grow(0);
+  m_Slices[m_Last++] = slice;
+}
 
-  memcpy(m_Ptr + m_Pos + m_Count, data, n);
-  m_Count += n;
-  m_Left -= n;
+void
+NewNet::Buffer::push_front(const Slice & slice) const
+{
+  if(m_First == 0)
+    grow(1);
+  m_Slices[--m_First] = slice;
+}
+
+void
+NewNet::Buffer::pop_front() const
+{
+  Block::release(m_Slices[m_First].block);
+  if(++m_First == m_Last)
+    m_First = m_Last = 0;
+}
+
+void
+NewNet::Buffer::pop_back()
+{
+  Block::release(m_Slices[--m_Last].block);
+  if(m_First == m_Last)
+    m_First = m_Last = 0;
+}
+
+void
+NewNet::Buffer::grow(size_t front) const
+{
+  size_t n = m_Last - m_First;
+  // Reuse the space of used up slices if that's enough, else double up
+  if(n + 1 > m_Capacity)
+  {
+    size_t capacity = std::max(m_Capacity * 2, (size_t)4);
+    Slice * slices = (Slice *)malloc(capacity * sizeof(Slice));
+    assert(slices != 0);
+    memcpy(slices + front, m_Slices + m_First, n * sizeof(Slice));
+    if(m_Slices != &m_Inline)
+      free(m_Slices);
+    m_Slices = slices;
+    m_Capacity = capacity;
+  }
+  else
+    memmove(m_Slices + front, m_Slices + m_First, n * sizeof(Slice));
+  m_First = front;
+  m_Last = front + n;
 }
@@ -25,12 +25,25 @@
 #include <sys/types.h>
 #include <assert.h>
 #include <string.h>
+#ifndef WIN32
+#include <sys/uio.h>
+#else
+struct iovec
+{
+  void * iov_base;
+  size_t iov_len;
+};
+#endif // ! WIN32
 
 namespace NewNet
 {
   //! A character buffer class.
-  /*! This class provides a simple character buffer that is used by
-      ClientSocket to buffer incoming and outgoing network data. */
+  /*! This class provides a character buffer that is used by ClientSocket
+      to buffer incoming and outgoing network data. The data is kept in a
+      chain of slices of reference counted memory blocks. Blocks are never
+      moved or reallocated: appending only ever writes behind the data that
+      is already there and copies of a buffer (or a part of it) share the
+      blocks instead of duplicating them. */
   class Buffer : public NewNet::Object
   {
   public:
@@ -39,29 +52,57 @@ namespace NewNet
     Buffer();
 
     //! Copy an existing buffer.
-    /*! Copy an existing buffer. */
+    /*! Copy an existing buffer. The data itself is shared, not copied. */
     Buffer(const Buffer & that);
 
+    //! Copy a part of an existing buffer.
+    /*! Create a buffer that holds the n bytes of that starting at offset.
+        The data itself is shared, not copied. Note: this asserts that
+        there are enough bytes in that. */
+    Buffer(const Buffer & that, size_t offset, size_t n);
+
     //! Copy an existing buffer.
-    /*! Copy an exisiting buffer. */
+    /*! Copy an exisiting buffer. The data itself is shared, not copied. */
     Buffer & operator=(const Buffer & that);
 
     //! Destructor.
-    /*! Frees all memory allocated by the buffer. */
+    /*! Releases all memory blocks held by the buffer. */
     ~Buffer();
 
     //! Get a pointer to the start of the buffer.
-    /*! Get a pointer to the start of the character buffer. */
-    unsigned char * data()
+    /*! Get a pointer to the contents of the buffer as one contiguous
+        character array. This copies the data together first if it is
+        spread over several blocks, use pullup(), copy() or segments()
+        when only a part of it is needed. */
+    const unsigned char * data() const
     {
-      return m_Ptr + m_Pos;
+      return pullup(m_Count);
     }
 
-    //! Get a const pointer to the start of the buffer.
-    /*! Get a const pointer to the start of the character buffer. */
-    const unsigned char * data() const
+    //! Get a pointer to the first n bytes of the buffer.
+    /*! Make sure the first n bytes of the buffer are contiguous and get a
+        pointer to them. This only copies data if they are spread over
+        several blocks. Note: this asserts that there are enough bytes in
+        the buffer. The pointer stays valid until the buffer is modified. */
+    const unsigned char * pullup(size_t n) const
+    {
+      assert(n <= m_Count);
+      if((m_First < m_Last) && (m_Slices[m_First].length >= n))
+        return m_Slices[m_First].data;
+      return pullupSlices(n);
+    }
+
+    //! Copy the first n bytes of the buffer.
+    /*! Copy the first n bytes of the buffer to the array pointed to by to
+        without removing them. Note: this asserts that there are enough
+        bytes in the buffer. */
+    void copy(unsigned char * to, size_t n) const
     {
-      return m_Ptr + m_Pos;
+      assert(n <= m_Count);
+      if((m_First < m_Last) && (m_Slices[m_First].length >= n))
+        memcpy(to, m_Slices[m_First].data, n);
+      else
+        copySlices(to, n);
     }
 
     //! Get the number of bytes that are in the buffer.
@@ -80,23 +121,71 @@ namespace NewNet
     }
 
     //! Seek forward in the buffer.
-    /*! Seek forward in the character buffer. Note: this asserts that there
-        are enough bytes in the buffer for the seek operation. It will raise
-        a signal if there's not. Note: calling this may move or reallocate
-        the buffer. All earlier results of data() will be invalidated. */
+    /*! Seek forward in the character buffer, releasing the blocks that
+        were used up. Note: this asserts that there are enough bytes in the
+        buffer for the seek operation. It will raise a signal if there's
+        not. */
     void seek(size_t n)
     {
       assert(n <= m_Count);
-      m_Pos += n;
-      m_Count -= n;
+      if((m_First < m_Last) && (m_Slices[m_First].length > n))
+      {
+        m_Slices[m_First].data += n;
+        m_Slices[m_First].length -= n;
+        m_Count -= n;
+      }
+      else
+        seekSlices(n);
     }
 
     //! Append data to the buffer
-    /*! Append data to the character buffer. Note: calling this may move
-        or reallocate the buffer. All earlier results of data() will be
-        invalidated. */
+    /*! Append data to the character buffer. The data is copied into the
+        free space of the last block and into new blocks from there. */
     void append(const unsigned char * data, size_t n);
 
+    //! Append a buffer to the buffer.
+    /*! Append the contents of another buffer. The data itself is shared,
+        not copied. */
+    void append(const Buffer & that);
+
+    //! Move the contents of another buffer into this one.
+    /*! Replace the contents of the buffer with those of that, leaving that
+        empty. This doesn't touch the data at all. */
+    void take(Buffer & that);
+
+    //! Make room for data at the end of the buffer.
+    /*! Describe free space for at least n bytes at the end of the buffer
+        in at most max entries of iov, allocating blocks where needed.
+        Returns the number of entries used. Bytes written there are only
+        added to the buffer by commit(), which has to be called before the
+        buffer is used otherwise. */
+    int reserve(size_t n, struct iovec * iov, int max);
+
+    //! Add data written to reserved space to the buffer.
+    /*! Add n bytes that were written to the space handed out by the last
+        call to reserve(). Unused blocks are released again. Note: this
+        asserts that there was enough space reserved for them. */
+    void commit(size_t n);
+
+    //! Describe the data in the buffer.
+    /*! Describe at most the first n bytes of the buffer in at most max
+        entries of iov, in order. Returns the number of entries used. The
+        entries stay valid until the buffer is modified. */
+    int segments(struct iovec * iov, int max, size_t n) const;
+
+    //! Stop sharing data with other buffers.
+    /*! Copies the slices whose memory is shared with other buffers into
+        blocks of this buffer's own. Block reference counts aren't thread
+        safe, so do this before handing a buffer over to another thread,
+        see Reactor::post(Buffer &, const BufferTask &). */
+    void unshare();
+
+    //! Free the memory blocks kept for reuse.
+    /*! Released blocks are recycled through a pool per thread. This frees
+        the calling thread's, for memory leak checkers that would otherwise
+        blame whoever released a block first. */
+    static void releasePool();
+
     //! Clear the buffer
     /*! Seeks to the end of the character buffer essentially clearing it. */
     void clear()
@@ -105,8 +194,46 @@ namespace NewNet
     }
 
   private:
-    unsigned char * m_Ptr;
-    size_t m_Pos, m_Count, m_Left;
+    /* A reference counted memory block, see nnbuffer.cpp. */
+    struct Block;
+
+    /* A piece of a memory block that holds data of this buffer. */
+    struct Slice
+    {
+      Block * block;
+      unsigned char * data;
+      size_t length;
+    };
+
+    /* The parts of pullup(), copy() and seek() that span slices. */
+    const unsigned char * pullupSlices(size_t n) const;
+    void copySlices(unsigned char * to, size_t n) const;
+    void seekSlices(size_t n);
+
+    /* Return the last block if data can be written right behind ours. */
+    Block * writable() const;
+
+    /* Share a slice of another buffer. */
+    void push(const Slice & slice);
+
+    /* Add a slice at the end, or in front of the others. */
+    void push_back(const Slice & slice);
+    void push_front(const Slice & slice) const;
+
+    /* Release the first or the last slice. */
+    void pop_front() const;
+    void pop_back();
+
+    /* Make room for one more slice, keeping free entries in front. */
+    void grow(size_t front) const;
+
+    /* The slices are m_Slices[m_First] up to m_Slices[m_Last]. A single
+       slice, the common case for message bodies, is kept in m_Inline so
+       most buffers never allocate their slice array. */
+    mutable Slice * m_Slices;
+    mutable size_t m_First, m_Last, m_Capacity;
+    mutable Slice m_Inline;
+    size_t m_Count, m_Reserved;
   };
 }
 
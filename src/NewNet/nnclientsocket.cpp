@@ -20,13 +20,26 @@
 
 #include "nnclientsocket.h"
 #include "nnlog.h"
+#include <algorithm>
 #include <iostream>
+#ifndef WIN32
+#include <sys/uio.h>
+#endif // ! WIN32
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif // __linux__
+
+/* Maximum number of pieces of a buffer handed to a single read or write. */
+#define IOV_COUNT 32
 
 void
 NewNet::ClientSocket::disconnect(bool invoke)
 {
   if((socketState() == SocketUninitialized) || (descriptor() < 0))
   {
+    /* Still resolving the host, drop its answer when it comes */
+    if(socketState() == SocketConnecting)
+      setSocketState(SocketDisconnected);
     NNLOG("newnet.net.warn", "Trying to disconnect an uninitialized client socket.");
     if (invoke)
       disconnectedEvent(this);
@@ -83,8 +96,39 @@ NewNet::ClientSocket::process()
 
   if(readyState() & StateReceive)
   {
-    unsigned char buf[1024];
-    ssize_t received = ::recv(descriptor(), (char *)buf, 1024, 0);
+    /* Keep reading until the socket is drained, the window is full or the
+       rate limiter says stop. Whatever arrived is reported in one go. */
+    size_t total = 0;
+    ssize_t received = 1; // result of the last read, if any
+    while(total < m_ReceiveSize)
+    {
+      size_t n = m_ReceiveSize - total;
+      if(downRateLimiter())
+        n = std::min(n, (size_t)std::max(downRateLimiter()->available(), (ssize_t)0));
+      if(n == 0)
+        break;
+
+      received = receive(n);
+      if(received <= 0)
+        break;
+
+      if(downRateLimiter())
+        downRateLimiter()->transferred(received);
+      total += received;
+
+      // Short read, nothing more is waiting
+      if((size_t)received < n)
+        break;
+    }
+
+    if(total > 0)
+    {
+      NNLOG("newnet.net.debug", "Received %u bytes on socket %u.", total, descriptor());
+      dataReceivedEvent(this);
+      if(socketState() != SocketConnected)
+        return;
+    }
+
     if(received == -1)
     {
       if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
@@ -108,23 +152,42 @@ NewNet::ClientSocket::process()
       disconnectedEvent(this);
       return;
     }
+  }
+
+  /* Keep writing until there's nothing left to send, the socket is full,
+     the window is full or the rate limiter says stop. dataSentEvent is
+     invoked after every write, so the buffer can be refilled on the way. */
+  size_t total = 0;
+  while((readyState() & StateSend) && dataWaiting() && (total < m_SendSize))
+  {
+    size_t n = m_SendSize - total;
+    if(upRateLimiter())
+      n = std::min(n, (size_t)std::max(upRateLimiter()->available(), (ssize_t)0));
+    if(n == 0)
+      break;
+
+    /* The send buffer was emptied behind our back (e.g. by clear()) */
+    if(m_SendBuffer.empty() && (m_SendFileCount == 0))
+    {
+      setDataWaiting(false);
+      break;
+    }
+
+    ssize_t sent;
+    if(m_SendBuffer.empty())
+    {
+      n = std::min(n, m_SendFileCount);
+      sent = sendFromFile(n);
+    }
     else
     {
-      NNLOG("newnet.net.debug", "Received %i bytes on socket %u.", received, descriptor());
-      if(downRateLimiter())
-        downRateLimiter()->transferred(received);
-      m_ReceiveBuffer.append(buf, received);
-      dataReceivedEvent(this);
+      n = std::min(n, m_SendBuffer.count());
+      sent = transmit(n);
     }
-  }
 
-  if((readyState() & StateSend) && dataWaiting())
-  {
-    size_t n = std::min((size_t)1024, m_SendBuffer.count());
-    ssize_t sent = ::send(descriptor(), (const char *)m_SendBuffer.data(), n, 0);
     if(sent < 0)
     {
-      if(errno == EAGAIN)
+      if((errno == EAGAIN) || (errno == EWOULDBLOCK))
         setReadyState(readyState() & ~StateSend);
       else
       {
@@ -139,9 +202,119 @@ NewNet::ClientSocket::process()
         NNLOG("newnet.net.debug", "Sent %i bytes to socket %u.", sent, descriptor());
         if(upRateLimiter())
           upRateLimiter()->transferred(sent);
-        m_SendBuffer.seek(sent);
-        setDataWaiting(m_SendBuffer.count() != 0);
+        total += sent;
+        setDataWaiting((m_SendBuffer.count() != 0) || (m_SendFileCount != 0));
         dataSentEvent(this);
+        if(socketState() != SocketConnected)
+          return;
+
+        // Short write, the socket is full
+        if((size_t)sent < n)
+          break;
+    }
+  }
+}
+
+ssize_t
+NewNet::ClientSocket::sendFromFile(size_t n)
+{
+#ifdef __linux__
+  if(! m_SendFileCopy)
+  {
+    ssize_t sent = ::sendfile(descriptor(), m_SendFile, &m_SendFileOffset, n);
+    if(sent > 0)
+    {
+      m_SendFileCount -= sent;
+      return sent;
     }
+    if(sent == 0)
+    {
+      // The file got shorter than promised
+      errno = EIO;
+      return -1;
+    }
+    if((errno != EINVAL) && (errno != ENOSYS))
+      return -1;
+
+    NNLOG("newnet.net.debug", "sendfile() unavailable for socket %u, copying instead.", descriptor());
+    m_SendFileCopy = true;
+  }
+#endif // __linux__
+
+  /* Read the piece into the send buffer, what doesn't get through now is
+     sent from there later. */
+  struct iovec iov[IOV_COUNT];
+  int count = m_SendBuffer.reserve(n, iov, IOV_COUNT);
+  size_t total = 0;
+  ssize_t result = 0;
+  for(int i = 0; i < count; ++i)
+  {
+    result = ::pread(m_SendFile, iov[i].iov_base, iov[i].iov_len, m_SendFileOffset + total);
+    if(result > 0)
+      total += result;
+    if((size_t)result != iov[i].iov_len)
+      break;
+  }
+  m_SendBuffer.commit(total);
+  if(total == 0)
+  {
+    if(result == 0)
+      errno = EIO;
+    return -1;
+  }
+  m_SendFileOffset += total;
+  m_SendFileCount -= total;
+
+  // On EAGAIN the data simply stays in the buffer
+  return transmit(total);
+}
+
+ssize_t
+NewNet::ClientSocket::receive(size_t n)
+{
+  /* Read straight into free space at the end of the receive buffer.
+     Blocks are only taken from the pool when data arrives for them, so
+     idle sockets don't keep large buffers around. */
+#ifndef WIN32
+  struct iovec iov[IOV_COUNT];
+  int count = m_ReceiveBuffer.reserve(n, iov, IOV_COUNT);
+  ssize_t received = ::readv(descriptor(), iov, count);
+#else
+  struct iovec iov[1];
+  m_ReceiveBuffer.reserve(n, iov, 1);
+  ssize_t received = ::recv(descriptor(), (char *)iov[0].iov_base, n, 0);
+#endif // ! WIN32
+  m_ReceiveBuffer.commit(received > 0 ? received : 0);
+  return received;
+}
+
+ssize_t
+NewNet::ClientSocket::transmit(size_t n)
+{
+  /* Write the pieces of the send buffer in as few calls as possible, only
+     stop early when the socket doesn't take everything. */
+  size_t total = 0;
+  while(total < n)
+  {
+#ifndef WIN32
+    struct iovec iov[IOV_COUNT];
+    int count = m_SendBuffer.segments(iov, IOV_COUNT, n - total);
+    ssize_t sent = ::writev(descriptor(), iov, count);
+#else
+    struct iovec iov[1];
+    int count = m_SendBuffer.segments(iov, 1, n - total);
+    ssize_t sent = ::send(descriptor(), (const char *)iov[0].iov_base, iov[0].iov_len, 0);
+#endif // ! WIN32
+    if(sent <= 0)
+      return (total > 0) ? (ssize_t)total : sent;
+    m_SendBuffer.seek(sent);
+    total += sent;
+
+    size_t described = 0;
+    for(int i = 0; i < count; ++i)
+      described += iov[i].iov_len;
+    if((size_t)sent < described)
+      break;
   }
+  return total;
 }
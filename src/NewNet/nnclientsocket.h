@@ -39,7 +39,9 @@ namespace NewNet
     //! Create an empty client socket.
     /*! This will create an empty client socket. The client socket starts in
         an uninitialized state without a descriptor. */
-    ClientSocket() : Socket()
+    ClientSocket() : Socket(), m_ReceiveSize(65536), m_SendSize(65536),
+                     m_SendFile(-1), m_SendFileOffset(0), m_SendFileCount(0),
+                     m_SendFileCopy(false)
     {
     }
 
@@ -54,6 +56,15 @@ namespace NewNet
         and send data through the socket. */
     virtual void process();
 
+    //! Stop sharing buffered data.
+    /*! Copies data the send and receive buffers share with other buffers,
+        see Buffer::unshare(). */
+    virtual void unshare()
+    {
+      m_SendBuffer.unshare();
+      m_ReceiveBuffer.unshare();
+    }
+
     //! Append data to the send buffer.
     /*! This is a convenience function that will append data to the send
         buffer and will mark the flag that specifies that the socket wants
@@ -64,6 +75,40 @@ namespace NewNet
       setDataWaiting(m_SendBuffer.count() > 0);
     }
 
+    //! Append a buffer to the send buffer.
+    /*! Like send(const unsigned char *, size_t), but the data of the
+        buffer is shared with the send buffer instead of being copied. */
+    void send(const Buffer & buffer)
+    {
+      m_SendBuffer.append(buffer);
+      setDataWaiting(m_SendBuffer.count() > 0);
+    }
+
+    //! Send a range of a file.
+    /*! Queues n bytes of the open file descriptor fd, starting at offset,
+        to be sent once the send buffer is empty. Where the platform allows
+        it, the data goes from the file to the socket without being copied
+        through user space, otherwise it is read into the send buffer bit
+        by bit. The descriptor is not owned by the socket and has to stay
+        open until the range is sent or replaced. Queueing a range replaces
+        the previous one, an empty range cancels it. */
+    void sendFile(int fd, off_t offset, size_t n)
+    {
+      m_SendFile = fd;
+      m_SendFileOffset = offset;
+      m_SendFileCount = n;
+      m_SendFileCopy = false;
+      setDataWaiting((m_SendBuffer.count() > 0) || (m_SendFileCount > 0));
+    }
+
+    //! Return the number of bytes left of the file range.
+    /*! Returns the number of bytes queued by sendFile() that haven't been
+        sent (or read into the send buffer) yet. */
+    size_t sendFileLeft() const
+    {
+      return m_SendFileCount;
+    }
+
     //! Return a reference to the send buffer.
     /*! Returns a reference to the send buffer. Note: if you manipulate the
         send buffer, be sure to call setDataWaiting(bool) to make sure the
@@ -80,6 +125,38 @@ namespace NewNet
       return m_ReceiveBuffer;
     }
 
+    //! Get the receive window size.
+    /*! Returns the maximum number of bytes read from the socket each time
+        it wakes up. Defaults to 64 KiB. */
+    size_t receiveSize() const
+    {
+      return m_ReceiveSize;
+    }
+
+    //! Set the receive window size.
+    /*! Sets the maximum number of bytes read from the socket each time it
+        wakes up. Bulk transfer sockets should use a large one. */
+    void setReceiveSize(size_t size)
+    {
+      m_ReceiveSize = size;
+    }
+
+    //! Get the send window size.
+    /*! Returns the maximum number of bytes written to the socket each time
+        it wakes up. Defaults to 64 KiB. */
+    size_t sendSize() const
+    {
+      return m_SendSize;
+    }
+
+    //! Set the send window size.
+    /*! Sets the maximum number of bytes written to the socket each time it
+        wakes up. Bulk transfer sockets should use a large one. */
+    void setSendSize(size_t size)
+    {
+      m_SendSize = size;
+    }
+
     //! Invoked when the socket can't connect.
     /*! This event will be invoked when the socket detects it cannot
         connect to the remote host. */
@@ -103,7 +180,21 @@ namespace NewNet
     Event<ClientSocket *> dataSentEvent;
 
   private:
+    /* Receive at most n bytes straight into the receive buffer. */
+    ssize_t receive(size_t n);
+
+    /* Write at most n bytes of the send buffer to the socket. */
+    ssize_t transmit(size_t n);
+
+    /* Send at most n bytes of the file range. */
+    ssize_t sendFromFile(size_t n);
+
     Buffer m_SendBuffer, m_ReceiveBuffer;
+    size_t m_ReceiveSize, m_SendSize;
+    int m_SendFile;
+    off_t m_SendFileOffset;
+    size_t m_SendFileCount;
+    bool m_SendFileCopy;
   };
 }
 
@@ -258,6 +258,14 @@ namespace NewNet
         delete callback;
     }
 
+    //! Check whether any callback is connected.
+    /*! Emitting an event without callbacks does nothing, so the emitter
+        can skip preparing its argument altogether. */
+    bool empty() const
+    {
+      return m_Callbacks.empty();
+    }
+
     //! Emit the event.
     /*! Emit the event, invokes the Callback::operator()(T t) method of all
         registered callbacks. */
@@ -47,7 +47,11 @@ void NewNet::Log::operator()(const std::string & domain, const char * fmt, ...)
       LogNotify notice;
       notice.domain = domain;
       notice.message = p;
-      logEvent(&notice);
+      {
+        /* Callbacks might log too */
+        std::lock_guard<std::recursive_mutex> lock(m_Mutex);
+        logEvent(&notice);
+      }
       free(p);
       return;
     }
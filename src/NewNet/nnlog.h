@@ -24,6 +24,7 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <mutex>
 #include "nnevent.h"
 
 namespace NewNet
@@ -31,7 +32,9 @@ namespace NewNet
   //! Controllable logging class
   /*! This class will let you output messages to the console in a controlled
       fashion. It works by enabling and disabling domains where events
-      can happen. */
+      can happen. Messages can be logged from any thread (reactors of a
+      ReactorPool do), logEvent is emitted by one thread at a time. Enable
+      domains before starting other threads. */
   class Log {
   public:
     typedef struct
@@ -61,6 +64,7 @@ namespace NewNet
   private:
     bool m_AllEnabled;
     std::vector<std::string> m_EnabledDomains;
+    std::recursive_mutex m_Mutex;
   };
 
   //! Console output class.
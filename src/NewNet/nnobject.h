@@ -34,26 +34,84 @@
 
 namespace NewNet
 {
+#ifdef NN_PTR_ATOMIC
+  //! State an object shares with its weak references.
+  /*! Holds the object's reference count and outlives the object for as
+      long as weak references point at it, so they can still tell whether
+      it's there and take a reference to it, from any thread. See
+      WeakRefPtr::lock(). */
+  struct ControlBlock
+  {
+    ControlBlock() : weak(1), alive(true)
+    {
+    }
+
+    //! Hold on to the block.
+    void retain()
+    {
+      weak.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    //! Let go of the block, deleting it if it was the last hold.
+    void release()
+    {
+      if(weak.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete this;
+    }
+
+    AtomicRefCounter strong;        //!< The object's reference count.
+    std::atomic<unsigned int> weak; //!< Weak references, plus one for the object.
+    std::atomic<bool> alive;        //!< False once the object is deleted.
+  };
+#endif // NN_PTR_ATOMIC
+
   //! Base class for objects.
   /*! This provides a base class for NewNet objects. It provides a reference
-      counter and a guard object for detecting deletion of the object. */
+      counter and a guard object for detecting deletion of the object.
+      When built with NN_PTR_ATOMIC, the reference counter is thread safe
+      and lives in a ControlBlock next to the object, which is what weak
+      references use. The guard object is never thread safe. */
   class Object
   {
   public:
+#ifdef NN_PTR_ATOMIC
+    typedef AtomicRefCounter Counter;
+#else
+    typedef RefCounter Counter;
+#endif // NN_PTR_ATOMIC
+
     //! Constructor.
     /*! This constructs a new object. Note that you don't have to call this.
-        It's an empty method. */
+        It's an empty method, unless the control block has to be set up. */
+#ifdef NN_PTR_ATOMIC
+    Object() : m_ControlBlock(new ControlBlock())
+#else
     Object()
+#endif // NN_PTR_ATOMIC
     {
     }
 
     //! Copy constructor.
     /*! Ensures that the reference count of the copied object is 0 and that
         the guard object is empty. */
+#ifdef NN_PTR_ATOMIC
+    Object(const Object &) : m_ControlBlock(new ControlBlock())
+#else
     Object(const Object &)
+#endif // NN_PTR_ATOMIC
     {
     }
 
+#ifdef NN_PTR_ATOMIC
+#ifndef DOXYGEN_UNDOCUMENTED
+    /* Each object keeps its own control block */
+    Object & operator=(const Object &)
+    {
+      return *this;
+    }
+#endif // DOXYGEN_UNDOCUMENTED
+#endif // NN_PTR_ATOMIC
+
     //! Destructor.
     /*! When an object is destroyed, the guard object will be emitted so the
         registered callbacks get called. */
@@ -62,12 +120,16 @@ namespace NewNet
       m_GuardObject.emit(this);
 #ifdef NN_PTR_DEBUG
  #ifdef NN_PTR_DEBUG_ASSERT
-      assert(m_RefCounter.count() == 0);
+      assert(refCounter().count() == 0);
  #else
-      if(m_RefCounter.count() != 0)
-        std::cerr << "Warning: Object " << this << " deleted while refcount = " << m_RefCounter.count() << "." << std::endl;
+      if(refCounter().count() != 0)
+        std::cerr << "Warning: Object " << this << " deleted while refcount = " << refCounter().count() << "." << std::endl;
  #endif // NN_PTR_DEBUG_ASSERT
 #endif // NN_PTR_DEBUG
+#ifdef NN_PTR_ATOMIC
+      m_ControlBlock->alive.store(false, std::memory_order_release);
+      m_ControlBlock->release();
+#endif // NN_PTR_ATOMIC
     }
 
     //! Reference to the guard object.
@@ -81,14 +143,30 @@ namespace NewNet
     //! Reference to the reference counter.
     /*! This returns a reference to the object's reference counter so you can
         manipulate it if you want to. */
-    RefCounter & refCounter()
+    Counter & refCounter()
     {
+#ifdef NN_PTR_ATOMIC
+      return m_ControlBlock->strong;
+#else
       return m_RefCounter;
+#endif // NN_PTR_ATOMIC
+    }
+
+#ifdef NN_PTR_ATOMIC
+    //! Reference to the control block.
+    ControlBlock * controlBlock()
+    {
+      return m_ControlBlock;
     }
+#endif // NN_PTR_ATOMIC
 
   private:
     GuardObject m_GuardObject;
+#ifdef NN_PTR_ATOMIC
+    ControlBlock * m_ControlBlock;
+#else
     RefCounter m_RefCounter;
+#endif // NN_PTR_ATOMIC
   };
 }
 
@@ -19,94 +19,189 @@
  */
 
 #include "nnratelimiter.h"
-#include "util.h"
-#include <vector>
-#include <queue>
 #include <algorithm>
-#include <iostream>
+#include <limits.h>
+
+/* The bucket holds at most this many seconds worth of tokens, which is
+   the largest burst allowed after a quiet period. */
+#define MAX_BURST 1
+/* Smallest number of bytes worth waking up for (unless the rate itself
+   is lower), so slow limits don't cause a stream of tiny transfers. */
+#define MIN_WINDOW 4096
+/* Length in miliseconds of the periods in which the children that use
+   a limiter are counted. */
+#define ACTIVE_PERIOD 500
+
+#ifdef NN_PTR_ATOMIC
+/* Lock the tree for the rest of the scope. */
+ #define LOCK_TREE std::lock_guard<std::mutex> lock(root()->m_Mutex)
+#else
+ #define LOCK_TREE
+#endif // NN_PTR_ATOMIC
+
+static void
+systemClock(struct timeval & now)
+{
+  gettimeofday(&now, 0);
+}
 
-/* Keep at most x seconds of data in the rate buffer */
-#define MAX_HISTORY 5
+NewNet::RateLimiter::RateLimiter(RateLimiter * parent, Clock clock) : m_Parent(parent), m_Clock(clock), m_Limit(-1), m_Rate(-1), m_Tokens(0), m_Period(0), m_Counted(-1), m_Active(0), m_WasActive(0)
+{
+  if(! m_Clock)
+    m_Clock = parent ? parent->m_Clock : &systemClock;
+  m_Clock(m_Last);
+}
 
-#ifndef DOXYGEN_UNDOCUMENTED
-typedef std::pair<struct timeval, ssize_t> RateData;
-struct NewNet::RateLimiter::Data
+#ifndef DOCYGEN_UNDOCUMENTED
+NewNet::RateLimiter::~RateLimiter()
 {
-  std::vector<RateData> rateData;
-};
+}
 #endif // DOXYGEN_UNDOCUMENTED
 
-NewNet::RateLimiter::RateLimiter()
+#ifdef NN_PTR_ATOMIC
+NewNet::RateLimiter *
+NewNet::RateLimiter::root()
 {
-  m_Limit = -1;
-  m_Data = new NewNet::RateLimiter::Data;
+  RateLimiter * root = this;
+  while(root->m_Parent)
+    root = root->m_Parent;
+  return root;
 }
+#endif // NN_PTR_ATOMIC
 
-#ifndef DOXYGEN_UNDOCUMENTED
-NewNet::RateLimiter::~RateLimiter()
+void
+NewNet::RateLimiter::setLimit(ssize_t limit)
 {
-  delete m_Data;
+  LOCK_TREE;
+  if(limit == m_Limit)
+    return;
+
+  /* A new limit starts out with a full bucket, like a quiet period. */
+  m_Limit = limit;
+  m_Tokens = (m_Limit > 0) ? (double)m_Limit * MAX_BURST : 0;
+  m_Clock(m_Last);
+}
+
+double
+NewNet::RateLimiter::refill(const struct timeval & now)
+{
+  double rate = m_Limit;
+  if(m_Parent)
+  {
+    double share = m_Parent->share(this, now);
+    if((share >= 0) && ((rate < 0) || (share < rate)))
+      rate = share;
+  }
+
+  double elapsed = (now.tv_sec - m_Last.tv_sec) + (now.tv_usec - m_Last.tv_usec) / 1000000.0;
+  m_Last = now;
+
+  /* Nothing to add if the clock went backwards. */
+  if((rate > 0) && (elapsed > 0))
+    m_Tokens = std::min(m_Tokens + rate * elapsed, rate * MAX_BURST);
+  m_Rate = rate;
+
+  long period = (now.tv_sec * 1000 + now.tv_usec / 1000) / ACTIVE_PERIOD;
+  if(period != m_Period)
+  {
+    m_WasActive = (period == m_Period + 1) ? m_Active : 0;
+    m_Active = 0;
+    m_Period = period;
+  }
+
+  return rate;
+}
+
+double
+NewNet::RateLimiter::share(RateLimiter * child, const struct timeval & now)
+{
+  double rate = refill(now);
+  if(child->m_Counted != m_Period)
+  {
+    child->m_Counted = m_Period;
+    m_Active++;
+  }
+
+  if(rate <= 0)
+    return rate;
+  return rate / std::max(std::max(m_Active, m_WasActive), 1u);
 }
-#endif // DOXYGEN_UNDOCUMENTED
 
 void
 NewNet::RateLimiter::transferred(ssize_t n)
 {
+  LOCK_TREE;
   struct timeval now;
-  gettimeofday(&now, 0);
-  m_Data->rateData.push_back(RateData(now, n));
+  m_Clock(now);
+  refill(now);
+  take(n);
 }
 
-#ifndef timercmp
-#define timercmp(tvp, uvp, cmp)\
-  ((tvp)->tv_sec cmp (uvp)->tv_sec ||\
-  (tvp)->tv_sec == (uvp)->tv_sec &&\
-  (tvp)->tv_usec cmp (uvp)->tv_usec)
-#endif
-
 void
-NewNet::RateLimiter::flush()
+NewNet::RateLimiter::take(ssize_t n)
 {
-  /* Flush all entries that are older than MAX_HISTORY second(s) */
-  struct timeval tv;
-  gettimeofday(&tv, 0);
-  tv.tv_sec -= MAX_HISTORY;
-  while((! m_Data->rateData.empty()) && timercmp(&tv, &m_Data->rateData.front().first, >))
-    m_Data->rateData.erase(m_Data->rateData.begin());
+  /* Going into debt is fine, it is paid off before the next window. */
+  if(m_Rate > 0)
+    m_Tokens -= n;
+
+  if(m_Parent)
+    m_Parent->take(n);
 }
 
 long
 NewNet::RateLimiter::nextWindow()
 {
-  flush();
+  LOCK_TREE;
+  struct timeval now;
+  m_Clock(now);
+  refill(now);
+  return wait();
+}
 
-  if(m_Limit == -1)
-    return 0;
-  else if(m_Limit == 0)
-    return 60000;
+long
+NewNet::RateLimiter::wait() const
+{
+  long wait = 0;
+  if(m_Rate == 0)
+    wait = 60000;
+  else if(m_Rate > 0)
+  {
+    double window = std::min(m_Rate, (double)MIN_WINDOW);
+    if(m_Tokens < window)
+      wait = std::max((long)((window - m_Tokens) * 1000 / m_Rate), 1L);
+  }
+
+  if(m_Parent)
+    wait = std::max(wait, m_Parent->wait());
+  return wait;
+}
 
-  ssize_t total = 0;
-  std::vector<RateData>::reverse_iterator it, end = m_Data->rateData.rend();
-  for(it = m_Data->rateData.rbegin(); it != end; ++it)
+ssize_t
+NewNet::RateLimiter::available()
+{
+  LOCK_TREE;
+  struct timeval now;
+  m_Clock(now);
+  refill(now);
+  return budget();
+}
+
+ssize_t
+NewNet::RateLimiter::budget() const
+{
+  ssize_t total = SSIZE_MAX;
+  if(m_Rate == 0)
+    total = 0;
+  else if(m_Rate > 0)
   {
-    total += (*it).second;
-    if(total >= m_Limit)
-    {
-      /* Rate limit will be 'unbreached' one second after this frame. */
-
-      struct timeval now;
-      gettimeofday(&now, 0);
-
-      struct timeval tv((*it).first);
-      tv.tv_sec += 1;
-
-      long d = difftime(tv, now);
-      if(d <= 0)
-        return 0;
-      else
-        return d;
-    }
+    /* Below the window the bucket counts as empty, see wait() */
+    if(m_Tokens >= std::min(m_Rate, (double)MIN_WINDOW))
+      total = (ssize_t)m_Tokens;
+    else
+      total = 0;
   }
 
-  return 0;
+  if(m_Parent)
+    total = std::min(total, m_Parent->budget());
+  return total;
 }
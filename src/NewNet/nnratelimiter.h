@@ -22,26 +22,56 @@
 #define NEWNET_RATELIMITER_H
 
 #include "nnobject.h"
+#include "nnrefptr.h"
+#include <sys/types.h>
 #include <sys/time.h>
+#ifdef NN_PTR_ATOMIC
+ #include <mutex>
+#endif // NN_PTR_ATOMIC
 
 namespace NewNet
 {
   //! Helper class for transfer rate limiting.
-  /*! This provides a transfer rate tracker and a method to calculate the
-      next window of opportunity (the moment the maximum transfer rate is
-      no longer broken) */
+  /*! This provides a token bucket that fills up at the maximum transfer
+      rate and is emptied by transferred data, and a method to calculate
+      the next window of opportunity (the moment the bucket holds enough
+      to be worth transferring again). Every operation takes constant time.
+
+      Limiters can be stacked: a limiter with a parent is held to its own
+      limit and to the parent's, and its bucket fills at no more than the
+      parent's rate divided by the number of the parent's children that
+      were active lately. Sockets with limiters that share a parent thus
+      split its bandwidth evenly instead of the first one taking it all.
+
+      When built with NN_PTR_ATOMIC, the limiters of a tree may be used by
+      sockets on different loops (see ReactorPool), the root's mutex then
+      guards all of them. */
   class RateLimiter : public Object
   {
   public:
+    //! Clock the limiter measures time with.
+    /*! Fills in the current time, like gettimeofday() does. */
+    typedef void (*Clock)(struct timeval & now);
+
     //! Constructor.
     /*! Create a new rate limiter. The limit will be initialized to -1 which
-        means that there will be no rate limiting. */
-    RateLimiter();
+        means that there will be no rate limiting. If parent is set, the
+        limiter also keeps to its share of the parent's limit. Time is read
+        from clock, the parent's if none is given and gettimeofday() if
+        there's no parent either. */
+    RateLimiter(RateLimiter * parent = 0, Clock clock = 0);
 
 #ifndef DOCYGEN_UNDOCUMENTED
     ~RateLimiter();
 #endif // DOXYGEN_UNDOCUMENTED
 
+    //! Get the parent limiter.
+    /*! Returns the limiter whose budget this one shares, if any. */
+    RateLimiter * parent() const
+    {
+      return m_Parent;
+    }
+
     //! Get the current transfer rate limit.
     /*! This returns the current transfer rate limit in bytes per second. 0
         means that no traffic will be allowed to be sent. A value of -1 means
@@ -55,36 +85,58 @@ namespace NewNet
     /*! This changes the current transfer rate limit. The limit is measured in
         bytes per second. A value of 0 means that no traffic will be allowed
         to pass. A value of -1 means that no limit is enforced. */
-    void setLimit(ssize_t limit)
-    {
-      m_Limit = limit;
-    }
+    void setLimit(ssize_t limit);
 
     //! Feed bytes to the collector.
-    /*! This adds a frame of bytes to the rate limit collector.
-        NewNet::ClientSocket calls this whenever it received or sent data
-        of the socket. */
+    /*! This takes the bytes from the bucket (and from those of the
+        parents). NewNet::ClientSocket calls this whenever it received or
+        sent data of the socket. */
     void transferred(ssize_t bytes);
 
     //! Next window of opportunity.
     /*! This will predict when the rate limit will be 'unbreached' and when
         data will be allowed to be transferred again. If the limit is set to 0
-        this always returns 60000 (60 seconds). If the limit is set to -1, it
-        always returns 0. Otherwise, it returns the number of miliseconds
-        until the next opportunity. */
+        this always returns 60000 (60 seconds). If the limit (and that of
+        every parent) is set to -1, it always returns 0. Otherwise, it returns
+        the number of miliseconds until the next opportunity. */
     long nextWindow();
 
+    //! Bytes allowed right now.
+    /*! This returns how many bytes can be transferred right now without
+        breaking the limit or taking more than the fair share of a parent's
+        budget. If there's no limit at all, it returns SSIZE_MAX. */
+    ssize_t available();
+
   private:
-    /* Flush old data from the vector */
-    void flush();
+    /* Add the tokens that accumulated until now, for this limiter and
+       its parents. Returns the rate (-1 for none) the bucket filled at. */
+    double refill(const struct timeval & now);
 
-    ssize_t m_Limit;
+    /* Refill and return the rate (-1 for none) a child may fill at. */
+    double share(RateLimiter * child, const struct timeval & now);
 
-#ifndef DOXYGEN_UNDOCUMENTED
-    // The collection data depends on platform specific types, hide it
-    struct Data;
-    struct Data * m_Data;
-#endif // DOXYGEN_UNDOCUMENTED
+    /* The parts of available(), nextWindow() and transferred() that don't
+       refill, walking up the parents. */
+    ssize_t budget() const;
+    long wait() const;
+    void take(ssize_t bytes);
+
+#ifdef NN_PTR_ATOMIC
+    /* The limiter at the top of the tree, whose mutex is locked. */
+    RateLimiter * root();
+
+    std::mutex m_Mutex;
+#endif // NN_PTR_ATOMIC
+
+    RefPtr<RateLimiter> m_Parent;
+    Clock m_Clock;
+    ssize_t m_Limit;
+    double m_Rate, m_Tokens;
+    struct timeval m_Last;
+    /* Children counted in the current and the last period, and the period
+       in which we were last counted by our parent. */
+    long m_Period, m_Counted;
+    unsigned int m_Active, m_WasActive;
   };
 }
 
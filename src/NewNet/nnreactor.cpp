@@ -24,17 +24,204 @@
 #include "util.h"
 #include <algorithm>
 #include <iostream>
-#include <queue>
+#include <unordered_map>
 #include <assert.h>
+#include <errno.h>
+#include <stdint.h>
 #include <sys/resource.h>
+#include <unistd.h>
+
+/* Timeouts are kept in a hierarchical timing wheel: TIMER_LEVELS levels of
+   TIMER_SLOTS slots each. The first level has a resolution of 1 ms, every
+   next one is TIMER_SLOTS times coarser. When the wheel reaches a slot of
+   a coarser level, its timeouts are cascaded down to the finer ones. Both
+   arming and cancelling a timeout is O(1), and nothing is ever copied. */
+#define TIMER_BITS 6
+#define TIMER_SLOTS (1 << TIMER_BITS)
+#define TIMER_LEVELS 5
+#define TIMER_MAX ((uint64_t(1) << (TIMER_BITS * TIMER_LEVELS)) - 1)
+
+#ifndef DOXYGEN_UNDOCUMENTED
+struct NewNet::Reactor::Timeouts
+{
+  struct Link
+  {
+    Link * prev, * next;
+  };
+
+  struct Node : public Link
+  {
+    uint64_t expires; // ms
+    int level; // -1 while not in the wheel
+    unsigned int slot;
+    RefPtr<Timeout::Callback> callback;
+  };
+
+  /* One node per pending callback, the map never moves its values. */
+  std::unordered_map<Timeout::Callback *, Node> nodes;
+  Link slots[TIMER_LEVELS][TIMER_SLOTS];
+  uint64_t occupied[TIMER_LEVELS]; // bitmap of non-empty slots per level
+  uint64_t now; // last tick processed, processing it again is harmless
+
+  Timeouts() : now(time())
+  {
+    for(int l = 0; l < TIMER_LEVELS; ++l)
+    {
+      occupied[l] = 0;
+      for(int i = 0; i < TIMER_SLOTS; ++i)
+        slots[l][i].prev = slots[l][i].next = &slots[l][i];
+    }
+  }
+
+  static uint64_t time()
+  {
+    struct timeval tv;
+    gettimeofday(&tv, 0);
+    return uint64_t(tv.tv_sec) * 1000 + tv.tv_usec / 1000;
+  }
+
+  static void append(Link * head, Link * link)
+  {
+    link->prev = head->prev;
+    link->next = head;
+    head->prev->next = link;
+    head->prev = link;
+  }
+
+  void unlink(Node * node)
+  {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    if((node->level >= 0) && (slots[node->level][node->slot].next == &slots[node->level][node->slot]))
+      occupied[node->level] &= ~(uint64_t(1) << node->slot);
+    node->level = -1;
+  }
+
+  void insert(Node * node)
+  {
+    uint64_t expires = std::max(node->expires, now);
+    // Too far away, park it at the end of the wheel, it will be recascaded.
+    if(expires - now > TIMER_MAX)
+      expires = now + TIMER_MAX;
+
+    uint64_t delta = expires - now;
+    int level = 0;
+    while(delta >> (TIMER_BITS * (level + 1)))
+      ++level;
+
+    node->level = level;
+    node->slot = (expires >> (TIMER_BITS * level)) & (TIMER_SLOTS - 1);
+    append(&slots[level][node->slot], node);
+    occupied[level] |= uint64_t(1) << node->slot;
+  }
+
+  void cascade(int level, unsigned int slot)
+  {
+    Link * head = &slots[level][slot];
+    while(head->next != head)
+    {
+      Node * node = static_cast<Node *>(head->next);
+      unlink(node);
+      insert(node);
+    }
+  }
+
+  /* Returns the first tick at which something has to be fired or cascaded,
+     UINT64_MAX if the wheel is empty. */
+  uint64_t next() const
+  {
+    uint64_t result = UINT64_MAX;
+    for(int l = 0; l < TIMER_LEVELS; ++l)
+    {
+      if(! occupied[l])
+        continue;
+      int shift = TIMER_BITS * l;
+      uint64_t unit = uint64_t(1) << shift;
+      // Slots of a coarser level are processed when their window starts.
+      uint64_t start = (now + unit - 1) & ~(unit - 1);
+      unsigned int first = (start >> shift) & (TIMER_SLOTS - 1);
+      uint64_t rotated = occupied[l] >> first;
+      if(first)
+        rotated |= occupied[l] << (TIMER_SLOTS - first);
+      result = std::min(result, start + __builtin_ctzll(rotated) * unit);
+    }
+    return result;
+  }
+
+  /* Fire everything that is due at 'until'. Returns true if anything was
+     fired. */
+  bool advance(uint64_t until)
+  {
+    bool fired = false;
+    for(uint64_t tick = next(); tick <= until; tick = next())
+    {
+      now = tick;
+      for(int l = 1; l < TIMER_LEVELS; ++l)
+      {
+        if(now & ((uint64_t(1) << (TIMER_BITS * l)) - 1))
+          break;
+        cascade(l, (now >> (TIMER_BITS * l)) & (TIMER_SLOTS - 1));
+      }
+
+      /* Detach the slot first, callbacks might add or remove timeouts.
+         Whatever they add at this very tick lands in the now empty slot
+         and is picked up on the next iteration. */
+      Link due;
+      due.prev = due.next = &due;
+      Link * head = &slots[0][now & (TIMER_SLOTS - 1)];
+      while(head->next != head)
+      {
+        Node * node = static_cast<Node *>(head->next);
+        unlink(node);
+        append(&due, node);
+      }
+
+      while(due.next != &due)
+      {
+        Node * node = static_cast<Node *>(due.next);
+        unlink(node);
+        long diff = until - node->expires;
+        RefPtr<Timeout::Callback> item = node->callback;
+        nodes.erase(item);
+
+        item->operator()(diff);
+        fired = true;
+      }
+    }
+    now = std::max(now, until);
+    return fired;
+  }
+};
+#endif // DOXYGEN_UNDOCUMENTED
 
 
 void eventCallback(int fd, short event, void *arg) {
     static_cast<NewNet::Reactor *>(arg)->eventCallback(fd, event, arg);
 }
 
+void socketCallback(int, short event, void *arg) {
+    NewNet::Socket * socket = static_cast<NewNet::Socket *>(arg);
+    if (socket->reactor())
+        socket->reactor()->socketCallback(socket, event);
+}
+
+void resolverCallback(int, short, void *arg) {
+    static_cast<NewNet::Reactor *>(arg)->resolverCallback();
+}
+
+void taskCallback(int, short, void *arg) {
+    static_cast<NewNet::Reactor *>(arg)->taskCallback();
+}
+
+void signalCallback(int signum, short, void *arg) {
+    static_cast<NewNet::Reactor *>(arg)->signalCallback(signum);
+}
+
 NewNet::Reactor::Reactor()
 {
+    m_maxFD = 0;
+    m_TimerAdded = false;
+    m_ResolverWatched = false;
     m_Timeouts = new Timeouts;
 #ifdef WIN32
     m_WsaData = new WSADATA;
@@ -58,7 +245,20 @@ NewNet::Reactor::Reactor()
 
     NNLOG("newnet.net.debug", "%i file descriptors available for newsoul.", m_maxSocketNo);
 
-    event_init();
+    m_Base = event_base_new();
+
+    /* Other threads wake us up through this pipe when they post tasks */
+    if (pipe(m_TaskPipe) == 0) {
+        setnonblocking(m_TaskPipe[0]);
+        setnonblocking(m_TaskPipe[1]);
+        event_set(&mEvTask, m_TaskPipe[0], EV_READ | EV_PERSIST, ::taskCallback, this);
+        event_base_set(m_Base, &mEvTask);
+        event_add(&mEvTask, NULL);
+    }
+    else {
+        NNLOG("newnet.net.warn", "Couldn't create the reactor's task pipe (errno: %i).", errno);
+        m_TaskPipe[0] = m_TaskPipe[1] = -1;
+    }
 }
 
 #ifndef DOXYGEN_UNDOCUMENTED
@@ -68,57 +268,54 @@ NewNet::Reactor::~Reactor()
   WSACleanup();
   delete (WSADATA *)m_WsaData;
 #endif // WIN32
+  setResolver(0);
+
+  /* Sockets might outlive us, their events mustn't point at our base */
+  std::vector<RefPtr<Socket> >::iterator it, end = m_Sockets.end();
+  for (it = m_Sockets.begin(); it != end; ++it) {
+    if ((*it)->eventFlags() && event_initialized((*it)->getEventData()))
+      event_del((*it)->getEventData());
+    (*it)->setEventFlags(0);
+    (*it)->setReactor(0);
+  }
+
+  if (m_TimerAdded)
+    evtimer_del(&mEvTimeout);
+  if (m_TaskPipe[0] >= 0) {
+    event_del(&mEvTask);
+    close(m_TaskPipe[0]);
+    close(m_TaskPipe[1]);
+  }
+  std::map<int, SignalEvent *>::iterator sit, sigEnd = m_Signals.end();
+  for (sit = m_Signals.begin(); sit != sigEnd; ++sit) {
+    event_del(&sit->second->ev);
+    delete sit->second;
+  }
+  event_base_free(m_Base);
   delete m_Timeouts;
 }
 #endif // DOXYGEN_UNDOCUMENTED
 
 /* Check if any timeouts have expired. If so, invoke them and remove them
-   from the queue. Also, update the timeout if a timeout should be called
+   from the wheel. Also, update the timeout if a timeout should be called
    before the currently set timeout. */
 bool
 NewNet::Reactor::checkTimeouts(struct timeval & timeout, bool & timeout_set)
 {
-  bool retVal = false;
+  bool retVal = m_Timeouts->advance(Timeouts::time());
 
-  struct timeval now;
-  gettimeofday(&now, 0);
-
-  std::vector<TimeoutItem>::iterator it;
-
-  std::vector<TimeoutItem> timeouts = m_Timeouts->timeouts; // copy the timeouts in case it is modified somewhere else while iterating
-
-  it = timeouts.begin();
-  while (it != timeouts.end())
+  uint64_t next = m_Timeouts->next();
+  if(next != UINT64_MAX)
   {
-    // Has the timeout expired?
-    if(timercmp(&now, &(*it).first, >=))
+    struct timeval tv;
+    tv.tv_sec = next / 1000;
+    tv.tv_usec = (next % 1000) * 1000;
+    if((! timeout_set) || (timercmp(&tv, &timeout, <)))
     {
-      // Calculate how long the timeout is overdue
-      gettimeofday(&now, 0);
-      unsigned long diff = difftime(now, (*it).first);
-
-      // Store the timeout callback and delete it from to-be-emitted list
-      NewNet::RefPtr<NewNet::Reactor::Timeout::Callback> item = it->second;
-
-      removeTimeout(item);
-
-      it = timeouts.erase(it);
-
-      // And emit it
-      if (item.isValid())
-        item->operator()(diff);
-
-      retVal = true;
-    }
-    else {
-      if((! timeout_set) || (timercmp(&(*it).first, &timeout, <))) {
-          /* If the timeout expires before the next cycle timeout, adjust
-             the cycle timeout. */
-          timeout.tv_sec = (*it).first.tv_sec;
-          timeout.tv_usec = (*it).first.tv_usec;
-          timeout_set = true;
-      }
-      ++it;
+      /* If the timeout expires before the next cycle timeout, adjust
+         the cycle timeout. */
+      timeout = tv;
+      timeout_set = true;
     }
   }
 
@@ -141,6 +338,7 @@ void NewNet::Reactor::add(Socket * socket)
   else
     m_Sockets.push_back(socket);
   socket->setReactor(this);
+  update(socket);
 }
 
 void NewNet::Reactor::remove(Socket * socket)
@@ -151,30 +349,35 @@ void NewNet::Reactor::remove(Socket * socket)
   assert(socket->reactor() == this);
 
   socket->setReactor(0);
+  m_Throttled.erase(socket);
+
+  struct event * ev = socket->getEventData();
+  if (socket->eventFlags() && event_initialized(ev))
+    event_del(ev);
+  socket->setEventFlags(0);
+
   std::vector<RefPtr<Socket> >::iterator it;
   it = std::find(m_Sockets.begin(), m_Sockets.end(), socket);
   if (it != m_Sockets.end()) {
-    // See if there is another socket using the same FD
-    std::vector<RefPtr<Socket> >::iterator itFD;
-    bool found = false;
-    for (itFD = m_Sockets.begin(); ((itFD != m_Sockets.end()) && !found); ++itFD) {
-        if (((*itFD)->descriptor() == fd) && (socket != *itFD))
-            found = true;
-    }
-    if (!found) {
-        // No other socket is using this FD stop watching it
-        struct event * ev = socket->getEventData();
-        if (event_initialized(ev))
-            event_del(ev);
-    }
-
+    /* Keep a reference, the reactor might hold the last one. */
+    RefPtr<Socket> sock(socket);
     m_Sockets.erase(it);
+
+    /* Another socket might have taken over this FD (see UserSocket). The
+       backend only knows one registration per FD, so renew theirs. */
+    if (fd >= 0) {
+      std::vector<RefPtr<Socket> >::iterator itFD;
+      for (itFD = m_Sockets.begin(); itFD != m_Sockets.end(); ++itFD) {
+        if ((*itFD)->descriptor() == fd)
+          checkSocket(*itFD, true);
+      }
+    }
   }
 }
 
 void NewNet::Reactor::run()
 {
-    NNLOG("newnet.net.debug", "Running reactor. Libevent is using %s method.", event_get_method());
+    NNLOG("newnet.net.debug", "Running reactor. Libevent is using %s method.", event_base_get_method(m_Base));
 
     bool loop = true;
     while (loop) {
@@ -182,18 +385,17 @@ void NewNet::Reactor::run()
     }
 
     // Launch the main loop
-    event_dispatch();
+    event_base_dispatch(m_Base);
 }
 
 bool
 NewNet::Reactor::prepareReactorData() {
     /* No timeout set yet */
-    static bool first_run = true; //let's abuse it a bit
     bool timeout_set = false;
     struct timeval timeout;
 
-    // Update the sockets watched by the reactor
-    checkSockets(timeout, timeout_set);
+    // Give sockets held back by their rate limiters another chance
+    checkThrottled(timeout, timeout_set);
 
     // Update the timeouts and call expired ones
     if (checkTimeouts(timeout, timeout_set))
@@ -219,11 +421,12 @@ NewNet::Reactor::prepareReactorData() {
         timeout.tv_usec = 0;
       }
 
-      if(!first_run) {
+      if(m_TimerAdded) {
           evtimer_del(&mEvTimeout); // delete potentially existing previous timeout
       }
-      first_run = false;
+      m_TimerAdded = true;
       evtimer_set(&mEvTimeout, ::eventCallback, this);
+      event_base_set(m_Base, &mEvTimeout);
       evtimer_add(&mEvTimeout, &timeout);
     }
 
@@ -236,67 +439,201 @@ NewNet::Reactor::prepareReactorData() {
 }
 
 void
-NewNet::Reactor::eventCallback(int fd, short event, void *arg) {
-    NNLOG("newnet.net.debug", "Entering event callback for socket %i.", fd);
+NewNet::Reactor::eventCallback(int, short, void *) {
+    NNLOG("newnet.net.debug", "Entering timer callback.");
 
     bool loop = true;
     while (loop) {
-        /* Make a copy of our socket list, as they might disappear because of
-           events that occur and then our iterators go berserk */
-        std::vector<RefPtr<Socket> > sockets(m_Sockets);
-
-        std::vector<RefPtr<Socket> >::iterator it, end = sockets.end();
-
-        for(it = sockets.begin(); it != end; ++it) {
-            NewNet::Socket * sock = *it;
-            struct event *evData = sock->getEventData();
-
-            // Let the sockets do their job
-            if ((sock->descriptor() >= 0) && ((evData->ev_res & EV_READ) || (evData->ev_res & EV_WRITE))) {
-              // Update the socket's ready state
-              long upLimit = (! sock->upRateLimiter()) ? 0 : sock->upRateLimiter()->nextWindow();
-              long downLimit = (! sock->downRateLimiter()) ? 0 : sock->downRateLimiter()->nextWindow();
-
-              int state = 0;
-              if ((downLimit == 0) && (evData->ev_res & EV_READ))
-                state |= NewNet::Socket::StateReceive;
-              if ((upLimit == 0) && (evData->ev_res & EV_WRITE))
-                state |= NewNet::Socket::StateSend;
-              sock->setReadyState(state);
-
-              // If we have something to report, make the socket process the events.
-              if(state)
-                sock->process();
-            }
-        }
+        loop = prepareReactorData();
+    }
+}
+
+void
+NewNet::Reactor::socketCallback(Socket * socket, short event) {
+    NNLOG("newnet.net.debug", "Entering event callback for socket %i.", socket->descriptor());
+
+    /* The socket might get removed (and deleted) while processing */
+    RefPtr<Socket> sock(socket);
+
+    if (sock->descriptor() >= 0) {
+      // Update the socket's ready state
+      long upLimit = (! sock->upRateLimiter()) ? 0 : sock->upRateLimiter()->nextWindow();
+      long downLimit = (! sock->downRateLimiter()) ? 0 : sock->downRateLimiter()->nextWindow();
+
+      int state = 0;
+      if ((downLimit == 0) && (event & EV_READ))
+        state |= NewNet::Socket::StateReceive;
+      if ((upLimit == 0) && (event & EV_WRITE))
+        state |= NewNet::Socket::StateSend;
+      sock->setReadyState(state);
+
+      // If we have something to report, make the socket process the events.
+      if(state)
+        sock->process();
+    }
 
+    // Processing (or the rate limiters) may have changed what we want to hear about
+    if (sock->reactor() == this)
+      update(sock);
+
+    bool loop = true;
+    while (loop) {
         loop = prepareReactorData();
     }
 }
 
 void
-NewNet::Reactor::checkSockets(struct timeval & timeout, bool & timeout_set) {
-    /* Make a copy of our socket list, as they might disappear because of
-       events that occur and then our iterators go berserk */
-    std::vector<RefPtr<Socket> > sockets(m_Sockets);
+NewNet::Reactor::resolverCallback() {
+    NNLOG("newnet.net.debug", "Entering resolver callback.");
+
+    /* Keep the resolver alive, a callback might replace it */
+    RefPtr<Resolver> resolver(m_Resolver);
+    resolver->deliver();
+
+    /* Nothing left to wait for, don't keep the main loop running */
+    if (m_ResolverWatched && (resolver == m_Resolver) && (resolver->pending() == 0)) {
+      event_del(&mEvResolver);
+      m_ResolverWatched = false;
+    }
 
-    /* Check which events we want to hear about from which sockets */
-    std::vector<RefPtr<Socket> >::iterator it, end = sockets.end();
+    bool loop = true;
+    while (loop) {
+        loop = prepareReactorData();
+    }
+}
 
-    int nfds = 0;
+void
+NewNet::Reactor::taskCallback() {
+    NNLOG("newnet.net.debug", "Entering task callback.");
+
+    char buf[64];
+    while (read(m_TaskPipe[0], buf, sizeof(buf)) > 0)
+      ;
 
-    for(it = sockets.begin(); it != end; ++it)
+    std::vector<Task> tasks;
     {
-      /* Convenience... */
-      NewNet::Socket * sock = *it;
-      struct event *evData = sock->getEventData();
-      int fd = sock->descriptor();
-      if(fd == -1)
-        continue;
+      std::lock_guard<std::mutex> lock(m_TaskMutex);
+      tasks.swap(m_Tasks);
+    }
+
+    std::vector<Task>::iterator it, end = tasks.end();
+    for (it = tasks.begin(); it != end; ++it)
+      (*it)();
+
+    bool loop = true;
+    while (loop) {
+        loop = prepareReactorData();
+    }
+}
+
+void
+NewNet::Reactor::signalCallback(int signum) {
+    NNLOG("newnet.net.debug", "Entering signal callback (%i).", signum);
+
+    std::map<int, SignalEvent *>::iterator it = m_Signals.find(signum);
+    if (it != m_Signals.end()) {
+      /* The callback might replace itself */
+      RefPtr<Signal::Callback> callback = it->second->callback;
+      (*callback)(signum);
+    }
+
+    bool loop = true;
+    while (loop) {
+        loop = prepareReactorData();
+    }
+}
+
+void
+NewNet::Reactor::addSignal(int signum, Signal::Callback * callback) {
+    SignalEvent *& watch = m_Signals[signum];
+    if (! watch) {
+      watch = new SignalEvent;
+      event_set(&watch->ev, signum, EV_SIGNAL | EV_PERSIST, ::signalCallback, this);
+      event_base_set(m_Base, &watch->ev);
+      event_add(&watch->ev, NULL);
+    }
+    watch->callback = callback;
+}
+
+void
+NewNet::Reactor::post(const Task & task) {
+    std::lock_guard<std::mutex> lock(m_TaskMutex);
+    m_Tasks.push_back(task);
+
+    /* One byte is enough, taskCallback() takes all the tasks. If the pipe
+       is full, it's about to run anyway. */
+    if (m_Tasks.size() == 1) {
+      char c = 0;
+      ssize_t written = write(m_TaskPipe[1], &c, 1);
+      (void)written;
+    }
+}
+
+void
+NewNet::Reactor::post(Buffer & buffer, const BufferTask & task) {
+    /* The parcel travels as a plain pointer, like sockets in
+       ReactorPool::assign(), so no reference count is touched on both
+       sides */
+    Buffer * parcel = new Buffer();
+    parcel->take(buffer);
+    parcel->unshare();
+    post([parcel, task]() {
+      task(*parcel);
+      delete parcel;
+    });
+}
+
+bool
+NewNet::Reactor::resolve(const std::string & host, Resolver::Resolved::Callback * callback) {
+    Resolver * res = resolver();
+    if (res->resolve(host, callback))
+      return true;
+
+    /* Only listen to the resolver while it's looking something up */
+    if (! m_ResolverWatched && (res->pending() > 0) && (res->descriptor() >= 0)) {
+      event_set(&mEvResolver, res->descriptor(), EV_READ | EV_PERSIST, ::resolverCallback, this);
+      event_base_set(m_Base, &mEvResolver);
+      event_add(&mEvResolver, NULL);
+      m_ResolverWatched = true;
+    }
+    return false;
+}
+
+NewNet::Resolver *
+NewNet::Reactor::resolver() {
+    if (! m_Resolver)
+      m_Resolver = new Resolver();
+    return m_Resolver;
+}
 
-      long n; // miliseconds to next window of opportunity
-      short evFlags = 0; // event type flag to be used
+void
+NewNet::Reactor::setResolver(Resolver * resolver) {
+    if (m_ResolverWatched) {
+      event_del(&mEvResolver);
+      m_ResolverWatched = false;
+    }
+    m_Resolver = resolver;
+}
 
+void
+NewNet::Reactor::update(Socket * socket) {
+    if (checkSocket(socket) > 0)
+        m_Throttled.insert(socket);
+    else
+        m_Throttled.erase(socket);
+}
+
+long
+NewNet::Reactor::checkSocket(Socket * sock, bool force) {
+    struct event *evData = sock->getEventData();
+    int fd = sock->descriptor();
+
+    long n; // miliseconds to next window of opportunity
+    long wait = 0; // miliseconds until the socket should be rechecked
+    short evFlags = 0; // event type flag to be used
+
+    if(fd != -1)
+    {
       switch(sock->socketState())
       {
         /* The socket is dead, no events are interesting */
@@ -309,13 +646,11 @@ NewNet::Reactor::checkSockets(struct timeval & timeout, bool & timeout_set) {
         /* Listening socket, check for read-ready events */
         case NewNet::Socket::SocketListening:
           evFlags = EV_READ;
-          nfds = std::max(nfds, fd + 1);
           break;
 
         /* Connecting socket, check for write-ready events */
         case NewNet::Socket::SocketConnecting:
           evFlags = EV_WRITE;
-          nfds = std::max(nfds, fd + 1);
           break;
 
         /* Connected socket, if possible / allowed check for read, write */
@@ -327,7 +662,7 @@ NewNet::Reactor::checkSockets(struct timeval & timeout, bool & timeout_set) {
           else
           {
             NNLOG("newnet.net.debug", "Download limiter for socket %i recommends %li ms sleep.", fd, n);
-            fixtime(timeout, n, timeout_set);
+            wait = n;
           }
 
           /* Check if we want to send, if we're allowed to send. And if we're
@@ -340,47 +675,68 @@ NewNet::Reactor::checkSockets(struct timeval & timeout, bool & timeout_set) {
             else
             {
               NNLOG("newnet.net.debug", "Upload rate limiter for socket %i reports next window in %li ms", fd, n);
-              fixtime(timeout, n, timeout_set);
+              if((wait == 0) || (n < wait))
+                wait = n;
             }
           }
-
-          nfds = std::max(nfds, fd + 1);
           break;
-        }
+      }
 
-      m_maxFD = nfds;
+      m_maxFD = std::max(m_maxFD, fd + 1);
+    }
 
-      if (evFlags > 0) {
-        if (event_initialized(evData))
-            event_del(evData);
-        event_set(evData, fd, evFlags, ::eventCallback, this);
-        event_add(evData, NULL);
-      }
+    /* Nothing changed, don't bother libevent */
+    if (!force && (evFlags == sock->eventFlags()) && ((evFlags == 0) || (evData->ev_fd == fd)))
+      return wait;
+
+    if (sock->eventFlags() && event_initialized(evData))
+      event_del(evData);
+    if (evFlags > 0) {
+      event_set(evData, fd, evFlags | EV_PERSIST, ::socketCallback, sock);
+      event_base_set(m_Base, evData);
+      event_add(evData, NULL);
+    }
+    sock->setEventFlags(evFlags);
+
+    return wait;
+}
+
+void
+NewNet::Reactor::checkThrottled(struct timeval & timeout, bool & timeout_set) {
+    if (m_Throttled.empty())
+      return;
+
+    /* Make a copy, sockets leave the set as soon as their window opens */
+    std::vector<Socket *> throttled(m_Throttled.begin(), m_Throttled.end());
+
+    std::vector<Socket *>::iterator it, end = throttled.end();
+    for (it = throttled.begin(); it != end; ++it) {
+      long n = checkSocket(*it);
+      if (n > 0)
+        fixtime(timeout, n, timeout_set);
+      else
+        m_Throttled.erase(*it);
     }
 }
 
 void
 NewNet::Reactor::stop()
 {
-  event_loopexit(NULL);
+  event_base_loopexit(m_Base, NULL);
 }
 
 NewNet::Reactor::Timeout::Callback *
 NewNet::Reactor::addTimeout(long msec, Timeout::Callback * callback)
 {
-  // Calculate when the event has to occur
-  struct timeval tv;
-  gettimeofday(&tv, 0);
-  tv.tv_sec += (msec / 1000);
-  tv.tv_usec += (msec % 1000) * 1000;
-  if(tv.tv_usec >= 1000000)
-  {
-    tv.tv_sec += 1;
-    tv.tv_usec -= 1000000;
-  }
+  Timeouts::Node & node = m_Timeouts->nodes[callback];
+  if(node.callback.isValid())
+    m_Timeouts->unlink(&node); // Already pending, just move it
+  else
+    node.callback = callback;
 
-  // Push the timeout on our queue
-  m_Timeouts->timeouts.push_back(TimeoutItem(tv, callback));
+  // Calculate when the event has to occur and put it in the wheel
+  node.expires = Timeouts::time() + std::max(msec, 0L);
+  m_Timeouts->insert(&node);
 
   // Return the callback, for convenience
   return callback;
@@ -389,20 +745,13 @@ NewNet::Reactor::addTimeout(long msec, Timeout::Callback * callback)
 void
 NewNet::Reactor::removeTimeout(Timeout::Callback * callback)
 {
-  std::queue<std::vector<TimeoutItem>::iterator> purge;
-  std::vector<TimeoutItem>::iterator it, end = m_Timeouts->timeouts.end();
-  for(it = m_Timeouts->timeouts.begin(); it != end; ++it)
-  {
-    if((*it).second == callback)
-    {
-      purge.push(it);
-    }
-  }
-  while(! purge.empty())
-  {
-    m_Timeouts->timeouts.erase(purge.front());
-    purge.pop();
-  }
+  std::unordered_map<Timeout::Callback *, Timeouts::Node>::iterator it;
+  it = m_Timeouts->nodes.find(callback);
+  if(it == m_Timeouts->nodes.end())
+    return;
+
+  m_Timeouts->unlink(&it->second);
+  m_Timeouts->nodes.erase(it);
 }
 
 int
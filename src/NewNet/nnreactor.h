@@ -22,10 +22,16 @@
 #define NEWNET_REACTOR_H
 
 #include "nnobject.h"
+#include "nnbuffer.h"
 #include "nnsocket.h"
 #include "nnrefptr.h"
 #include "nnevent.h"
+#include "nnresolver.h"
 #include "util.h"
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
 #include <vector>
 #include <event.h>
 
@@ -52,7 +58,11 @@ namespace NewNet
 {
   //! Monitors sockets and timeouts. This is what drives your application.
   /*! The Reactor class provides your application with a main-loop. It
-      monitors the sockets and waits for timeouts to occur. */
+      monitors the sockets and waits for timeouts to occur. Every reactor
+      has its own libevent base, so several of them can run at once, each
+      on its own thread (see ReactorPool). A reactor and its sockets
+      must only be touched from the thread running it, other threads talk
+      to it with post(). */
   class Reactor : public Object
   {
   public:
@@ -79,8 +89,8 @@ namespace NewNet
     //! Start the main loop.
     /*! Call this to start the reactor's main loop. The reactor will start
         listening for events and waiting for timeouts to happen. This method
-        will not return until there are no sockets and timeouts left, or when
-        Reactor::stop() is called. */
+        will not return until Reactor::stop() is called, as other threads
+        might still post() tasks. */
     void run();
 
     //! Stop the main loop.
@@ -88,6 +98,26 @@ namespace NewNet
         first process any pending events before exiting. */
     void stop();
 
+    //! Task run on the reactor's thread.
+    typedef std::function<void()> Task;
+
+    //! Run a task on the reactor's thread.
+    /*! Queues task to be run by the reactor's main loop, as soon as it
+        wakes up. This is the only method that can be called from any
+        thread. Tasks capture what they need by value, the objects they
+        touch must belong to this reactor. */
+    void post(const Task & task);
+
+    //! Task receiving a buffer on the reactor's thread.
+    typedef std::function<void(Buffer &)> BufferTask;
+
+    //! Hand a buffer over to the reactor's thread.
+    /*! Moves the contents of buffer, which is left empty, to a buffer that
+        is passed to task on the reactor's thread. Data the buffer shared
+        with others is copied on the way (see Buffer::unshare()), so no
+        memory block is ever used by two threads. */
+    void post(Buffer & buffer, const BufferTask & task);
+
     //! Convenience definition for timeouts.
     /*! A convenience definition for timeout callback. Note: Timeouts aren't
         actually used as events, but the Event::Callback class is used to
@@ -96,7 +126,9 @@ namespace NewNet
 
     //! Add a new timeout to the reactor.
     /*! Add a new timeout callback to the reactor so that the callback
-        will be invoked after approximately msec miliseconds. Note: stores
+        will be invoked after approximately msec miliseconds. If the
+        callback is already pending, it is rescheduled instead, which is
+        much cheaper than removing it and binding a new one. Note: stores
         a RefPtr to the callback object. */
     Timeout::Callback * addTimeout(long msec, Timeout::Callback * callback);
 
@@ -111,10 +143,52 @@ namespace NewNet
     }
 
     //! Remove a timeout from the reactor.
-    /*! This removes all pending timeouts that have 'callback' as a callback
+    /*! This removes the pending timeout that has 'callback' as a callback
         and frees the RefPtr on the callback object. */
     void removeTimeout(Timeout::Callback * callback);
 
+    //! Convenience definition for signals.
+    /*! A convenience definition for signal callbacks, they are passed the
+        number of the signal that was caught. */
+    typedef Event<int> Signal;
+
+    //! Handle a signal on the reactor's thread.
+    /*! Catch signum and invoke callback from the main loop whenever it is
+        delivered. Unlike a plain signal handler, the callback may do
+        anything a socket or timeout callback may. A later call for the
+        same signal replaces the callback. Note: stores a RefPtr to the
+        callback object. */
+    void addSignal(int signum, Signal::Callback * callback);
+
+    //! Handle a signal on the reactor's thread with a method of an object.
+    template<class ObjectType, typename MethodType>
+    void addSignal(int signum, ObjectType * object, MethodType method)
+    {
+      addSignal(signum, Signal::bind(object, method));
+    }
+
+    //! Resolve a host name without blocking.
+    /*! Resolve host through the reactor's resolver, the answer is handed
+        to callback from the main loop (or right away, see
+        Resolver::resolve()). Returns true if it was answered right away. */
+    bool resolve(const std::string & host, Resolver::Resolved::Callback * callback);
+
+    //! Resolve a host name without blocking, answer to a method of an object.
+    template<class ObjectType, typename MethodType>
+    bool resolve(const std::string & host, ObjectType * object, MethodType method)
+    {
+      return resolve(host, Resolver::Resolved::bind(object, method));
+    }
+
+    //! Return the reactor's resolver.
+    /*! Creates one using getaddrinfo() on first use. */
+    Resolver * resolver();
+
+    //! Replace the reactor's resolver.
+    /*! Lookups pending in the old one are dropped. Note: stores a RefPtr
+        to the resolver. */
+    void setResolver(Resolver * resolver);
+
     //! Returns the maximum number of sockets that can be opened
     /*! On linux this is usually 1024 */
     int maxSocketNo();
@@ -125,17 +199,61 @@ namespace NewNet
     //! Returns the highest file descriptor currently used
     int maxFileDescriptor();
 
-    //! Invoked by libevent when a socket wakes up
-    /*! Invoked by libevent when a socket wakes up */
+    //! Update a socket's registration.
+    /*! Recalculates the events the socket is interested in (based on its
+        state, wether it has data waiting and its rate limiters) and
+        updates its libevent registration if that changed. Sockets call
+        this themselves whenever their state changes. */
+    void update(Socket * socket);
+
+    //! Invoked by libevent when the reactor's timer wakes up
+    /*! Invoked by libevent when the reactor's timer wakes up */
     void eventCallback(int, short, void *);
 
+    //! Invoked by libevent when a socket wakes up
+    /*! Invoked by libevent when a socket wakes up. Only the socket that
+        fired is processed. */
+    void socketCallback(Socket * socket, short event);
+
+    //! Invoked by libevent when the resolver has answers
+    /*! Invoked by libevent when the resolver has answers. */
+    void resolverCallback();
+
+    //! Invoked by libevent when tasks were posted
+    /*! Invoked by libevent when tasks were posted. */
+    void taskCallback();
+
+    //! Invoked by libevent when a signal was caught
+    /*! Invoked by libevent when a signal was caught. */
+    void signalCallback(int signum);
+
   private:
+    struct event_base * m_Base;
     struct event mEvTimeout;
+    bool m_TimerAdded;
+    struct event mEvResolver;
+    bool m_ResolverWatched;
+    struct event mEvTask;
+    int m_TaskPipe[2];
+    std::mutex m_TaskMutex;
+    std::vector<Task> m_Tasks;
+    struct SignalEvent {
+      struct event ev;
+      RefPtr<Signal::Callback> callback;
+    };
+    std::map<int, SignalEvent *> m_Signals;
 
   protected:
-    //! Prepare sockets to be watched by the reactor.
-    /*! Prepare sockets to be watched by the reactor. */
-    void checkSockets(struct timeval & timeout, bool & timeout_set);
+    //! Register a socket for the events it is interested in.
+    /*! Register a socket for the events it is interested in. Returns the
+        number of miliseconds until one of its rate limiters opens the
+        next window, or 0 if it isn't being held back. */
+    long checkSocket(Socket * socket, bool force = false);
+
+    //! Recheck sockets held back by their rate limiters.
+    /*! Recheck sockets held back by their rate limiters. Set up next
+        reactor wake up if some of them are still waiting. */
+    void checkThrottled(struct timeval & timeout, bool & timeout_set);
 
     //! Check for timeouts and emit needed actions. Set up next reactor wake up.
     /*! Check for timeouts and emit needed actions. Set up next reactor wake up. */
@@ -148,6 +266,8 @@ namespace NewNet
     int m_maxSocketNo;
     int m_maxFD;
     std::vector<RefPtr<Socket> > m_Sockets;
+    std::set<Socket *> m_Throttled;
+    RefPtr<Resolver> m_Resolver;
 
 #ifndef DOXYGEN_UNDOCUMENTED
     struct Timeouts;
@@ -159,12 +279,4 @@ namespace NewNet
   };
 }
 
-#ifndef DOXYGEN_UNDOCUMENTED
-typedef std::pair<struct timeval, NewNet::RefPtr<NewNet::Reactor::Timeout::Callback> > TimeoutItem;
-struct NewNet::Reactor::Timeouts
-{
-  std::vector<TimeoutItem> timeouts;
-};
-#endif
-
 #endif // NEWNET_REACTOR_H
@@ -0,0 +1,104 @@
+/*  NewNet - A networking framework in C++
+    Copyright (C) 2006-2007 Ingmar K. Steen (iksteen@gmail.com)
+    Copyright 2008 little blue poney <lbponey@users.sourceforge.net>
+    Karol 'Kenji Takahashi' Woźniak © 2014
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+ */
+
+#include "nnreactorpool.h"
+#include "nnlog.h"
+
+NewNet::ReactorPool::ReactorPool(Reactor * main, unsigned int loops) : m_Next(0)
+{
+  m_Loops.push_back(main);
+  for(unsigned int i = 1; i < loops; ++i)
+    m_Loops.push_back(new Reactor());
+}
+
+#ifndef DOXYGEN_UNDOCUMENTED
+NewNet::ReactorPool::~ReactorPool()
+{
+  stop();
+}
+#endif // DOXYGEN_UNDOCUMENTED
+
+void
+NewNet::ReactorPool::start()
+{
+  if(! m_Threads.empty())
+    return;
+
+  NNLOG("newnet.net.debug", "Starting %u worker loops.", size() - 1);
+
+  /* The threads only get raw pointers, the reactors' reference counts
+     belong to this thread */
+  for(unsigned int i = 1; i < size(); ++i)
+  {
+    Reactor * reactor = m_Loops[i];
+    m_Threads.push_back(std::thread([reactor]() { reactor->run(); }));
+  }
+}
+
+void
+NewNet::ReactorPool::stop()
+{
+  if(m_Threads.empty())
+    return;
+
+  for(unsigned int i = 1; i < size(); ++i)
+  {
+    Reactor * reactor = m_Loops[i];
+    reactor->post([reactor]() { reactor->stop(); });
+  }
+
+  std::vector<std::thread>::iterator it, end = m_Threads.end();
+  for(it = m_Threads.begin(); it != end; ++it)
+    it->join();
+  m_Threads.clear();
+
+  NNLOG("newnet.net.debug", "Stopped %u worker loops.", size() - 1);
+}
+
+NewNet::Reactor *
+NewNet::ReactorPool::next()
+{
+  if(size() == 1)
+    return main();
+
+  m_Next = m_Next % (size() - 1) + 1;
+  return m_Loops[m_Next];
+}
+
+void
+NewNet::ReactorPool::assign(Socket * socket, Reactor * loop)
+{
+  if(socket->reactor() == loop)
+    return;
+
+  /* Keep the socket alive in transit, the reference is handed over with
+     it and dropped on the other side */
+  ++(socket->refCounter());
+  if(socket->reactor())
+    socket->reactor()->remove(socket);
+  socket->unshare();
+
+  loop->post([socket, loop]() {
+    loop->add(socket);
+    if(--(socket->refCounter()))
+      delete socket;
+  });
+}
@@ -0,0 +1,103 @@
+/*  NewNet - A networking framework in C++
+    Copyright (C) 2006-2007 Ingmar K. Steen (iksteen@gmail.com)
+    Copyright 2008 little blue poney <lbponey@users.sourceforge.net>
+    Karol 'Kenji Takahashi' Woźniak © 2014
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+ */
+
+#ifndef NEWNET_REACTORPOOL_H
+#define NEWNET_REACTORPOOL_H
+
+#include "nnobject.h"
+#include "nnrefptr.h"
+#include "nnreactor.h"
+#include <thread>
+#include <vector>
+
+namespace NewNet
+{
+  //! Spreads sockets over several reactors, each running on its own thread.
+  /*! The main reactor is the one the application runs itself. It keeps
+      the control traffic and everything that touches shared state. The
+      pool adds worker reactors next to it, sockets that don't need much
+      besides themselves (bulk transfers, say) can be handed over to them
+      with assign(). Events of sockets on a worker loop are emitted on its
+      thread, so whatever they have to tell the rest of the application
+      is posted back to the main reactor, see Reactor::post(). */
+  class ReactorPool : public Object
+  {
+  public:
+    //! Constructor.
+    /*! Create a pool of loops reactors in total: main and loops - 1
+        workers. The workers don't run until start() is called. */
+    ReactorPool(Reactor * main, unsigned int loops);
+
+#ifndef DOXYGEN_UNDOCUMENTED
+    ~ReactorPool();
+#endif // DOXYGEN_UNDOCUMENTED
+
+    //! Start the worker loops, each on its own thread.
+    void start();
+
+    //! Stop the worker loops and wait for their threads to finish.
+    /*! Sockets stay in the worker reactors until the pool is deleted,
+        which must happen on the main reactor's thread. */
+    void stop();
+
+    //! Number of loops, the main one included.
+    unsigned int size() const
+    {
+      return m_Loops.size();
+    }
+
+    //! Return a loop, 0 being the main one.
+    Reactor * loop(unsigned int i) const
+    {
+      return m_Loops[i];
+    }
+
+    //! Return the main loop.
+    Reactor * main() const
+    {
+      return m_Loops[0];
+    }
+
+    //! Pick a worker loop for a new socket.
+    /*! Workers are picked in turn, the main loop is returned if there
+        are none. */
+    Reactor * next();
+
+    //! Hand a socket over to another loop.
+    /*! Removes the socket from its current reactor and adds it to loop,
+        on loop's thread. Call this on the thread of the socket's current
+        reactor (or any thread, if it has none) and don't touch the socket
+        afterwards. Buffered data it shares is copied first, see
+        Socket::unshare(). Unless NewNet is built with NN_PTR_ATOMIC, no
+        other RefPtr to the socket may be left behind, as reference counts
+        aren't thread safe then. With it, references may stay on other
+        threads, WeakRefPtr::lock() them to keep the socket alive while
+        posting tasks to its loop. */
+    void assign(Socket * socket, Reactor * loop);
+
+  private:
+    std::vector<RefPtr<Reactor> > m_Loops;
+    std::vector<std::thread> m_Threads;
+    unsigned int m_Next;
+  };
+}
+
+#endif // NEWNET_REACTORPOOL_H
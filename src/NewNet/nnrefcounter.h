@@ -21,6 +21,8 @@
 #ifndef NEWNET_REFCOUNTER_H
 #define NEWNET_REFCOUNTER_H
 
+#include <atomic>
+
 #ifdef NN_PTR_DEBUG
  #ifdef NN_PTR_DEBUG_ASSERT
   #include <assert.h>
@@ -83,6 +85,88 @@ namespace NewNet
   private:
     unsigned int m_RefCount;
   };
+
+  //! Thread safe reference counter.
+  /*! Works like RefCounter, but the count may be changed from several
+      threads at once. Objects use it instead of RefCounter when NewNet is
+      built with NN_PTR_ATOMIC. Copying a counter doesn't copy its count,
+      the copy starts at 0. */
+  class AtomicRefCounter
+  {
+  public:
+    //! Create a new reference counter object.
+    /*! Creates a new reference counter object with the reference count
+        initialized at 0. */
+    AtomicRefCounter() : m_RefCount(0)
+    {
+    }
+
+#ifndef DOXYGEN_UNDOCUMENTED
+    AtomicRefCounter(const AtomicRefCounter &) : m_RefCount(0)
+    {
+    }
+
+    AtomicRefCounter & operator=(const AtomicRefCounter &)
+    {
+      return *this;
+    }
+#endif // DOXYGEN_UNDOCUMENTED
+
+    //! Increment the reference count.
+    /*! Increment the reference count by 1. Whoever increments already holds
+        a reference, so nothing needs to be ordered against it. */
+    void operator++()
+    {
+      m_RefCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    //! Decrement the reference count.
+    /*! Decrement the reference count by 1. Returns true if the reference
+        count drops to zero. Delete the owner object if that happens, all
+        writes done through other references are visible by then. */
+    bool operator--()
+    {
+#ifdef NN_PTR_DEBUG
+ #ifdef NN_PTR_DEBUG_ASSERT
+      assert(count() > 0);
+ #else
+      if(count() == 0)
+      {
+        std::cerr << "Warning: Attempting to decrement refcount of unreferenced object!" << std::endl;
+        return true;
+      }
+ #endif // NN_PTR_DEBUG_ASSERT
+#endif // NN_PTR_DEBUG
+      return m_RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    //! Increment the reference count unless it is zero.
+    /*! Returns false if the count was zero, i.e. the owner object is
+        unreferenced or already being deleted. Used to turn weak references
+        into strong ones. */
+    bool acquire()
+    {
+      unsigned int count = m_RefCount.load(std::memory_order_relaxed);
+      while(count != 0)
+      {
+        if(m_RefCount.compare_exchange_weak(count, count + 1, std::memory_order_acquire, std::memory_order_relaxed))
+          return true;
+      }
+      return false;
+    }
+
+    //! Return the reference count.
+    /*! Return the value of this reference counter. It may have changed by
+        the time the caller looks at it, unless all references are held by
+        the calling thread. */
+    unsigned int count()
+    {
+      return m_RefCount.load(std::memory_order_relaxed);
+    }
+
+  private:
+    std::atomic<unsigned int> m_RefCount;
+  };
 }
 
 #endif // NEWNET_REFCOUNTER_H
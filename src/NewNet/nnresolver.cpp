@@ -0,0 +1,281 @@
+/*  NewNet - A networking framework in C++
+    Copyright (C) 2006-2007 Ingmar K. Steen (iksteen@gmail.com)
+    Copyright 2008 little blue poney <lbponey@users.sourceforge.net>
+    Karol 'Kenji Takahashi' Woźniak © 2014
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+ */
+
+#include "nnresolver.h"
+#include "nnlog.h"
+#include "util.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+/* getaddrinfo() doesn't tell how long an answer is valid, so resolved
+   hosts are kept for RESOLVER_TTL ms and failures for RESOLVER_NEGATIVE_TTL
+   ms, unless the lookup says otherwise. */
+#define RESOLVER_TTL 300000
+#define RESOLVER_NEGATIVE_TTL 30000
+/* Lookups running at the same time. One slow host shouldn't hold back
+   all the others, but there's no point in hammering the name server. */
+#define RESOLVER_WORKERS 4
+/* Expired answers are dropped once the cache grows this big. */
+#define RESOLVER_CACHE 1024
+
+static uint64_t
+now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, 0);
+  return uint64_t(tv.tv_sec) * 1000 + tv.tv_usec / 1000;
+}
+
+bool
+NewNet::Resolver::lookup(const std::string & host, struct in_addr & address, long &)
+{
+  struct addrinfo hints, * info = 0;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+
+  int error = getaddrinfo(host.c_str(), 0, &hints, &info);
+  if(error != 0 || ! info)
+    return false;
+
+  address = ((struct sockaddr_in *)info->ai_addr)->sin_addr;
+  freeaddrinfo(info);
+  return true;
+}
+
+NewNet::Resolver::Resolver(const Lookup & lookup) : m_Lookup(lookup), m_Idle(0), m_Stopping(false)
+{
+  if(! m_Lookup)
+    m_Lookup = &Resolver::lookup;
+
+  if(pipe(m_Pipe) != 0)
+  {
+    NNLOG("newnet.net.warn", "Couldn't create the resolver's pipe (errno: %i).", errno);
+    m_Pipe[0] = m_Pipe[1] = -1;
+  }
+  else
+  {
+    setnonblocking(m_Pipe[0]);
+    setnonblocking(m_Pipe[1]);
+  }
+}
+
+#ifndef DOXYGEN_UNDOCUMENTED
+NewNet::Resolver::~Resolver()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Stopping = true;
+  }
+  m_Wakeup.notify_all();
+
+  /* Workers stuck in a lookup finish it first, there's no way to
+     interrupt getaddrinfo() */
+  std::vector<std::thread>::iterator it, end = m_Workers.end();
+  for(it = m_Workers.begin(); it != end; ++it)
+    it->join();
+
+  if(m_Pipe[0] >= 0)
+  {
+    close(m_Pipe[0]);
+    close(m_Pipe[1]);
+  }
+}
+#endif // DOXYGEN_UNDOCUMENTED
+
+bool
+NewNet::Resolver::parse(const std::string & host, struct in_addr & address)
+{
+  return inet_pton(AF_INET, host.c_str(), &address) == 1;
+}
+
+bool
+NewNet::Resolver::resolve(const std::string & host, Resolved::Callback * callback)
+{
+  RefPtr<Resolved::Callback> cb(callback);
+
+  Result result;
+  result.host = host;
+  memset(&result.address, 0, sizeof(result.address));
+
+  result.resolved = parse(host, result.address);
+  if(result.resolved)
+  {
+    (*callback)(&result);
+    return true;
+  }
+
+  std::unordered_map<std::string, Entry>::iterator cached = m_Cache.find(host);
+  if(cached != m_Cache.end())
+  {
+    if(cached->second.expires > now())
+    {
+      NNLOG("newnet.net.debug", "Host '%s' found in the resolver's cache.", host.c_str());
+      result.resolved = cached->second.resolved;
+      result.address = cached->second.address;
+      (*callback)(&result);
+      return true;
+    }
+    m_Cache.erase(cached);
+  }
+
+  std::vector<RefPtr<Resolved::Callback> > & waiting = m_Waiting[host];
+  waiting.push_back(callback);
+  if(waiting.size() > 1)
+    return false; // Already being looked up
+
+  if(m_Pipe[0] < 0)
+  {
+    /* No way to hear back from the workers, look it up right here */
+    Answer answer;
+    answer.host = host;
+    answer.ttl = -1;
+    memset(&answer.address, 0, sizeof(answer.address));
+    answer.resolved = m_Lookup(host, answer.address, answer.ttl);
+    m_Answers.push_back(answer);
+    deliver();
+    return true;
+  }
+
+  std::lock_guard<std::mutex> lock(m_Mutex);
+  m_Queue.push_back(host);
+  if((m_Idle == 0) && (m_Workers.size() < RESOLVER_WORKERS))
+    m_Workers.push_back(std::thread(&Resolver::work, this));
+  else
+    m_Wakeup.notify_one();
+  return false;
+}
+
+void
+NewNet::Resolver::work()
+{
+  std::unique_lock<std::mutex> lock(m_Mutex);
+  while(true)
+  {
+    ++m_Idle;
+    while(! m_Stopping && m_Queue.empty())
+      m_Wakeup.wait(lock);
+    --m_Idle;
+    if(m_Stopping)
+      return;
+
+    Answer answer;
+    answer.host = m_Queue.front();
+    answer.ttl = -1;
+    memset(&answer.address, 0, sizeof(answer.address));
+    m_Queue.pop_front();
+
+    lock.unlock();
+    answer.resolved = m_Lookup(answer.host, answer.address, answer.ttl);
+    lock.lock();
+
+    /* One byte is enough to wake up deliver(), it takes all answers. If
+       the pipe is full, deliver() is about to run anyway. Nothing is
+       logged here, logging belongs to the reactor's thread. */
+    m_Answers.push_back(answer);
+    if(m_Answers.size() == 1)
+    {
+      char c = 0;
+      ssize_t written = write(m_Pipe[1], &c, 1);
+      (void)written;
+    }
+  }
+}
+
+void
+NewNet::Resolver::store(const Answer & answer)
+{
+  long ttl = answer.ttl;
+  if(ttl < 0)
+    ttl = answer.resolved ? RESOLVER_TTL : RESOLVER_NEGATIVE_TTL;
+  if(ttl == 0)
+    return;
+
+  uint64_t time = now();
+  if(m_Cache.size() >= RESOLVER_CACHE)
+  {
+    std::unordered_map<std::string, Entry>::iterator it = m_Cache.begin();
+    while(it != m_Cache.end())
+    {
+      if(it->second.expires <= time)
+        it = m_Cache.erase(it);
+      else
+        ++it;
+    }
+    if(m_Cache.size() >= RESOLVER_CACHE)
+      m_Cache.clear();
+  }
+
+  Entry & entry = m_Cache[answer.host];
+  entry.resolved = answer.resolved;
+  entry.address = answer.address;
+  entry.expires = time + ttl;
+}
+
+void
+NewNet::Resolver::deliver()
+{
+  if(m_Pipe[0] >= 0)
+  {
+    char buf[64];
+    while(read(m_Pipe[0], buf, sizeof(buf)) > 0)
+      ;
+  }
+
+  std::vector<Answer> answers;
+  {
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    answers.swap(m_Answers);
+  }
+
+  std::vector<Answer>::iterator it, end = answers.end();
+  for(it = answers.begin(); it != end; ++it)
+  {
+    if(it->resolved)
+      NNLOG("newnet.net.debug", "Resolved host '%s'.", it->host.c_str());
+    else
+      NNLOG("newnet.net.debug", "Cannot resolve host '%s'.", it->host.c_str());
+    store(*it);
+
+    std::map<std::string, std::vector<RefPtr<Resolved::Callback> > >::iterator waiting = m_Waiting.find(it->host);
+    if(waiting == m_Waiting.end())
+      continue;
+
+    /* Callbacks may resolve the same host again */
+    std::vector<RefPtr<Resolved::Callback> > callbacks;
+    callbacks.swap(waiting->second);
+    m_Waiting.erase(waiting);
+
+    Result result;
+    result.host = it->host;
+    result.resolved = it->resolved;
+    result.address = it->address;
+
+    std::vector<RefPtr<Resolved::Callback> >::iterator cb, cbEnd = callbacks.end();
+    for(cb = callbacks.begin(); cb != cbEnd; ++cb)
+      (*(*cb))(&result);
+  }
+}
@@ -0,0 +1,163 @@
+/*  NewNet - A networking framework in C++
+    Copyright (C) 2006-2007 Ingmar K. Steen (iksteen@gmail.com)
+    Copyright 2008 little blue poney <lbponey@users.sourceforge.net>
+    Karol 'Kenji Takahashi' Woźniak © 2014
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+ */
+
+#ifndef NEWNET_RESOLVER_H
+#define NEWNET_RESOLVER_H
+
+#include "nnobject.h"
+#include "nnrefptr.h"
+#include "nnevent.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include <netinet/in.h>
+
+namespace NewNet
+{
+  //! Resolves host names without blocking the reactor.
+  /*! Lookups run on a few worker threads, answers are handed back on the
+      thread calling deliver() (the reactor's, see Reactor::resolve()), so
+      callbacks never race with the rest of the application. Answers,
+      failures included, are cached for as long as the lookup says they
+      are valid. Numeric addresses never reach the workers. */
+  class Resolver : public Object
+  {
+  public:
+    //! Answer to a lookup.
+    struct Result
+    {
+      std::string host;       //!< Host name that was looked up.
+      bool resolved;          //!< False if the host couldn't be resolved.
+      struct in_addr address; //!< Its IPv4 address, if resolved.
+    };
+
+    //! Event type of lookup callbacks.
+    typedef Event<const Result *> Resolved;
+
+    //! Blocking lookup run by the workers.
+    /*! Fills in the address and returns true if the host was resolved.
+        May set ttl to the number of miliseconds the answer stays valid,
+        otherwise the resolver's defaults are used. */
+    typedef std::function<bool(const std::string & host, struct in_addr & address, long & ttl)> Lookup;
+
+    //! Constructor.
+    /*! Create a resolver using lookup, getaddrinfo() if it's empty. */
+    Resolver(const Lookup & lookup = Lookup());
+
+#ifndef DOXYGEN_UNDOCUMENTED
+    ~Resolver();
+#endif // DOXYGEN_UNDOCUMENTED
+
+    //! Resolve a host name.
+    /*! Invokes callback with the answer. Numeric addresses and cached
+        answers are handed over right away, in which case true is returned.
+        Otherwise the lookup is queued (once, no matter how many callbacks
+        wait for the same host) and the callback is invoked from deliver().
+        Note: stores a RefPtr to the callback until it's invoked. */
+    bool resolve(const std::string & host, Resolved::Callback * callback);
+
+    //! Resolve a host name, answer to a method of an object.
+    template<class ObjectType, typename MethodType>
+    bool resolve(const std::string & host, ObjectType * object, MethodType method)
+    {
+      return resolve(host, Resolved::bind(object, method));
+    }
+
+    //! Hand over finished lookups.
+    /*! Caches the answers of finished lookups and invokes the callbacks
+        waiting for them. Call this when descriptor() becomes readable. */
+    void deliver();
+
+    //! Descriptor that becomes readable when lookups finish.
+    int descriptor() const
+    {
+      return m_Pipe[0];
+    }
+
+    //! Number of hosts still being looked up.
+    size_t pending() const
+    {
+      return m_Waiting.size();
+    }
+
+    //! Forget all cached answers.
+    void clear()
+    {
+      m_Cache.clear();
+    }
+
+    //! Parse a numeric IPv4 address.
+    /*! Returns false if host isn't one. */
+    static bool parse(const std::string & host, struct in_addr & address);
+
+    //! Look a host up with getaddrinfo(), blocking.
+    /*! The default Lookup. Leaves ttl alone, getaddrinfo() doesn't know. */
+    static bool lookup(const std::string & host, struct in_addr & address, long & ttl);
+
+  private:
+#ifndef DOXYGEN_UNDOCUMENTED
+    /* Cached answer */
+    struct Entry
+    {
+      bool resolved;
+      struct in_addr address;
+      uint64_t expires; // ms
+    };
+
+    /* Answer of a worker, waiting for deliver() */
+    struct Answer
+    {
+      std::string host;
+      bool resolved;
+      struct in_addr address;
+      long ttl; // ms
+    };
+
+    void work();
+    void store(const Answer & answer);
+
+    Lookup m_Lookup;
+    int m_Pipe[2];
+
+    /* Only touched by the thread calling resolve() and deliver() */
+    std::unordered_map<std::string, Entry> m_Cache;
+    std::map<std::string, std::vector<RefPtr<Resolved::Callback> > > m_Waiting;
+
+    /* Shared with the workers, guarded by m_Mutex */
+    std::mutex m_Mutex;
+    std::condition_variable m_Wakeup;
+    std::deque<std::string> m_Queue;
+    std::vector<Answer> m_Answers;
+    std::vector<std::thread> m_Workers;
+    size_t m_Idle;
+    bool m_Stopping;
+#endif // DOXYGEN_UNDOCUMENTED
+  };
+}
+
+#endif // NEWNET_RESOLVER_H
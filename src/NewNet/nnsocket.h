@@ -105,7 +105,7 @@ namespace NewNet
         uninitialized, has no pending events, no error and no data waiting. */
     Socket() : m_Reactor(0), m_FD(-1), m_SocketState(SocketUninitialized),
               m_ReadyState(0), m_SocketError(ErrorNoError),
-              m_DataWaiting(false)
+              m_DataWaiting(false), m_EventFlags(0)
     {
         m_EventData = new struct event;
         m_EventData->ev_flags = 0; // This event has not been initialized
@@ -140,6 +140,7 @@ namespace NewNet
     void setDescriptor(int fd)
     {
       m_FD = fd;
+      stateChanged();
     }
 
     //! Return the current socket state.
@@ -154,6 +155,7 @@ namespace NewNet
     void setSocketState(SocketState socketState)
     {
       m_SocketState = socketState;
+      stateChanged();
     }
 
     //! Return the socket's ready state.
@@ -199,7 +201,10 @@ namespace NewNet
     /*! Called by subclasses to specify that there's data waiting to be sent */
     void setDataWaiting(bool dataWaiting)
     {
+      if(m_DataWaiting == dataWaiting)
+        return;
       m_DataWaiting = dataWaiting;
+      stateChanged();
     }
 
     //! Return the current download rate limiter.
@@ -238,6 +243,14 @@ namespace NewNet
     {
     }
 
+    //! Stop sharing data with other objects.
+    /*! Called before the socket is handed over to another thread (see
+        ReactorPool::assign()), subclasses copy whatever they share with
+        objects staying behind. */
+    virtual void unshare()
+    {
+    }
+
     //! Associate some libevent data to the socket.
     /*! Associate some libevent data to the socket. */
     void setEventData(struct event & evData) {
@@ -250,6 +263,29 @@ namespace NewNet
         return m_EventData;
     }
 
+    //! Return the events the socket is registered for.
+    /*! Returns the libevent flags the reactor currently watches the
+        socket's descriptor for. 0 means the socket is not registered. */
+    short eventFlags() const
+    {
+      return m_EventFlags;
+    }
+
+    //! Set the events the socket is registered for.
+    /*! Called by the reactor after it (re)registered the socket's
+        libevent data. */
+    void setEventFlags(short eventFlags)
+    {
+      m_EventFlags = eventFlags;
+    }
+
+  protected:
+    //! Notify the reactor about a state change.
+    /*! Called whenever something the reactor's interest set depends on
+        (descriptor, socket state, data waiting) changes, so that the
+        reactor can update this socket's registration. */
+    void stateChanged();
+
   private:
     Reactor * m_Reactor;
     int m_FD;
@@ -259,6 +295,7 @@ namespace NewNet
     bool m_DataWaiting;
     RefPtr<RateLimiter> m_DownRateLimiter, m_UpRateLimiter;
     struct event * m_EventData;
+    short m_EventFlags;
   };
 }
 
@@ -30,24 +30,62 @@ NewNet::TcpClientSocket::connect(const std::string & host, unsigned int port)
   assert((descriptor() == -1) || (socketState() == SocketUninitialized));
 
   setSocketState(SocketConnecting);
+  m_Host = host;
+  m_Port = port;
+
+  // Add a connection timeout, it covers resolving the host too
+  if (reactor()) {
+    m_ConnectionTimeout = reactor()->addTimeout(120000, this, &TcpClientSocket::onConnectionTimeout);
+  }
+
+  // Numeric addresses don't need resolving
+  struct in_addr address;
+  if(Resolver::parse(host, address))
+  {
+    connect(address);
+    return;
+  }
 
   NNLOG("newnet.net.debug", "Resolving host '%s'.", host.c_str());
-  struct hostent *h = gethostbyname(host.c_str());
-  if(! h)
+  if(reactor())
+    reactor()->resolve(host, this, &TcpClientSocket::onResolved);
+  else
   {
-    NNLOG("newnet.net.warn", "Cannot resolve host '%s'.", host.c_str());
-    setSocketError(ErrorCannotResolve);
-    cannotConnectEvent(this);
+    Resolver::Result result;
+    long ttl = -1;
+    result.host = host;
+    result.resolved = Resolver::lookup(host, result.address, ttl);
+    onResolved(&result);
+  }
+}
+
+void
+NewNet::TcpClientSocket::onResolved(const Resolver::Result * result)
+{
+  /* Gave up, or went on to another host in the meantime */
+  if((socketState() != SocketConnecting) || (descriptor() != -1) || (result->host != m_Host))
+    return;
+
+  if(! result->resolved)
+  {
+    NNLOG("newnet.net.warn", "Cannot resolve host '%s'.", m_Host.c_str());
+    cannotConnect(ErrorCannotResolve);
     return;
   }
 
+  connect(result->address);
+}
+
+void
+NewNet::TcpClientSocket::connect(const struct in_addr & addr)
+{
   struct sockaddr_in address;
   memset(&address, 0, sizeof(address));
   address.sin_family = AF_INET;
-  memcpy(&(address.sin_addr.s_addr), *(h->h_addr_list), sizeof(address.sin_addr.s_addr));
-  address.sin_port = htons(port);
+  address.sin_addr = addr;
+  address.sin_port = htons(m_Port);
 
-  NNLOG("newnet.net.debug", "Connecting to host '%s:%u'.", host.c_str(), port);
+  NNLOG("newnet.net.debug", "Connecting to host '%s:%u'.", m_Host.c_str(), m_Port);
 
   int s = socket(PF_INET, SOCK_STREAM, 0);
   if (!setnonblocking(s))
@@ -56,37 +94,42 @@ NewNet::TcpClientSocket::connect(const std::string & host, unsigned int port)
 
   if(s < 0)
     {
-      NNLOG("newnet.net.warn", "Cannot connect to host '%s:%u', error: %i.", host.c_str(), port, WSAGetLastError());
-      setSocketError(ErrorCannotConnect);
-      cannotConnectEvent(this);
+      NNLOG("newnet.net.warn", "Cannot connect to host '%s:%u', error: %i.", m_Host.c_str(), m_Port, WSAGetLastError());
+      cannotConnect(ErrorCannotConnect);
       return;
     }
 
-  // Add a connection timeout
-  if (reactor()) {
-    m_ConnectionTimeout = reactor()->addTimeout(120000, this, &TcpClientSocket::onConnectionTimeout);
-  }
-
   connectedEvent.connect(this, &TcpClientSocket::onConnected);
 
   if(::connect(s, (struct sockaddr *)&address, sizeof(struct sockaddr_in)) == 0)
   {
     // When using non blocking socket (most of the time), we don't get here.
-    NNLOG("newnet.net.debug", "Connected to host '%s:%u'.", host.c_str(), port);
+    NNLOG("newnet.net.debug", "Connected to host '%s:%u'.", m_Host.c_str(), m_Port);
     setSocketState(SocketConnected);
     connectedEvent(this);
   }
   else if(WSAGetLastError() != WSAEWOULDBLOCK)
   {
     // When using non blocking socket (most of the time), we don't get here.
-    NNLOG("newnet.net.warn", "Cannot connect to host '%s:%u', error: %i.", host.c_str(), port, WSAGetLastError());
-    setSocketError(ErrorCannotConnect);
-    cannotConnectEvent(this);
+    NNLOG("newnet.net.warn", "Cannot connect to host '%s:%u', error: %i.", m_Host.c_str(), m_Port, WSAGetLastError());
+    cannotConnect(ErrorCannotConnect);
   }
 }
 
+void
+NewNet::TcpClientSocket::cannotConnect(SocketError error)
+{
+  if (reactor())
+    reactor()->removeTimeout(m_ConnectionTimeout);
+  setSocketError(error);
+  cannotConnectEvent(this);
+}
+
 void
 NewNet::TcpClientSocket::onConnectionTimeout(long) {
+    // Still resolving, its answer will be dropped
+    if ((socketState() == SocketConnecting) && (descriptor() == -1))
+      setSocketError(ErrorCannotResolve);
     cannotConnectEvent(this);
 }
 
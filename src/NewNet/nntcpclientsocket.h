@@ -22,6 +22,7 @@
 #define NEWNET_TCPCLIENTSOCKET_H
 
 #include "nnclientsocket.h"
+#include "nnresolver.h"
 #include <string>
 
 namespace NewNet
@@ -35,21 +36,30 @@ namespace NewNet
     //! Create a new unconnected TCP/IP client socket.
     /*! This creates a new, unconnected TCP/IP client socket. Call connect()
         to connect the client socket to a remote host. */
-    TcpClientSocket() : ClientSocket()
+    TcpClientSocket() : ClientSocket(), m_Port(0)
     {
     }
 
     //! Connect to a remote host.
     /*! Creates a new descriptor and tries to connect it to the specified
-        port on the specified host. */
+        port on the specified host. Host names are resolved through the
+        reactor's resolver without blocking, the socket stays in the
+        connecting state (without a descriptor) in the meantime. */
     void connect(const std::string & host, unsigned int port);
 
     void onConnectionTimeout(long);
 
     void onConnected(ClientSocket *);
 
+    void onResolved(const Resolver::Result * result);
+
   private:
+    void connect(const struct in_addr & address);
+    void cannotConnect(SocketError error);
+
     NewNet::WeakRefPtr<NewNet::Event<long>::Callback> m_ConnectionTimeout;
+    std::string m_Host;
+    unsigned int m_Port;
   };
 }
 
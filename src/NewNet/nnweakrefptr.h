@@ -23,11 +23,144 @@
 
 #include "nnbaseptr.h"
 #include "nnguardobject.h"
+#include "nnrefptr.h"
+#ifdef NN_PTR_ATOMIC
+ #include "nnobject.h"
+#endif // NN_PTR_ATOMIC
 
 namespace NewNet
 {
   class Object;
 
+#ifdef NN_PTR_ATOMIC
+  //! A weak reference pointer class.
+  /*! A weak reference pointer as implemented in this class points at NULL
+      after the object it once pointed as is deleted. This is done by
+      holding on to the object's control block, which tells whether the
+      object is still there. Nothing is registered with the object, so
+      weak references may be made, copied and dropped on any thread. To
+      use the object from a thread other than its owner's, lock() it. */
+  template<class T> class WeakRefPtr : public BasePtr<T>
+  {
+  public:
+    //! Create a new weak reference pointer that points at NULL.
+    /*! Create a new weak reference pointer that points at NULL. */
+    WeakRefPtr() : BasePtr<T>(), m_ControlBlock(0)
+    {
+    }
+
+    //! Create a new weak reference pointer that points at t.
+    /*! Create a new weak reference pointer that points at t. */
+    WeakRefPtr(T * t) : BasePtr<T>(t), m_ControlBlock(t ? t->controlBlock() : 0)
+    {
+      if(m_ControlBlock)
+        m_ControlBlock->retain();
+    }
+
+    //! Create a new weak reference pointer that points at t.
+    /*! Create a new weak reference pointer that points at t. */
+    WeakRefPtr(const WeakRefPtr& t) : BasePtr<T>(t.m_Ptr), m_ControlBlock(t.m_ControlBlock)
+    {
+      if(m_ControlBlock)
+        m_ControlBlock->retain();
+    }
+
+    //! Assign t's object to this pointer.
+    /*! Assign t's object to this pointer. */
+    WeakRefPtr& operator=(const WeakRefPtr& t)
+    {
+      assign(t.m_Ptr, t.m_ControlBlock);
+      return *this;
+    }
+
+    //! Assign object t to this pointer.
+    /*! Assign object t to this pointer. */
+    WeakRefPtr& operator=(T * t)
+    {
+      assign(t, t ? t->controlBlock() : 0);
+      return *this;
+    }
+
+#ifndef DOXYGEN_UNDOCUMENTED
+    ~WeakRefPtr()
+    {
+      if(m_ControlBlock)
+        m_ControlBlock->release();
+    }
+#endif // DOXYGEN_UNDOCUMENTED
+
+    //! Return the pointer.
+    /*! Return the pointer, NULL if the object was deleted. */
+    T * ptr() const
+    {
+      if(m_ControlBlock && m_ControlBlock->alive.load(std::memory_order_acquire))
+        return BasePtr<T>::m_Ptr;
+      return 0;
+    }
+
+    //! Cast operator to T *.
+    /*! This provides a cast operator to T *. */
+    operator T*() const
+    {
+      return ptr();
+    }
+
+    //! Dereferencing operator to T &.
+    T & operator*() const
+    {
+      return *ptr();
+    }
+
+    //! Dereferencing operator to T *.
+    T * operator->() const
+    {
+      return ptr();
+    }
+
+    //! Determine wether the pointer is valid (not NULL).
+    /*! Return true if the object is still there. */
+    bool isValid() const
+    {
+      return ptr() != 0;
+    }
+
+    //! Check if the pointer is NULL.
+    /*! Returns true if the object was deleted or never set. */
+    bool operator!() const
+    {
+      return ptr() == 0;
+    }
+
+    //! Take a strong reference to the object.
+    /*! Returns a RefPtr to the object, or a NULL one if it's unreferenced
+        or being (or was) deleted. The object can't go away while the
+        returned pointer is held, whichever thread drops its last other
+        reference. */
+    RefPtr<T> lock() const
+    {
+      if(! m_ControlBlock || ! m_ControlBlock->strong.acquire())
+        return RefPtr<T>();
+      RefPtr<T> p(BasePtr<T>::m_Ptr);
+      --(m_ControlBlock->strong);
+      return p;
+    }
+
+  private:
+#ifndef DOXYGEN_UNDOCUMENTED
+    void assign(T * t, ControlBlock * controlBlock)
+    {
+      if(controlBlock)
+        controlBlock->retain();
+      if(m_ControlBlock)
+        m_ControlBlock->release();
+      BasePtr<T>::m_Ptr = t;
+      m_ControlBlock = controlBlock;
+    }
+
+    ControlBlock * m_ControlBlock;
+#endif // DOXYGEN_UNDOCUMENTED
+  };
+#else
   //! A weak reference pointer class.
   /*! A weak reference pointer as implemented in this class points at NULL
       after the object it once pointed as is deleted. This is done by
@@ -119,6 +252,16 @@ namespace NewNet
     }
 #endif // DOXYGEN_UNDOCUMENTED
 
+    //! Take a strong reference to the object.
+    /*! Returns a RefPtr to the object, or a NULL one if it's unreferenced
+        or was deleted. */
+    RefPtr<T> lock() const
+    {
+      if(BasePtr<T>::m_Ptr && BasePtr<T>::m_Ptr->refCounter().count() > 0)
+        return RefPtr<T>(BasePtr<T>::m_Ptr);
+      return RefPtr<T>();
+    }
+
   protected:
 #ifndef DOXYGEN_UNDOCUMENTED
     void objectDestroyed(Object * p)
@@ -130,6 +273,7 @@ namespace NewNet
     }
 #endif // DOXYGEN_UNDOCUMENTED
   };
+#endif // NN_PTR_ATOMIC
 }
 
 #undef NN_PTR_CHECK
@@ -22,13 +22,50 @@ void newsoul::Config::init(std::istream &is) {
     std::string j((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
 
     this->json = json_tokener_parse(j.c_str());
+    this->compile({});
 }
 
-newsoul::Config::Config(std::istream &is, bool autosave) : autosave(autosave) {
+void newsoul::Config::compile(std::initializer_list<const std::string> keys) {
+    if(keys.size() > 0) {
+        const std::string &section = *keys.begin();
+        if(section != "users" && section != "uploads" && section != "downloads"
+        && section != "database" && section != "privateRooms") {
+            return;
+        }
+    }
+
+    std::unique_ptr<Snapshot> snapshot(new Snapshot());
+    for(const std::string &user : this->getVec({"users", "banned"})) {
+        snapshot->banned.insert(user);
+    }
+    for(const std::string &user : this->getVec({"users", "buddies"})) {
+        snapshot->buddies.insert(user);
+    }
+    for(const std::string &user : this->getVec({"users", "ignored"})) {
+        snapshot->ignored.insert(user);
+    }
+    for(const std::string &user : this->getVec({"users", "trusted"})) {
+        snapshot->trusted.insert(user);
+    }
+    snapshot->buddiesOnly = this->getBool({"uploads", "buddiesOnly"});
+    snapshot->buddiesFirst = this->getBool({"uploads", "buddiesFirst"});
+    snapshot->allowTrusted = this->getBool({"uploads", "allowTrusted"});
+    snapshot->buddyShares = this->getBool({"database", "buddy", "enabled"});
+    snapshot->autoclearDownloads = this->getBool({"downloads", "autoclear"});
+    snapshot->autoretryDownloads = this->getBool({"downloads", "autoretry"});
+    snapshot->autoclearUploads = this->getBool({"uploads", "autoclear"});
+    snapshot->privateRooms = this->getBool({"privateRooms", "enabled"});
+    snapshot->upSlots = (unsigned int)this->getInt({"uploads", "slots"});
+    snapshot->downSlots = (unsigned int)this->getInt({"downloads", "slots"});
+
+    this->compiled.reset(snapshot.release());
+}
+
+newsoul::Config::Config(std::istream &is, bool autosave) : autosave(autosave), background(false), dirty(false) {
     this->init(is);
 }
 
-newsoul::Config::Config(const std::string &fn, bool autosave) : fn(fn), autosave(autosave) {
+newsoul::Config::Config(const std::string &fn, bool autosave) : fn(fn), autosave(autosave), background(false), dirty(false) {
     std::ifstream f(this->fn);
     if(!f.is_open() || !f.good()) {
         this->fn = path::join({os::config(), "newsoul", "config.json"});
@@ -51,11 +88,67 @@ newsoul::Config::~Config() {
     json_object_put(this->json);
 }
 
-void newsoul::Config::save() {
-    std::ofstream f(this->fn);
-    const char *jsonstring = json_object_to_json_string_ext(this->json, JSON_C_TO_STRING_PRETTY);
-    f.write(jsonstring, strlen(jsonstring));
+void newsoul::Config::write(const std::string &fn, const std::string &data) {
+    const std::string tmp = fn + ".tmp";
+    std::ofstream f(tmp);
+    f.write(data.data(), data.size());
     f.close();
+    if(f.good()) {
+        std::rename(tmp.c_str(), fn.c_str());
+    } else {
+        std::remove(tmp.c_str());
+    }
+}
+
+void newsoul::Config::save() {
+    if(this->writer.joinable()) {
+        this->writer.join();
+    }
+    this->dirty = false;
+    write(this->fn, json_object_to_json_string_ext(this->json, JSON_C_TO_STRING_PRETTY));
+}
+
+void newsoul::Config::writeBehind(const std::function<void()> &scheduler, bool background) {
+    this->scheduler = scheduler;
+    this->background = background;
+    if(!scheduler) {
+        this->flush();
+    }
+}
+
+void newsoul::Config::flush(bool wait) {
+    if(!this->dirty) {
+        if(wait && this->writer.joinable()) {
+            this->writer.join();
+        }
+        return;
+    }
+    if(wait || !this->background) {
+        this->save();
+        return;
+    }
+
+    if(this->writer.joinable()) {
+        this->writer.join();
+    }
+    this->dirty = false;
+    // json-c is not thread safe, so serialize here and only write there.
+    std::string data(json_object_to_json_string_ext(this->json, JSON_C_TO_STRING_PRETTY));
+    this->writer = std::thread(&Config::write, this->fn, std::move(data));
+}
+
+void newsoul::Config::changed() {
+    if(!this->autosave) {
+        return;
+    }
+    if(!this->scheduler) {
+        this->save();
+        return;
+    }
+    if(!this->dirty) {
+        this->dirty = true;
+        this->scheduler();
+    }
 }
 
 struct json_object *newsoul::Config::get(std::initializer_list<const std::string> keys) {
@@ -113,10 +206,8 @@ void newsoul::Config::set(std::initializer_list<const std::string> keys, struct
         copy = part;
     }
     json_object_object_add(copy, (*(keys.end() - 1)).c_str(), value);
-
-    if(this->autosave) {
-        this->save();
-    }
+    this->compile(keys);
+    this->changed();
 }
 
 void newsoul::Config::set(std::initializer_list<const std::string> keys, int value) {
@@ -158,10 +249,8 @@ void newsoul::Config::add(std::initializer_list<const std::string> keys, const s
     }
 
     json_object_array_add(result, json_object_new_string(value.c_str()));
-
-    if(this->autosave) {
-        this->save();
-    }
+    this->compile(keys);
+    this->changed();
 }
 
 bool newsoul::Config::del(std::initializer_list<const std::string> keys, const std::string &key) {
@@ -170,10 +259,8 @@ bool newsoul::Config::del(std::initializer_list<const std::string> keys, const s
     if(result != NULL) {
         if(json_object_object_get(result, key.c_str()) != NULL) {
             json_object_object_del(result, key.c_str());
-
-            if(this->autosave) {
-                this->save();
-            }
+            this->compile(keys);
+            this->changed();
 
             return true;
         } else if(json_object_is_type(result, json_type_array)) {
@@ -203,10 +290,8 @@ bool newsoul::Config::del(std::initializer_list<const std::string> keys, const s
 
             json_object_object_del(jkey, skey.c_str());
             json_object_object_add(jkey, skey.c_str(), narray);
-
-            if(this->autosave) {
-                this->save();
-            }
+            this->compile(keys);
+            this->changed();
 
             return true;
         }
@@ -19,12 +19,17 @@
 #ifndef __NEWSOUL_CONFIG_H__
 #define __NEWSOUL_CONFIG_H__
 
+#include <cstdio>
 #include <cstring>
 #include <initializer_list>
 #include <json-c/json.h>
 #include <fstream>
+#include <functional>
 #include <map>
+#include <memory>
 #include <streambuf>
+#include <thread>
+#include <unordered_set>
 #include <vector>
 #include "utils/convert.h"
 #include "utils/os.h"
@@ -33,9 +38,38 @@
 
 namespace newsoul {
     class Config {
+    public:
+        /*!
+         * Typed copy of the settings that are checked on hot paths,
+         * e.g. for every queued upload or search request, so that they
+         * do not have to walk JSON each time.
+         */
+        struct Snapshot {
+            std::unordered_set<std::string> banned;
+            std::unordered_set<std::string> buddies;
+            std::unordered_set<std::string> ignored;
+            std::unordered_set<std::string> trusted;
+            bool buddiesOnly;
+            bool buddiesFirst;
+            bool allowTrusted;
+            bool buddyShares;
+            bool autoclearDownloads;
+            bool autoretryDownloads;
+            bool autoclearUploads;
+            bool privateRooms;
+            unsigned int upSlots;
+            unsigned int downSlots;
+        };
+
+    private:
         std::string fn;
         bool autosave;
         struct json_object *json;
+        std::unique_ptr<const Snapshot> compiled;
+        std::function<void()> scheduler;
+        bool background;
+        bool dirty;
+        std::thread writer;
 
         /*!
          * Does real initialization, i.e. reads stream contents and
@@ -43,6 +77,24 @@ namespace newsoul {
          * \param is Input stream to read from.
          */
         void init(std::istream &is);
+        /*!
+         * Rebuilds the snapshot from current JSON state and swaps it in,
+         * if the keys changed are ones the snapshot is made of.
+         * \param keys List of keys which were changed.
+         */
+        void compile(std::initializer_list<const std::string> keys);
+        /*!
+         * Called after every mutation. Saves right away, or marks
+         * the state dirty and schedules a write in write-behind mode.
+         */
+        void changed();
+        /*!
+         * Writes JSON to a file atomically, i.e. to a temporary file,
+         * which is then renamed over the target.
+         * \param fn Filename to write to.
+         * \param data JSON to write.
+         */
+        static void write(const std::string &fn, const std::string &data);
 
         /*!
          * General getter method.
@@ -81,6 +133,30 @@ namespace newsoul {
          * Saves current JSON state to disk.
          */
         void save();
+        /*!
+         * Turns on write-behind mode for autosave. Mutations then only
+         * mark the state dirty and, on the first one since the last
+         * write, call the scheduler, which should arrange for flush()
+         * to be called later (e.g. on a reactor timeout). So a burst
+         * of mutations ends up in a single write.
+         * \param scheduler Schedules a write. Empty function turns
+         * write-behind mode off, saving on every mutation again.
+         * \param background Whether scheduled writes may happen in
+         * a separate thread. JSON is still serialized on the caller's.
+         */
+        void writeBehind(const std::function<void()> &scheduler, bool background=false);
+        /*!
+         * Writes pending changes, if there are any.
+         * Also done on destruction.
+         * \param wait If false and background writes are on, returns
+         * right away and writes in a separate thread. Otherwise changes,
+         * including earlier background writes, are on disk on return.
+         */
+        void flush(bool wait=true);
+        /*!
+         * \return True if there are changes not written yet.
+         */
+        bool pending() const { return this->dirty; }
 
         /*!
          * Gets a value of type integer.
@@ -150,6 +226,14 @@ namespace newsoul {
          */
         bool del(std::initializer_list<const std::string> keys, const std::string &key);
 
+        /*!
+         * Gets the typed snapshot of hot settings. It is kept up to date
+         * with set, add and del, but a reference to it is only valid
+         * until the next of them.
+         * \return Current snapshot.
+         */
+        const Snapshot &snapshot() const { return *this->compiled; }
+
         /*!
          * Compatibility layer for clients using old-style
          * configuration structure.
@@ -86,13 +86,13 @@ DISTRIBUTEDMESSAGE(DSearchRequest, 3)
 
 	PARSE
 		unknown = unpack_int();
-		username = unpack_string();
+		unpack_string(username);
 		ticket = unpack_int();
-		query = unpack_string();
+		unpack_string(query);
 	END_PARSE
 
 	uint unknown, ticket;
-	std::string username, query;
+	newsoul::ArenaString username, query;
 END
 
 DISTRIBUTEDMESSAGE(DBranchLevel, 4)
@@ -19,6 +19,27 @@
  */
 
 #include "distributedsocket.h"
+#include "messagedispatcher.h"
+
+namespace
+{
+  /* Messages a distributed socket understands, see messagedispatcher.h. */
+  newsoul::MessageDispatcher<newsoul::DistributedSocket> s_Dispatcher("newsoul.messages.distributed", "distributed", {
+    #define MAP_MESSAGE(ID, TYPE, EVENT) \
+      { ID, #TYPE, [](newsoul::DistributedSocket * owner, const NewNet::Buffer & data) -> bool \
+        { \
+          if(owner->EVENT.empty()) \
+            return false; \
+          TYPE msg; \
+          msg.setDistributedSocket(owner); \
+          msg.parse_network_packet(data); \
+          owner->EVENT(&msg); \
+          return true; \
+        }, 0, 0 },
+    #include "distributedeventtable.h"
+    #undef MAP_MESSAGE
+  });
+}
 
 newsoul::DistributedSocket::DistributedSocket(newsoul::HandshakeSocket * that) : newsoul::UserSocket(that, "D"), newsoul::MessageProcessor(1)
 {
@@ -114,6 +135,7 @@ newsoul::DistributedSocket::onDisconnected(NewNet::ClientSocket * socket) {
 void newsoul::DistributedSocket::onCannotConnectActive(NewNet::ClientSocket * socket) {
     NNLOG("newsoul.distrib.debug", "Cannot connect a distributed socket in active mode. Trying passive.");
     socket->sendBuffer().clear(); // We have a HInitiate message still waiting in the buffer. We don't need it anymore
+    socket->setDataWaiting(false);
     disconnect();
     initiatePassive();
 }
@@ -157,25 +179,11 @@ newsoul::DistributedSocket::onMessageReceived(const MessageData * data)
     if (m_DataTimeout.isValid())
         newsoul()->reactor()->removeTimeout(m_DataTimeout);
 
-  switch(data->type)
+  if(! s_Dispatcher.dispatch(this, data->type, data->data))
   {
-    #define MAP_MESSAGE(ID, TYPE, EVENT) \
-      case ID: \
-      { \
-        NNLOG("newsoul.messages.distributed", "Received distributed message " #TYPE "."); \
-        TYPE msg; \
-        msg.setDistributedSocket(this); \
-        msg.parse_network_packet(data->data, data->length); \
-        EVENT(&msg); \
-        break; \
-      }
-    #include "distributedeventtable.h"
-    #undef MAP_MESSAGE
-
-    default:
-        NNLOG("newsoul.distrib.warn", "Received unknown distributed message, type: %u, length: %u", data->type, data->length);
-        NetworkMessage msg;
-        msg.parse_network_packet(data->data, data->length);
+    NNLOG("newsoul.distrib.warn", "Received unknown distributed message, type: %u, length: %u", data->type, data->length);
+    NetworkMessage msg;
+    msg.parse_network_packet(data->data);
   }
 }
 
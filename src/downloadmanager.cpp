@@ -319,8 +319,9 @@ void
 newsoul::Download::setSocket(DownloadSocket * socket)
 {
     // If we already have a download socket, first stop it and then replace it by the new one
-    if(m_Socket.isValid() && m_Socket != socket)
-        m_Socket->stop();
+    NewNet::RefPtr<DownloadSocket> previous = m_Socket.lock();
+    if(previous.isValid() && previous != socket)
+        previous->stop();
 
     m_Socket = socket;
 
@@ -462,21 +463,24 @@ newsoul::DownloadManager::askPendingPlaces(PeerSocket * socket) {
 /**
  * Analyse the folder contents we've received and look if we can start some download with it
  */
-void newsoul::DownloadManager::addFolderContents(const std::string & user, const Shares & folders) {
+void newsoul::DownloadManager::addFolderContents(const std::string & user, const FileList & folders) {
     if (m_ContentsAsked.find(user) == m_ContentsAsked.end()) {
         NNLOG("newsoul.down.warn", "Unexpected folder content from %s.", user.c_str());
         return;
     }
 
-    Shares::const_iterator fit;
+    std::vector<FileList::DirEntry>::const_iterator fit, sit;
     std::string downloadDir = newsoul()->config()->getStr({"downloads", "complete"});
 
     // Don't download files matching a blacklist item
     std::vector<std::string> blacklistItems = newsoul()->config()->getVec({"downloads", "blacklist"});
 
-    for (fit = folders.begin(); fit != folders.end(); fit++) {
+    // Directories of a folder follow each other
+    for (fit = folders.dirs().begin(); fit != folders.dirs().end(); fit = sit) {
+        for (sit = fit; sit != folders.dirs().end() && sit->folder == fit->folder; sit++);
+
         // Folder we have asked the contents
-        std::string remotePathBase = newsoul()->codeset()->fromPeer(user, fit->first);
+        std::string remotePathBase = newsoul()->codeset()->fromPeer(user, folders.str(fit->folder));
         // The (optional) local path where the folder should be downloaded
         std::string localPathBase = m_ContentsAsked[user].find(remotePathBase)->second;
         if (m_ContentsAsked[user].find(remotePathBase) == m_ContentsAsked[user].end()) {
@@ -484,11 +488,11 @@ void newsoul::DownloadManager::addFolderContents(const std::string & user, const
             continue;
         }
 
-        Dirs::const_iterator sit;
+        std::vector<FileList::DirEntry>::const_iterator dit;
         m_AllowUpdate = false;
-        for (sit = fit->second.begin(); sit != fit->second.end(); sit++) {
+        for (dit = fit; dit != sit; dit++) {
             // Remote path where the file is located (=remotePath without the filename)
-            std::string remotePathDir = newsoul()->codeset()->fromPeer(user, sit->first);
+            std::string remotePathDir = newsoul()->codeset()->fromPeer(user, folders.str(dit->path));
 
             // Some clients (official one for example) sends us files from folder /example/folder2 when asking only for /example/folder
             // Just throw away the wrongly sent files
@@ -506,10 +510,10 @@ void newsoul::DownloadManager::addFolderContents(const std::string & user, const
             if (posB != std::string::npos && posB < remotePathDir.size())
                 localPath += newsoul()->codeset()->fromUtf8ToFS(remotePathDir.substr(posB));
 
-            Dir::const_iterator fiit;
+            const FileList::FileEntry * fiit;
             bool blacklisted = false;
-            for (fiit = sit->second.begin(); fiit != sit->second.end(); fiit++) {
-                std::string filename = newsoul()->codeset()->fromPeer(user, fiit->first);
+            for (fiit = folders.begin(*dit); fiit != folders.end(*dit); fiit++) {
+                std::string filename = newsoul()->codeset()->fromPeer(user, folders.str(fiit->name));
 
                 // Don't download files matching a blacklist item
                 std::vector<std::string>::const_iterator bit;
@@ -537,7 +541,7 @@ void newsoul::DownloadManager::addFolderContents(const std::string & user, const
                     add(user, remotePath);
                 Download * addedDown = findDownload(user, remotePath);
                 if (addedDown)
-                    addedDown->setSize(fiit->second.size);
+                    addedDown->setSize(fiit->size);
             }
         }
         m_AllowUpdate = true;
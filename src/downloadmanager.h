@@ -23,6 +23,7 @@
 
 #include <sstream>
 #include "downloadsocket.h"
+#include "filelist.h"
 #include "peermanager.h"
 #include "servermanager.h"
 #include "sharesdb.h"
@@ -160,7 +161,7 @@ namespace newsoul
     void updateRates();
 
     /* Analyse the folder contents we've received and if we can start some download with it */
-    void addFolderContents(const std::string & user, const Shares & folders);
+    void addFolderContents(const std::string & user, const FileList & folders);
 
     void enqueueDownload(Download * download);
 
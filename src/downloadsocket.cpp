@@ -21,8 +21,11 @@
 #include "downloadsocket.h"
 
 newsoul::DownloadSocket::DownloadSocket(newsoul::Newsoul * newsoul, newsoul::Download * download)
-              : UserSocket(newsoul, "F"), m_Download(download)
+              : UserSocket(newsoul, "F"), m_Download(download), m_Position(0), m_Size(0)
 {
+    // Bulk transfer, move as much as possible per wake up.
+    setReceiveSize(262144);
+
     // Connect our data received event.
     dataReceivedEvent.connect(this, &DownloadSocket::onDataReceived);
     // Connect disconnected event.
@@ -77,6 +80,9 @@ newsoul::DownloadSocket::onConnected(NewNet::ClientSocket *)
         buf[i + 4] = (pos >> (i * 8)) & 0xff;
     }
     send(buf, 12);
+
+    // The rest is bulk, it runs on a loop of its own.
+    handOver();
 }
 
 /*
@@ -85,15 +91,23 @@ newsoul::DownloadSocket::onConnected(NewNet::ClientSocket *)
 void
 newsoul::DownloadSocket::onDisconnected(ClientSocket *)
 {
-	NNLOG("newsoul.down.debug", "DownloadSocket disconnected");
-
-	if(m_Download->position() >= m_Download->size())
-		m_Download->setState(TS_Finished);
-	else
-		m_Download->setState(TS_ConnectionClosed);
-
     if(m_Output.is_open())
         m_Output.close();
+
+    if(! m_Download)
+        return;
+
+    // We're done with the download, it's let go of on the main loop
+    NewNet::RefPtr<Download> download(m_Download);
+    m_Download = 0;
+    toMain([download]() mutable {
+        NNLOG("newsoul.down.debug", "DownloadSocket disconnected");
+
+        if(download->position() >= download->size())
+            download->setState(TS_Finished);
+        else
+            download->setState(TS_ConnectionClosed);
+    });
 }
 
 /*
@@ -113,7 +127,7 @@ newsoul::DownloadSocket::wait()
 {
     // Wait for an incoming connection (via TicketSocket).
     m_Download->setState(TS_Waiting);
-    newsoul()->downloads()->transferTicketReceivedEvent.connect(this, &DownloadSocket::onTransferTicketReceived);
+    m_TicketReceived = newsoul()->downloads()->transferTicketReceivedEvent.connect(this, &DownloadSocket::onTransferTicketReceived);
 }
 
 /*
@@ -123,7 +137,7 @@ void
 newsoul::DownloadSocket::stop()
 {
     NNLOG("newsoul.down.debug", "Disconnecting download socket...");
-    disconnect();
+    onLoop([this]() { disconnect(); });
 }
 
 /*
@@ -132,14 +146,14 @@ newsoul::DownloadSocket::stop()
 void
 newsoul::DownloadSocket::onTransferTicketReceived(TicketSocket * socket)
 {
-    if((m_Download->state() == TS_Waiting) && (m_Download->ticket() == socket->ticket()) && (m_Download->user() == socket->user()))
+    if(m_Download && (m_Download->state() == TS_Waiting) && (m_Download->ticket() == socket->ticket()) && (m_Download->user() == socket->user()))
     {
         NNLOG("newsoul.down.debug", "*does happy dance* (found a download)");
 
         // Steal the socket and its data.
         setDescriptor(socket->descriptor());
         setSocketState(SocketConnected);
-        receiveBuffer() = socket->receiveBuffer();
+        receiveBuffer().take(socket->receiveBuffer());
 
         // Open our incomplete file
         openIncompleteFile();
@@ -154,6 +168,9 @@ newsoul::DownloadSocket::onTransferTicketReceived(TicketSocket * socket)
 
         // Change the state.
         m_Download->setState(TS_Transferring);
+
+        // The rest is bulk, it runs on a loop of its own.
+        handOver();
     }
 }
 
@@ -174,7 +191,9 @@ newsoul::DownloadSocket::openIncompleteFile()
     }
 
     // Set the position of the download to EOF
-    m_Download->setPosition(m_Output.tellp());
+    m_Position = m_Output.tellp();
+    m_Size = m_Download->size();
+    m_Download->setPosition(m_Position);
     NNLOG("newsoul.down.debug", "Set position to %llu (%llu).", m_Download->position(), (uint64)m_Output.tellp());
 
     return true;
@@ -186,26 +205,44 @@ newsoul::DownloadSocket::openIncompleteFile()
 void
 newsoul::DownloadSocket::onDataReceived(NewNet::ClientSocket * socket)
 {
-    if (m_Download->state() == TS_Transferring) {
+    // Data is taken while the incomplete file is open, see openIncompleteFile()
+    if (m_Output.is_open()) {
         if (m_DataTimeout.isValid())
-            newsoul()->reactor()->removeTimeout(m_DataTimeout);
-
-        m_DataTimeout = newsoul()->reactor()->addTimeout(60000, this, &DownloadSocket::dataTimeout);
+            reactor()->addTimeout(60000, m_DataTimeout);
+        else
+            m_DataTimeout = reactor()->addTimeout(60000, this, &DownloadSocket::dataTimeout);
+
+        // Write buffer to disk, piece by piece.
+        size_t received = receiveBuffer().count();
+        while(! receiveBuffer().empty()) {
+            struct iovec iov[16];
+            int count = receiveBuffer().segments(iov, 16, receiveBuffer().count());
+            size_t written = 0;
+            for(int i = 0; i < count; ++i) {
+                m_Output.write((const char *)iov[i].iov_base, iov[i].iov_len);
+                written += iov[i].iov_len;
+            }
+            // Drop what's on disk.
+            receiveBuffer().seek(written);
+        }
+        m_Position += received;
 
-        // Write buffer to disk.
-        m_Output.write((const char *)receiveBuffer().data(), receiveBuffer().count());
         // Increase the download counter.
-        m_Download->received(receiveBuffer().count());
-        // Clear buffer.
-        receiveBuffer().clear();
+        NewNet::RefPtr<Download> download(m_Download);
+        toMain([download, received]() mutable {
+            if (download->state() == TS_Transferring)
+                download->received(received);
+        });
 
         // Finished?
-        if(m_Download->position() >= m_Download->size()) {
-            NNLOG("newsoul.down.debug", "Download of %s from %s finished.", m_Download->remotePath().c_str(), m_Download->user().c_str());
+        if(m_Position >= m_Size) {
             // Close output.
             m_Output.close();
             // Rename / move file.
-            finish();
+            toMain([download]() mutable {
+                NNLOG("newsoul.down.debug", "Download of %s from %s finished.", download->remotePath().c_str(), download->user().c_str());
+                finish(download);
+            });
             // Disconnect.
             stop();
         }
@@ -216,32 +253,55 @@ newsoul::DownloadSocket::onDataReceived(NewNet::ClientSocket * socket)
     }
 }
 
+/*
+    The socket moves to another loop, nothing on the main one may call it anymore
+*/
+void
+newsoul::DownloadSocket::onHandingOver()
+{
+    UserSocket::onHandingOver();
+
+    if (m_TicketReceived.isValid())
+        m_TicketReceived->disconnect();
+    if (m_DataTimeout.isValid())
+        reactor()->removeTimeout(m_DataTimeout);
+}
+
+/*
+    The socket arrived on its new loop, the data timeout starts over there
+*/
+void
+newsoul::DownloadSocket::onHandedOver()
+{
+    m_DataTimeout = reactor()->addTimeout(60000, this, &DownloadSocket::dataTimeout);
+}
+
 /*
     Call it when the download is complete : move the file from incomplete to complete dir
 */
 void
-newsoul::DownloadSocket::finish()
+newsoul::DownloadSocket::finish(Download * download)
 {
     // Ok, we're done.
-    m_Download->setState(TS_Finished);
+    download->setState(TS_Finished);
 
-    std::string destpath = m_Download->destinationPath(true);
+    std::string destpath = download->destinationPath(true);
 
 #ifdef WIN32
     // On Win32, rename doesn't overwrite an existing file automatically.
     remove(destpath.c_str());
 #endif // WIN32
     // Rename the incomplete file to the destination path.
-    if(rename(m_Download->incompletePath().c_str(), destpath.c_str()) == -1) {
+    if(rename(download->incompletePath().c_str(), destpath.c_str()) == -1) {
         if(errno == EXDEV) {
             /* Incomplete and destination path are on different partitions or
              mount points. We'll have to copy it manually. */
             NNLOG("newsoul.down.warn", "Having incomplete and download directory on different partitions is a bad idea!");
             // Open the input stream.
             std::ifstream fin;
-            fin.open(m_Download->incompletePath().c_str(), std::fstream::in | std::fstream::binary);
+            fin.open(download->incompletePath().c_str(), std::fstream::in | std::fstream::binary);
             if(! fin.is_open()) {
-                NNLOG("newsoul.down.warn", "Couldn't open '%s' for reading.", m_Download->incompletePath().c_str());
+                NNLOG("newsoul.down.warn", "Couldn't open '%s' for reading.", download->incompletePath().c_str());
                 return;
             }
             // Open the output stream.
@@ -261,7 +321,7 @@ newsoul::DownloadSocket::finish()
                 n = fin.readsome(buffer, 8192);
                 if(fin.fail()) {
                     // Problem...
-                    NNLOG("newsoul.down.warn", "Couldn't read from '%s'.", m_Download->incompletePath().c_str());
+                    NNLOG("newsoul.down.warn", "Couldn't read from '%s'.", download->incompletePath().c_str());
                     ok = false;
                     break;
                 }
@@ -283,8 +343,8 @@ newsoul::DownloadSocket::finish()
 
             if(ok) {
                 // Everything went ok. Remove the incomplete file.
-                if(remove(m_Download->incompletePath().c_str()) == -1)
-                    NNLOG("newsoul.down.warn", "Couldn't remove '%s'.", m_Download->incompletePath().c_str());
+                if(remove(download->incompletePath().c_str()) == -1)
+                    NNLOG("newsoul.down.warn", "Couldn't remove '%s'.", download->incompletePath().c_str());
             }
             else {
                 // Things went not ok. Delete the destination file.
@@ -294,7 +354,7 @@ newsoul::DownloadSocket::finish()
         }
         else {
             // Something happened. But nobody knows what.
-            NNLOG("newsoul.down.warn", "Renaming '%s' to '%s' failed for unknown reason.", m_Download->incompletePath().c_str(), destpath.c_str());
+            NNLOG("newsoul.down.warn", "Renaming '%s' to '%s' failed for unknown reason.", download->incompletePath().c_str(), destpath.c_str());
         }
     }
 }
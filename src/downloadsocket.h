@@ -48,12 +48,16 @@ namespace newsoul
     void onCannotConnect(NewNet::ClientSocket * socket);
     void onTransferTicketReceived(TicketSocket * socket);
     void onDataReceived(NewNet::ClientSocket * socket);
-    void finish();
+    void onHandingOver();
+    void onHandedOver();
+    static void finish(Download * download);
     void dataTimeout(long);
 
     NewNet::RefPtr<Download> m_Download;
     std::ofstream m_Output;
+    uint64 m_Position, m_Size; // Where we are in the file, kept here so the socket needn't ask the download
     NewNet::WeakRefPtr<NewNet::Event<long>::Callback> m_DataTimeout;
+    NewNet::WeakRefPtr<NewNet::Event<TicketSocket *>::Callback> m_TicketReceived;
   };
 }
 
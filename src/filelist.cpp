@@ -0,0 +1,142 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include "filelist.h"
+
+newsoul::FileList::FileList() {
+    this->clear();
+}
+
+newsoul::FileList::FileList(const Dir &dir) {
+    this->clear();
+    this->addDir(std::string());
+    for(const auto &file : dir) {
+        this->addFile(file.first, file.second);
+    }
+}
+
+void newsoul::FileList::clear() {
+    this->strings.assign(1, '\0');
+    this->interned.clear();
+    this->dirEntries.clear();
+    this->fileEntries.clear();
+}
+
+uint32_t newsoul::FileList::store(const char *s, size_t length) {
+    if(length == 0) {
+        return 0;
+    }
+    const uint32_t offset = this->strings.size();
+    this->strings.insert(this->strings.end(), s, s + length);
+    this->strings.push_back('\0');
+    return offset;
+}
+
+uint32_t newsoul::FileList::store(const std::string &s) {
+    return this->store(s.data(), s.size());
+}
+
+uint32_t newsoul::FileList::intern(const std::string &s) {
+    if(s.empty()) {
+        return 0;
+    }
+    auto it = this->interned.find(s);
+    if(it != this->interned.end()) {
+        return it->second;
+    }
+    const uint32_t offset = this->store(s);
+    this->interned[s] = offset;
+    return offset;
+}
+
+void newsoul::FileList::addDir(const std::string &path, const std::string &folder) {
+    // Files always go to the last directory, so repeating it is free to
+    // merge, as a Dirs map would.
+    if(!this->dirEntries.empty()) {
+        const DirEntry &last = this->dirEntries.back();
+        if(path == this->str(last.path) && folder == this->str(last.folder)) {
+            return;
+        }
+    }
+    DirEntry dir;
+    dir.folder = this->intern(folder);
+    dir.path = this->store(path);
+    dir.first = this->fileEntries.size();
+    dir.count = 0;
+    this->dirEntries.push_back(dir);
+}
+
+void newsoul::FileList::addFile(const std::string &name, uint64_t size, const std::string &ext) {
+    this->addFile(name.data(), name.size(), size, ext);
+}
+
+void newsoul::FileList::addFile(const char *name, size_t length, uint64_t size, const std::string &ext) {
+    if(this->dirEntries.empty()) {
+        this->addDir(std::string());
+    }
+    FileEntry file;
+    file.name = this->store(name, length);
+    file.ext = this->intern(ext);
+    file.size = size;
+    file.attrsCount = 0;
+    this->fileEntries.push_back(file);
+    this->dirEntries.back().count++;
+}
+
+void newsoul::FileList::addFile(const std::string &name, const File &file) {
+    this->addFile(name, file.size, file.ext);
+    for(unsigned int attr : file.attrs) {
+        this->addAttr(attr);
+    }
+}
+
+void newsoul::FileList::addAttr(unsigned int value) {
+    if(this->fileEntries.empty()) {
+        return;
+    }
+    FileEntry &file = this->fileEntries.back();
+    if(file.attrsCount < MAX_ATTRS) {
+        file.attrs[file.attrsCount++] = value;
+    }
+}
+
+void newsoul::FileList::addDirs(const Dirs &dirs, const std::string &folder) {
+    for(const auto &dir : dirs) {
+        this->addDir(dir.first, folder);
+        for(const auto &file : dir.second) {
+            this->addFile(file.first, file.second);
+        }
+    }
+}
+
+newsoul::FileList newsoul::FileList::recoded(const std::function<std::string(const std::string&)> &func) const {
+    FileList list;
+    list.fileEntries.reserve(this->fileEntries.size());
+    list.dirEntries.reserve(this->dirEntries.size());
+    for(const DirEntry &dir : this->dirEntries) {
+        list.addDir(func(this->str(dir.path)), func(this->str(dir.folder)));
+        for(const FileEntry *file = this->begin(dir); file != this->end(dir); ++file) {
+            list.addFile(func(this->str(file->name)), file->size, this->str(file->ext));
+            FileEntry &copy = list.fileEntries.back();
+            copy.attrsCount = file->attrsCount;
+            std::copy(file->attrs, file->attrs + file->attrsCount, copy.attrs);
+        }
+    }
+    return list;
+}
@@ -0,0 +1,165 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __NEWSOUL_FILELIST_H__
+#define __NEWSOUL_FILELIST_H__
+
+#include <functional>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "sharesdb.h"
+
+namespace newsoul {
+    /*!
+     * Flat list of files grouped by directories, and directories optionally
+     * grouped by folders, as sent in shares, folder contents and search replies.
+     *
+     * All names live in a single string arena (extensions and folders
+     * are stored there once), while files are fixed size records kept
+     * contiguously, directory after directory. So a list of a million
+     * files takes a handful of allocations, instead of a few per file
+     * like Shares/Dirs/Dir maps do.
+     */
+    class FileList {
+    public:
+        /*!
+         * Number of attributes kept per file, the rest is dropped.
+         */
+        static const unsigned int MAX_ATTRS = 6;
+
+        /*!
+         * Single directory, strings are offsets to be passed to str().
+         */
+        struct DirEntry {
+            uint32_t folder;
+            uint32_t path;
+            uint32_t first;
+            uint32_t count;
+        };
+
+        /*!
+         * Single file, strings are offsets to be passed to str().
+         */
+        struct FileEntry {
+            uint32_t name;
+            uint32_t ext;
+            uint64_t size;
+            uint32_t attrsCount;
+            unsigned int attrs[MAX_ATTRS];
+        };
+
+    private:
+        std::vector<char> strings;
+        std::map<std::string, uint32_t> interned;
+        std::vector<DirEntry> dirEntries;
+        std::vector<FileEntry> fileEntries;
+
+        uint32_t store(const char *s, size_t length);
+        uint32_t store(const std::string &s);
+        uint32_t intern(const std::string &s);
+
+    public:
+        FileList();
+        /*!
+         * Makes a list of a single, unnamed directory.
+         * \param dir Files to put in it.
+         */
+        explicit FileList(const Dir &dir);
+
+        /*!
+         * Drops all directories and files.
+         */
+        void clear();
+        /*!
+         * Starts a new directory, files added from now on go there.
+         * Repeating the last directory continues it instead.
+         * \param path Directory path.
+         * \param folder Folder the directory belongs to, if any.
+         */
+        void addDir(const std::string &path, const std::string &folder=std::string());
+        /*!
+         * Adds a file to the last directory.
+         * \param name File name.
+         * \param size File size.
+         * \param ext File extension.
+         */
+        void addFile(const std::string &name, uint64_t size, const std::string &ext);
+        /*!
+         * Adds a file to the last directory, straight from a message.
+         * \param name File name, not NUL terminated.
+         * \param length File name length.
+         * \param size File size.
+         * \param ext File extension.
+         */
+        void addFile(const char *name, size_t length, uint64_t size, const std::string &ext);
+        /*!
+         * Adds a file to the last directory.
+         * \param name File name.
+         * \param file File attributes.
+         */
+        void addFile(const std::string &name, const File &file);
+        /*!
+         * Adds an attribute to the last file.
+         * \param value Attribute value.
+         */
+        void addAttr(unsigned int value);
+        /*!
+         * Adds directories of a folder.
+         * \param dirs Directories to add, with their files.
+         * \param folder Folder they belong to, if any.
+         */
+        void addDirs(const Dirs &dirs, const std::string &folder=std::string());
+
+        /*!
+         * \return All directories, in the order they were added.
+         */
+        const std::vector<DirEntry> &dirs() const { return this->dirEntries; }
+        /*!
+         * \return First file of a directory.
+         */
+        const FileEntry *begin(const DirEntry &dir) const { return this->fileEntries.data() + dir.first; }
+        /*!
+         * \return Past the last file of a directory.
+         */
+        const FileEntry *end(const DirEntry &dir) const { return this->fileEntries.data() + dir.first + dir.count; }
+        /*!
+         * \param offset String offset, as found in entries.
+         * \return The string.
+         */
+        const char *str(uint32_t offset) const { return &this->strings[offset]; }
+        /*!
+         * \return Number of files in all directories.
+         */
+        size_t filesCount() const { return this->fileEntries.size(); }
+        /*!
+         * \return True if there are no files, even if there are directories.
+         */
+        bool empty() const { return this->fileEntries.empty(); }
+        /*!
+         * Makes a copy with all names passed through a function,
+         * e.g. to convert them from the peer's encoding.
+         * \param func Name conversion.
+         * \return Converted list.
+         */
+        FileList recoded(const std::function<std::string(const std::string&)> &func) const;
+    };
+}
+
+#endif // __NEWSOUL_FILELIST_H__
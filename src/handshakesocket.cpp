@@ -51,7 +51,7 @@ newsoul::HandshakeSocket::onMessageReceived(const MessageData * data)
       // Apparently, we requested somebody to connect to us.
       NNLOG("newsoul.messages.handshake", "Received peer handshake message HPierceFirewall");
       HPierceFirewall msg;
-      msg.parse_network_packet(data->data, data->length);
+      msg.parse_network_packet(data->data);
       m_Token = msg.token;
       receiveBuffer().seek(data->length + 5);
       // Tell the peer manager, it should know more.
@@ -65,7 +65,7 @@ newsoul::HandshakeSocket::onMessageReceived(const MessageData * data)
       // Somebody wants to establish a connection.
       NNLOG("newsoul.messages.handshake", "Received peer handshake message HInitiate");
       HInitiate msg;
-      msg.parse_network_packet(data->data, data->length);
+      msg.parse_network_packet(data->data);
       NNLOG("newsoul.hand.debug", "HInitiate payload: %s %s %u", msg.user.c_str(), msg.type.c_str(), msg.token);
       // Set some variables.
       m_Token = msg.token;
@@ -115,7 +115,7 @@ newsoul::HandshakeSocket::onMessageReceived(const MessageData * data)
     default:
         NNLOG("newsoul.hand.warn", "Received unknown peer handshake message, type: %u, length: %u", data->type, data->length);
         NetworkMessage msg;
-        msg.parse_network_packet(data->data, data->length);
+        msg.parse_network_packet(data->data);
   }
 }
 
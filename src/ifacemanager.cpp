@@ -55,7 +55,7 @@ static std::string challenge()
   return r;
 }
 
-newsoul::IfaceManager::IfaceManager(Newsoul * newsoul) : m_Newsoul(newsoul)
+newsoul::IfaceManager::IfaceManager(Newsoul * newsoul) : m_Newsoul(newsoul), m_RoomMessageCallback(0), m_PublicChatCallback(0)
 {
   m_AwayState = 0;
   m_ReceivedTimeDiff = false;
@@ -70,7 +70,6 @@ newsoul::IfaceManager::IfaceManager(Newsoul * newsoul) : m_Newsoul(newsoul)
   newsoul->server()->addUserReceivedEvent.connect(this, &IfaceManager::onServerAddUserReceived);
   newsoul->server()->userStatusReceivedEvent.connect(this, &IfaceManager::onServerUserStatusReceived);
   newsoul->server()->privateMessageReceivedEvent.connect(this, &IfaceManager::onServerPrivateMessageReceived);
-  newsoul->server()->roomMessageReceivedEvent.connect(this, &IfaceManager::onServerRoomMessageReceived);
   newsoul->server()->roomJoinedEvent.connect(this, &IfaceManager::onServerRoomJoined);
   newsoul->server()->roomLeftEvent.connect(this, &IfaceManager::onServerRoomLeft);
   newsoul->server()->userJoinedRoomEvent.connect(this, &IfaceManager::onServerUserJoinedRoom);
@@ -87,7 +86,6 @@ newsoul::IfaceManager::IfaceManager(Newsoul * newsoul) : m_Newsoul(newsoul)
   newsoul->server()->itemSimilarUsersReceivedEvent.connect(this, &IfaceManager::onServerItemSimilarUsersReceived);
   newsoul->server()->userInterestsReceivedEvent.connect(this, &IfaceManager::onServerUserInterestsReceived);
   newsoul->server()->newPasswordReceivedEvent.connect(this, &IfaceManager::onServerNewPasswordSet);
-  newsoul->server()->publicChatReceivedEvent.connect(this, &IfaceManager::onServerPublicChatReceived);
 
   newsoul->server()->privRoomToggleReceivedEvent.connect(this, &IfaceManager::onServerPrivRoomToggled);
   newsoul->server()->privRoomAlterableMembersReceivedEvent.connect(this, &IfaceManager::onServerPrivRoomAlterableMembers);
@@ -259,11 +257,34 @@ newsoul::IfaceManager::sendNewSearchToAll(const std::string & query, uint token)
     SEND_ALL(ISearch(query, token));
 }
 
+/*
+    Chat lines are only ever passed on to interfaces, not cached like room
+    members or tickers, so only listen to them while there are interfaces.
+    The server then doesn't even parse them.
+*/
+void
+newsoul::IfaceManager::listenToRoomChat(bool listen)
+{
+  if(listen && ! m_RoomMessageCallback)
+  {
+    m_RoomMessageCallback = newsoul()->server()->roomMessageReceivedEvent.connect(this, &IfaceManager::onServerRoomMessageReceived);
+    m_PublicChatCallback = newsoul()->server()->publicChatReceivedEvent.connect(this, &IfaceManager::onServerPublicChatReceived);
+  }
+  else if(! listen && m_RoomMessageCallback)
+  {
+    newsoul()->server()->roomMessageReceivedEvent.disconnect(m_RoomMessageCallback);
+    newsoul()->server()->publicChatReceivedEvent.disconnect(m_PublicChatCallback);
+    m_RoomMessageCallback = 0;
+    m_PublicChatCallback = 0;
+  }
+}
+
 void
 newsoul::IfaceManager::onIfaceAccepted(IfaceSocket * socket)
 {
   NNLOG("newsoul.iface.debug", "Accepted new interface socket.");
   m_Ifaces.push_back(socket);
+  listenToRoomChat(true);
 
   // Connect the events
   socket->disconnectedEvent.connect(this, &IfaceManager::onIfaceDisconnected);
@@ -341,6 +362,8 @@ newsoul::IfaceManager::onIfaceDisconnected(NewNet::ClientSocket * socket)
     it = std::find(m_Ifaces.begin(), m_Ifaces.end(), static_cast<IfaceSocket *>(socket));
     if (it != m_Ifaces.end())
         m_Ifaces.erase(it);
+    if (m_Ifaces.empty())
+        listenToRoomChat(false);
     if(socket->reactor())
         socket->reactor()->remove(socket);
 }
@@ -1487,17 +1510,9 @@ newsoul::IfaceManager::onPeerSharesReceived(const PSharesReply * message)
     PeerSocket * socket = message->peerSocket();
 
     // We need to convert the shares with correct encoding
-    Dirs oriShares = message->shares;
-    Dirs encShares;
-    Dirs::iterator itFold;
-    Dir::iterator itFile;
-    for(itFold = oriShares.begin(); itFold != oriShares.end(); ++itFold) {
-        Dir newFold;
-        for(itFile = itFold->second.begin(); itFile != itFold->second.end(); ++itFile) {
-            newFold[newsoul()->codeset()->fromPeer(socket->user(), itFile->first)] = itFile->second;
-        }
-        encShares[newsoul()->codeset()->fromPeer(socket->user(), itFold->first)] = newFold;
-    }
+    FileList encShares = message->shares.recoded([this, socket](const std::string &name) {
+        return newsoul()->codeset()->fromPeer(socket->user(), name);
+    });
 
     std::map<std::string, std::vector<NewNet::WeakRefPtr<IfaceSocket> > >::iterator it;
     std::vector<NewNet::WeakRefPtr<IfaceSocket> >::iterator fit;
@@ -1561,7 +1576,7 @@ newsoul::IfaceManager::onUploadRemoved(Upload * upload)
 }
 
 void
-newsoul::IfaceManager::onSearchReply(uint ticket, const std::string & user, bool slotfree, uint avgspeed, uint queuelen, const Dir & folders)
+newsoul::IfaceManager::onSearchReply(uint ticket, const std::string & user, bool slotfree, uint avgspeed, uint queuelen, const FileList & folders)
 {
   SEND_ALL(ISearchReply(ticket, user, slotfree, avgspeed, queuelen, folders));
 }
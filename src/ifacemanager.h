@@ -60,7 +60,7 @@ namespace newsoul
     }
 
     // Some search results received
-    void onSearchReply(uint ticket, const std::string & user, bool slotfree, uint avgspeed, uint queuelen, const Dir & folders);
+    void onSearchReply(uint ticket, const std::string & user, bool slotfree, uint avgspeed, uint queuelen, const FileList & folders);
 
     void sendNewSearchToAll(const std::string & query, uint token);
 
@@ -69,6 +69,7 @@ namespace newsoul
     void removeListener(const std::string & path);
 
     void flushPrivateMessages();
+    void listenToRoomChat(bool listen);
 
     // Log event handler:
     void onLog(const NewNet::Log::LogNotify * notice);
@@ -197,6 +198,8 @@ namespace newsoul
     std::map<std::string, NewNet::RefPtr<NewNet::Object> > m_Factories;
     std::map<std::string, NewNet::RefPtr<NewNet::ServerSocket> > m_ServerSockets;
     std::vector<NewNet::RefPtr<IfaceSocket> > m_Ifaces;
+    NewNet::Event<const SSayRoom *>::Callback * m_RoomMessageCallback;
+    NewNet::Event<const SPublicChat *>::Callback * m_PublicChatCallback;
 
     // Pending requests:
     std::map<std::string, std::vector<NewNet::WeakRefPtr<IfaceSocket> > > m_PendingInfo, m_PendingShares;
@@ -22,6 +22,7 @@
 #ifndef NEWSOUL_IFACEMESSAGES_H
 #define NEWSOUL_IFACEMESSAGES_H
 
+#include "filelist.h"
 #include "networkmessage.h"
 #include "downloadmanager.h"
 #include "uploadmanager.h"
@@ -64,6 +65,14 @@ public:
 			pack(*ait);
 	}
 
+	inline void pack(const newsoul::FileList& list, const newsoul::FileList::FileEntry& fe) {
+		pack(fe.size);
+		pack(std::string(list.str(fe.ext)));
+		pack((uint32)fe.attrsCount);
+		for(uint32 i = 0; i < fe.attrsCount; ++i)
+			pack(fe.attrs[i]);
+	}
+
 	inline void pack(const newsoul::Download * download)
 	{
 		pack((uchar)0);
@@ -614,20 +623,20 @@ IFACEMESSAGE(IUserShares, 0x0205)
 */
 
 	IUserShares() {}
-	IUserShares(const std::string& _u, const newsoul::Dirs& _s)
+	IUserShares(const std::string& _u, const newsoul::FileList& _s)
                    : user(_u), shares(_s) {}
 
 	MAKE
 		pack(user);
-		pack((uint32)shares.size());
-        newsoul::Dirs::const_iterator dit = shares.begin();
-		for(; dit != shares.end(); ++dit) {
-			pack((*dit).first);
-			pack((uint32)(*dit).second.size());
-            newsoul::Dir::const_iterator fit = (*dit).second.begin();
-			for(; fit != (*dit).second.end(); ++fit) {
-				pack((*fit).first);
-				pack((*fit).second);
+		pack((uint32)shares.dirs().size());
+        std::vector<newsoul::FileList::DirEntry>::const_iterator dit = shares.dirs().begin();
+		for(; dit != shares.dirs().end(); ++dit) {
+			pack(std::string(shares.str(dit->path)));
+			pack((uint32)dit->count);
+            const newsoul::FileList::FileEntry * fit = shares.begin(*dit);
+			for(; fit != shares.end(*dit); ++fit) {
+				pack(std::string(shares.str(fit->name)));
+				pack(shares, *fit);
 			}
 		}
 	END_MAKE
@@ -637,7 +646,7 @@ IFACEMESSAGE(IUserShares, 0x0205)
 	END_PARSE
 
 	std::string user;
-    newsoul::Dirs shares;
+    newsoul::FileList shares;
 END
 
 IFACEMESSAGE(IPeerAddress, 0x0206)
@@ -1519,7 +1528,7 @@ IFACEMESSAGE(ISearchReply, 0x0402)
 	folder results -- The actual results
 */
 	ISearchReply() {}
-	ISearchReply(uint32 _t, const std::string& _u, bool _f, uint32 _s, uint32 _q, const newsoul::Dir& _r)
+	ISearchReply(uint32 _t, const std::string& _u, bool _f, uint32 _s, uint32 _q, const newsoul::FileList& _r)
                     : username(_u), results(_r) { ticket = _t, slotfree = _f, speed = _s, queue = _q; }
 
 	MAKE
@@ -1528,11 +1537,14 @@ IFACEMESSAGE(ISearchReply, 0x0402)
 		pack((unsigned char)slotfree);
 		pack(speed);
 		pack(queue); // Slsk protocol uses 64bit int. It would be a good idea to do the same in newsoul protocol one day.
-		pack((uint32)results.size());
-        newsoul::Dir::const_iterator it = results.begin();
-		for(; it != results.end(); ++it) {
-			pack((*it).first);
-			pack((const newsoul::File&)(*it).second);
+		pack((uint32)results.filesCount());
+        std::vector<newsoul::FileList::DirEntry>::const_iterator dit = results.dirs().begin();
+		for(; dit != results.dirs().end(); ++dit) {
+            const newsoul::FileList::FileEntry * it = results.begin(*dit);
+			for(; it != results.end(*dit); ++it) {
+				pack(std::string(results.str(it->name)));
+				pack(results, *it);
+			}
 		}
 	END_MAKE
 
@@ -1542,7 +1554,7 @@ IFACEMESSAGE(ISearchReply, 0x0402)
 
 	uint32 ticket, speed, queue;
 	std::string username;
-    newsoul::Dir results;
+    newsoul::FileList results;
 	bool slotfree;
 END
 
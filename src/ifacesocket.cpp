@@ -19,6 +19,39 @@
  */
 
 #include "ifacesocket.h"
+#include "messagedispatcher.h"
+
+namespace
+{
+  /* Messages an interface socket understands, see messagedispatcher.h. */
+  newsoul::MessageDispatcher<newsoul::IfaceSocket> s_Dispatcher("newsoul.messages.iface", "interface", {
+    #define MAP_MESSAGE(ID, TYPE, EVENT) \
+      { ID, #TYPE, [](newsoul::IfaceSocket * owner, const NewNet::Buffer & data) -> bool \
+        { \
+          if(owner->EVENT.empty()) \
+            return false; \
+          TYPE msg; \
+          msg.setIfaceSocket(owner); \
+          msg.parse_network_packet(data); \
+          owner->EVENT(&msg); \
+          return true; \
+        }, 0, 0 },
+    #define MAP_C_MESSAGE(ID, TYPE, EVENT) \
+      { ID, #TYPE, [](newsoul::IfaceSocket * owner, const NewNet::Buffer & data) -> bool \
+        { \
+          if(owner->EVENT.empty()) \
+            return false; \
+          TYPE msg(owner->cipherContext()); \
+          msg.setIfaceSocket(owner); \
+          msg.parse_network_packet(data); \
+          owner->EVENT(&msg); \
+          return true; \
+        }, 0, 0 },
+    #include "ifaceeventtable.h"
+    #undef MAP_MESSAGE
+    #undef MAP_C_MESSAGE
+  });
+}
 
 newsoul::IfaceSocket::IfaceSocket() : NewNet::ClientSocket(), MessageProcessor(4), m_Authenticated(false)
 {
@@ -49,7 +82,7 @@ newsoul::IfaceSocket::sendMessage(const NewNet::Buffer & buffer)
   buf[2] = (buffer.count() >> 16) & 0xff;
   buf[3] = (buffer.count() >> 24) & 0xff;
   send(buf, 4);
-  send(buffer.data(), buffer.count());
+  send(buffer);
 }
 
 void
@@ -62,36 +95,11 @@ newsoul::IfaceSocket::onMessageReceived(const MessageData * data)
     return;
   }
 
-  switch(data->type)
+  if(! s_Dispatcher.dispatch(this, data->type, data->data))
   {
-    #define MAP_MESSAGE(ID, TYPE, EVENT) \
-      case ID: \
-      { \
-        NNLOG("newsoul.messages.iface", "Received interface message " #TYPE "."); \
-        TYPE msg; \
-        msg.setIfaceSocket(this); \
-        msg.parse_network_packet(data->data, data->length); \
-        EVENT(&msg); \
-        break; \
-      }
-    #define MAP_C_MESSAGE(ID, TYPE, EVENT) \
-      case ID: \
-      { \
-        NNLOG("newsoul.messages.iface", "Received interface message " #TYPE "."); \
-        TYPE msg(m_CipherContext); \
-        msg.setIfaceSocket(this); \
-        msg.parse_network_packet(data->data, data->length); \
-        EVENT(&msg); \
-        break; \
-      }
-    #include "ifaceeventtable.h"
-    #undef MAP_MESSAGE
-    #undef MAP_C_MESSAGE
-
-    default:
-        NNLOG("newsoul.iface.warn", "Received unknown interface message, type: %u, length: %u", data->type, data->length);
-        NetworkMessage msg;
-        msg.parse_network_packet(data->data, data->length);
+    NNLOG("newsoul.iface.warn", "Received unknown interface message, type: %u, length: %u", data->type, data->length);
+    NetworkMessage msg;
+    msg.parse_network_packet(data->data);
   }
 }
 
@@ -0,0 +1,98 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "messagearena.h"
+
+// Size of arena chunks, enough for any chat line or search request.
+#define CHUNKSIZE 16384
+
+thread_local newsoul::MessageArena * newsoul::MessageArena::s_Current = 0;
+
+newsoul::MessageArena::~MessageArena()
+{
+  std::vector<Chunk>::iterator it, end = m_Chunks.end();
+  for(it = m_Chunks.begin(); it != end; ++it)
+    delete [] (*it).data;
+}
+
+void *
+newsoul::MessageArena::allocate(size_t n)
+{
+  // Keep everything aligned.
+  n = (n + 7) & ~(size_t)7;
+
+  // Find the next chunk that can hold it.
+  while(m_Chunk < m_Chunks.size())
+  {
+    Chunk & chunk = m_Chunks[m_Chunk];
+    if(chunk.size - m_Used >= n)
+    {
+      void * p = chunk.data + m_Used;
+      m_Used += n;
+      return p;
+    }
+    ++m_Chunk;
+    m_Used = 0;
+  }
+
+  // None left, allocate a new one.
+  Chunk chunk;
+  chunk.size = (n > CHUNKSIZE) ? n : CHUNKSIZE;
+  chunk.data = new char[chunk.size];
+  m_Chunks.push_back(chunk);
+  m_Chunk = m_Chunks.size() - 1;
+  m_Used = n;
+  return chunk.data;
+}
+
+void
+newsoul::MessageArena::rewind(size_t chunk, size_t used)
+{
+  // Oversized chunks are made for one huge string at a time, don't keep
+  // them around once they aren't used anymore.
+  for(size_t i = m_Chunks.size(); i > chunk; --i)
+  {
+    if((m_Chunks[i - 1].size > CHUNKSIZE) && ((i - 1 > chunk) || (used == 0)))
+    {
+      delete [] m_Chunks[i - 1].data;
+      m_Chunks.erase(m_Chunks.begin() + (i - 1));
+    }
+  }
+  m_Chunk = chunk;
+  m_Used = used;
+}
+
+char *
+newsoul::ArenaString::resize(size_t n)
+{
+  MessageArena * arena = MessageArena::current();
+  if(! arena)
+  {
+    m_Heap.assign(n, '\0');
+    m_Data = m_Heap.c_str();
+    m_Size = n;
+    return &m_Heap[0];
+  }
+
+  m_Heap.clear();
+  char * p = (char *)arena->allocate(n + 1);
+  p[n] = '\0';
+  m_Data = p;
+  m_Size = n;
+  return p;
+}
@@ -0,0 +1,195 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NEWSOUL_MESSAGEARENA_H
+#define NEWSOUL_MESSAGEARENA_H
+
+#include <string>
+#include <string.h>
+#include <vector>
+
+namespace newsoul
+{
+  /* MessageArena is a monotonic allocator for data parsed out of incoming
+     messages. Such messages only live while they are being dispatched, so
+     their memory is never freed one piece at a time, the arena is just
+     rewound once the dispatch is over and its chunks are reused. */
+  class MessageArena
+  {
+  public:
+    MessageArena() : m_Chunk(0), m_Used(0)
+    {
+    }
+
+    ~MessageArena();
+
+    /* Return the arena of the message being dispatched in this thread, or
+       null if there is none. */
+    static MessageArena * current()
+    {
+      return s_Current;
+    }
+
+    /* Allocate n bytes. They stay valid until the arena is rewound past
+       them, that is until the Scope they were allocated in ends. */
+    void * allocate(size_t n);
+
+    /* Makes the arena current for the lifetime of the scope. When the
+       scope ends, everything allocated within it is dropped and the
+       previously current arena is restored, so scopes can be nested. */
+    class Scope
+    {
+    public:
+      Scope(MessageArena & arena) : m_Arena(arena), m_Previous(s_Current),
+                                    m_Chunk(arena.m_Chunk), m_Used(arena.m_Used)
+      {
+        s_Current = &arena;
+      }
+
+      ~Scope()
+      {
+        m_Arena.rewind(m_Chunk, m_Used);
+        s_Current = m_Previous;
+      }
+
+    private:
+      Scope(const Scope &);
+      Scope & operator=(const Scope &);
+
+      MessageArena & m_Arena;
+      MessageArena * m_Previous;
+      size_t m_Chunk, m_Used;
+    };
+
+  private:
+    MessageArena(const MessageArena &);
+    MessageArena & operator=(const MessageArena &);
+
+    /* Go back to a position returned earlier by m_Chunk and m_Used. */
+    void rewind(size_t chunk, size_t used);
+
+    struct Chunk
+    {
+      char * data;
+      size_t size;
+    };
+
+    std::vector<Chunk> m_Chunks;     // Chunks of memory, kept between dispatches
+    size_t m_Chunk;                  // Chunk we're allocating from
+    size_t m_Used;                   // Bytes used of that chunk
+    static thread_local MessageArena * s_Current;
+  };
+
+  /* String field of a parsed message. It keeps its characters in the current
+     MessageArena when it's filled in by NetworkMessage::unpack_string, and on
+     the heap otherwise (e.g. when a message is made to be sent). Copies are
+     always made on the heap, so they can safely outlive the message. It
+     converts to std::string implicitly, so handlers can use it as one. */
+  class ArenaString
+  {
+  public:
+    ArenaString() : m_Data(""), m_Size(0)
+    {
+    }
+
+    ArenaString(const std::string & s) : m_Heap(s)
+    {
+      m_Data = m_Heap.c_str();
+      m_Size = m_Heap.size();
+    }
+
+    ArenaString(const ArenaString & that) : m_Heap(that.m_Data, that.m_Size)
+    {
+      m_Data = m_Heap.c_str();
+      m_Size = m_Heap.size();
+    }
+
+    ArenaString & operator=(const ArenaString & that)
+    {
+      if(this != &that)
+        *this = std::string(that.m_Data, that.m_Size);
+      return *this;
+    }
+
+    ArenaString & operator=(const std::string & s)
+    {
+      m_Heap = s;
+      m_Data = m_Heap.c_str();
+      m_Size = m_Heap.size();
+      return *this;
+    }
+
+    /* Make room for n characters, NUL terminated, and return where to write
+       them. The arena is used if there is a current one. */
+    char * resize(size_t n);
+
+    void clear()
+    {
+      m_Heap.clear();
+      m_Data = "";
+      m_Size = 0;
+    }
+
+    const char * c_str() const
+    {
+      return m_Data;
+    }
+
+    const char * data() const
+    {
+      return m_Data;
+    }
+
+    size_t size() const
+    {
+      return m_Size;
+    }
+
+    bool empty() const
+    {
+      return m_Size == 0;
+    }
+
+    std::string str() const
+    {
+      return std::string(m_Data, m_Size);
+    }
+
+    operator std::string() const
+    {
+      return str();
+    }
+
+    bool operator==(const std::string & s) const
+    {
+      return (s.size() == m_Size) && (memcmp(s.data(), m_Data, m_Size) == 0);
+    }
+
+    bool operator!=(const std::string & s) const
+    {
+      return ! (*this == s);
+    }
+
+  private:
+    const char * m_Data;  // Characters, in the arena or in m_Heap
+    size_t m_Size;        // Number of characters
+    std::string m_Heap;   // Characters, if not in the arena
+  };
+}
+
+#endif // NEWSOUL_MESSAGEARENA_H
@@ -0,0 +1,510 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NEWSOUL_MESSAGECODEC_H
+#define NEWSOUL_MESSAGECODEC_H
+
+#include <string.h>
+#include <sys/uio.h>
+#include "filelist.h"
+#include "messagearena.h"
+#include "mutypes.h"
+#include "NewNet/nnbuffer.h"
+
+/* Schema based message codecs.
+
+   A message describes its wire layout once, as a template member walking
+   its fields in order:
+
+     template<typename Codec> void schema(Codec & c)
+     {
+       c & user & ticket & newsoul::codec::files(results);
+     }
+
+   and the same description is instantiated with three codecs: Sizer
+   computes the encoded size, Encoder writes all fields into a single
+   block reserved up front, and Decoder reads them back in one pass,
+   checking bounds on every read instead of every field checking
+   buffer.count() by hand. See encode() and decode() at the bottom. */
+
+namespace newsoul
+{
+  namespace codec
+  {
+    /* List of files as found in search and folder contents replies: count,
+       then code byte, name, size, extension and (code, value) attributes
+       for each file. All directories of the list are flattened. */
+    struct Files
+    {
+      FileList & list;
+      /* Pack '/' in names as '\'. */
+      bool slashes;
+      /* Sizes are 32 bit, as some clients send them. */
+      bool shortSizes;
+    };
+
+    inline Files files(FileList & list, bool slashes = false, bool shortSizes = false)
+    {
+      Files f = { list, slashes, shortSizes };
+      return f;
+    }
+
+    /* 64 bit value that some clients send as 32 bit. It is decoded as
+       32 bit if there are less than 8 bytes left. */
+    struct Compat64
+    {
+      uint64 & value;
+    };
+
+    inline Compat64 compat64(uint64 & value)
+    {
+      Compat64 c = { value };
+      return c;
+    }
+
+    /* Computes the size of encoded fields. */
+    class Sizer
+    {
+    public:
+      Sizer() : m_Size(0)
+      {
+      }
+
+      size_t size() const
+      {
+        return m_Size;
+      }
+
+      Sizer & operator&(uchar)
+      {
+        m_Size += 1;
+        return *this;
+      }
+
+      Sizer & operator&(bool)
+      {
+        m_Size += 1;
+        return *this;
+      }
+
+      Sizer & operator&(uint32)
+      {
+        m_Size += 4;
+        return *this;
+      }
+
+      Sizer & operator&(int32)
+      {
+        m_Size += 4;
+        return *this;
+      }
+
+      Sizer & operator&(uint64)
+      {
+        m_Size += 8;
+        return *this;
+      }
+
+      Sizer & operator&(Compat64)
+      {
+        m_Size += 8;
+        return *this;
+      }
+
+      Sizer & operator&(const std::string & s)
+      {
+        m_Size += 4 + s.size();
+        return *this;
+      }
+
+      Sizer & operator&(const ArenaString & s)
+      {
+        m_Size += 4 + s.size();
+        return *this;
+      }
+
+      Sizer & operator&(const std::vector<uchar> & v)
+      {
+        m_Size += 4 + v.size();
+        return *this;
+      }
+
+      template<typename T> Sizer & operator&(const std::vector<T> & v)
+      {
+        m_Size += 4;
+        typename std::vector<T>::const_iterator it, end = v.end();
+        for(it = v.begin(); it != end; ++it)
+          *this & *it;
+        return *this;
+      }
+
+      Sizer & operator&(const Files & f)
+      {
+        const FileList & list = f.list;
+        m_Size += 4;
+        std::vector<FileList::DirEntry>::const_iterator dit, dend = list.dirs().end();
+        for(dit = list.dirs().begin(); dit != dend; ++dit)
+        {
+          const FileList::FileEntry * it, * end = list.end(*dit);
+          for(it = list.begin(*dit); it != end; ++it)
+            m_Size += 1 + 4 + strlen(list.str(it->name)) + (f.shortSizes ? 4 : 8) + 4 + strlen(list.str(it->ext)) + 4 + 8 * it->attrsCount;
+        }
+        return *this;
+      }
+
+    private:
+      size_t m_Size;
+    };
+
+    /* Writes encoded fields to memory sized by Sizer. */
+    class Encoder
+    {
+    public:
+      Encoder(uchar * to) : m_Pos(to)
+      {
+      }
+
+      Encoder & operator&(uchar c)
+      {
+        *m_Pos++ = c;
+        return *this;
+      }
+
+      Encoder & operator&(bool b)
+      {
+        *m_Pos++ = b ? 1 : 0;
+        return *this;
+      }
+
+      Encoder & operator&(uint32 i)
+      {
+        m_Pos[0] = i & 0xff;
+        m_Pos[1] = (i >> 8) & 0xff;
+        m_Pos[2] = (i >> 16) & 0xff;
+        m_Pos[3] = (i >> 24) & 0xff;
+        m_Pos += 4;
+        return *this;
+      }
+
+      Encoder & operator&(int32 i)
+      {
+        return *this & (uint32)i;
+      }
+
+      Encoder & operator&(uint64 i)
+      {
+        *this & (uint32)(i & 0xffffffff);
+        return *this & (uint32)(i >> 32);
+      }
+
+      Encoder & operator&(Compat64 c)
+      {
+        return *this & c.value;
+      }
+
+      Encoder & operator&(const std::string & s)
+      {
+        return bytes(s.data(), s.size());
+      }
+
+      Encoder & operator&(const ArenaString & s)
+      {
+        return bytes(s.data(), s.size());
+      }
+
+      Encoder & operator&(const std::vector<uchar> & v)
+      {
+        return bytes((const char *)v.data(), v.size());
+      }
+
+      template<typename T> Encoder & operator&(const std::vector<T> & v)
+      {
+        *this & (uint32)v.size();
+        typename std::vector<T>::const_iterator it, end = v.end();
+        for(it = v.begin(); it != end; ++it)
+          *this & *it;
+        return *this;
+      }
+
+      Encoder & operator&(const Files & f)
+      {
+        const FileList & list = f.list;
+        *this & (uint32)list.filesCount();
+        std::vector<FileList::DirEntry>::const_iterator dit, dend = list.dirs().end();
+        for(dit = list.dirs().begin(); dit != dend; ++dit)
+        {
+          const FileList::FileEntry * it, * end = list.end(*dit);
+          for(it = list.begin(*dit); it != end; ++it)
+          {
+            *this & (uchar)1;
+            const char * name = list.str(it->name);
+            uchar * start = m_Pos + 4;
+            bytes(name, strlen(name));
+            if(f.slashes)
+              for(uchar * p = start; p != m_Pos; ++p)
+                if(*p == '/')
+                  *p = '\\';
+            if(f.shortSizes)
+              *this & (uint32)it->size;
+            else
+              *this & (uint64)it->size;
+            const char * ext = list.str(it->ext);
+            bytes(ext, strlen(ext));
+            *this & (uint32)it->attrsCount;
+            for(uint32 j = 0; j < it->attrsCount; ++j)
+              *this & j & (uint32)it->attrs[j];
+          }
+        }
+        return *this;
+      }
+
+    private:
+      Encoder & bytes(const char * data, size_t n)
+      {
+        *this & (uint32)n;
+        memcpy(m_Pos, data, n);
+        m_Pos += n;
+        return *this;
+      }
+
+      uchar * m_Pos;
+    };
+
+    /* Reads fields from contiguous memory. A read past the end fails the
+       decoder, leaves the field zeroed or empty and makes every following
+       read fail as well. */
+    class Decoder
+    {
+    public:
+      Decoder(const uchar * data, size_t n) : m_Start(data), m_Pos(data), m_End(data + n), m_Ok(true)
+      {
+      }
+
+      /* False if a read went past the end of the data. */
+      bool ok() const
+      {
+        return m_Ok;
+      }
+
+      /* Number of bytes read so far. */
+      size_t consumed() const
+      {
+        return m_Pos - m_Start;
+      }
+
+      /* Number of bytes left to read. */
+      size_t remaining() const
+      {
+        return m_End - m_Pos;
+      }
+
+      Decoder & operator&(uchar & c)
+      {
+        c = need(1) ? *m_Pos++ : 0;
+        return *this;
+      }
+
+      Decoder & operator&(bool & b)
+      {
+        b = need(1) ? (*m_Pos++ != 0) : false;
+        return *this;
+      }
+
+      Decoder & operator&(uint32 & i)
+      {
+        i = 0;
+        if(need(4))
+        {
+          i = m_Pos[0] | (m_Pos[1] << 8) | (m_Pos[2] << 16) | ((uint32)m_Pos[3] << 24);
+          m_Pos += 4;
+        }
+        return *this;
+      }
+
+      Decoder & operator&(int32 & i)
+      {
+        uint32 u;
+        *this & u;
+        i = (int32)u;
+        return *this;
+      }
+
+      Decoder & operator&(uint64 & i)
+      {
+        uint32 low, high;
+        *this & low & high;
+        i = ((uint64)high << 32) | low;
+        return *this;
+      }
+
+      Decoder & operator&(Compat64 c)
+      {
+        if(remaining() >= 8)
+          return *this & c.value;
+        uint32 i;
+        *this & i;
+        c.value = i;
+        return *this;
+      }
+
+      Decoder & operator&(std::string & s)
+      {
+        uint32 n;
+        *this & n;
+        if(need(n))
+        {
+          s.assign((const char *)m_Pos, n);
+          m_Pos += n;
+        }
+        else
+          s.clear();
+        return *this;
+      }
+
+      Decoder & operator&(ArenaString & s)
+      {
+        uint32 n;
+        *this & n;
+        s.clear();
+        if(need(n))
+        {
+          memcpy(s.resize(n), m_Pos, n);
+          m_Pos += n;
+        }
+        return *this;
+      }
+
+      Decoder & operator&(std::vector<uchar> & v)
+      {
+        uint32 n;
+        *this & n;
+        v.clear();
+        if(need(n))
+        {
+          v.assign(m_Pos, m_Pos + n);
+          m_Pos += n;
+        }
+        return *this;
+      }
+
+      template<typename T> Decoder & operator&(std::vector<T> & v)
+      {
+        uint32 n;
+        *this & n;
+        v.clear();
+        // Every element takes at least a byte, don't trust bigger counts.
+        if(! need(n))
+          return *this;
+        v.resize(n);
+        typename std::vector<T>::iterator it, end = v.end();
+        for(it = v.begin(); it != end; ++it)
+        {
+          *this & *it;
+          if(! m_Ok)
+          {
+            // Keep the elements read in full.
+            v.erase(it, end);
+            break;
+          }
+        }
+        return *this;
+      }
+
+      Decoder & operator&(const Files & f)
+      {
+        FileList & list = f.list;
+        uint32 n;
+        *this & n;
+        for(; n && m_Ok; --n)
+        {
+          uchar code;
+          uint32 nameLength, extLength, attrs, attrCode, attr;
+          uint64 size = 0;
+          *this & code & nameLength;
+          if(! need(nameLength))
+            break;
+          const char * name = (const char *)m_Pos;
+          m_Pos += nameLength;
+          if(f.shortSizes)
+          {
+            uint32 shortSize;
+            *this & shortSize;
+            size = shortSize;
+          }
+          else
+            *this & size;
+          *this & extLength;
+          if(! need(extLength))
+            break;
+          list.addFile(name, nameLength, size, std::string((const char *)m_Pos, extLength));
+          m_Pos += extLength;
+          *this & attrs;
+          for(; attrs && m_Ok; --attrs)
+          {
+            *this & attrCode & attr;
+            if(m_Ok)
+              list.addAttr(attr);
+          }
+        }
+        return *this;
+      }
+
+    private:
+      bool need(size_t n)
+      {
+        if(m_Ok && ((size_t)(m_End - m_Pos) >= n))
+          return true;
+        m_Ok = false;
+        m_Pos = m_End;
+        return false;
+      }
+
+      const uchar * m_Start;
+      const uchar * m_Pos;
+      const uchar * m_End;
+      bool m_Ok;
+    };
+
+    /* Append the fields of a schema to a buffer, with a single reservation. */
+    template<typename T> void encode(NewNet::Buffer & buffer, T & message)
+    {
+      Sizer sizer;
+      message.schema(sizer);
+      if(sizer.size() == 0)
+        return;
+      struct iovec iov;
+      buffer.reserve(sizer.size(), &iov, 1);
+      Encoder encoder((uchar *)iov.iov_base);
+      message.schema(encoder);
+      buffer.commit(sizer.size());
+    }
+
+    /* Read the fields of a schema from the start of a buffer, and seek past
+       them. Return false if the buffer was too short. */
+    template<typename T> bool decode(NewNet::Buffer & buffer, T & message)
+    {
+      size_t n = buffer.count();
+      Decoder decoder(n ? buffer.pullup(n) : 0, n);
+      message.schema(decoder);
+      buffer.seek(decoder.consumed());
+      return decoder.ok();
+    }
+  }
+}
+
+#endif // NEWSOUL_MESSAGECODEC_H
@@ -0,0 +1,132 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef NEWSOUL_MESSAGEDISPATCHER_H
+#define NEWSOUL_MESSAGEDISPATCHER_H
+
+#include <initializer_list>
+#include <string>
+#include <vector>
+#include "mutypes.h"
+#include "NewNet/nnbuffer.h"
+#include "NewNet/nnlog.h"
+
+namespace newsoul
+{
+  /* MessageDispatcher is the table of messages a kind of socket understands,
+     indexed by message type. There is one per socket class, built once from
+     its event table, e.g.:
+
+       #define MAP_MESSAGE(ID, TYPE, EVENT) \
+         { ID, #TYPE, [](PeerSocket * socket, const NewNet::Buffer & data) -> bool { \
+           if(socket->EVENT.empty()) return false; \
+           TYPE msg; msg.parse_network_packet(data); socket->EVENT(&msg); \
+           return true; }, 0, 0 },
+
+     Handlers return false when nobody listens to their event, so messages
+     of that type are not even parsed. Entries also count how many messages
+     of their type were received and how many of those were skipped, the
+     whole table is logged to domain + ".debug" every REPORT_INTERVAL
+     messages. */
+  template<typename Owner> class MessageDispatcher
+  {
+  public:
+    /* Parse a message and emit it through the owner's event. Return false,
+       without parsing anything, if the event has no callbacks. */
+    typedef bool (*Handler)(Owner * owner, const NewNet::Buffer & data);
+
+    struct Entry
+    {
+      uint32 type;
+      const char * name;
+      Handler handler;
+      /* Number of messages of this type received so far. */
+      unsigned long received;
+      /* Number of those that were skipped, as nobody listened. */
+      unsigned long skipped;
+    };
+
+    /* Constructor. Messages are logged to domain as "Received <kind>
+       message <name>.". */
+    /* Number of dispatched messages between two reports. */
+    static const unsigned long REPORT_INTERVAL = 10000;
+
+    MessageDispatcher(const std::string & domain, const char * kind, std::initializer_list<Entry> entries)
+                     : m_Domain(domain), m_DebugDomain(domain + ".debug"), m_Kind(kind),
+                       m_Entries(entries), m_Dispatched(0)
+    {
+      for(size_t i = 0; i < m_Entries.size(); ++i)
+      {
+        uint32 type = m_Entries[i].type;
+        if(type >= m_Index.size())
+          m_Index.resize(type + 1, 0);
+        m_Index[type] = i + 1;
+      }
+    }
+
+    /* Parse and emit a message. Return false if its type is unknown. */
+    bool dispatch(Owner * owner, uint32 type, const NewNet::Buffer & data)
+    {
+      if(type >= m_Index.size() || ! m_Index[type])
+        return false;
+
+      Entry & entry = m_Entries[m_Index[type] - 1];
+      ++entry.received;
+      NNLOG(m_Domain, "Received %s message %s.", m_Kind, entry.name);
+      if(! entry.handler(owner, data))
+        ++entry.skipped;
+      if(++m_Dispatched % REPORT_INTERVAL == 0)
+        report();
+      return true;
+    }
+
+    /* Log how many messages of each type were received and skipped. */
+    void report() const
+    {
+      NNLOG(m_DebugDomain, "%lu %s messages dispatched:", m_Dispatched, m_Kind);
+      typename std::vector<Entry>::const_iterator it, end = m_Entries.end();
+      for(it = m_Entries.begin(); it != end; ++it)
+        if(it->received)
+          NNLOG(m_DebugDomain, "  %s: %lu received, %lu skipped", it->name, it->received, it->skipped);
+    }
+
+    /* Return the entry of a message type, or null if it is unknown. */
+    const Entry * entry(uint32 type) const
+    {
+      if(type >= m_Index.size() || ! m_Index[type])
+        return 0;
+      return &m_Entries[m_Index[type] - 1];
+    }
+
+    /* All entries, in event table order. */
+    const std::vector<Entry> & entries() const
+    {
+      return m_Entries;
+    }
+
+  private:
+    std::string m_Domain;                 // Log domain, built only once
+    std::string m_DebugDomain;            // Log domain of reports
+    const char * m_Kind;                  // Kind of messages, for logging
+    std::vector<Entry> m_Entries;         // Entries, in event table order
+    std::vector<unsigned short> m_Index;  // Type to entry position + 1, 0 if unknown
+    unsigned long m_Dispatched;           // Messages of known types so far
+  };
+}
+
+#endif // NEWSOUL_MESSAGEDISPATCHER_H
@@ -25,8 +25,6 @@ newsoul::MessageProcessor::parseMessage(NewNet::ClientSocket * socket)
 {
   /* How many bytes do we have in store? */
   size_t count = socket->receiveBuffer().count();
-  /* Set up an easy-access pointer to the buffer. */
-  uchar * inbuf = socket->receiveBuffer().data();
 
   /* If we have less than 4 + m_CodeSize bytes, bail out:
      4 bytes for the message length
@@ -34,6 +32,9 @@ newsoul::MessageProcessor::parseMessage(NewNet::ClientSocket * socket)
   if(count < (4 + m_CodeSize))
     return false;
 
+  /* Set up an easy-access pointer to the message header. */
+  const uchar * inbuf = socket->receiveBuffer().pullup(4 + m_CodeSize);
+
   /* Unpack the message length. 32bit little endian, that's the slsk way. */
   uint32 len = inbuf[0] + (inbuf[1] << 8) + (inbuf[2] << 16) + (inbuf[3] << 24);
 
@@ -47,14 +48,29 @@ newsoul::MessageProcessor::parseMessage(NewNet::ClientSocket * socket)
   if(count < (len + 4))
     return false;
 
+  /* Message too short to even hold its type, skip it. */
+  if(len < m_CodeSize)
+  {
+    socket->receiveBuffer().seek(len + 4);
+    return ! socket->receiveBuffer().empty();
+  }
+
   /* A complete message is here. Set up the message data structure and emit
      messageReceivedEvent. */
   struct MessageData messageData;
   messageData.socket = socket;
   messageData.type = mtype;
   messageData.length = len - m_CodeSize;
-  messageData.data = inbuf + 4 + m_CodeSize;
-  messageReceivedEvent(&messageData);
+  NewNet::Buffer body(socket->receiveBuffer(), 4 + m_CodeSize, len - m_CodeSize);
+  messageData.data.take(body);
+  {
+    /* Messages are parsed and handled right away, so the string fields
+       they're parsed into can go to an arena that's dropped once the
+       handlers return. One arena does for all sockets of this thread. */
+    static thread_local MessageArena arena;
+    MessageArena::Scope scope(arena);
+    messageReceivedEvent(&messageData);
+  }
 
   /* This happens if the socket descriptor is transferred to another socket
      instance. Bail out and terminate all processing, somebody else owns
@@ -21,6 +21,7 @@
 #ifndef NEWSOUL_MESSAGEPROCESSOR_H
 #define NEWSOUL_MESSAGEPROCESSOR_H
 
+#include "messagearena.h"
 #include "mutypes.h"
 #include "NewNet/nnclientsocket.h"
 
@@ -47,8 +48,9 @@ namespace newsoul
       uint32 type;
       /* Length of the data body. */
       uint32 length;
-      /* Pointer to the data that's part of the message. */
-      const unsigned char * data;
+      /* The data that's part of the message. It shares the memory of the
+         socket's receive buffer, so it can be kept without copying. */
+      NewNet::Buffer data;
     };
 
     /* Emitted when a complete message has been received and parsed. */
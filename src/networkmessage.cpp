@@ -38,6 +38,13 @@ void NetworkMessage::pack(const std::string& str, bool trslash)
         pack((uchar)str[i]);
 }
 
+/* Pack a string field. */
+void NetworkMessage::pack(const newsoul::ArenaString& str)
+{
+  pack((uint32)str.size());
+  buffer.append((const unsigned char *)str.data(), str.size());
+}
+
 /* Pack an IPv4 IP address. */
 void NetworkMessage::pack_ip(const std::string& str)
 {
@@ -67,10 +74,8 @@ void NetworkMessage::pack(const std::vector<uchar>& d)
 {
   // Pack the array size.
   pack((uint32)d.size());
-  // Pack the array data.
-  std::vector<uchar>::const_iterator it, end = d.end();
-  for(it = d.begin(); it != end; ++it)
-    pack(*it);
+  // Append the array data to the buffer directly.
+  buffer.append(d.data(), d.size());
 }
 
 /* Pack a 32bit unsigned integer (little-endian) */
@@ -114,9 +119,10 @@ void NetworkMessage::pack(uint64 i)
 uint32 NetworkMessage::unpack_int()
 {
   // If we have less than 4 bytes, that's bad.
-  if(buffer.count() < 4)
+  if(! available(4))
     return 0;
-  unsigned char * buf = buffer.data();
+  unsigned char buf[4];
+  buffer.copy(buf, 4);
   uint32 l = buf[0] + (buf[1] << 8) + (buf[2] << 16) + (buf[3] << 24);
   buffer.seek(4);
   return l;
@@ -126,9 +132,10 @@ uint32 NetworkMessage::unpack_int()
 int32 NetworkMessage::unpack_signed_int()
 {
   // If we have less than 4 bytes, that's bad.
-  if(buffer.count() < 4)
+  if(! available(4))
     return 0;
-  unsigned char * buf = buffer.data();
+  unsigned char buf[4];
+  buffer.copy(buf, 4);
   int32 l;
   if ((buf[3] & 0xf0) == 0xf0) // This is a negative int
     l = -1 - ((buf[0] ^ 0xff) + ((buf[1] ^ 0xff) << 8) + ((buf[2] ^ 0xff) << 16) + ((buf[3] ^ 0xff) << 24));
@@ -142,9 +149,10 @@ int32 NetworkMessage::unpack_signed_int()
 uint64 NetworkMessage::unpack_off()
 {
   // If we have less than 8 bytes, that's bad.
-  if(buffer.count() < 8)
+  if(! available(8))
     return 0;
-  unsigned char * buf = buffer.data();
+  unsigned char buf[8];
+  buffer.copy(buf, 8);
   uint64 l = ((uint64)buf[0] << 0)  + ((uint64)buf[1] << 8)  +
             ((uint64)buf[2] << 16) + ((uint64)buf[3] << 24) +
             ((uint64)buf[4] << 32) + ((uint64)buf[5] << 40) +
@@ -159,30 +167,53 @@ std::string NetworkMessage::unpack_string()
   std::string x;
 
   // We need at least 4 bytes for the length.
-  if(buffer.count() < 4)
+  if(! available(4))
     return x;
 
   // Unpack the string length.
   uint32 len = unpack_int();
   // Do we have enough bytes?
-  if (buffer.count() < len)
+  if (! available(len))
     return x;
 
   // Copy the string data.
-  x.assign((const char *)buffer.data(), len);
+  x.resize(len);
+  if(len > 0)
+    buffer.copy((unsigned char *)&x[0], len);
   buffer.seek(len);
 
   return x;
 }
 
+/* Unpack a string into a field. Copies the characters straight from the
+   buffer, to the arena if the message is being dispatched. */
+void NetworkMessage::unpack_string(newsoul::ArenaString& x)
+{
+  x.clear();
+  // We need at least 4 bytes for the length.
+  if(! available(4))
+    return;
+  // Unpack the string length.
+  uint32 len = unpack_int();
+  // Do we have enough bytes?
+  if (! available(len))
+    return;
+  // Copy the string data.
+  char * to = x.resize(len);
+  if(len > 0)
+    buffer.copy((unsigned char *)to, len);
+  buffer.seek(len);
+}
+
 /* Unpack an IPv4 IP address. */
 std::string NetworkMessage::unpack_ip()
 {
   // We need at least 4 bytes of data.
-  if(buffer.count() < 4)
+  if(! available(4))
     return "0.0.0.0";
 
-  unsigned char * buf = buffer.data();
+  unsigned char buf[4];
+  buffer.copy(buf, 4);
   char _ip[16];
   // Funky formatting.
   snprintf(_ip, 16, "%u.%u.%u.%u", buf[3], buf[2], buf[1], buf[0]);
@@ -196,18 +227,22 @@ std::vector<uchar> NetworkMessage::unpack_vector()
   std::vector<uchar> vec;
 
   // We need at least 4 bytes of data for the length.
-  if(buffer.count() < 4)
+  if(! available(4))
     return vec;
 
   // Unpack the array length.
   uint32 len = unpack_int();
   // Bail out if we don't have enough data.
-  if(buffer.count() < len)
+  if(! available(len))
     return vec;
 
-  // Copy the array data.
-  for(uint32 i = 0; i < len; i++)
-    vec.push_back(unpack_char());
+  // Copy the array data at once.
+  if(len)
+  {
+    const uchar * data = buffer.pullup(len);
+    vec.assign(data, data + len);
+    buffer.seek(len);
+  }
 
   return vec;
 }
@@ -217,8 +252,8 @@ std::vector<uchar> NetworkMessage::unpack_raw_message()
 {
   std::vector<uchar> vec;
 
-  // We need at least 4 bytes of data for the length.
-  if(buffer.count() == 0)
+  // Inflate whatever is left, if the message is being decompressed.
+  if(! available((size_t)-1) && buffer.count() == 0)
     return vec;
 
   // Unpack the array length.
@@ -262,88 +297,102 @@ void NetworkMessage::compress()
   delete [] outbuf;
 }
 
-// Allocate 1MByte as a default result buffer.
-#define DEFAULTALLOC 1000000
+// Inflate at most 64KBytes at a time.
+#define INFLATEWINDOW 65536
 // Decompress the network message data.
 void NetworkMessage::decompress()
 {
-  // Intialize the zlib stream.
-  z_stream zst;
-  zst.zalloc = (alloc_func)NULL;
-  zst.zfree = (free_func)NULL;
+  stream_decompress();
+  // Inflate everything right away.
+  available((size_t)-1);
+}
 
-  // Set input buffer.
-  zst.avail_in = buffer.count();
-  zst.next_in = (Bytef*)buffer.data();
+// Start decompressing the network message data. The buffer is refilled
+// from the compressed data by available(), as the message is unpacked.
+void NetworkMessage::stream_decompress()
+{
+  end_inflate();
 
-  // Allocate and set output buffer.
-  NewNet::Buffer output_buffer;
-  zst.avail_out = DEFAULTALLOC;
-  uchar * outbuf = new uchar[DEFAULTALLOC];
-  assert(outbuf != 0);
-  zst.next_out = (Bytef*)outbuf;
+  // Intialize the zlib stream.
+  inflater = new z_stream;
+  inflater->zalloc = (alloc_func)NULL;
+  inflater->zfree = (free_func)NULL;
+  inflater->opaque = (voidpf)NULL;
+  inflater->avail_in = 0;
+  inflater->next_in = (Bytef*)NULL;
 
   // Initialize zlib's decompression routines.
-  int err = inflateInit(&zst);
+  int err = inflateInit(inflater);
   if (err != Z_OK)
   {
     // Something went horrible wrong.
     buffer.seek(buffer.count());
-    delete [] outbuf;
     if (err != Z_MEM_ERROR)
-      inflateEnd(&zst);
+      inflateEnd(inflater);
+    delete inflater;
+    inflater = 0;
     NNLOG("newsoul.warn", "Corrupted packet encountered (decompression error).");
     return;
   }
 
-  do {
-    // Try to decompress the buffer.
-    err = inflate(&zst, Z_FINISH);
+  // Set the compressed data aside, the buffer will hold the inflated data.
+  deflated.take(buffer);
+}
+
+bool NetworkMessage::inflate_more(size_t n)
+{
+  while(inflater && (buffer.count() < n))
+  {
+    // Feed zlib one compressed segment at a time.
+    struct iovec in, out;
+    if(deflated.segments(&in, 1, deflated.count()) == 0)
+    {
+      in.iov_base = 0;
+      in.iov_len = 0;
+    }
+    buffer.reserve(INFLATEWINDOW, &out, 1);
+    inflater->next_in = (Bytef*)in.iov_base;
+    inflater->avail_in = in.iov_len;
+    inflater->next_out = (Bytef*)out.iov_base;
+    inflater->avail_out = out.iov_len;
+
+    // Try to decompress the next bit.
+    int err = ::inflate(inflater, Z_NO_FLUSH);
+    buffer.commit(out.iov_len - inflater->avail_out);
+    deflated.seek(in.iov_len - inflater->avail_in);
     switch(err)
     {
       // Cool, we're finished.
       case Z_STREAM_END:
+        end_inflate();
         break;
-      // Problem with the buffer
-      case Z_BUF_ERROR:
-        if (zst.avail_out > 0)
-        {
-          // Bad stuff...
-          inflateEnd(&zst);
-          buffer.seek(buffer.count());
-          delete [] outbuf;
-          NNLOG("newsoul.warn", "Corrupted packet encountered (decompression error).");
-          return;
-        }
       case Z_OK:
-        // We're out of memory. Push the data to the buffer and continue.
-        output_buffer.append(outbuf, DEFAULTALLOC - zst.avail_out);
-        zst.avail_out = DEFAULTALLOC;
-        zst.next_out = (Bytef*)outbuf;
         break;
+      // Truncated or otherwise bad data. Keep what we got so far.
       default:
-        // Bad stuff...
         NNLOG("newsoul.warn", "Corrupted packet encountered (decompression error).");
-        inflateEnd(&zst);
-        buffer.seek(buffer.count());
-        delete [] outbuf;
-        return;
+        end_inflate();
+        break;
     }
-  } while (err != Z_STREAM_END);
-
-  // Append the rest of the decompressed data to the buffer.
-  output_buffer.append(outbuf, DEFAULTALLOC - zst.avail_out);
-  delete [] outbuf;
+  }
+  return buffer.count() >= n;
+}
+#undef INFLATEWINDOW
 
-  // We're finished, clean up.
-  inflateEnd(&zst);
+void NetworkMessage::end_inflate()
+{
+  if(! inflater)
+    return;
+  inflateEnd(inflater);
+  delete inflater;
+  inflater = 0;
+  deflated.clear();
+}
 
-  // Seek past the compressed data.
-  buffer.seek(buffer.count());
-  // Append the output buffer to the message buffer.
-  buffer.append(output_buffer.data(), output_buffer.count());
+NetworkMessage::~NetworkMessage()
+{
+  end_inflate();
 }
-#undef DEFAULTALLOC
 
 void NetworkMessage::garbage_collector() {
     std::vector<uchar> raw = unpack_raw_message();
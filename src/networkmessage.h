@@ -24,6 +24,7 @@
 #include <iomanip>
 #include <sstream>
 #include <zlib.h>
+#include "messagearena.h"
 #include "mutypes.h"
 #include "NewNet/nnbuffer.h"
 #include "NewNet/nnlog.h"
@@ -55,6 +56,10 @@ class GenericMessage
 class NetworkMessage: public GenericMessage
 {
 public:
+  NetworkMessage() : inflater(0) {}
+
+  virtual ~NetworkMessage();
+
   /* This is where data gets stored when you call make_network_packet(). */
   NewNet::Buffer buffer;
 
@@ -69,9 +74,9 @@ public:
 
   /* Wrapper around unsafe_parse_network_packet: catch out of memory
      exceptions. */
-  virtual void parse_network_packet(const unsigned char * data, size_t count)
+  virtual void parse_network_packet(const NewNet::Buffer & data)
   {
-    buffer.append(data, count);
+    buffer.append(data);
     try
     {
       unsafe_parse_network_packet();
@@ -85,6 +90,8 @@ public:
 protected:
   /* Pack a string. */
   void pack(const std::string&, bool=false);
+  /* Pack a string field. */
+  void pack(const newsoul::ArenaString&);
   /* Pack an IP address. */
   void pack_ip(const std::string&);
   /* Pack a raw data array. */
@@ -103,6 +110,8 @@ protected:
 
   /* Unpack a string. */
   std::string unpack_string();
+  /* Unpack a string into a field, in the arena of the current dispatch. */
+  void unpack_string(newsoul::ArenaString&);
   /* Unpack raw data. */
   std::vector<uchar> unpack_vector();
   /* Unpack raw data of the rest of the message. */
@@ -119,9 +128,9 @@ protected:
   uchar unpack_char()
   {
     uchar c = 0; // Default value
-    if(! buffer.empty())
+    if(available(1))
     {
-      c = buffer.data()[0]; // Grab next byte in buffer
+      buffer.copy(&c, 1); // Grab next byte in buffer
       buffer.seek(1); // Seek forward one byte
     }
     else
@@ -133,10 +142,20 @@ protected:
     return c;
   }
 
+  /* Return true if there are at least n bytes left to unpack. When the
+     message is being decompressed bit by bit, inflate up to n bytes first. */
+  bool available(size_t n)
+  {
+    return (buffer.count() >= n) || inflate_more(n);
+  }
+
   /* Compress the message. */
   void compress();
   /* Decompress the message. */
   void decompress();
+  /* Decompress the message as it gets unpacked, so that only a small
+     window of the inflated data is held at a time. */
+  void stream_decompress();
 
   /* Handle unexpected data in messages */
   void garbage_collector();
@@ -151,6 +170,16 @@ protected:
   }
 
 private:
+  /* Inflate more data into the buffer until it holds n bytes or the
+     stream ends. Return true if it does hold n bytes. */
+  bool inflate_more(size_t n);
+  /* Stop decompressing, dropping the rest of the compressed data. */
+  void end_inflate();
+
+  /* Decompression state and the data still to inflate. */
+  z_stream * inflater;
+  NewNet::Buffer deflated;
+
   /* Return the message type identifier. Note that if you use the MAKE and
      END_MAKE macros in your own messages you can redefine get_type to be of
      a different type than unsigned char. */
@@ -19,19 +19,18 @@
 
  */
 
+#include <algorithm>
+#include <thread>
 #include "newsoul.h"
 #include "searchmanager.h"
 
-newsoul::Newsoul *newsoul::Newsoul::_instance = 0; // Yeah, right
-
 newsoul::Newsoul::Newsoul() {
     /* Seed the random generator and fabricate our starting token. */
     srand(time(NULL));
     m_Token = rand();
 
+    this->_globalShares = NULL;
     this->_buddyShares = NULL;
-
-    Newsoul::_instance = this;
 }
 
 newsoul::Newsoul::~Newsoul() {
@@ -327,6 +326,21 @@ int newsoul::Newsoul::run(int argc, char *argv[]) {
 
     m_Reactor = new NewNet::Reactor();
 
+    /* Uploads and downloads move to loops of their own once they start
+       transferring (see UserSocket::handOver()). That takes thread safe
+       reference counts, without them the pool is just the reactor. */
+#ifdef NN_PTR_ATOMIC
+    m_Transfers = new NewNet::ReactorPool(m_Reactor, std::max(std::thread::hardware_concurrency(), 2u));
+#else
+    m_Transfers = new NewNet::ReactorPool(m_Reactor, 1);
+#endif // NN_PTR_ATOMIC
+
+    /* Write config changes behind, so that bursts of them (wishlist
+       searches, interface edits) don't rewrite the file every time. */
+    this->_config->writeBehind([this] {
+        this->m_Reactor->addTimeout(2000, this, &Newsoul::onConfigSaveTimeout);
+    }, true);
+
     /* Instantiate the various components. Order can be important here. */
     m_Codeset = new CodesetManager(this);
     m_Server = new ServerManager(this);
@@ -337,27 +351,86 @@ int newsoul::Newsoul::run(int argc, char *argv[]) {
     m_Searches = new SearchManager(this);
 
     this->LoadDownloads();
+    this->WatchShares();
 
 #ifndef _WIN32
-    signal(SIGHUP, &handleSignals);
-    signal(SIGALRM, &handleSignals);
+    this->m_Reactor->addSignal(SIGHUP, this, &Newsoul::onSignal);
+    this->m_Reactor->addSignal(SIGALRM, this, &Newsoul::onSignal);
 #endif
-    signal(SIGINT, &handleSignals);
+    this->m_Reactor->addSignal(SIGINT, this, &Newsoul::onSignal);
 
     this->m_Server->connect();
+    this->m_Transfers->start();
     this->m_Reactor->run();
+    /* Transfers still running are dropped here, while the managers their
+       sockets report to are still there. */
+    this->m_Transfers->stop();
+    this->m_Transfers = 0;
     this->m_Downloads->saveDownloads();
+    this->_config->flush();
     return 0;
 }
 
+void newsoul::Newsoul::onConfigSaveTimeout(long) {
+    this->_config->flush(false);
+}
+
 void newsoul::Newsoul::LoadShares() {
+    const bool indexed = this->_config->getBool({"database", "index"});
     const std::string shares = this->_config->getStr({"database", "global", "dbpath"});
     if (!shares.empty()) {
-        this->_globalShares = new SharesDB(shares, [this]{this->sendSharedNumber();});
+        this->_globalShares = new SharesDB(shares, [this]{this->sendSharedNumber();}, indexed);
     }
     const std::string bshares = this->_config->getStr({"database", "buddy", "dbpath"});
     if (!bshares.empty() && haveBuddyShares()) {
-        this->_buddyShares = new SharesDB(bshares, [this]{this->sendSharedNumber();});
+        this->_buddyShares = new SharesDB(bshares, [this]{this->sendSharedNumber();}, indexed);
+    }
+}
+
+void newsoul::Newsoul::UnwatchShares() {
+    if(this->m_GlobalWatcher) {
+        this->m_GlobalWatcher->disconnect();
+        this->m_Reactor->remove(this->m_GlobalWatcher);
+        this->m_GlobalWatcher = NULL;
+    }
+    if(this->m_BuddyWatcher) {
+        this->m_BuddyWatcher->disconnect();
+        this->m_Reactor->remove(this->m_BuddyWatcher);
+        this->m_BuddyWatcher = NULL;
+    }
+}
+
+void newsoul::Newsoul::WatchShares() {
+    this->UnwatchShares();
+
+    if(this->_globalShares != NULL) {
+        this->m_GlobalWatcher = new SharesWatcher(this->_globalShares,
+            this->_config->getVec({"database", "global", "paths"}),
+            [this]{this->sendSharedNumber();});
+        this->m_Reactor->add(this->m_GlobalWatcher);
+    }
+    if(this->_buddyShares != NULL) {
+        this->m_BuddyWatcher = new SharesWatcher(this->_buddyShares,
+            this->_config->getVec({"database", "buddy", "paths"}),
+            [this]{this->sendSharedNumber();});
+        this->m_Reactor->add(this->m_BuddyWatcher);
+    }
+}
+
+void newsoul::Newsoul::ReloadShares() {
+    /* The watchers flush into the databases they were given, so they
+       have to go before those do. */
+    this->UnwatchShares();
+
+    delete this->_globalShares;
+    this->_globalShares = NULL;
+    delete this->_buddyShares;
+    this->_buddyShares = NULL;
+
+    this->LoadShares();
+    this->WatchShares();
+    if(this->_globalShares != NULL) {
+        this->sendSharedNumber();
     }
 }
 
@@ -365,60 +438,60 @@ void newsoul::Newsoul::LoadDownloads() {
     m_Downloads->loadDownloads();
 }
 
-bool newsoul::Newsoul::isBanned(const std::string u) {
-    return config()->contains({"users", "banned"}, u);
+bool newsoul::Newsoul::isBanned(const std::string &u) {
+    return config()->snapshot().banned.count(u) != 0;
 }
 
-bool newsoul::Newsoul::isIgnored(const std::string u) {
-    return config()->contains({"users", "ignored"}, u);
+bool newsoul::Newsoul::isIgnored(const std::string &u) {
+    return config()->snapshot().ignored.count(u) != 0;
 }
 
-bool newsoul::Newsoul::isTrusted(const std::string u) {
-    return config()->contains({"users", "trusted"}, u);
+bool newsoul::Newsoul::isTrusted(const std::string &u) {
+    return config()->snapshot().trusted.count(u) != 0;
 }
 
-bool newsoul::Newsoul::isBuddied(const std::string u) {
-    return config()->contains({"users", "buddies"}, u);
+bool newsoul::Newsoul::isBuddied(const std::string &u) {
+    return config()->snapshot().buddies.count(u) != 0;
 }
 
-bool newsoul::Newsoul::isPrivileged(const std::string u) {
+bool newsoul::Newsoul::isPrivileged(const std::string &u) {
     return std::find(mPrivilegedUsers.begin(), mPrivilegedUsers.end(), u) != mPrivilegedUsers.end();
 }
 
 bool newsoul::Newsoul::toBuddiesOnly() {
-    return config()->getBool({"uploads", "buddiesOnly"});
+    return config()->snapshot().buddiesOnly;
 }
 
 bool newsoul::Newsoul::haveBuddyShares() {
-    return config()->getBool({"database", "buddy", "enabled"});
+    return config()->snapshot().buddyShares;
 }
 
 bool newsoul::Newsoul::trustingUploads() {
-    return config()->getBool({"uploads", "allowTrusted"});
+    return config()->snapshot().allowTrusted;
 }
 
 bool newsoul::Newsoul::autoClearFinishedDownloads() {
-    return config()->getBool({"downloads", "autoclear"});
+    return config()->snapshot().autoclearDownloads;
 }
 
 bool newsoul::Newsoul::autoRetryDownloads() {
-    return config()->getBool({"downloads", "autoretry"});
+    return config()->snapshot().autoretryDownloads;
 }
 
 bool newsoul::Newsoul::autoClearFinishedUploads() {
-    return config()->getBool({"uploads", "autoclear"});
+    return config()->snapshot().autoclearUploads;
 }
 
 bool newsoul::Newsoul::privilegeBuddies() {
-    return config()->getBool({"uploads", "buddiesFirst"});
+    return config()->snapshot().buddiesFirst;
 }
 
 unsigned int newsoul::Newsoul::upSlots() {
-    return (unsigned int)config()->getInt({"uploads", "slots"});
+    return config()->snapshot().upSlots;
 }
 
 unsigned int newsoul::Newsoul::downSlots() {
-    return (unsigned int)config()->getInt({"downloads", "slots"});
+    return config()->snapshot().downSlots;
 }
 
 // Add this user to the list of privileged ones
@@ -449,28 +522,22 @@ void newsoul::Newsoul::sendSharedNumber() {
 }
 
 bool newsoul::Newsoul::isEnabledPrivRoom() {
-    return config()->getBool({"privateRooms", "enabled"});
+    return config()->snapshot().privateRooms;
 }
 
-void newsoul::Newsoul::handleSignals(int signal) {
+void newsoul::Newsoul::onSignal(int signal) {
     if(signal == SIGINT) {
         NNLOG("newsoul.debug", "Got %i, stopping the reactor.", signal);
-        _instance->m_Reactor->stop();
+        this->m_Reactor->stop();
 #ifndef _WIN32
     } else if(signal == SIGHUP) {
         NNLOG("newsoul.debug", "Got %i, reloading shares.", signal);
-        _instance->LoadShares();
+        this->ReloadShares();
     } else if(signal == SIGALRM) {
         NNLOG("newsoul.debug", "Got %i, reconnecting.", signal);
-        if(!_instance->m_Server->loggedIn()) {
-            _instance->m_Server->connect();
+        if(!this->m_Server->loggedIn()) {
+            this->m_Server->connect();
         }
 #endif
     }
-
-#ifndef _WIN32
-    ::signal(SIGHUP, &handleSignals);
-    ::signal(SIGALRM, &handleSignals);
-#endif
-    ::signal(SIGINT, &handleSignals);
 }
@@ -26,8 +26,10 @@
 #include <string>
 #include "config.h"
 #include "sharesdb.h"
+#include "shareswatcher.h"
 #include "servermessages.h"
 #include "NewNet/nnreactor.h"
+#include "NewNet/nnreactorpool.h"
 #include "NewNet/nnrefptr.h"
 
 namespace newsoul
@@ -46,6 +48,7 @@ namespace newsoul
 
         /* Our strong references to the various components. */
         NewNet::RefPtr<NewNet::Reactor> m_Reactor;
+        NewNet::RefPtr<NewNet::ReactorPool> m_Transfers;
         NewNet::RefPtr<CodesetManager> m_Codeset;
         NewNet::RefPtr<ServerManager> m_Server;
         NewNet::RefPtr<PeerManager> m_Peers;
@@ -55,12 +58,31 @@ namespace newsoul
         Config *_config;
         SharesDB *_globalShares;
         SharesDB *_buddyShares;
+        NewNet::RefPtr<SharesWatcher> m_GlobalWatcher;
+        NewNet::RefPtr<SharesWatcher> m_BuddyWatcher;
         NewNet::RefPtr<SearchManager> m_Searches;
         int m_Token;
         std::vector<std::string> mPrivilegedUsers;
 
-        static Newsoul *_instance;
-        static void handleSignals(int signal);
+        /*!
+         * Handles signals, called from the reactor's main loop.
+         * \param signal Number of the signal caught.
+         */
+        void onSignal(int signal);
+        /*!
+         * Stops watching the shared directories, applying the changes
+         * still waiting.
+         */
+        void UnwatchShares();
+        /*!
+         * Reopens the shares databases and watches them again.
+         */
+        void ReloadShares();
+
+        /*!
+         * Writes config changes gathered since it was scheduled.
+         */
+        void onConfigSaveTimeout(long);
 
         /*!
          * Parses a single piece of CLI interface chain.
@@ -144,6 +166,12 @@ namespace newsoul
             return m_Reactor;
         }
 
+        /* Return the pool of loops that bulk transfers run on, the reactor
+           being its main loop. */
+        NewNet::ReactorPool *transfers() const {
+            return m_Transfers;
+        }
+
         /* Return a pointer to the config manager. */
         Config *config() const {
             return this->_config;
@@ -194,13 +222,15 @@ namespace newsoul
         }
 
         void LoadShares();
+        /* (Re)start watching the shared directories for changes. */
+        void WatchShares();
         void LoadDownloads();
 
-        bool isBanned(const std::string u);
-        bool isIgnored(const std::string u);
-        bool isTrusted(const std::string u);
-        bool isBuddied(const std::string u);
-        bool isPrivileged(const std::string u);
+        bool isBanned(const std::string &u);
+        bool isIgnored(const std::string &u);
+        bool isTrusted(const std::string &u);
+        bool isBuddied(const std::string &u);
+        bool isPrivileged(const std::string &u);
         bool toBuddiesOnly();
         bool haveBuddyShares();
         bool trustingUploads();
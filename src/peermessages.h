@@ -22,6 +22,8 @@
 #define NEWSOUL_PEERMESSAGES_H
 
 #include "servermessages.h"
+#include "filelist.h"
+#include "messagecodec.h"
 #include "sharesdb.h"
 
 namespace newsoul
@@ -57,62 +59,45 @@ PEERMESSAGE(PSharesRequest, 4)
 END
 
 PEERMESSAGE(PSharesReply, 5)
-	PSharesReply() { data = NULL; };
-	PSharesReply(const std::vector<uchar>& _data) {
-		data_len = _data.size();
-		std::vector<uchar>::const_iterator it = _data.begin();
-		int i = 0;
-		data = new uchar[data_len];
-		for(; it != _data.end(); ++it)
-			data[i++] = *it;
-	};
-
-	~PSharesReply() {
-		if(data)
-			delete [] data;
-	};
+	PSharesReply() {};
+	/* The already compressed shares are not copied, the packet shares their blocks. */
+	PSharesReply(const NewNet::Buffer& _data) : data(_data) {};
 
 	MAKE
-		for(uint i = 0; i < data_len; i++)
-			pack(data[i]);
+		buffer.append(data);
 	END_MAKE
 
 	PARSE
-		decompress();
+		stream_decompress();
 		uint n = unpack_int();
 		while(n) {
-            if (buffer.count() < 4)
+            if (! available(4))
                 break; // If this happens, message is malformed. No need to continue (prevent huge loops)
-			std::string dirname = unpack_string();
+			shares.addDir(unpack_string());
 			uint f = unpack_int();
-            newsoul::Dir files;
 			while(f) {
-			    if (buffer.empty())
+			    if (! available(1))
                     break; // If this happens, message is malformed. No need to continue (prevent huge loops)
 				unpack_char();
 				std::string filename = unpack_string();
-                newsoul::File fe;
-				fe.size = unpack_off();
-				fe.ext = unpack_string();
+				uint64 size = unpack_off();
+				shares.addFile(filename, size, unpack_string());
 				uint attrs = unpack_int();
 				while(attrs) {
-                    if (buffer.count() < 4)
+                    if (! available(4))
                         break; // If this happens, message is malformed. No need to continue (prevent huge loops)
 					unpack_int();
-					fe.attrs.push_back(unpack_int());
+					shares.addAttr(unpack_int());
 					attrs--;
 				}
-				files[filename] = fe;
 				f--;
 			}
-			shares[dirname] = files;
 			n--;
 		}
 	END_PARSE
 
-	uchar *data;
-	uint data_len;
-    newsoul::Dirs shares;
+	NewNet::Buffer data;
+    newsoul::FileList shares;
 END
 
 PEERMESSAGE(PSearchRequest, 8)
@@ -126,123 +111,67 @@ PEERMESSAGE(PSearchRequest, 8)
 
 	PARSE
 		ticket = unpack_int();
-		query = unpack_string();
+		unpack_string(query);
 	END_PARSE
 
-	std::string query;
+	newsoul::ArenaString query;
 	uint ticket;
 END
 
 PEERMESSAGE(PSearchReply, 9)
-	PSearchReply() {};
-	PSearchReply(uint _t, const std::string& _u, const newsoul::Dir& _r, uint _spe, uint64 _que, bool _fre)
-                    : user(_u), results(_r), ticket(_t), avgspeed(_spe), queuelen(_que), slotfree(_fre) {}
+	PSearchReply() : shortSizes(false) {};
+	PSearchReply(uint _t, const std::string& _u, const newsoul::FileList& _r, uint _spe, uint64 _que, bool _fre)
+                    : user(_u), results(_r), ticket(_t), avgspeed(_spe), queuelen(_que), slotfree(_fre), shortSizes(false) {}
 
 	MAKE
-		pack(user);
-		pack(ticket);
-		pack((uint32)results.size());
-        newsoul::Dir::iterator it = results.begin();
-		for(; it != results.end(); ++it) {
-			pack((uchar)1);
-			pack((*it).first, true);
-			pack((*it).second.size);
-			pack((*it).second.ext);
-			pack((uint32)(*it).second.attrs.size());
-			std::vector<uint>::iterator ait = (*it).second.attrs.begin();
-			for(uint j = 0; ait != (*it).second.attrs.end(); ++ait) {
-				pack(j++);
-				pack(*ait);
-			}
-		}
-		pack((uchar)slotfree);
-		pack(avgspeed);
-		pack(queuelen);
-
+		newsoul::codec::encode(buffer, *this);
 		compress();
 	END_MAKE
 
 	PARSE
 		decompress();
 
-		user = unpack_string();
-		ticket = unpack_int();
-		uint n = unpack_int();
-		NewNet::Buffer backupBuffer;
-		backupBuffer.append(buffer.data(), buffer.count()); // Save buffer in case the message is malformed (see below)
-		uint backupN = n;
-		bool malformedMsg = false;
-
-		while(n) {
-            if (buffer.empty()) {
-                // Message claimed n files, but we exhausted buffer. It means message is malformed.
-			    // This happens with an unknown exotic client which codes file size using uint32 instead of uint64
-			    // The way to solve this is to reparse the message using uint32 (see below)
-                malformedMsg = true;
-                buffer.clear();
-                break;
-            }
-			unpack_char();
-			std::string fn = unpack_string();
-            newsoul::File fe;
-            fe.size = unpack_off(); // Sometimes an uint with an exotic client
-			fe.ext = unpack_string();
-			int attrs = unpack_int();
-            while(attrs) {
-                if (buffer.count() < 4)
-                    break; // If this happens, message is malformed. No need to continue (prevent huge loops)
-                unpack_int();
-                fe.attrs.push_back(unpack_int());
-                attrs--;
-            }
-			results[fn] = fe;
-			n--;
+		size_t n = buffer.count();
+		const uchar * data = n ? buffer.pullup(n) : 0;
+		newsoul::codec::Decoder decoder(data, n);
+		head(decoder, results, false);
+		if(! decoder.ok()) {
+			// Message claimed more files than it holds. This happens with an unknown
+			// exotic client which codes file size using uint32 instead of uint64,
+			// so try again that way, keeping what we got if that fails too.
+			newsoul::FileList shortResults;
+			newsoul::codec::Decoder retry(data, n);
+			head(retry, shortResults, true);
+			if(retry.ok()) {
+				std::swap(results, shortResults);
+				shortSizes = true;
+				decoder = retry;
+			}
 		}
-		slotfree = (unpack_char() != 0);
-		avgspeed = unpack_int();
-		if (buffer.count() >= 8)
-            queuelen = unpack_off();
-        else
-            queuelen = static_cast<uint64>(unpack_int()); // Some clients use uint32 instead of uint64
-
-        // If there was a problem try reparsing using uint32 for size
-        if (malformedMsg) {
-            buffer = backupBuffer;
-            n = backupN;
-            results.clear();
-            while(n) {
-			    if (buffer.empty())
-                    break; // If this happens, message is malformed. No need to continue (prevent huge loops)
-                unpack_char();
-                std::string fn = unpack_string();
-                newsoul::File fe;
-                fe.size = static_cast<uint64>(unpack_int()); // Sometimes an uint with an exotic client
-                fe.ext = unpack_string();
-                int attrs = unpack_int();
-                while(attrs) {
-                    if (buffer.count() < 4)
-                        break; // If this happens, message is malformed. No need to continue (prevent huge loops)
-                    unpack_int();
-                    fe.attrs.push_back(unpack_int());
-                    attrs--;
-                }
-                results[fn] = fe;
-                n--;
-            }
-            slotfree = (unpack_char() != 0);
-            avgspeed = unpack_int();
-            if (buffer.count() >= 8)
-                queuelen = unpack_off();
-            else
-                queuelen = static_cast<uint64>(unpack_int()); // Some clients use uint32 instead of uint64
-        }
+		// A short tail just leaves these zeroed.
+		tail(decoder);
+		buffer.seek(decoder.consumed());
 	END_PARSE
 
+	template<typename Codec> void schema(Codec & c) {
+		head(c, results, shortSizes);
+		tail(c);
+	}
+
+	template<typename Codec> void head(Codec & c, newsoul::FileList & files, bool shortFileSizes) {
+		c & user & ticket & newsoul::codec::files(files, true, shortFileSizes);
+	}
+
+	template<typename Codec> void tail(Codec & c) {
+		c & slotfree & avgspeed & newsoul::codec::compat64(queuelen); // Some clients use uint32 for queuelen
+	}
+
 	std::string user;
-    newsoul::Dir results;
+    newsoul::FileList results;
 	uint ticket, avgspeed;
 	uint64 queuelen;
 	bool slotfree;
+	bool shortSizes; // File sizes are sent as uint32
 END
 
 PEERMESSAGE(PInfoRequest, 15)
@@ -313,30 +242,35 @@ END
 
 PEERMESSAGE(PFolderContentsReply, 37)
 	PFolderContentsReply() {};
-	PFolderContentsReply(const newsoul::Shares _f)
+	PFolderContentsReply(const newsoul::FileList& _f)
                            : folders(_f) {};
 
 	MAKE
-		pack((uint32)folders.size());
-        newsoul::Shares::iterator fit = folders.begin();
-		for(; fit != folders.end(); ++fit) {
-			pack((*fit).first);
-			pack((uint32)(*fit).second.size());
-            newsoul::Dirs::iterator dit = (*fit).second.begin();
-			for(; dit != (*fit).second.end(); ++dit) {
-				pack((*dit).first, true);
-				pack((uint32)(*dit).second.size());
-                newsoul::Dir::iterator it = (*dit).second.begin();
-				for(; it != (*dit).second.end(); ++it) {
+		// Directories of a folder follow each other, count the folders first.
+		std::vector<newsoul::FileList::DirEntry>::const_iterator dit, last;
+		std::vector<newsoul::FileList::DirEntry>::const_iterator begin = folders.dirs().begin(), end = folders.dirs().end();
+		uint32 n = 0;
+		for(dit = begin; dit != end; ++dit)
+			if(dit == begin || dit->folder != (dit - 1)->folder)
+				n++;
+		pack(n);
+		for(dit = begin; dit != end;) {
+			pack(std::string(folders.str(dit->folder)));
+			for(last = dit; last != end && last->folder == dit->folder; ++last);
+			pack((uint32)(last - dit));
+			for(; dit != last; ++dit) {
+				pack(std::string(folders.str(dit->path)), true);
+				pack((uint32)dit->count);
+				const newsoul::FileList::FileEntry * it = folders.begin(*dit);
+				for(; it != folders.end(*dit); ++it) {
 					pack((uchar)1);
-					pack((*it).first);
-					pack((*it).second.size);
-					pack((*it).second.ext);
-					pack((uint32)(*it).second.attrs.size());
-					std::vector<uint>::iterator ait = (*it).second.attrs.begin();
-					for(uint j = 0; ait != (*it).second.attrs.end(); ++ait) {
-						pack(j++);
-						pack(*ait);
+					pack(std::string(folders.str(it->name)));
+					pack(it->size);
+					pack(std::string(folders.str(it->ext)));
+					pack((uint32)it->attrsCount);
+					for(uint j = 0; j < it->attrsCount; ++j) {
+						pack(j);
+						pack(it->attrs[j]);
 					}
 				}
 			}
@@ -346,37 +280,34 @@ PEERMESSAGE(PFolderContentsReply, 37)
 	END_MAKE
 
 	PARSE
-		decompress();
+		stream_decompress();
 
 		uint n = unpack_int();
 		while(n) {
-            if (buffer.count() < 4)
+            if (! available(4))
                 break; // If this happens, message is malformed. No need to continue (prevent huge loops)
 			std::string _folder = unpack_string();
 			uint o = unpack_int();
 			while(o) {
-                if (buffer.count() < 4)
+                if (! available(4))
                     break; // If this happens, message is malformed. No need to continue (prevent huge loops)
-				std::string _dir = unpack_string();
+				folders.addDir(unpack_string(), _folder);
 				uint p = unpack_int();
-				folders[_folder][_dir].clear();
 				while(p) {
-                    if (buffer.empty())
+                    if (! available(1))
                         break; // If this happens, message is malformed. No need to continue (prevent huge loops)
-                    newsoul::File fe;
 					unpack_char();
 					std::string _name = unpack_string();
-					fe.size = unpack_off();
-					fe.ext = unpack_string();
+					uint64 size = unpack_off();
+					folders.addFile(_name, size, unpack_string());
 					uint q = unpack_int();
 					while(q) {
-                        if (buffer.count() < 4)
+                        if (! available(4))
                             break; // If this happens, message is malformed. No need to continue (prevent huge loops)
 						unpack_int();
-						fe.attrs.push_back(unpack_int());
+						folders.addAttr(unpack_int());
 						q--;
 					}
-					folders[_folder][_dir][_name] = fe;
 					p--;
 				}
 				o--;
@@ -385,7 +316,7 @@ PEERMESSAGE(PFolderContentsReply, 37)
 		}
 	END_PARSE
 
-	newsoul::Shares folders;
+	newsoul::FileList folders;
 END
 
 PEERMESSAGE(PTransferRequest, 40)
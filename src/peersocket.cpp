@@ -21,6 +21,27 @@
 
 #include "peersocket.h"
 #include "ifacemanager.h"
+#include "messagedispatcher.h"
+
+namespace
+{
+  /* Messages a peer socket understands, see messagedispatcher.h. */
+  newsoul::MessageDispatcher<newsoul::PeerSocket> s_Dispatcher("newsoul.messages.peer", "peer", {
+    #define MAP_MESSAGE(ID, TYPE, EVENT) \
+      { ID, #TYPE, [](newsoul::PeerSocket * owner, const NewNet::Buffer & data) -> bool \
+        { \
+          if(owner->EVENT.empty()) \
+            return false; \
+          TYPE msg; \
+          msg.setPeerSocket(owner); \
+          msg.parse_network_packet(data); \
+          owner->EVENT(&msg); \
+          return true; \
+        }, 0, 0 },
+    #include "peereventtable.h"
+    #undef MAP_MESSAGE
+  });
+}
 
 newsoul::PeerSocket::PeerSocket(newsoul::Newsoul * newsoul) : newsoul::UserSocket(newsoul, "P"), newsoul::MessageProcessor(4)
 {
@@ -91,12 +112,9 @@ newsoul::PeerSocket::onDisconnected(NewNet::ClientSocket *)
 void
 newsoul::PeerSocket::onDataReceived(NewNet::ClientSocket * socket)
 {
-  if (m_SocketTimeout.isValid()) {
-    newsoul()->reactor()->removeTimeout(m_SocketTimeout);
-
-    // If there's no activity in the next 130 seconds, then the socket should be closed (timeout)
-    m_SocketTimeout = newsoul()->reactor()->addTimeout(130000, this, &PeerSocket::onSocketTimeout);
-  }
+  // If there's no activity in the next 130 seconds, then the socket should be closed (timeout)
+  if (m_SocketTimeout.isValid())
+    newsoul()->reactor()->addTimeout(130000, m_SocketTimeout);
 }
 
 void
@@ -105,32 +123,15 @@ newsoul::PeerSocket::onMessageReceived(const MessageData * data)
   if (m_SearchResultsOnlyTimeout.isValid())
     newsoul()->reactor()->removeTimeout(m_SearchResultsOnlyTimeout);
 
-  if (m_SocketTimeout.isValid()) {
-    newsoul()->reactor()->removeTimeout(m_SocketTimeout);
-
-    // If there's no activity in the next 130 seconds, then the socket should be closed (timeout)
-    m_SocketTimeout = newsoul()->reactor()->addTimeout(130000, this, &PeerSocket::onSocketTimeout);
-  }
+  // If there's no activity in the next 130 seconds, then the socket should be closed (timeout)
+  if (m_SocketTimeout.isValid())
+    newsoul()->reactor()->addTimeout(130000, m_SocketTimeout);
 
-  switch(data->type)
+  if(! s_Dispatcher.dispatch(this, data->type, data->data))
   {
-    #define MAP_MESSAGE(ID, TYPE, EVENT) \
-      case ID: \
-      { \
-        NNLOG("newsoul.messages.peer", "Received peer message " #TYPE "."); \
-        TYPE msg; \
-        msg.setPeerSocket(this); \
-        msg.parse_network_packet(data->data, data->length); \
-        EVENT(&msg); \
-        break; \
-      }
-    #include "peereventtable.h"
-    #undef MAP_MESSAGE
-
-    default:
-        NNLOG("newsoul.peers.warn", "Received unknown peer message, type: %u, length: %u", data->type, data->length);
-        NetworkMessage msg;
-        msg.parse_network_packet(data->data, data->length);
+    NNLOG("newsoul.peers.warn", "Received unknown peer message, type: %u, length: %u", data->type, data->length);
+    NetworkMessage msg;
+    msg.parse_network_packet(data->data);
   }
 }
 
@@ -195,7 +196,7 @@ void
 newsoul::PeerSocket::onUploadQueueNotificationReceived(const PUploadQueueNotification *)
 {
   std::string state = " is not a buddy";
-  if (newsoul()->config()->contains({"users", "buddies"}, user()))
+  if (newsoul()->isBuddied(user()))
     state = " is a buddy";
 
   std::string isbuddy = user() + state;
@@ -404,23 +405,18 @@ newsoul::PeerSocket::onFolderContentsRequested(const PFolderContentsRequest * me
 {
     if (! newsoul()->isBanned(user())) {
         std::vector<std::string>::const_iterator it;
-        Shares reply;
+        FileList reply;
         for (it = message->dirs.begin(); it != message->dirs.end(); it++) {
             std::string dir = *it;
             Dirs content;
-            if (newsoul()->haveBuddyShares() && newsoul()->isBuddied(user())) {
+            if (newsoul()->haveBuddyShares() && newsoul()->isBuddied(user()))
                 content = newsoul()->buddyshares()->contents(dir);
-                if (content.size() > 0)
-                    reply[dir] = content;
-            }
-            else {
+            else
                 content = newsoul()->shares()->contents(dir);
-                if (content.size() > 0)
-                    reply[dir] = content;
-            }
+            reply.addDirs(content, dir);
         }
 
-        if (reply.size() > 0) {
+        if (! reply.dirs().empty()) {
             PFolderContentsReply msg(reply);
             sendMessage(msg.make_network_packet());
         }
@@ -436,12 +432,9 @@ void
 newsoul::PeerSocket::onSearchResultsReceived(const PSearchReply * message) {
     NNLOG("newsoul.peers.debug", "Search result from %s", user().c_str());
 
-    Dir folders;
-    Dir::const_iterator it = message->results.begin();
-    for(; it != message->results.end(); ++it) {
-        std::string encodedFilename = newsoul()->codeset()->fromPeer(user(), (*it).first);
-        folders[encodedFilename] = (*it).second;
-        }
+    FileList folders = message->results.recoded([this](const std::string &name) {
+        return newsoul()->codeset()->fromPeer(user(), name);
+    });
 
     newsoul()->searches()->searchReplyReceived(message->ticket, user(), message->slotfree, message->avgspeed, message->queuelen, folders);
 
@@ -501,4 +494,5 @@ newsoul::PeerSocket::stopConnectOurself() {
     }
 
     sendBuffer().clear(); // We have a HInitiate message still waiting in the buffer. We don't need it anymore
+    setDataWaiting(false);
 }
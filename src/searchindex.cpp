@@ -0,0 +1,428 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "searchindex.h"
+#include <algorithm>
+#include <ctype.h>
+#include <string.h>
+#include "sharesdb.h"
+
+/* Do not bother compacting small indices. */
+#define COMPACT_MIN 4096
+
+/* Bits per term in TermFilter, ~1% false positives with 7 hashes. */
+#define FILTER_BITS 10
+#define FILTER_HASHES 7
+
+namespace {
+    /* Same as FTS4 "simple" tokenizer: ASCII alphanumerics
+       and all non-ASCII bytes make up terms. */
+    inline bool isTermChar(unsigned char c) {
+        return (
+            c >= 0x80 ||
+            (c >= '0' && c <= '9') ||
+            (c >= 'a' && c <= 'z') ||
+            (c >= 'A' && c <= 'Z')
+        );
+    }
+
+    inline char lower(char c) {
+        return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+    }
+
+    /* Finds the next term in [s, end), moving s past it. */
+    inline bool nextTerm(const char *&s, const char *end, const char *&start, size_t &length) {
+        while(s < end && !isTermChar(*s)) {
+            ++s;
+        }
+        if(s == end) {
+            return false;
+        }
+        start = s;
+        while(s < end && isTermChar(*s)) {
+            ++s;
+        }
+        length = s - start;
+        return true;
+    }
+
+    inline bool equal(const char *s, size_t length, const std::string &token, bool prefix) {
+        if(prefix ? length < token.size() : length != token.size()) {
+            return false;
+        }
+        for(unsigned int i = 0; i < token.size(); ++i) {
+            if(lower(s[i]) != token[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::string term(const char *s, size_t length) {
+        std::string result(s, length);
+        for(char &c : result) {
+            c = lower(c);
+        }
+        return result;
+    }
+
+    /* Removes ids of dead slots, renumbering the rest. */
+    void remap(std::vector<uint32_t> &ids, const std::vector<uint32_t> &to) {
+        unsigned int n = 0;
+        for(uint32_t id : ids) {
+            if(to[id] != UINT32_MAX) {
+                ids[n++] = to[id];
+            }
+        }
+        ids.resize(n);
+    }
+
+    /* FNV-1a, halves are used as the two hashes of TermFilter. */
+    uint64_t hash(const std::string &term) {
+        uint64_t h = 14695981039346656037ULL;
+        for(unsigned char c : term) {
+            h ^= c;
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+}
+
+/* Words which consist of more than one term are phrases, as in FTS. */
+std::vector<newsoul::SearchIndex::Element> newsoul::SearchIndex::parse(const std::string &query) {
+    std::vector<Element> elements;
+    size_t i = 0;
+    while(i < query.size()) {
+        if(isspace((unsigned char)query[i])) {
+            ++i;
+            continue;
+        }
+
+        Element element;
+        element.prefix = false;
+        element.negative = query[i] == '-';
+        if(element.negative) {
+            ++i;
+        }
+        size_t end;
+        std::string text;
+        if(i < query.size() && query[i] == '"') {
+            end = std::min(query.find('"', i + 1), query.size());
+            text = query.substr(i + 1, end - i - 1);
+            ++end;
+        } else {
+            end = i;
+            while(end < query.size() && !isspace((unsigned char)query[end])) {
+                ++end;
+            }
+            text = query.substr(i, end - i);
+        }
+        i = end;
+
+        if(!text.empty() && text[text.size() - 1] == '*') {
+            element.prefix = true;
+        }
+        const char *s = text.data();
+        const char *start;
+        size_t length;
+        while(nextTerm(s, text.data() + text.size(), start, length)) {
+            element.tokens.push_back(term(start, length));
+        }
+        if(!element.tokens.empty()) {
+            elements.push_back(element);
+        }
+    }
+    return elements;
+}
+
+newsoul::SearchIndex::SearchIndex() : dead(0) { }
+
+void newsoul::SearchIndex::clear() {
+    this->strings.clear();
+    this->slots.clear();
+    this->terms.clear();
+    this->dirs.clear();
+    this->dead = 0;
+}
+
+void newsoul::SearchIndex::add(const std::string &path, const File &file) {
+    const uint32_t id = this->slots.size();
+    Slot slot;
+    slot.path = this->strings.size();
+    this->strings.insert(this->strings.end(), path.begin(), path.end());
+    this->strings.push_back('\0');
+    slot.ext = this->strings.size();
+    this->strings.insert(this->strings.end(), file.ext.begin(), file.ext.end());
+    this->strings.push_back('\0');
+    slot.size = file.size;
+    slot.mtime = file.mtime;
+    for(unsigned int i = 0; i < 3; ++i) {
+        slot.attrs[i] = i < file.attrs.size() ? file.attrs[i] : 0;
+    }
+    slot.live = true;
+    this->slots.push_back(slot);
+
+    const char *s = path.data();
+    const char *start;
+    size_t length;
+    while(nextTerm(s, path.data() + path.size(), start, length)) {
+        std::vector<uint32_t> &ids = this->terms[term(start, length)];
+        if(ids.empty() || ids.back() != id) {
+            ids.push_back(id);
+        }
+    }
+
+    size_t slash = path.rfind('/');
+    this->dirs[path.substr(0, slash == std::string::npos ? 0 : slash)].push_back(id);
+}
+
+void newsoul::SearchIndex::removeSlots(std::vector<uint32_t> &ids) {
+    for(uint32_t id : ids) {
+        if(this->slots[id].live) {
+            this->slots[id].live = false;
+            ++this->dead;
+        }
+    }
+}
+
+void newsoul::SearchIndex::removeDir(const std::string &dir) {
+    auto it = this->dirs.find(dir);
+    if(it == this->dirs.end()) {
+        return;
+    }
+    this->removeSlots(it->second);
+    this->dirs.erase(it);
+    this->compact();
+}
+
+void newsoul::SearchIndex::removeTree(const std::string &path) {
+    const std::string prefix = path + '/';
+    auto it = this->dirs.lower_bound(path);
+    while(it != this->dirs.end() && (it->first == path || it->first.compare(0, prefix.size(), prefix) == 0)) {
+        this->removeSlots(it->second);
+        it = this->dirs.erase(it);
+    }
+    this->compact();
+}
+
+void newsoul::SearchIndex::compact() {
+    if(this->dead < COMPACT_MIN || this->dead * 2 < this->slots.size()) {
+        return;
+    }
+
+    std::vector<uint32_t> to(this->slots.size(), UINT32_MAX);
+    std::vector<char> strings;
+    std::vector<Slot> slots;
+    for(uint32_t id = 0; id < this->slots.size(); ++id) {
+        Slot slot = this->slots[id];
+        if(!slot.live) {
+            continue;
+        }
+        to[id] = slots.size();
+        const char *path = &this->strings[slot.path];
+        const char *ext = &this->strings[slot.ext];
+        slot.path = strings.size();
+        strings.insert(strings.end(), path, path + strlen(path) + 1);
+        slot.ext = strings.size();
+        strings.insert(strings.end(), ext, ext + strlen(ext) + 1);
+        slots.push_back(slot);
+    }
+
+    for(auto it = this->terms.begin(); it != this->terms.end();) {
+        remap(it->second, to);
+        if(it->second.empty()) {
+            it = this->terms.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for(auto &dir : this->dirs) {
+        remap(dir.second, to);
+    }
+    this->strings.swap(strings);
+    this->slots.swap(slots);
+    this->dead = 0;
+}
+
+bool newsoul::SearchIndex::matches(uint32_t id, const Element &element) const {
+    const char *s = this->path(id);
+    const char *end = s + strlen(s);
+    const char *start;
+    size_t length;
+    while(nextTerm(s, end, start, length)) {
+        const char *cur = start;
+        unsigned int k = 0;
+        for(; k < element.tokens.size(); ++k) {
+            bool prefix = element.prefix && k == element.tokens.size() - 1;
+            if(!nextTerm(cur, end, start, length) || !equal(start, length, element.tokens[k], prefix)) {
+                break;
+            }
+        }
+        if(k == element.tokens.size()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void newsoul::SearchIndex::query(const std::string &query, std::vector<uint32_t> &hits, size_t limit) const {
+    std::vector<Element> elements = SearchIndex::parse(query);
+
+    //Every term of every wanted element has to be there.
+    std::vector<const std::vector<uint32_t>*> lists;
+    std::vector<std::vector<uint32_t>> unions;
+    unions.reserve(elements.size());
+    bool verify = false;
+    for(const Element &element : elements) {
+        if(element.negative) {
+            verify = true;
+            continue;
+        }
+        verify = verify || element.tokens.size() > 1;
+        for(unsigned int k = 0; k < element.tokens.size(); ++k) {
+            const std::string &token = element.tokens[k];
+            if(element.prefix && k == element.tokens.size() - 1) {
+                unions.push_back(std::vector<uint32_t>());
+                std::vector<uint32_t> &ids = unions.back();
+                auto it = this->terms.lower_bound(token);
+                for(; it != this->terms.end() && it->first.compare(0, token.size(), token) == 0; ++it) {
+                    ids.insert(ids.end(), it->second.begin(), it->second.end());
+                }
+                std::sort(ids.begin(), ids.end());
+                ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+                lists.push_back(&ids);
+            } else {
+                auto it = this->terms.find(token);
+                if(it == this->terms.end()) {
+                    return;
+                }
+                lists.push_back(&it->second);
+            }
+        }
+    }
+    if(lists.empty()) {
+        return;
+    }
+    std::sort(lists.begin(), lists.end(), [](const std::vector<uint32_t> *a, const std::vector<uint32_t> *b) {
+        return a->size() < b->size();
+    });
+
+    std::vector<std::vector<uint32_t>::const_iterator> cursors;
+    for(const std::vector<uint32_t> *list : lists) {
+        cursors.push_back(list->begin());
+    }
+    size_t found = 0;
+    for(uint32_t id : *lists[0]) {
+        if(found == limit) {
+            break;
+        }
+        if(!this->slots[id].live) {
+            continue;
+        }
+        bool all = true;
+        for(unsigned int i = 1; all && i < lists.size(); ++i) {
+            cursors[i] = std::lower_bound(cursors[i], lists[i]->end(), id);
+            all = cursors[i] != lists[i]->end() && *cursors[i] == id;
+        }
+        for(unsigned int i = 0; all && verify && i < elements.size(); ++i) {
+            const Element &element = elements[i];
+            if(element.negative || element.tokens.size() > 1) {
+                all = this->matches(id, element) != element.negative;
+            }
+        }
+        if(all) {
+            hits.push_back(id);
+            ++found;
+        }
+    }
+}
+
+const char *newsoul::SearchIndex::path(uint32_t id) const {
+    return &this->strings[this->slots[id].path];
+}
+
+void newsoul::SearchIndex::file(uint32_t id, File &file) const {
+    const Slot &slot = this->slots[id];
+    file.size = slot.size;
+    file.ext = &this->strings[slot.ext];
+    file.mtime = slot.mtime;
+    file.attrs.assign(slot.attrs, slot.attrs + 3);
+}
+
+newsoul::TermFilter::TermFilter() : count(0), capacity(0) { }
+
+void newsoul::TermFilter::reset(size_t terms) {
+    this->capacity = std::max(terms * 2, (size_t)4096);
+    this->bits.assign((this->capacity * FILTER_BITS + 63) / 64, 0);
+    this->count = 0;
+}
+
+void newsoul::TermFilter::add(const std::string &term) {
+    if(this->bits.empty()) {
+        return;
+    }
+    const uint64_t h = hash(term);
+    const uint64_t size = this->bits.size() * 64;
+    uint32_t h1 = h, h2 = h >> 32;
+    bool added = false;
+    for(unsigned int i = 0; i < FILTER_HASHES; ++i) {
+        uint64_t bit = (h1 + (uint64_t)i * h2) % size;
+        uint64_t mask = (uint64_t)1 << (bit % 64);
+        added = added || !(this->bits[bit / 64] & mask);
+        this->bits[bit / 64] |= mask;
+    }
+    //Terms already in (or colliding with ones that are) do not fill it up.
+    if(added) {
+        ++this->count;
+    }
+}
+
+void newsoul::TermFilter::addPath(const std::string &path) {
+    const char *s = path.data();
+    const char *start;
+    size_t length;
+    while(nextTerm(s, path.data() + path.size(), start, length)) {
+        this->add(term(start, length));
+    }
+}
+
+bool newsoul::TermFilter::mayMatch(const std::string &query) const {
+    if(this->bits.empty()) {
+        return true;
+    }
+    const uint64_t size = this->bits.size() * 64;
+    for(const SearchIndex::Element &element : SearchIndex::parse(query)) {
+        if(element.negative) {
+            continue;
+        }
+        for(unsigned int k = 0; k < element.tokens.size(); ++k) {
+            if(element.prefix && k == element.tokens.size() - 1) {
+                continue;
+            }
+            const uint64_t h = hash(element.tokens[k]);
+            uint32_t h1 = h, h2 = h >> 32;
+            for(unsigned int i = 0; i < FILTER_HASHES; ++i) {
+                uint64_t bit = (h1 + (uint64_t)i * h2) % size;
+                if(!(this->bits[bit / 64] & ((uint64_t)1 << (bit % 64)))) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,172 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __NEWSOUL_SEARCHINDEX_H__
+#define __NEWSOUL_SEARCHINDEX_H__
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace newsoul {
+    class File;
+
+    /*!
+     * Memory resident full text index of shared files.
+     * Maps path terms to sorted lists of file IDs, while file attributes
+     * live in flat arrays. Queries are answered by intersecting these lists,
+     * without touching SQLite or allocating anything per matched file.
+     *
+     * Paths are split into terms the same way FTS4 "simple" tokenizer does,
+     * and queries support the same subset of FTS syntax SharesDB::query
+     * is used with (terms, "phrases", prefix* and -negation), so results
+     * are the same as these of the PATHS table.
+     */
+    class SearchIndex {
+    public:
+        /*!
+         * Single query element, a term or a "phrase".
+         */
+        struct Element {
+            std::vector<std::string> tokens;
+            bool prefix;
+            bool negative;
+        };
+
+    private:
+        struct Slot {
+            uint32_t path;
+            uint32_t ext;
+            uint64_t size;
+            int64_t mtime;
+            unsigned int attrs[3];
+            bool live;
+        };
+
+        /* Paths and extensions, NUL terminated, pointed to by slots. */
+        std::vector<char> strings;
+        std::vector<Slot> slots;
+        std::map<std::string, std::vector<uint32_t>> terms;
+        /* Files by directory, so that updates can find them. */
+        std::map<std::string, std::vector<uint32_t>> dirs;
+        size_t dead;
+
+        void removeSlots(std::vector<uint32_t> &ids);
+        void compact();
+        bool matches(uint32_t id, const Element &element) const;
+
+    public:
+        /*!
+         * Splits a query into terms and "phrases", with optional
+         * leading - (negation) and trailing * (prefix).
+         * \param query FTS style query.
+         * \return Query elements, with lowercased tokens.
+         */
+        static std::vector<Element> parse(const std::string &query);
+
+        SearchIndex();
+
+        /*!
+         * Drops all files.
+         */
+        void clear();
+        /*!
+         * Adds a file to the index.
+         * \param path Whole path to the file.
+         * \param file File attributes.
+         */
+        void add(const std::string &path, const File &file);
+        /*!
+         * Drops all files directly inside a directory.
+         * \param dir Directory.
+         */
+        void removeDir(const std::string &dir);
+        /*!
+         * Drops all files inside a directory and its subdirectories.
+         * \param path Directory.
+         */
+        void removeTree(const std::string &path);
+        /*!
+         * Finds files matching a query.
+         * \param query FTS style query.
+         * \param hits Vector to append IDs of matching files to.
+         * \param limit Maximum number of IDs to append.
+         */
+        void query(const std::string &query, std::vector<uint32_t> &hits, size_t limit) const;
+        /*!
+         * \param id File ID, as returned by query.
+         * \return Path of the file.
+         */
+        const char *path(uint32_t id) const;
+        /*!
+         * \param id File ID, as returned by query.
+         * \param file File structure to fill.
+         */
+        void file(uint32_t id, File &file) const;
+        /*!
+         * \return Number of files in the index.
+         */
+        size_t size() const { return this->slots.size() - this->dead; }
+    };
+
+    /*!
+     * Bloom filter of all path terms in shares.
+     * Tells for sure when a query cannot match anything, so that
+     * most of the searches flooding the network are dropped before
+     * getting anywhere near the index or SQLite.
+     * Terms cannot be removed, stale ones only cost false positives
+     * until the filter is filled again.
+     */
+    class TermFilter {
+        std::vector<uint64_t> bits;
+        size_t count;
+        size_t capacity;
+
+    public:
+        TermFilter();
+
+        /*!
+         * Drops all terms and resizes the filter.
+         * \param terms Number of terms to make room for.
+         */
+        void reset(size_t terms);
+        /*!
+         * \param term Lowercased term to add.
+         */
+        void add(const std::string &term);
+        /*!
+         * Adds all terms of a path.
+         * \param path Path to add.
+         */
+        void addPath(const std::string &path);
+        /*!
+         * \return True if there are more distinct terms than the filter was made for.
+         */
+        bool full() const { return this->count > this->capacity; }
+        /*!
+         * Checks whether a query might match anything.
+         * Only wanted, whole terms are taken into account.
+         * \param query FTS style query.
+         * \return False if it surely does not, true otherwise.
+         */
+        bool mayMatch(const std::string &query) const;
+    };
+}
+
+#endif // __NEWSOUL_SEARCHINDEX_H__
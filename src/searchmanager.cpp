@@ -21,6 +21,9 @@
 
 #include "searchmanager.h"
 
+/* Number of recent search results to keep. */
+#define RESULTS_CACHE_SIZE 256
+
 newsoul::SearchManager::SearchManager(Newsoul * newsoul) : m_Newsoul(newsoul)
 {
     // Connect some events.
@@ -40,6 +43,9 @@ newsoul::SearchManager::SearchManager(Newsoul * newsoul) : m_Newsoul(newsoul)
     m_TransferSpeed = 0;
     m_ChildrenMaxNumber = 3;
     m_WishlistInterval = 720; // Default wishlist interval
+    m_CacheHits = 0;
+    m_CacheMisses = 0;
+    m_FilteredSearches = 0;
 }
 
 newsoul::SearchManager::~SearchManager()
@@ -351,7 +357,7 @@ void newsoul::SearchManager::sendSearchResults(const std::string & username, con
         else
             db = newsoul()->shares();
 
-        Dir results = db->query(query);
+        const FileList & results = queryShares(db, db == newsoul()->buddyshares(), query);
 
         if (!results.empty()) {
             m_PendingResults[username][token] = results;
@@ -360,6 +366,65 @@ void newsoul::SearchManager::sendSearchResults(const std::string & username, con
 	}
 }
 
+/**
+  * Return the results of a query, reusing the ones of recent identical queries.
+  * The same popular queries flood the network over and over, and most of them
+  * match nothing at all, so those are dropped by the shares' term filter first.
+  */
+const newsoul::FileList & newsoul::SearchManager::queryShares(SharesDB * db, bool buddy, const std::string & query) {
+    static const FileList noResults;
+
+    if (!db->mayMatch(query)) {
+        m_FilteredSearches++;
+        return noResults;
+    }
+
+    // Case and spacing do not change the results
+    std::string key(buddy ? "b" : "g");
+    for (std::string::const_iterator it = query.begin(); it != query.end(); it++) {
+        if (isspace((unsigned char) *it)) {
+            if (key.size() > 1 && key[key.size() - 1] != ' ')
+                key += ' ';
+        }
+        else if (*it >= 'A' && *it <= 'Z')
+            key += *it - 'A' + 'a';
+        else
+            key += *it;
+    }
+    if (key.size() > 1 && key[key.size() - 1] == ' ')
+        key.erase(key.size() - 1);
+
+    std::map<std::string, ResultsCache::iterator>::iterator it = m_ResultsCacheIndex.find(key);
+    if (it != m_ResultsCacheIndex.end()) {
+        m_ResultsCache.splice(m_ResultsCache.begin(), m_ResultsCache, it->second);
+        CachedResults & cached = it->second->second;
+        if (cached.generation == db->generation()) {
+            m_CacheHits++;
+            return cached.results;
+        }
+        // Shares changed since
+        m_CacheMisses++;
+        cached.generation = db->generation();
+        db->query(query, cached.results);
+        return cached.results;
+    }
+
+    m_CacheMisses++;
+    if ((m_CacheHits + m_CacheMisses) % 1000 == 0)
+        NNLOG("newsoul.peers.debug", "Search results cache: %llu hits, %llu misses, %llu filtered", (unsigned long long) m_CacheHits, (unsigned long long) m_CacheMisses, (unsigned long long) m_FilteredSearches);
+
+    if (m_ResultsCache.size() >= RESULTS_CACHE_SIZE) {
+        m_ResultsCacheIndex.erase(m_ResultsCache.back().first);
+        m_ResultsCache.pop_back();
+    }
+    m_ResultsCache.push_front(std::make_pair(key, CachedResults()));
+    m_ResultsCacheIndex[key] = m_ResultsCache.begin();
+    CachedResults & cached = m_ResultsCache.front().second;
+    cached.generation = db->generation();
+    db->query(query, cached.results);
+    return cached.results;
+}
+
 /**
   * Initiate a search in our buddy list
   */
@@ -415,11 +480,11 @@ void newsoul::SearchManager::wishlistAdd(const std::string & query) {
 void newsoul::SearchManager::onPeerSocketReady(PeerSocket * socket) {
     std::string username = socket->user();
 
-    std::map<std::string, std::map<uint, Dir> >::iterator pending = m_PendingResults.find(username);
+    std::map<std::string, std::map<uint, FileList> >::iterator pending = m_PendingResults.find(username);
     if (pending != m_PendingResults.end() && m_PendingResults[username].size()) {
         NNLOG("newsoul.peers.debug", "Sending search results to %s", username.c_str());
 
-        std::map<uint, Dir>::const_iterator it;
+        std::map<uint, FileList>::const_iterator it;
         for (it = m_PendingResults[username].begin(); it != m_PendingResults[username].end(); it++) {
             PSearchReply msg(it->first, username, it->second, transferSpeed(), (uint64) newsoul()->uploads()->queueTotalLength(), newsoul()->uploads()->hasFreeSlots());
             socket->sendMessage(msg.make_network_packet());
@@ -520,13 +585,13 @@ void
 newsoul::SearchManager::onPeerSocketUnavailable(std::string user)
 {
     // Could not connect to the peer or disconnected: delete the pending search results
-    std::map<std::string, std::map<uint, Dir> >::iterator it;
+    std::map<std::string, std::map<uint, FileList> >::iterator it;
     it = m_PendingResults.find(user);
     if (it != m_PendingResults.end())
         m_PendingResults.erase(it);
 }
 
 void
-newsoul::SearchManager::searchReplyReceived(uint ticket, const std::string & user, bool slotfree, uint avgspeed, uint64 queuelen, const Dir & folders) {
+newsoul::SearchManager::searchReplyReceived(uint ticket, const std::string & user, bool slotfree, uint avgspeed, uint64 queuelen, const FileList & folders) {
     newsoul()->ifaces()->onSearchReply(ticket, user, slotfree, avgspeed, (uint) queuelen, folders);
 }
@@ -20,6 +20,7 @@
 #ifndef NEWSOUL_SEARCHMANAGER_H
 #define NEWSOUL_SEARCHMANAGER_H
 
+#include <list>
 #include "distributedsocket.h"
 #include "ifacemanager.h"
 #include "peersocket.h"
@@ -60,7 +61,7 @@ namespace newsoul
     uint transferSpeed() {return m_TransferSpeed;};
     void setTransferSpeed(uint speed) {m_TransferSpeed = speed;};
 
-    void searchReplyReceived(uint ticket, const std::string & user, bool slotfree, uint avgspeed, uint64 queuelen, const Dir & folders);
+    void searchReplyReceived(uint ticket, const std::string & user, bool slotfree, uint avgspeed, uint64 queuelen, const FileList & folders);
     void branchLevelReceived(DistributedSocket * socket, uint level);
 
     void transmitSearch(uint unknown, const std::string & username, uint ticket, const std::string & query);
@@ -72,6 +73,11 @@ namespace newsoul
     void roomsSearch(uint token, const std::string & query);
     void wishlistAdd(const std::string & query);
 
+    /* Searches answered from the results cache, computed, and dropped by the term filter. */
+    uint64 cacheHits() const {return m_CacheHits;};
+    uint64 cacheMisses() const {return m_CacheMisses;};
+    uint64 filteredSearches() const {return m_FilteredSearches;};
+
   protected:
     /* Find or make a peer socket for the specified user. */
     PeerSocket * peerSocket(const std::string & user);
@@ -89,6 +95,15 @@ namespace newsoul
     void onChildDisconnected(NewNet::ClientSocket * socket_);
     void onWishlistTimeout(long);
 
+    /* Return results of a query, from cache if the shares did not change since. */
+    const FileList & queryShares(SharesDB * db, bool buddy, const std::string & query);
+
+    struct CachedResults {
+      uint64 generation;
+      FileList results;
+    };
+    typedef std::list<std::pair<std::string, CachedResults> > ResultsCache;
+
     NewNet::WeakRefPtr<Newsoul>                 m_Newsoul;          // Ref to the newsoul
     std::string                                 m_ParentIp;         // The IP address of our parent
     std::string                                 m_BranchRoot;       // Parent of the branch we're in
@@ -101,10 +116,16 @@ namespace newsoul
                                                 m_PotentialParents; // Potential parent we're connecting to
     std::map<std::string, std::pair<NewNet::RefPtr<DistributedSocket>, uint> >
                                                 m_Children;         // List of all our children with their respective depth
-    std::map<std::string, std::map<uint, Dir> >
+    std::map<std::string, std::map<uint, FileList> >
                                                 m_PendingResults;   // Pending search results we'll have to send soon
     std::map<std::string, time_t>               m_Wishlist;         // Wishlist items with the last time we searched for them
     NewNet::WeakRefPtr<NewNet::Event<long>::Callback> m_WishlistTimeout; // Wishlist timeout
+    ResultsCache                                m_ResultsCache;     // Recent search results, most recently used first
+    std::map<std::string, ResultsCache::iterator>
+                                                m_ResultsCacheIndex;// Recent search results by normalized query
+    uint64                                      m_CacheHits;        // Searches answered from m_ResultsCache
+    uint64                                      m_CacheMisses;      // Searches we had to query shares for
+    uint64                                      m_FilteredSearches; // Searches dropped by the shares term filter
   };
 }
 
@@ -19,6 +19,26 @@
  */
 
 #include "servermanager.h"
+#include "messagedispatcher.h"
+
+namespace
+{
+  /* Messages the server manager understands, see messagedispatcher.h. */
+  newsoul::MessageDispatcher<newsoul::ServerManager> s_Dispatcher("newsoul.messages.server", "server", {
+    #define MAP_MESSAGE(ID, TYPE, EVENT) \
+      { ID, #TYPE, [](newsoul::ServerManager * owner, const NewNet::Buffer & data) -> bool \
+        { \
+          if(owner->EVENT.empty()) \
+            return false; \
+          TYPE msg; \
+          msg.parse_network_packet(data); \
+          owner->EVENT(&msg); \
+          return true; \
+        }, 0, 0 },
+    #include "servereventtable.h"
+    #undef MAP_MESSAGE
+  });
+}
 
 newsoul::ServerManager::ServerManager(Newsoul * newsoul) : m_Newsoul(newsoul), m_LoggedIn(false)
 {
@@ -135,7 +155,7 @@ newsoul::ServerManager::sendMessage(const NewNet::Buffer & buffer)
   buf[2] = (buffer.count() >> 16) & 0xff;
   buf[3] = (buffer.count() >> 24) & 0xff;
   m_Socket->send(buf, 4);
-  m_Socket->send(buffer.data(), buffer.count());
+  m_Socket->send(buffer);
 }
 
 #define SEND_MESSAGE(m) sendMessage(m.make_network_packet())
@@ -197,25 +217,11 @@ newsoul::ServerManager::onDisconnected(NewNet::ClientSocket * socket)
 void
 newsoul::ServerManager::onMessageReceived(const TcpMessageSocket::MessageData * data)
 {
-  switch(data->type)
+  if(! s_Dispatcher.dispatch(this, data->type, data->data))
   {
-
-    #define MAP_MESSAGE(ID, TYPE, EVENT) \
-      case ID: \
-      { \
-        NNLOG("newsoul.messages.server", "Received server message " #TYPE "."); \
-        TYPE msg; \
-        msg.parse_network_packet(data->data, data->length); \
-        EVENT(&msg); \
-        break; \
-      }
-    #include "servereventtable.h"
-    #undef MAP_MESSAGE
-
-    default:
-        NNLOG("newsoul.server.warn", "Received unknown server message, type: %u, length: %u", data->type, data->length);
-        NetworkMessage msg;
-        msg.parse_network_packet(data->data, data->length);
+    NNLOG("newsoul.server.warn", "Received unknown server message, type: %u, length: %u", data->type, data->length);
+    NetworkMessage msg;
+    msg.parse_network_packet(data->data);
   }
 }
 
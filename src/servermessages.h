@@ -21,6 +21,7 @@
 #ifndef NEWSOUL_SERVERMESSAGES_H
 #define NEWSOUL_SERVERMESSAGES_H
 
+#include "messagecodec.h"
 #include "networkmessage.h"
 
 class ServerMessage : public NetworkMessage {
@@ -151,12 +152,12 @@ SERVERMESSAGE(SGetStatus, 7)
 	END_MAKE
 
 	PARSE
-		user = unpack_string();
+		unpack_string(user);
 		status = unpack_int();
 		privileged = (unpack_char() != 0); // Not used (SAddPrivileged and SPrivilegedUsers should do the trick)
 	END_PARSE
 
-	std::string user;
+	newsoul::ArenaString user;
 	uint32 status;
 	bool privileged;
 END
@@ -170,12 +171,12 @@ SERVERMESSAGE(SSayRoom, 13)
 	END_MAKE
 
 	PARSE
-		room = unpack_string();
-		user = unpack_string();
-		line = unpack_string();
+		unpack_string(room);
+		unpack_string(user);
+		unpack_string(line);
 	END_PARSE
 
-	std::string room, user, line;
+	newsoul::ArenaString room, user, line;
 END
 
 SERVERMESSAGE(SJoinRoom, 14)
@@ -330,12 +331,12 @@ SERVERMESSAGE(SFileSearch, 26)
 	END_MAKE
 
 	PARSE
-		user = unpack_string();
+		unpack_string(user);
 		ticket = unpack_int();
-		query = unpack_string();
+		unpack_string(query);
 	END_PARSE
 
-	std::string user, query;
+	newsoul::ArenaString user, query;
 	uint32 ticket;
 END
 
@@ -527,60 +528,37 @@ SERVERMESSAGE(SRoomList, 64)
 	END_MAKE
 
 	PARSE
-		uint32 n = unpack_int();
-		std::vector<std::string> rooms;
-		while(n) {
-            if (buffer.count() < 4)
-                break; // If this happens, message is malformed. No need to continue (prevent huge loops)
-			rooms.push_back(unpack_string());
-			n--;
-		}
-		unpack_int();
-		std::vector<std::string>::iterator it = rooms.begin();
-		for(; it != rooms.end(); ++it)
-			roomlist[*it] = unpack_int();
-
-        // Get rooms owned by us
-		uint32 no = unpack_int();
-		std::vector<std::string> privroomsOwned;
-		while(no) {
-            if (buffer.count() < 4)
-                break; // If this happens, message is malformed. No need to continue (prevent huge loops)
-			privroomsOwned.push_back(unpack_string());
-			no--;
-		}
-		unpack_int();
-		std::vector<std::string>::iterator ito = privroomsOwned.begin();
-		for(; ito != privroomsOwned.end(); ++ito)
-			privroomlist[*ito] = std::pair<uint32, uint32>(unpack_int(), 2);
-
-        // Get rooms where we're member
-		uint32 nm = unpack_int();
-		std::vector<std::string> privroomsMember;
-		while(nm) {
-            if (buffer.count() < 4)
-                break; // If this happens, message is malformed. No need to continue (prevent huge loops)
-			privroomsMember.push_back(unpack_string());
-			nm--;
-		}
-		unpack_int();
-		std::vector<std::string>::iterator itp = privroomsMember.begin();
-		for(; itp != privroomsMember.end(); ++itp)
-			privroomlist[*itp] = std::pair<uint32, uint32>(unpack_int(), 0);
-
-        // Get rooms where we're operator (no users nb as it is given in rooms where we're member)
-		uint32 np = unpack_int();
-		std::vector<std::string> privrooms;
-		while(np) {
-            if (buffer.count() < 4)
-                break; // If this happens, message is malformed. No need to continue (prevent huge loops)
-		    std::string opedRoom = unpack_string();
-		    if (privroomlist.find(opedRoom) != privroomlist.end())
-                privroomlist[opedRoom].second = 1;
-			np--;
+		// Older servers stop after any of the lists, keep what is there.
+		Lists lists;
+		newsoul::codec::decode(buffer, lists);
+
+		for(size_t i = 0; i < lists.rooms.size() && i < lists.users.size(); ++i)
+			roomlist[lists.rooms[i]] = lists.users[i];
+		// Rooms owned by us
+		for(size_t i = 0; i < lists.owned.size() && i < lists.ownedUsers.size(); ++i)
+			privroomlist[lists.owned[i]] = std::pair<uint32, uint32>(lists.ownedUsers[i], 2);
+		// Rooms where we're member
+		for(size_t i = 0; i < lists.member.size() && i < lists.memberUsers.size(); ++i)
+			privroomlist[lists.member[i]] = std::pair<uint32, uint32>(lists.memberUsers[i], 0);
+		// Rooms where we're operator (no users nb as it is given in rooms where we're member)
+		std::vector<std::string>::const_iterator it = lists.operated.begin();
+		for(; it != lists.operated.end(); ++it) {
+			PrivRoomList::iterator room = privroomlist.find(*it);
+			if(room != privroomlist.end())
+				room->second.second = 1;
 		}
 	END_PARSE
 
+	/* Room names and user counts, as they are sent. */
+	struct Lists {
+		std::vector<std::string> rooms, owned, member, operated;
+		std::vector<uint32> users, ownedUsers, memberUsers;
+
+		template<typename Codec> void schema(Codec & c) {
+			c & rooms & users & owned & ownedUsers & member & memberUsers & operated;
+		}
+	};
+
 	RoomList roomlist;
 	PrivRoomList privroomlist; // [name[users, status]] with status : { 0 => member, 1 => operator, 2 => owner}
 END
@@ -662,14 +640,14 @@ SERVERMESSAGE(SSearchRequest, 93)
 	PARSE
         dCode = unpack_char();
         unknown = unpack_int();
-        username = unpack_string();
+        unpack_string(username);
         token = unpack_int();
-        query = unpack_string();
+        unpack_string(query);
 	END_PARSE
 
     char dCode;
 	uint32 unknown, token;
-	std::string username, query;
+	newsoul::ArenaString username, query;
 END
 
 SERVERMESSAGE(SAcceptChildren, 100)
@@ -17,27 +17,209 @@
 */
 
 #include "sharesdb.h"
+#include <fstream>
+#include <string.h>
+#include "NewNet/nnlog.h"
+#include "filelist.h"
+
+#define CACHE_VERSION 1
+
+namespace {
+    /* Last generation given to any SharesDB. */
+    uint64_t generations = 0;
+
+    /* Stores scanned entries, preparing its statements only once. */
+    class Writer {
+        sqlite3 *db;
+        sqlite3_stmt *dir;
+        sqlite3_stmt *file;
+        sqlite3_stmt *attrs;
+
+    public:
+        Writer(sqlite3 *db) : db(db) {
+            sqlite3_prepare_v2(this->db,
+                "INSERT OR IGNORE INTO DIR(path, parentID, type) "
+                "VALUES(?1, COALESCE((SELECT ID FROM DIR WHERE path=?2), 0), 1); "
+            , -1, &this->dir, NULL);
+            sqlite3_prepare_v2(this->db,
+                "INSERT OR REPLACE INTO DIR(path, parentID, type) "
+                "VALUES(?1, COALESCE((SELECT ID FROM DIR WHERE path=?2), 0), 0); "
+            , -1, &this->file, NULL);
+            sqlite3_prepare_v2(this->db,
+                "INSERT OR REPLACE INTO "
+                "FILE(dirID, size, ext, mtime, bitrate, length, vbr) "
+                "VALUES(?, ?, ?, ?, ?, ?, ?); "
+            , -1, &this->attrs, NULL);
+        }
+
+        ~Writer() {
+            sqlite3_finalize(this->attrs);
+            sqlite3_finalize(this->file);
+            sqlite3_finalize(this->dir);
+        }
+
+        /* Returns whether anything changed. */
+        bool write(const newsoul::ScanEntry &entry) {
+            sqlite3_stmt *stmt = entry.isDir ? this->dir : this->file;
+            sqlite3_bind_text(stmt, 1, entry.path.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_text(stmt, 2, entry.dir.c_str(), -1, SQLITE_STATIC);
+            int res = sqlite3_step(stmt);
+            sqlite3_reset(stmt);
+            if(res != SQLITE_DONE) {
+                NNLOG("newsoul.shares.warn", "Cannot add %s to shares: %s.", entry.path.c_str(), sqlite3_errmsg(this->db));
+                return false;
+            }
+            if(entry.isDir) {
+                return sqlite3_changes(this->db) > 0;
+            }
+
+            sqlite3_bind_int64(this->attrs, 1, sqlite3_last_insert_rowid(this->db));
+            sqlite3_bind_int64(this->attrs, 2, entry.size);
+            sqlite3_bind_text(this->attrs, 3, entry.ext.c_str(), -1, SQLITE_STATIC);
+            sqlite3_bind_int64(this->attrs, 4, entry.mtime);
+            sqlite3_bind_int(this->attrs, 5, entry.bitrate);
+            sqlite3_bind_int(this->attrs, 6, entry.length);
+            sqlite3_bind_int(this->attrs, 7, entry.vbr);
+            res = sqlite3_step(this->attrs);
+            sqlite3_reset(this->attrs);
+            if(res != SQLITE_DONE) {
+                //The file is listed all the same, so its directory did change.
+                NNLOG("newsoul.shares.warn", "Cannot store attributes of %s: %s.", entry.path.c_str(), sqlite3_errmsg(this->db));
+            }
+            return true;
+        }
+    };
+}
+
+namespace {
+    const char *statements[newsoul::StatementCache::SIZE] = {
+        //ATTRS
+        "SELECT size, ext, mtime, bitrate, length, vbr FROM FILE "
+        "WHERE dirID=(SELECT ID FROM DIR WHERE path=?) LIMIT 1; ",
+        //IS_SHARED
+        "SELECT EXISTS(SELECT 1 FROM DIR WHERE path=? LIMIT 1); ",
+        //PROPER_CASE
+        "SELECT path FROM DIR WHERE path=?1 COLLATE NOCASE "
+        "ORDER BY path=?1 DESC LIMIT 1; ",
+        //COUNT
+        "SELECT COUNT(*) FROM DIR WHERE type=?; ",
+        //CONTENTS
+        "SELECT d.path, d.type, f.size, f.ext, f.mtime, f.bitrate, f.length, f.vbr "
+        "FROM DIR AS d LEFT JOIN FILE AS f ON d.ID=f.dirID "
+        "WHERE d.path=?1 OR (d.path>?2 AND d.path<?3) "
+        "ORDER BY d.type DESC; ",
+        //REMOVE
+        "DELETE FROM DIR WHERE path=?1 OR (path>?2 AND path<?3); ",
+        //QUERY
+        "SELECT p.path, f.size, f.ext, f.mtime, f.bitrate, f.length, f.vbr "
+        "FROM PATHS AS p JOIN FILE AS f ON p.docid=f.dirID "
+        "WHERE p.path MATCH ? LIMIT 500; "
+    };
+}
 
-newsoul::SharesDB *newsoul::SharesDB::_this;
+namespace {
+    /* Binds a path to ?1, and the range all paths inside of it
+       sort within to ?2 and ?3 (as '0' comes right after '/'). */
+    void bindTree(sqlite3_stmt *stmt, std::string path) {
+        while(path.size() > 1 && path[path.size() - 1] == '/') {
+            path.erase(path.size() - 1);
+        }
+        std::string from = path == "/" ? path : path + '/';
+        std::string to = from;
+        to[to.size() - 1] = '0';
+        sqlite3_bind_text(stmt, 1, path.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 2, from.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, 3, to.c_str(), -1, SQLITE_TRANSIENT);
+    }
+}
+
+newsoul::StatementCache::StatementCache() : db(NULL) {
+    for(int id = 0; id < SIZE; ++id) {
+        this->stmts[id] = NULL;
+    }
+}
+
+newsoul::StatementCache::~StatementCache() {
+    this->finalize();
+}
+
+sqlite3_stmt *newsoul::StatementCache::get(sqlite3 *db, Id id) {
+    if(db != this->db) {
+        this->finalize();
+        this->db = db;
+    }
+    if(this->stmts[id] == NULL) {
+        sqlite3_prepare_v2(this->db, statements[id], -1, &this->stmts[id], NULL);
+    }
+    return this->stmts[id];
+}
 
-newsoul::SharesDB::SharesDB(const std::string &fn, std::function<void(void)> func) {
+void newsoul::StatementCache::finalize() {
+    for(int id = 0; id < SIZE; ++id) {
+        sqlite3_finalize(this->stmts[id]);
+        this->stmts[id] = NULL;
+    }
+}
+
+newsoul::SharesDB::SharesDB(const std::string &fn, std::function<void(void)> func, bool indexed) {
     this->updateApp = func;
+    this->index = indexed ? new SearchIndex() : NULL;
     const std::string efn = path::expand(fn);
     os::_mkdir(efn);
-    std::string dfn = path::join({efn, "shares.db"});
-    int res = sqlite3_open(dfn.c_str(), &this->db);
+    this->dbfn = path::join({efn, "shares.db"});
+    this->cachefn = path::join({efn, "shares.cache"});
+    int res = sqlite3_open(this->dbfn.c_str(), &this->db);
     this->createDB();
     //TODO: Handle errors. Really
-    this->compress();
+    if(this->loadCache()) {
+        if(this->index) {
+            this->buildIndex();
+        }
+    } else {
+        sqlite3_stmt *stmt;
+        sqlite3_prepare_v2(this->db, "SELECT path FROM DIR WHERE type=1;", -1, &stmt, NULL);
+        while(sqlite3_step(stmt) == SQLITE_ROW) {
+            const unsigned char *p = sqlite3_column_text(stmt, 0);
+            this->dirty.insert(reinterpret_cast<const char*>(p));
+        }
+        sqlite3_finalize(stmt);
+        this->compress();
+    }
+    this->gen = ++generations;
+    this->buildFilter();
+    for(int id = 0; id < StatementCache::SIZE; ++id) {
+        this->stmts.get(this->db, (StatementCache::Id)id);
+    }
 }
 
 newsoul::SharesDB::~SharesDB() {
+    delete this->index;
+    this->stmts.finalize();
     sqlite3_close(this->db);
 }
 
 void newsoul::SharesDB::createDB() {
+    //Older databases kept the whole hierarchy in CLOSURE,
+    //which was bigger than everything else together. Paths inside
+    //of a directory can be found through the path index just as well.
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(this->db,
+        "SELECT 1 FROM sqlite_master WHERE type='table' AND name='CLOSURE'; "
+    , -1, &stmt, NULL);
+    bool migrate = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+    if(migrate) {
+        sqlite3_exec(this->db,
+            "DROP TRIGGER IF EXISTS insert_closure; "
+            "DROP TRIGGER IF EXISTS delete_closure; "
+            "DROP TABLE CLOSURE; "
+            "VACUUM; "
+        , NULL, NULL, NULL);
+    }
+
     int res = sqlite3_exec(this->db,
         "PRAGMA foreign_keys = ON; "
+        //REPLACE on DIR has to fire delete_paths for the old row.
         "PRAGMA recursive_triggers = ON; "
 
         "CREATE TABLE IF NOT EXISTS DIR( "
@@ -47,14 +229,6 @@ void newsoul::SharesDB::createDB() {
         "type INTEGER NOT NULL); "
         //type: 0 - file, 1 - directory
 
-        "CREATE TABLE IF NOT EXISTS CLOSURE( "
-        "parentID INTEGER NOT NULL, "
-        "childID INTEGER NOT NULL, "
-        "depth INTEGER NOT NULL, "
-        "PRIMARY KEY(parentID, childID), "
-        "UNIQUE(parentID, depth, childID), "
-        "UNIQUE(childID, parentID, depth)); "
-
         "CREATE TABLE IF NOT EXISTS FILE( "
         "dirID INTEGER PRIMARY KEY, "
         "size INTEGER, "
@@ -66,32 +240,19 @@ void newsoul::SharesDB::createDB() {
         "FOREIGN KEY(dirID) REFERENCES DIR(ID) "
         "ON DELETE CASCADE ON UPDATE CASCADE); "
 
-        "CREATE TRIGGER insert_closure AFTER INSERT ON DIR "
-        "BEGIN "
-        "INSERT INTO CLOSURE(parentID, childID, depth) "
-        "VALUES(new.ID, new.ID, 0);"
-        "INSERT INTO CLOSURE(parentId, childID, depth) "
-        "SELECT parent.parentID, child.childID, parent.depth+child.depth+1 "
-        "FROM CLOSURE parent, CLOSURE child "
-        "WHERE parent.childID=new.parentID and child.parentID=new.ID; "
-        "END; "
+        "CREATE INDEX IF NOT EXISTS DIR_parentID ON DIR(parentID); "
+        //For toProperCase. NOCASE folds ASCII only, same as LOWER did.
+        "CREATE INDEX IF NOT EXISTS DIR_path_nocase ON DIR(path COLLATE NOCASE); "
 
-        "CREATE TRIGGER delete_closure AFTER DELETE ON DIR "
-        "BEGIN "
-        "DELETE FROM CLOSURE WHERE childID=old.ID; "
-        "DELETE FROM DIR "
-        "WHERE ID in (SELECT childID FROM CLOSURE WHERE parentID=old.ID); "
-        "END; "
-
-        "CREATE VIRTUAL TABLE PATHS USING fts4(path); "
+        "CREATE VIRTUAL TABLE IF NOT EXISTS PATHS USING fts4(path); "
 
-        "CREATE TRIGGER insert_paths AFTER INSERT ON DIR "
+        "CREATE TRIGGER IF NOT EXISTS insert_paths AFTER INSERT ON DIR "
         "WHEN new.type=0 "
         "BEGIN "
         "INSERT INTO PATHS(docid, path) VALUES(new.ID, new.path); "
         "END; "
 
-        "CREATE TRIGGER delete_paths AFTER DELETE ON DIR "
+        "CREATE TRIGGER IF NOT EXISTS delete_paths AFTER DELETE ON DIR "
         "WHEN old.type=0 "
         "BEGIN "
         "DELETE FROM PATHS WHERE docid=old.ID; "
@@ -99,53 +260,89 @@ void newsoul::SharesDB::createDB() {
     , NULL, NULL, NULL);
 }
 
-int newsoul::SharesDB::add(const char *path, const struct stat *st, int type, struct FTW *ftwbuf) {
-    std::string dir(path, 0, ftwbuf->base - 1);
-    switch(type) {
-        case FTW_F:
-            SharesDB::_this->addFile(dir, path, *st, false);
-            break;
-        case FTW_D:
-            SharesDB::_this->addDir(path, false);
-            break;
-        default: //TODO: report error
-            break;
-    }
-    return 0;
-}
+void newsoul::SharesDB::add(const std::vector<std::string> &paths) {
+    const char *sql =
+        "SELECT d.path, f.size, f.mtime FROM DIR AS d JOIN FILE AS f "
+        "ON d.ID=f.dirID WHERE d.path=?1 OR (d.path>?2 AND d.path<?3); ";
+    sqlite3_stmt *stmt;
 
-void newsoul::SharesDB::add(std::initializer_list<const std::string> paths) {
-    SharesDB::_this = this;
+    SharesScanner::Known known;
+    sqlite3_prepare_v2(this->db, sql, -1, &stmt, NULL);
+    for(const std::string &path : paths) {
+        bindTree(stmt, path);
+        while(sqlite3_step(stmt) == SQLITE_ROW) {
+            const unsigned char *p = sqlite3_column_text(stmt, 0);
+            known[reinterpret_cast<const char*>(p)] = std::make_pair(
+                (uint64_t)sqlite3_column_int64(stmt, 1),
+                (time_t)sqlite3_column_int64(stmt, 2)
+            );
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
 
+    //Should we die halfway, the cache must not be trusted.
+    ::remove(this->cachefn.c_str());
     int res = sqlite3_exec(this->db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+    std::vector<std::string> roots;
     for(auto path : paths) {
-        nftw(path.c_str(), SharesDB::add, 20, 0);
+        //Scanner only adds what is inside, ancestors have to be there already.
+        struct stat st;
+        if(stat(path.c_str(), &st) == 0) {
+            this->addDir(S_ISDIR(st.st_mode) ? path : path::split(path, 1)[0], false);
+        }
+        roots.push_back(path);
     }
+
+    Writer writer(this->db);
+    unsigned int rows = 0;
+    SharesScanner(known).scan(roots, [&](const std::vector<ScanEntry> &batch) {
+        for(const ScanEntry &entry : batch) {
+            if(writer.write(entry)) {
+                this->dirty.insert(entry.isDir ? entry.path : entry.dir);
+            }
+        }
+        //Do not let a long scan grow one huge journal.
+        rows += batch.size();
+        if(rows >= 10000) {
+            sqlite3_exec(this->db, "COMMIT TRANSACTION; BEGIN TRANSACTION;", NULL, NULL, NULL);
+            rows = 0;
+        }
+    });
     res = sqlite3_exec(this->db, "COMMIT TRANSACTION;", NULL, NULL, NULL);
-}
 
-void newsoul::SharesDB::remove(std::initializer_list<const std::string> paths) {
-    char *sql;
+    this->compress();
+}
 
+void newsoul::SharesDB::remove(const std::vector<std::string> &paths) {
+    ::remove(this->cachefn.c_str());
     for(auto path : paths) {
-        sql = sqlite3_mprintf("DELETE FROM DIR WHERE path=%Q;", path.c_str());
-        int res = sqlite3_exec(this->db, sql, NULL, NULL, NULL);
-        sqlite3_free(sql);
+        StatementCache::Statement stmt(this->stmts.get(this->db, StatementCache::REMOVE));
+        bindTree(stmt, path);
+        int res = sqlite3_step(stmt);
+        this->forget(path);
     }
-}
 
-void newsoul::SharesDB::addFile(const std::string &dir, const std::string &path, const struct stat &st, bool commit) {
-    std::string ext = string::tolower(path.substr(path.rfind('.') + 1));
-    int bitrate = 0;
-    int length = 0;
-    int vbr = 0;
+    this->compress();
+}
 
-    TagLib::FileRef fp(path.c_str());
-    if(!fp.isNull() && fp.audioProperties()) {
-        TagLib::AudioProperties *props = fp.audioProperties();
-        bitrate = props->bitrate();
-        length = props->length();
+void newsoul::SharesDB::forget(const std::string &path) {
+    this->records.erase(path);
+    const std::string prefix = path + '/';
+    auto it = this->records.lower_bound(prefix);
+    while(it != this->records.end() && it->first.compare(0, prefix.size(), prefix) == 0) {
+        it = this->records.erase(it);
+    }
+    if(this->index) {
+        this->index->removeTree(path);
     }
+    //Might have been a file, then its directory's record changes.
+    this->dirty.insert(path::split(path, 1)[0]);
+}
+
+void newsoul::SharesDB::addFile(const std::string &dir, const std::string &path, const struct stat &st, bool commit) {
+    ScanEntry entry = ScanEntry::file(dir, path, st);
+    ScanEntry::readAttrs(entry);
 
     this->addDir(dir, commit);
 
@@ -153,20 +350,12 @@ void newsoul::SharesDB::addFile(const std::string &dir, const std::string &path,
     if(commit) {
         res = sqlite3_exec(this->db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
     }
-    char *sql = sqlite3_mprintf(
-        "INSERT OR REPLACE INTO DIR(path, parentID, type) "
-        "VALUES(%Q, COALESCE((SELECT ID FROM DIR WHERE path=%Q), 0), 0); "
-        "INSERT OR REPLACE INTO "
-        "FILE(dirID, size, ext, mtime, bitrate, length, vbr) "
-        "VALUES(last_insert_rowid(), %d, %Q, %d, %d, %d, %d); "
-        , path.c_str(), dir.c_str()
-        , st.st_size, ext.c_str(), st.st_mtime, bitrate, length, vbr
-    );
-    res = sqlite3_exec(this->db, sql, NULL, NULL, NULL);
+    if(Writer(this->db).write(entry)) {
+        this->dirty.insert(dir);
+    }
     if(commit) {
         res = sqlite3_exec(this->db, "COMMIT TRANSACTION;", NULL, NULL, NULL);
     }
-    sqlite3_free(sql);
 }
 
 void newsoul::SharesDB::addDir(const std::string &path, bool commit) {
@@ -185,14 +374,18 @@ void newsoul::SharesDB::addDir(const std::string &path, bool commit) {
     res = sqlite3_prepare_v2(this->db, sql, -1, &stmt, NULL);
     sqlite3_bind_text(stmt, 1, recreated_path.c_str(), -1, SQLITE_STATIC);
     sqlite3_bind_null(stmt, 2);
-    res = sqlite3_step(stmt);
+    if(sqlite3_step(stmt) == SQLITE_DONE) {
+        this->dirty.insert(recreated_path);
+    }
     for(unsigned int i = 1; i < pieces.size(); ++i) {
         sqlite3_reset(stmt);
         std::string parent(recreated_path);
         sqlite3_bind_text(stmt, 2, parent.c_str(), -1, SQLITE_STATIC);
         recreated_path = path::join({recreated_path, pieces[i]});
         sqlite3_bind_text(stmt, 1, recreated_path.c_str(), -1, SQLITE_STATIC);
-        sqlite3_step(stmt);
+        if(sqlite3_step(stmt) == SQLITE_DONE) {
+            this->dirty.insert(recreated_path);
+        }
     }
     sqlite3_finalize(stmt);
     if(commit) {
@@ -216,139 +409,300 @@ void newsoul::SharesDB::pack(std::vector<unsigned char> &data, std::string s) {
 }
 
 void newsoul::SharesDB::compress() {
-    const char *sql1 = "SELECT ID, path FROM DIR WHERE type=1;";
+    const char *sql1 = "SELECT ID FROM DIR WHERE path=? AND type=1;";
     const char *sql2 =
-        "SELECT COUNT(*) FROM DIR AS d JOIN CLOSURE AS c ON d.ID=c.childID "
-        "WHERE c.parentID=? AND d.type=0 AND c.depth=1; ";
-    const char *sql3 =
         "SELECT d.path, f.* FROM DIR AS d JOIN FILE AS f ON d.ID=f.dirID "
         "WHERE d.parentID=?; ";
     sqlite3_stmt *stmt1;
     sqlite3_stmt *stmt2;
-    sqlite3_stmt *stmt3;
 
-    std::vector<unsigned char> inBuf;
-    this->pack<uint32_t>(inBuf, this->dirsCount());
     sqlite3_prepare_v2(this->db, sql1, -1, &stmt1, NULL);
     sqlite3_prepare_v2(this->db, sql2, -1, &stmt2, NULL);
-    sqlite3_prepare_v2(this->db, sql3, -1, &stmt3, NULL);
-    while(sqlite3_step(stmt1) == SQLITE_ROW) {
-        int id = sqlite3_column_int(stmt1, 0);
-        const unsigned char *p = sqlite3_column_text(stmt1, 1);
-        std::string path(reinterpret_cast<const char*>(p));
-        this->pack<uint32_t>(inBuf, path.size());
-        for(const char &c : path) {
-            if(c == '/') {
-                inBuf.push_back('\\');
-            } else {
-                inBuf.push_back(c);
-            }
+    for(const std::string &path : this->dirty) {
+        if(this->index) {
+            this->index->removeDir(path);
         }
-
-        sqlite3_bind_int(stmt2, 1, id);
-        if(sqlite3_step(stmt2) == SQLITE_ROW) {
-            this->pack<uint32_t>(inBuf, sqlite3_column_int(stmt2, 0));
+        sqlite3_bind_text(stmt1, 1, path.c_str(), -1, SQLITE_STATIC);
+        if(sqlite3_step(stmt1) != SQLITE_ROW) {
+            sqlite3_reset(stmt1);
+            this->records.erase(path);
+            continue;
         }
-        sqlite3_reset(stmt2);
+        int id = sqlite3_column_int(stmt1, 0);
+        sqlite3_reset(stmt1);
 
-        sqlite3_bind_int(stmt3, 1, id);
-        while(sqlite3_step(stmt3) == SQLITE_ROW) {
-            const unsigned char *p = sqlite3_column_text(stmt3, 0);
+        std::vector<unsigned char> files;
+        uint32_t count = 0;
+        sqlite3_bind_int(stmt2, 1, id);
+        while(sqlite3_step(stmt2) == SQLITE_ROW) {
+            const unsigned char *p = sqlite3_column_text(stmt2, 0);
             const std::string fpath(reinterpret_cast<const char*>(p));
             std::string basename = path::split(fpath, 1)[1];
 
-            inBuf.push_back(1);
-            this->pack(inBuf, basename);
-            this->pack<uint64_t>(inBuf, sqlite3_column_int64(stmt3, 2));
-            const unsigned char *e = sqlite3_column_text(stmt3, 3);
+            files.push_back(1);
+            this->pack(files, basename);
+            this->pack<uint64_t>(files, sqlite3_column_int64(stmt2, 2));
+            const unsigned char *e = sqlite3_column_text(stmt2, 3);
             std::string ext(reinterpret_cast<const char*>(e));
-            this->pack(inBuf, ext);
-            this->pack<uint32_t>(inBuf, 3);
-            this->pack<uint32_t>(inBuf, 0);
-            this->pack<uint32_t>(inBuf, sqlite3_column_int(stmt3, 5));
-            this->pack<uint32_t>(inBuf, 1);
-            this->pack<uint32_t>(inBuf, sqlite3_column_int(stmt3, 6));
-            this->pack<uint32_t>(inBuf, 2);
-            this->pack<uint32_t>(inBuf, sqlite3_column_int(stmt3, 7));
+            this->pack(files, ext);
+            this->pack<uint32_t>(files, 3);
+            this->pack<uint32_t>(files, 0);
+            this->pack<uint32_t>(files, sqlite3_column_int(stmt2, 5));
+            this->pack<uint32_t>(files, 1);
+            this->pack<uint32_t>(files, sqlite3_column_int(stmt2, 6));
+            this->pack<uint32_t>(files, 2);
+            this->pack<uint32_t>(files, sqlite3_column_int(stmt2, 7));
+            ++count;
+
+            if(this->index) {
+                File fe;
+                fe.size = sqlite3_column_int64(stmt2, 2);
+                fe.ext = ext;
+                fe.mtime = sqlite3_column_int64(stmt2, 4);
+                fe.attrs = std::vector<unsigned int>({
+                    (unsigned int)sqlite3_column_int(stmt2, 5),
+                    (unsigned int)sqlite3_column_int(stmt2, 6),
+                    (unsigned int)sqlite3_column_int(stmt2, 7)
+                });
+                this->index->add(fpath, fe);
+            }
+            this->filter.addPath(fpath);
         }
-        sqlite3_reset(stmt3);
+        sqlite3_reset(stmt2);
+
+        std::vector<unsigned char> &record = this->records[path];
+        record.clear();
+        this->pack(record, string::replace(path, '/', '\\'));
+        this->pack<uint32_t>(record, count);
+        record.insert(record.end(), files.begin(), files.end());
     }
-    sqlite3_finalize(stmt3);
     sqlite3_finalize(stmt2);
     sqlite3_finalize(stmt1);
+    this->dirty.clear();
+    this->gen = ++generations;
+    if(this->filter.full()) {
+        this->buildFilter();
+    }
+
+    std::vector<unsigned char> inBuf;
+    this->pack<uint32_t>(inBuf, this->records.size());
+    for(const auto &record : this->records) {
+        inBuf.insert(inBuf.end(), record.second.begin(), record.second.end());
+    }
 
     uLong outLen = compressBound(inBuf.size());
-    char *outBuf = new char[outLen];
-    if(::compress((Bytef*)outBuf, &outLen, (Bytef*)inBuf.data(), inBuf.size()) == Z_OK) {
-        this->compressed = std::vector<unsigned char>(outBuf, outBuf + outLen);
+    NewNet::Buffer outBuf;
+    struct iovec iov;
+    outBuf.reserve(outLen, &iov, 1);
+    if(::compress((Bytef*)iov.iov_base, &outLen, (Bytef*)inBuf.data(), inBuf.size()) == Z_OK) {
+        outBuf.commit(outLen);
+        this->compressed = outBuf;
     } else {
-        //TODO: report error
+        outBuf.commit(0);
+        NNLOG("newsoul.shares.warn", "Cannot compress the shares list.");
     }
 
-    delete [] outBuf;
+    this->saveCache();
 }
 
-int newsoul::SharesDB::getAttrs(const std::string &fn, File *fe) const {
-    char *sql = sqlite3_mprintf(
-        "SELECT * FROM FILE WHERE dirID=("
-        "SELECT ID FROM DIR WHERE path=%Q)"
-        "LIMIT 1;"
-        , fn.c_str()
-    );
+void newsoul::SharesDB::buildIndex() {
+    const char *sql =
+        "SELECT d.path, f.* FROM DIR AS d JOIN FILE AS f ON d.ID=f.dirID; ";
     sqlite3_stmt *stmt;
 
+    if(this->index) {
+        this->index->clear();
+    } else {
+        this->index = new SearchIndex();
+    }
     sqlite3_prepare_v2(this->db, sql, -1, &stmt, NULL);
-    sqlite3_free(sql);
+    while(sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char *p = sqlite3_column_text(stmt, 0);
+        const unsigned char *e = sqlite3_column_text(stmt, 3);
+        File fe;
+        fe.size = sqlite3_column_int64(stmt, 2);
+        fe.ext = std::string(reinterpret_cast<const char*>(e));
+        fe.mtime = sqlite3_column_int64(stmt, 4);
+        fe.attrs = std::vector<unsigned int>({
+            (unsigned int)sqlite3_column_int(stmt, 5),
+            (unsigned int)sqlite3_column_int(stmt, 6),
+            (unsigned int)sqlite3_column_int(stmt, 7)
+        });
+        this->index->add(reinterpret_cast<const char*>(p), fe);
+    }
+    sqlite3_finalize(stmt);
+}
+
+void newsoul::SharesDB::buildFilter() {
+    //PATHS already knows all distinct terms, no need to tokenize again.
+    const char *sql = "SELECT term FROM PATHS_TERMS WHERE col='*';";
+    sqlite3_stmt *stmt;
+
+    sqlite3_exec(this->db,
+        "CREATE VIRTUAL TABLE IF NOT EXISTS temp.PATHS_TERMS "
+        "USING fts4aux(main, PATHS);"
+    , NULL, NULL, NULL);
+    std::vector<std::string> terms;
+    if(sqlite3_prepare_v2(this->db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        //Better no filter than one rejecting everything.
+        this->filter = TermFilter();
+        return;
+    }
+    while(sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char *t = sqlite3_column_text(stmt, 0);
+        terms.push_back(reinterpret_cast<const char*>(t));
+    }
+    sqlite3_finalize(stmt);
+
+    this->filter.reset(terms.size());
+    for(const std::string &term : terms) {
+        this->filter.add(term);
+    }
+}
+
+bool newsoul::SharesDB::loadCache() {
+    struct stat st;
+    std::ifstream f(this->cachefn, std::ios::binary);
+    if(!f.is_open() || stat(this->dbfn.c_str(), &st) != 0) {
+        return false;
+    }
+    std::vector<unsigned char> data(
+        (std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>()
+    );
+
+    size_t pos = 0;
+    auto unpack = [&data, &pos](size_t n, uint64_t &value) {
+        if(data.size() - pos < n) {
+            return false;
+        }
+        value = 0;
+        for(unsigned int i = 0; i < n; ++i) {
+            value |= (uint64_t)data[pos + i] << (i * 8);
+        }
+        pos += n;
+        return true;
+    };
+    auto bytes = [&data, &pos](uint64_t n, std::vector<unsigned char> &out) {
+        if(data.size() - pos < n) {
+            return false;
+        }
+        out.assign(data.begin() + pos, data.begin() + pos + n);
+        pos += n;
+        return true;
+    };
+
+    uint64_t version, size, mtime, n;
+    if(!unpack(4, version) || version != CACHE_VERSION ||
+       !unpack(8, size) || size != (uint64_t)st.st_size ||
+       !unpack(8, mtime) || mtime != (uint64_t)st.st_mtime) {
+        return false;
+    }
+    if(!unpack(4, n) || data.size() - pos < n) {
+        return false;
+    }
+    NewNet::Buffer compressed;
+    compressed.append(data.data() + pos, n);
+    pos += n;
+    if(!unpack(4, n)) {
+        return false;
+    }
+    std::map<std::string, std::vector<unsigned char>> records;
+    for(uint64_t i = 0; i < n; ++i) {
+        uint64_t length;
+        std::vector<unsigned char> path;
+        std::vector<unsigned char> record;
+        if(!unpack(4, length) || !bytes(length, path) ||
+           !unpack(4, length) || !bytes(length, record)) {
+            return false;
+        }
+        records[std::string(path.begin(), path.end())].swap(record);
+    }
+
+    this->compressed = compressed;
+    this->records.swap(records);
+    return true;
+}
+
+void newsoul::SharesDB::saveCache() {
+    struct stat st;
+    if(this->cachefn.empty() || stat(this->dbfn.c_str(), &st) != 0) {
+        return;
+    }
+
+    std::vector<unsigned char> data;
+    this->pack<uint32_t>(data, CACHE_VERSION);
+    this->pack<uint64_t>(data, st.st_size);
+    this->pack<uint64_t>(data, st.st_mtime);
+    this->pack<uint32_t>(data, this->compressed.count());
+    const unsigned char *blob = this->compressed.pullup(this->compressed.count());
+    data.insert(data.end(), blob, blob + this->compressed.count());
+    this->pack<uint32_t>(data, this->records.size());
+    for(const auto &record : this->records) {
+        this->pack(data, record.first);
+        this->pack<uint32_t>(data, record.second.size());
+        data.insert(data.end(), record.second.begin(), record.second.end());
+    }
+
+    const std::string tmp = this->cachefn + ".tmp";
+    std::ofstream f(tmp, std::ios::binary);
+    f.write((const char*)data.data(), data.size());
+    f.close();
+    if(f.good()) {
+        rename(tmp.c_str(), this->cachefn.c_str());
+    }
+}
+
+int newsoul::SharesDB::getAttrs(const std::string &fn, File *fe) const {
+    StatementCache::Statement stmt(this->stmts.get(this->db, StatementCache::ATTRS));
+
+    sqlite3_bind_text(stmt, 1, fn.c_str(), -1, SQLITE_STATIC);
     if(sqlite3_step(stmt) == SQLITE_ROW) {
-        fe->size = sqlite3_column_int(stmt, 1);
-        const unsigned char *ext = sqlite3_column_text(stmt, 2);
+        fe->size = sqlite3_column_int64(stmt, 0);
+        const unsigned char *ext = sqlite3_column_text(stmt, 1);
         fe->ext = std::string(reinterpret_cast<const char*>(ext));
-        fe->mtime = sqlite3_column_int(stmt, 3);
+        fe->mtime = sqlite3_column_int64(stmt, 2);
         fe->attrs = std::vector<unsigned int>({
+            (unsigned int)sqlite3_column_int(stmt, 3),
             (unsigned int)sqlite3_column_int(stmt, 4),
-            (unsigned int)sqlite3_column_int(stmt, 5),
-            (unsigned int)sqlite3_column_int(stmt, 6)
+            (unsigned int)sqlite3_column_int(stmt, 5)
         });
-        sqlite3_finalize(stmt);
         return 0;
     }
-    sqlite3_finalize(stmt);
     return 1;
 }
 
 newsoul::Dirs newsoul::SharesDB::contents(const std::string &fn) {
-    char *sql1 = sqlite3_mprintf(
-        "SELECT d.* FROM DIR AS d JOIN CLOSURE AS c ON d.ID=c.childID "
-        "WHERE c.parentID=(SELECT ID FROM DIR WHERE path=%Q) "
-        "ORDER BY d.type DESC; "
-        , fn.c_str()
-    );
-    const char *sql2 = "SELECT * FROM FILE WHERE path=?;";
-    sqlite3_stmt *stmt1;
-    sqlite3_stmt *stmt2;
+    StatementCache::Statement stmt(this->stmts.get(this->db, StatementCache::CONTENTS));
 
     Dirs results;
-    sqlite3_prepare_v2(this->db, sql1, -1, &stmt1, NULL);
-    sqlite3_prepare_v2(this->db, sql2, -1, &stmt2, NULL);
-    while(sqlite3_step(stmt1) == SQLITE_ROW) {
-        int type = sqlite3_column_int(stmt1, 3);
-        const unsigned char *p = sqlite3_column_text(stmt1, 1);
+    bindTree(stmt, fn);
+    while(sqlite3_step(stmt) == SQLITE_ROW) {
+        int type = sqlite3_column_int(stmt, 1);
+        const unsigned char *p = sqlite3_column_text(stmt, 0);
         const std::string path(reinterpret_cast<const char*>(p));
         if(type == 0) {
+            if(sqlite3_column_type(stmt, 3) == SQLITE_NULL) {
+                continue;
+            }
             std::vector<std::string> split = path::split(path, 1);
             std::string dirname = split[0];
             std::string basename = split[1];
 
-            File fe;
-            if(this->getAttrs(path, &fe) == 0) {
-                results[dirname][basename] = fe;
-            }
+            File &fe = results[dirname][basename];
+            fe.size = sqlite3_column_int64(stmt, 2);
+            const unsigned char *ext = sqlite3_column_text(stmt, 3);
+            fe.ext = std::string(reinterpret_cast<const char*>(ext));
+            fe.mtime = sqlite3_column_int64(stmt, 4);
+            fe.attrs = std::vector<unsigned int>({
+                (unsigned int)sqlite3_column_int(stmt, 5),
+                (unsigned int)sqlite3_column_int(stmt, 6),
+                (unsigned int)sqlite3_column_int(stmt, 7)
+            });
         } else {
             results[path];
         }
     }
 
-    sqlite3_free(sql1);
     return results;
 }
 
@@ -359,73 +713,91 @@ newsoul::Dir newsoul::SharesDB::query(const std::string &query) const {
     //Instead, it aims at providing result sets in fashion similar
     //to "normal" search engines, e.g. Google.
     //TODO: Support new fts syntax? It is not enabled anywhere FWIK.
-    const char *sql = sqlite3_mprintf(
-        "SELECT path FROM PATHS WHERE path MATCH %Q LIMIT 500;", query.c_str()
-    );
-    sqlite3_stmt *stmt;
-
     Dir results;
-    sqlite3_prepare_v2(this->db, sql, -1, &stmt, NULL);
+    if(this->index) {
+        std::vector<uint32_t> hits;
+        this->index->query(query, hits, 500);
+        for(uint32_t id : hits) {
+            this->index->file(id, results[this->index->path(id)]);
+        }
+        return results;
+    }
+
+    StatementCache::Statement stmt(this->stmts.get(this->db, StatementCache::QUERY));
+    sqlite3_bind_text(stmt, 1, query.c_str(), -1, SQLITE_STATIC);
     while(sqlite3_step(stmt) == SQLITE_ROW) {
         const unsigned char *p = sqlite3_column_text(stmt, 0);
-        const std::string path(reinterpret_cast<const char*>(p));
-        File fe;
-        this->getAttrs(path, &fe);
-        results[path] = fe;
+        File &fe = results[reinterpret_cast<const char*>(p)];
+        fe.size = sqlite3_column_int64(stmt, 1);
+        const unsigned char *ext = sqlite3_column_text(stmt, 2);
+        fe.ext = std::string(reinterpret_cast<const char*>(ext));
+        fe.mtime = sqlite3_column_int64(stmt, 3);
+        fe.attrs = std::vector<unsigned int>({
+            (unsigned int)sqlite3_column_int(stmt, 4),
+            (unsigned int)sqlite3_column_int(stmt, 5),
+            (unsigned int)sqlite3_column_int(stmt, 6)
+        });
     }
 
     return results;
 }
 
+void newsoul::SharesDB::query(const std::string &query, FileList &results) const {
+    if(!this->index) {
+        results = FileList(this->query(query));
+        return;
+    }
+
+    results.clear();
+    results.addDir(std::string());
+    std::vector<uint32_t> hits;
+    this->index->query(query, hits, 500);
+    File fe;
+    for(uint32_t id : hits) {
+        const char *path = this->index->path(id);
+        this->index->file(id, fe);
+        results.addFile(path, strlen(path), fe.size, fe.ext);
+        for(unsigned int attr : fe.attrs) {
+            results.addAttr(attr);
+        }
+    }
+}
+
 std::string newsoul::SharesDB::toProperCase(const std::string &lower) {
-    char *sql = sqlite3_mprintf(
-        "SELECT path FROM DIR WHERE LOWER(path)=%Q;"
-        , lower.c_str()
-    );
-    sqlite3_stmt *stmt;
+    StatementCache::Statement stmt(this->stmts.get(this->db, StatementCache::PROPER_CASE));
 
     std::string result;
-    sqlite3_prepare_v2(this->db, sql, -1, &stmt, NULL);
+    sqlite3_bind_text(stmt, 1, lower.c_str(), -1, SQLITE_STATIC);
     if(sqlite3_step(stmt) == SQLITE_ROW) {
         result = std::string(
             reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0))
         );
     }
-    sqlite3_finalize(stmt);
 
-    sqlite3_free(sql);
     return result;
 }
 
-unsigned int newsoul::SharesDB::getSingleValue(char *sql) {
-    sqlite3_stmt *stmt;
-
+unsigned int newsoul::SharesDB::getSingleValue(sqlite3_stmt *stmt) const {
     int value = 0;
-    sqlite3_prepare_v2(this->db, sql, -1, &stmt, NULL);
     if(sqlite3_step(stmt) == SQLITE_ROW) {
         value = sqlite3_column_int(stmt, 0);
     }
-    sqlite3_finalize(stmt);
 
-    sqlite3_free(sql);
     return value;
 }
 
 unsigned int newsoul::SharesDB::getCount(int type) {
-    char *sql = sqlite3_mprintf(
-        "SELECT COUNT(*) FROM DIR WHERE type=%d;", type
-    );
+    StatementCache::Statement stmt(this->stmts.get(this->db, StatementCache::COUNT));
 
-    return this->getSingleValue(sql);
+    sqlite3_bind_int(stmt, 1, type);
+    return this->getSingleValue(stmt);
 }
 
 bool newsoul::SharesDB::isShared(const std::string &fn) {
-    char *sql = sqlite3_mprintf(
-        "SELECT EXISTS(SELECT 1 FROM DIR WHERE path=%Q LIMIT 1);"
-        , fn.c_str()
-    );
+    StatementCache::Statement stmt(this->stmts.get(this->db, StatementCache::IS_SHARED));
 
-    return this->getSingleValue(sql);
+    sqlite3_bind_text(stmt, 1, fn.c_str(), -1, SQLITE_STATIC);
+    return this->getSingleValue(stmt);
 }
 
 unsigned int newsoul::SharesDB::filesCount() {
@@ -20,19 +20,22 @@
 #define __NEWSOUL_SHARESDB_H__
 
 #include <initializer_list>
-#include <ftw.h>
 #include <map>
 #include <sqlite3.h>
 #include <stdint.h>
 #include <sys/stat.h>
 #include <taglib/fileref.h>
 #include <queue>
+#include <set>
 #include <vector>
 #include <zlib.h>
 #include "utils/os.h"
 #include "utils/path.h"
 #include "utils/string.h"
 #include <functional>
+#include "NewNet/nnbuffer.h"
+#include "searchindex.h"
+#include "sharesscanner.h"
 
 namespace newsoul {
     class File {
@@ -56,21 +59,115 @@ namespace newsoul {
     typedef std::map<std::string, Dir> Dirs;
     typedef std::map<std::string, Dirs> Shares;
 
+    class FileList;
+
+    /*!
+     * Statements SharesDB runs over and over, each prepared only once.
+     */
+    class StatementCache {
+    public:
+        enum Id {
+            ATTRS,
+            IS_SHARED,
+            PROPER_CASE,
+            COUNT,
+            CONTENTS,
+            REMOVE,
+            QUERY,
+            SIZE
+        };
+
+        /*!
+         * Resets a statement when going out of scope,
+         * so that it is ready for the next caller.
+         */
+        class Statement {
+            sqlite3_stmt *stmt;
+
+        public:
+            Statement(sqlite3_stmt *stmt) : stmt(stmt) { }
+            ~Statement() {
+                if(this->stmt) {
+                    sqlite3_reset(this->stmt);
+                    sqlite3_clear_bindings(this->stmt);
+                }
+            }
+            operator sqlite3_stmt*() const { return this->stmt; }
+        };
+
+    private:
+        sqlite3 *db;
+        sqlite3_stmt *stmts[SIZE];
+
+    public:
+        StatementCache();
+        ~StatementCache();
+
+        /*!
+         * Gets a prepared statement, preparing it first if needed.
+         * \param db Database to run it on, all statements are
+         * prepared again if it is not the one used before.
+         * \param id Statement to get.
+         * \return Statement, NULL if it could not be prepared.
+         */
+        sqlite3_stmt *get(sqlite3 *db, Id id);
+        /*!
+         * Finalizes all statements, has to be done before closing the database.
+         */
+        void finalize();
+    };
+
     class SharesDB {
-        static SharesDB *_this;
         //FIXME: This is silly and will have to go.
         std::function<void(void)> updateApp;
-        std::vector<unsigned char> compressed;
+        /*!
+         * Compressed shares, never modified once built, so that replies
+         * to all browsing peers can share its blocks instead of copying it.
+         */
+        NewNet::Buffer compressed;
+        std::string dbfn;
+        std::string cachefn;
+        /*!
+         * Serialized SLSK records of all directories, by path.
+         */
+        std::map<std::string, std::vector<unsigned char>> records;
+        /*!
+         * Directories which records have to be serialized again.
+         */
+        std::set<std::string> dirty;
+        TermFilter filter;
+        uint64_t gen;
 
-        unsigned int getSingleValue(char *sql);
+        mutable StatementCache stmts;
+
+        unsigned int getSingleValue(sqlite3_stmt *stmt) const;
+        /*!
+         * Drops records of a removed file/directory and its subdirectories.
+         * \param path Removed path.
+         */
+        void forget(const std::string &path);
+        /*!
+         * Restores records and compressed shares saved by saveCache.
+         * Fails if the database changed since.
+         * \return True on success, false otherwise.
+         */
+        bool loadCache();
+        void saveCache();
+        /*!
+         * Fills the term filter again with all terms in the database.
+         */
+        void buildFilter();
         unsigned int getCount(int type);
 
     protected:
         sqlite3 *db;
+        /*!
+         * In-memory copy of all files for query, NULL if not enabled.
+         */
+        SearchIndex *index;
 
-        SharesDB() { }
+        SharesDB() : gen(0), index(NULL) { }
         void createDB();
-        static int add(const char *path, const struct stat *st, int type, struct FTW *ftwbuf);
         /*!
          * Retrieves file attributes from database.
          * \param fn Path to file.
@@ -97,30 +194,45 @@ namespace newsoul {
 
         template<typename T> void pack(std::vector<unsigned char> &data, T i);
         void pack(std::vector<unsigned char> &data, std::string s);
+        /*!
+         * Serializes dirty directories again and recompresses the shares.
+         * Also refreshes their files in the search index.
+         */
         void compress();
+        /*!
+         * Enables the search index and fills it from the database.
+         */
+        void buildIndex();
 
     public:
-        SharesDB(const std::string &fn, std::function<void(void)> func);
+        /*!
+         * \param fn Directory to keep the database in.
+         * \param func Called when the shares change.
+         * \param indexed Answer queries from memory instead of FTS.
+         */
+        SharesDB(const std::string &fn, std::function<void(void)> func, bool indexed=false);
         ~SharesDB();
 
         /*!
          * Adds given files/directories to the database.
-         * Directories are scanned recursively.
+         * Directories are scanned recursively, in parallel.
+         * Files which size and mtime did not change are skipped.
          * Usually used to add directories through CLI.
          * \param paths Files/directories to add.
          */
-        void add(std::initializer_list<const std::string> paths);
+        void add(const std::vector<std::string> &paths);
         /*!
          * Removes given files/directories from the database.
          * Usually used to remove directories through CLI.
          * \param paths Files/directories to remove.
          */
-        void remove(std::initializer_list<const std::string> paths);
+        void remove(const std::vector<std::string> &paths);
         /*!
          * Returns SLSK compatible, compressed version of the database.
+         * Copies of the returned buffer share its data.
          * \return Compressed DB entries.
          */
-        inline const std::vector<unsigned char> &shares() const { return this->compressed; }
+        inline const NewNet::Buffer &shares() const { return this->compressed; }
         /*!
          * Retrieves files contained within all directories
          * inside the given one.
@@ -128,11 +240,38 @@ namespace newsoul {
          * \return Files within fn.
          */
         Dirs contents(const std::string &fn);
+        /*!
+         * Finds files which paths match the query (at most 500).
+         * \param query FTS style query.
+         * \return Matching files.
+         */
         Dir query(const std::string &query) const;
+        /*!
+         * Finds files which paths match the query (at most 500).
+         * With the search index enabled, matches go straight from it
+         * into the list, without building a Dir on the way.
+         * \param query FTS style query.
+         * \param results List to fill, as a single unnamed directory.
+         */
+        void query(const std::string &query, FileList &results) const;
+        /*!
+         * Cheaply checks whether a query might match anything.
+         * \param query FTS style query.
+         * \return False if query surely matches nothing, true otherwise.
+         */
+        bool mayMatch(const std::string &query) const { return this->filter.mayMatch(query); }
+        /*!
+         * Changes every time shares change, and is never the same
+         * for two different databases, so can be used to tell
+         * whether results of query are still valid.
+         * \return Current generation.
+         */
+        inline uint64_t generation() const { return this->gen; }
         /*!
          * Repairs distorted path case.
          * Use case: We get path from an case insensitive FS (e.g. NTFS).
-         * \param lower Distorted path.
+         * Looked up through an index, so it does not matter how big shares are.
+         * \param lower Distorted path, in any case.
          * \return Repaired path.
          */
         std::string toProperCase(const std::string &lower);
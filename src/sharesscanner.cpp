@@ -0,0 +1,255 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sharesscanner.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <mutex>
+#include <set>
+#include <string.h>
+#include <taglib/fileref.h>
+#include <thread>
+#include "utils/string.h"
+#include "NewNet/nnlog.h"
+
+struct newsoul::SharesScanner::State {
+    std::mutex mutex;
+    std::condition_variable workReady;
+    std::condition_variable resultsReady;
+    /* Directories to list and files to read properties of. */
+    std::deque<ScanEntry> tasks;
+    /* Entries waiting for the sink. */
+    std::vector<ScanEntry> results;
+    /* Directories already queued, so symlink loops end. */
+    std::set<std::pair<dev_t, ino_t>> visited;
+    /* Number of workers with a task in hand. */
+    unsigned int busy;
+    /* What workers failed to do, logged by the scanning thread,
+       as log listeners may talk to sockets. */
+    struct Error {
+        const char *action;
+        std::string path;
+        int code;
+    };
+    std::vector<Error> errors;
+
+    void fail(const char *action, const std::string &path) {
+        Error error = {action, path, errno};
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->errors.push_back(error);
+    }
+};
+
+namespace {
+    std::string dirname(const std::string &path) {
+        size_t index = path.rfind('/');
+        if(index == std::string::npos) {
+            return std::string();
+        }
+        return path.substr(0, std::max(index, (size_t)1));
+    }
+
+    newsoul::ScanEntry directory(const std::string &dir, const std::string &path) {
+        newsoul::ScanEntry entry;
+        entry.path = path;
+        entry.dir = dir;
+        entry.isDir = true;
+        entry.size = 0;
+        entry.mtime = 0;
+        entry.bitrate = 0;
+        entry.length = 0;
+        entry.vbr = 0;
+        return entry;
+    }
+}
+
+newsoul::ScanEntry newsoul::ScanEntry::file(const std::string &dir, const std::string &path, const struct stat &st) {
+    ScanEntry entry = directory(dir, path);
+    entry.isDir = false;
+    entry.size = st.st_size;
+    entry.mtime = st.st_mtime;
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if(dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+        entry.ext = string::tolower(path.substr(dot + 1));
+    }
+    return entry;
+}
+
+void newsoul::ScanEntry::readAttrs(ScanEntry &entry) {
+    TagLib::FileRef fp(entry.path.c_str());
+    if(!fp.isNull() && fp.audioProperties()) {
+        TagLib::AudioProperties *props = fp.audioProperties();
+        entry.bitrate = props->bitrate();
+        entry.length = props->length();
+    }
+}
+
+newsoul::SharesScanner::SharesScanner(const Known &known, unsigned int threads) : known(known) {
+    if(threads == 0) {
+        //Reading tags is mostly waiting for the disk,
+        //so it is worth having a few workers even on a single CPU.
+        threads = std::max(4u, std::thread::hardware_concurrency());
+    }
+    this->threads = threads;
+}
+
+bool newsoul::SharesScanner::changed(const std::string &path, const struct stat &st) const {
+    auto it = this->known.find(path);
+    return (
+        it == this->known.end() ||
+        it->second.first != (uint64_t)st.st_size ||
+        it->second.second != st.st_mtime
+    );
+}
+
+void newsoul::SharesScanner::list(const ScanEntry &dir, State &state) const {
+    DIR *dp = opendir(dir.path.c_str());
+    if(dp == NULL) {
+        state.fail("list", dir.path);
+        return;
+    }
+
+    std::vector<ScanEntry> found;
+    std::vector<std::pair<dev_t, ino_t>> ids;
+    const std::string prefix = dir.path == "/" ? dir.path : dir.path + '/';
+    struct dirent *de;
+    while((de = readdir(dp)) != NULL) {
+        if(strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+            continue;
+        }
+        struct stat st;
+        const std::string path = prefix + de->d_name;
+        if(fstatat(dirfd(dp), de->d_name, &st, 0) != 0) {
+            state.fail("stat", path);
+            continue;
+        }
+        if(S_ISDIR(st.st_mode)) {
+            found.push_back(directory(dir.path, path));
+            ids.push_back(std::make_pair(st.st_dev, st.st_ino));
+        } else if(S_ISREG(st.st_mode) && this->changed(path, st)) {
+            found.push_back(ScanEntry::file(dir.path, path, st));
+            ids.push_back(std::make_pair(0, 0));
+        }
+    }
+    closedir(dp);
+
+    if(found.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        for(unsigned int i = 0; i < found.size(); ++i) {
+            if(!found[i].isDir || state.visited.insert(ids[i]).second) {
+                state.tasks.push_back(std::move(found[i]));
+            }
+        }
+    }
+    state.workReady.notify_all();
+}
+
+void newsoul::SharesScanner::work(State &state) const {
+    std::unique_lock<std::mutex> lock(state.mutex);
+    while(true) {
+        state.workReady.wait(lock, [&state] {
+            return !state.tasks.empty() || state.busy == 0;
+        });
+        if(state.tasks.empty()) {
+            break;
+        }
+        ScanEntry task = std::move(state.tasks.front());
+        state.tasks.pop_front();
+        ++state.busy;
+
+        if(task.isDir) {
+            //Goes out before anything found inside gets queued.
+            state.results.push_back(task);
+            lock.unlock();
+            state.resultsReady.notify_one();
+            this->list(task, state);
+        } else {
+            lock.unlock();
+            ScanEntry::readAttrs(task);
+            lock.lock();
+            state.results.push_back(std::move(task));
+            lock.unlock();
+            state.resultsReady.notify_one();
+        }
+
+        lock.lock();
+        if(--state.busy == 0 && state.tasks.empty()) {
+            state.workReady.notify_all();
+            state.resultsReady.notify_one();
+        }
+    }
+}
+
+void newsoul::SharesScanner::scan(const std::vector<std::string> &roots, Sink sink) {
+    State state;
+    state.busy = 0;
+    for(std::string root : roots) {
+        while(root.size() > 1 && root[root.size() - 1] == '/') {
+            root.erase(root.size() - 1);
+        }
+        struct stat st;
+        if(stat(root.c_str(), &st) != 0) {
+            NNLOG("newsoul.shares.warn", "Cannot share %s (errno: %i).", root.c_str(), errno);
+            continue;
+        }
+        if(S_ISDIR(st.st_mode)) {
+            if(state.visited.insert(std::make_pair(st.st_dev, st.st_ino)).second) {
+                state.tasks.push_back(directory(dirname(root), root));
+            }
+        } else if(S_ISREG(st.st_mode) && this->changed(root, st)) {
+            state.tasks.push_back(ScanEntry::file(dirname(root), root, st));
+        }
+    }
+
+    std::vector<std::thread> workers;
+    for(unsigned int i = 0; i < this->threads; ++i) {
+        workers.push_back(std::thread(&SharesScanner::work, this, std::ref(state)));
+    }
+
+    std::unique_lock<std::mutex> lock(state.mutex);
+    while(true) {
+        state.resultsReady.wait(lock, [&state] {
+            return !state.results.empty() || (state.busy == 0 && state.tasks.empty());
+        });
+        if(state.results.empty()) {
+            break;
+        }
+        std::vector<ScanEntry> batch;
+        batch.swap(state.results);
+        lock.unlock();
+        sink(batch);
+        lock.lock();
+    }
+    lock.unlock();
+
+    for(std::thread &worker : workers) {
+        worker.join();
+    }
+
+    for(const State::Error &error : state.errors) {
+        NNLOG("newsoul.shares.warn", "Cannot %s %s (errno: %i).", error.action, error.path.c_str(), error.code);
+    }
+}
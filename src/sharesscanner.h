@@ -0,0 +1,102 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __NEWSOUL_SHARESSCANNER_H__
+#define __NEWSOUL_SHARESSCANNER_H__
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <sys/stat.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace newsoul {
+    /*!
+     * Directory or file found while scanning shares.
+     */
+    class ScanEntry {
+    public:
+        std::string path;
+        std::string dir;
+        bool isDir;
+        uint64_t size;
+        time_t mtime;
+        std::string ext;
+        int bitrate;
+        int length;
+        int vbr;
+
+        /*!
+         * Creates a file entry, without audio properties.
+         * \param dir Directory in which the file lies.
+         * \param path Whole path (usually dir+fn).
+         * \param st Statistics structure.
+         * \return The new entry.
+         */
+        static ScanEntry file(const std::string &dir, const std::string &path, const struct stat &st);
+        /*!
+         * Fills audio properties of a file entry, if it has any.
+         * \param entry Entry to fill.
+         */
+        static void readAttrs(ScanEntry &entry);
+    };
+
+    /*!
+     * Walks shared directories on a pool of threads.
+     * Workers list directories and read audio properties in parallel,
+     * the calling thread gets the results in batches, so it can stay
+     * the only one touching the database.
+     */
+    class SharesScanner {
+    public:
+        /*!
+         * Size and mtime of files already in the database, by path.
+         */
+        typedef std::unordered_map<std::string, std::pair<uint64_t, time_t>> Known;
+        typedef std::function<void(const std::vector<ScanEntry> &)> Sink;
+
+        /*!
+         * \param known Files to skip, unless their size or mtime changed.
+         * \param threads Number of workers, 0 picks one based on CPUs.
+         */
+        SharesScanner(const Known &known, unsigned int threads=0);
+
+        /*!
+         * Scans given files/directories recursively.
+         * Every directory comes before its contents, so the sink
+         * can always refer to the parent of an entry.
+         * \param roots Files/directories to scan.
+         * \param sink Called on the calling thread with found entries.
+         */
+        void scan(const std::vector<std::string> &roots, Sink sink);
+
+    private:
+        struct State;
+
+        const Known &known;
+        unsigned int threads;
+
+        bool changed(const std::string &path, const struct stat &st) const;
+        void list(const ScanEntry &dir, State &state) const;
+        void work(State &state) const;
+    };
+}
+
+#endif // __NEWSOUL_SHARESSCANNER_H__
@@ -0,0 +1,230 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "shareswatcher.h"
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include "NewNet/nnlog.h"
+
+/* How long to wait for more events before touching the database [ms]. */
+#define FLUSH_DELAY 2000
+
+#ifdef __linux__
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+                    IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+#endif
+
+newsoul::SharesWatcher::SharesWatcher(SharesDB *db, const std::vector<std::string> &roots, std::function<void(void)> updated) {
+    this->db = db;
+    this->updated = updated;
+    for(std::string root : roots) {
+        while(root.size() > 1 && root[root.size() - 1] == '/') {
+            root.erase(root.size() - 1);
+        }
+        this->roots.push_back(root);
+    }
+
+#ifdef __linux__
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(fd == -1) {
+        NNLOG("newsoul.shares.warn", "Cannot watch shares, inotify failed (errno: %i).", errno);
+        return;
+    }
+    this->setDescriptor(fd);
+    for(const std::string &root : this->roots) {
+        this->watch(root);
+    }
+    this->setSocketState(SocketListening);
+    NNLOG("newsoul.shares.debug", "Watching %u shared directories.", this->dirs.size());
+#endif
+}
+
+newsoul::SharesWatcher::~SharesWatcher() {
+    if(this->descriptor() != -1) {
+        close(this->descriptor());
+    }
+}
+
+void newsoul::SharesWatcher::disconnect() {
+    if(this->descriptor() == -1) {
+        return;
+    }
+    if(this->flushTimeout.isValid()) {
+        this->reactor()->removeTimeout(this->flushTimeout);
+        this->flush(0);
+    }
+    close(this->descriptor());
+    this->setDescriptor(-1);
+    this->setSocketState(SocketDisconnected);
+    this->dirs.clear();
+    this->watches.clear();
+}
+
+void newsoul::SharesWatcher::watch(const std::string &path) {
+#ifdef __linux__
+    int wd = inotify_add_watch(this->descriptor(), path.c_str(), WATCH_MASK);
+    if(wd == -1) {
+        //ENOSPC means fs.inotify.max_user_watches is too low.
+        NNLOG("newsoul.shares.warn", "Cannot watch %s (errno: %i).", path.c_str(), errno);
+        return;
+    }
+    //The same directory again means a symlink loop.
+    if(!this->dirs.insert(std::make_pair(wd, path)).second) {
+        return;
+    }
+    this->watches[path] = wd;
+
+    DIR *dp = opendir(path.c_str());
+    if(dp == NULL) {
+        return;
+    }
+    struct dirent *de;
+    while((de = readdir(dp)) != NULL) {
+        if(strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+            continue;
+        }
+        const std::string child = path + '/' + de->d_name;
+        bool isDir = de->d_type == DT_DIR;
+        if(de->d_type == DT_UNKNOWN || de->d_type == DT_LNK) {
+            struct stat st;
+            isDir = stat(child.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+        }
+        if(isDir) {
+            this->watch(child);
+        }
+    }
+    closedir(dp);
+#endif
+}
+
+void newsoul::SharesWatcher::unwatch(const std::string &path) {
+#ifdef __linux__
+    const std::string prefix = path + '/';
+    auto it = this->watches.lower_bound(path);
+    while(it != this->watches.end() && (it->first == path || it->first.compare(0, prefix.size(), prefix) == 0)) {
+        inotify_rm_watch(this->descriptor(), it->second);
+        this->dirs.erase(it->second);
+        it = this->watches.erase(it);
+    }
+#endif
+}
+
+void newsoul::SharesWatcher::changed(const std::string &path) {
+    this->changes.insert(path);
+    if(!this->flushTimeout.isValid()) {
+        this->flushTimeout = this->reactor()->addTimeout(FLUSH_DELAY, this, &SharesWatcher::flush);
+    }
+}
+
+void newsoul::SharesWatcher::removed(const std::string &path) {
+    //Whatever changed inside is gone as well.
+    const std::string prefix = path + '/';
+    auto it = this->changes.lower_bound(path);
+    while(it != this->changes.end() && (*it == path || it->compare(0, prefix.size(), prefix) == 0)) {
+        it = this->changes.erase(it);
+    }
+    this->removals.insert(path);
+    if(!this->flushTimeout.isValid()) {
+        this->flushTimeout = this->reactor()->addTimeout(FLUSH_DELAY, this, &SharesWatcher::flush);
+    }
+}
+
+void newsoul::SharesWatcher::flush(long) {
+    std::vector<std::string> removals(this->removals.begin(), this->removals.end());
+    std::vector<std::string> changes(this->changes.begin(), this->changes.end());
+    this->removals.clear();
+    this->changes.clear();
+
+    NNLOG("newsoul.shares.debug", "Applying %u removed and %u changed paths.", removals.size(), changes.size());
+    //Removals go first, a path might have been deleted and created again.
+    if(!removals.empty()) {
+        this->db->remove(removals);
+    }
+    if(!changes.empty()) {
+        this->db->add(changes);
+    }
+    this->updated();
+}
+
+void newsoul::SharesWatcher::process() {
+#ifdef __linux__
+    if(!(this->readyState() & StateReceive)) {
+        return;
+    }
+
+    char buf[65536] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while((n = read(this->descriptor(), buf, sizeof(buf))) > 0) {
+        for(char *p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event*)p)->len) {
+            const struct inotify_event *ev = (const struct inotify_event*)p;
+            if(ev->mask & IN_Q_OVERFLOW) {
+                NNLOG("newsoul.shares.warn", "Lost inotify events, rescanning shares.");
+                for(const std::string &root : this->roots) {
+                    this->changed(root);
+                }
+                continue;
+            }
+            auto it = this->dirs.find(ev->wd);
+            if(it == this->dirs.end()) {
+                continue;
+            }
+            const std::string dir = it->second;
+            if(ev->mask & IN_IGNORED) {
+                auto watch = this->watches.find(dir);
+                if(watch != this->watches.end() && watch->second == ev->wd) {
+                    this->watches.erase(watch);
+                }
+                this->dirs.erase(it);
+                continue;
+            }
+            if(ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                //Subdirectories get reported by their parents.
+                if(std::find(this->roots.begin(), this->roots.end(), dir) != this->roots.end()) {
+                    this->unwatch(dir);
+                    this->removed(dir);
+                }
+                continue;
+            }
+            if(ev->len == 0) {
+                continue;
+            }
+
+            const std::string path = dir + '/' + ev->name;
+            if(ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                if(ev->mask & IN_ISDIR) {
+                    this->unwatch(path);
+                }
+                this->removed(path);
+            } else if(ev->mask & IN_ISDIR) {
+                //IN_CREATE or IN_MOVED_TO. Files might have appeared
+                //before the watch did, the add will find them.
+                this->watch(path);
+                this->changed(path);
+            } else if(ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                this->changed(path);
+            }
+        }
+    }
+#endif
+}
@@ -0,0 +1,84 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __NEWSOUL_SHARESWATCHER_H__
+#define __NEWSOUL_SHARESWATCHER_H__
+
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "sharesdb.h"
+#include "NewNet/nnreactor.h"
+#include "NewNet/nnsocket.h"
+#include "NewNet/nnweakrefptr.h"
+
+namespace newsoul {
+    /*!
+     * Keeps a shares database current while newsoul is running.
+     * Watches all shared directories with inotify (so it is a no-op on
+     * other systems). Changes are collected for a moment and then applied
+     * together, so copying a whole album costs a single add.
+     */
+    class SharesWatcher : public NewNet::Socket {
+        SharesDB *db;
+        std::function<void(void)> updated;
+        std::vector<std::string> roots;
+        std::map<int, std::string> dirs;
+        std::map<std::string, int> watches;
+        std::set<std::string> changes;
+        std::set<std::string> removals;
+        NewNet::WeakRefPtr<NewNet::Reactor::Timeout::Callback> flushTimeout;
+
+    protected:
+        /*!
+         * Starts watching a directory and all directories inside it.
+         * \param path Directory to watch.
+         */
+        void watch(const std::string &path);
+        /*!
+         * Stops watching a directory and all directories inside it.
+         * \param path Directory to stop watching.
+         */
+        void unwatch(const std::string &path);
+        void changed(const std::string &path);
+        void removed(const std::string &path);
+        void flush(long);
+
+    public:
+        /*!
+         * \param db Database to keep current.
+         * \param roots Shared directories.
+         * \param updated Called after changes were applied to the database.
+         */
+        SharesWatcher(SharesDB *db, const std::vector<std::string> &roots, std::function<void(void)> updated);
+        ~SharesWatcher();
+
+        /*!
+         * Stops watching and applies changes still waiting.
+         */
+        void disconnect();
+        /*!
+         * Reads inotify events, called by the reactor.
+         */
+        virtual void process();
+    };
+}
+
+#endif // __NEWSOUL_SHARESWATCHER_H__
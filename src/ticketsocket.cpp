@@ -50,7 +50,7 @@ newsoul::TicketSocket::findTicket() {
     NNLOG("newsoul.ticket.debug", "TicketSocket got %u bytes", receiveBuffer().count());
     // Unpack the ticket
     if (receiveBuffer().count() >= 4 ) {
-        unsigned char * data = receiveBuffer().data();
+        const unsigned char * data = receiveBuffer().pullup(4);
         m_Ticket = data[0] + (data[1] << 8) + (data[2] << 16) + (data[3] << 24);
         receiveBuffer().seek(4);
     }
@@ -21,6 +21,9 @@
 
 #include "uploadmanager.h"
 #include "ifacemanager.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /**
   * Constructor
@@ -39,7 +42,7 @@ newsoul::Upload::Upload(newsoul::Newsoul * newsoul, const std::string & user, co
     m_TicketValid = false;
     m_State = TS_Offline;
     m_Collected = 0;
-    m_File = 0;
+    m_File = -1;
 
 	m_CollectStart.tv_sec = m_CollectStart.tv_usec = 0;
 
@@ -75,13 +78,16 @@ newsoul::Upload::setState(TrState state)
         case TS_Aborted:
         case TS_RemoteError:
         case TS_LocalError:
+        {
             closeFile();
 
-            if(m_Socket.isValid()) {
-                m_Socket->disconnect();
+            NewNet::RefPtr<UploadSocket> socket = m_Socket.lock();
+            if(socket.isValid()) {
+                socket->stop();
                 m_Socket = 0;
             }
             break;
+        }
 
         case TS_Finished:
         case TS_ConnectionClosed:
@@ -162,15 +168,17 @@ void
 newsoul::Upload::setSocket(UploadSocket * socket)
 {
     // If we already have an upload socket, first stop it and then replace it by the new one
-    if(m_Socket.isValid() && (m_Socket != socket))
-        m_Socket->stop();
+    NewNet::RefPtr<UploadSocket> previous = m_Socket.lock();
+    if(previous.isValid() && (previous != socket))
+        previous->stop();
 
     m_Socket = socket;
 
 	m_CollectStart.tv_sec = m_CollectStart.tv_usec = 0;
 
     if (socket) {
-        socket->setUpRateLimiter(newsoul()->uploads()->limiter());
+        // Every transfer gets its share of the user's share of the global limit
+        socket->setUpRateLimiter(new NewNet::RateLimiter(newsoul()->uploads()->userLimiter(m_User)));
         if (m_WaitingTimeout.isValid())
             newsoul()->reactor()->removeTimeout(m_WaitingTimeout);
     }
@@ -190,10 +198,15 @@ newsoul::Upload::setPosition(uint64 position)
   * Close the file. the ifstream object can only be used once so delete it. We'll create a new one later if needed.
   */
 void newsoul::Upload::closeFile() {
-    if (m_File) {
+    if (m_File >= 0) {
         NNLOG("newsoul.up.debug", "Closing %s", m_LocalPath.c_str());
-        delete m_File;
-        m_File = 0;
+        // The socket must not stream from a closed descriptor, it closes it itself
+        NewNet::RefPtr<UploadSocket> socket = m_Socket.lock();
+        if (socket.isValid())
+            socket->closeFile(m_File);
+        else
+            close(m_File);
+        m_File = -1;
     }
 }
 
@@ -204,19 +217,16 @@ bool newsoul::Upload::openFile()
 {
     closeFile();
 
-	m_File = new std::ifstream(m_LocalPath.c_str(), std::fstream::in | std::fstream::binary);
+	m_File = open(m_LocalPath.c_str(), O_RDONLY);
 
-	if(m_File->fail() || !m_File->is_open()) {
+	struct stat st;
+	if(m_File < 0 || fstat(m_File, &st) != 0) {
 	    NNLOG("newsoul.up.warn", "Error while opening %s", m_LocalPath.c_str());
+	    closeFile();
 		return false;
 	}
 
-    // go to the end of the file
-    m_File->seekg( 0, std::ios_base::end );
-    // the position = size of the file
-    m_Size = m_File->tellg();
-    // go back to previous position
-    m_File->seekg( 0,  std::ios_base::beg ) ;
+    m_Size = st.st_size;
 
     NNLOG("newsoul.up.debug", "Opening file %s (size: %i)", m_LocalPath.c_str(), size());
 
@@ -227,42 +237,36 @@ bool newsoul::Upload::openFile()
   * Seek to the position 'pos' in the file
   */
 bool newsoul::Upload::seek(uint64 pos) {
-    if (pos < 0 || pos > m_Size) {
-        NNLOG("newsoul.up.warn", "Wrong seeking position: %u (max size: %u)", pos, m_Size);
+	if (m_File < 0)
+		return false;
+
+    // The file may have changed since it was opened
+    struct stat st;
+    if (fstat(m_File, &st) == 0)
+        m_Size = st.st_size;
+
+    if (pos > m_Size) {
+        NNLOG("newsoul.up.warn", "Wrong seeking position: %llu (max size: %llu)", pos, m_Size);
         return false;
     }
 
-	NNLOG("newsoul.up.debug", "seeking to %u", pos);
+	NNLOG("newsoul.up.debug", "seeking to %llu", pos);
 	setState(TS_Transferring);
 
-	m_File->seekg(pos, std::ios_base::beg);
-
-	if (!m_File)
-		return false;
-
 	m_Position = pos;
 
 	return true;
 }
 
 /**
-  * Reads some data in the file and put it in the send buffer
+  * Queues the rest of the file on the socket. It goes out straight from the file (see NewNet::ClientSocket::sendFile)
   */
-bool newsoul::Upload::read(NewNet::Buffer & buffer) {
-    NNLOG("newsoul.up.debug", "Reading from file");
-
-    if(!m_Socket)
+bool newsoul::Upload::stream() {
+    if(!m_Socket || m_File < 0 || m_Position > m_Size)
         return false;
 
-	char buf[1024 * 1024];
-
-	m_File->read(buf, 1024 * 1024);
-	int64_t count = m_File->gcount();
-	if(count == -1)
-		return false;
-
-    NNLOG("newsoul.up.debug", "Appending %u bytes to the buffer", count);
-    m_Socket->send((const unsigned char *) &buf, count);
+    NNLOG("newsoul.up.debug", "Streaming %llu bytes from position %llu", m_Size - m_Position, m_Position);
+    m_Socket->sendFile(m_File, m_Position, m_Size - m_Position);
 
 	return true;
 }
@@ -539,6 +543,33 @@ void newsoul::UploadManager::checkUploads() {
 	}
 }
 
+/**
+  * Get (or create) the rate limiter for the uploads to this user
+  */
+NewNet::RefPtr<NewNet::RateLimiter>
+newsoul::UploadManager::userLimiter(const std::string & user)
+{
+    // Locked, the last transfer to the user might let go of it on another loop
+    std::map<std::string, NewNet::WeakRefPtr<NewNet::RateLimiter> >::iterator it = m_UserLimiters.find(user);
+    if (it != m_UserLimiters.end()) {
+        NewNet::RefPtr<NewNet::RateLimiter> limiter = it->second.lock();
+        if (limiter.isValid())
+            return limiter;
+    }
+
+    // Forget about the users whose uploads are all gone
+    for (it = m_UserLimiters.begin(); it != m_UserLimiters.end();) {
+        if (!it->second.isValid())
+            m_UserLimiters.erase(it++);
+        else
+            ++it;
+    }
+
+    NewNet::RefPtr<NewNet::RateLimiter> limiter = new NewNet::RateLimiter(m_Limiter);
+    m_UserLimiters[user] = limiter.ptr();
+    return limiter;
+}
+
 /**
   * Update the rate limiter for every uploads
   */
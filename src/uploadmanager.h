@@ -45,7 +45,7 @@ namespace newsoul
     bool openFile();
     void closeFile();
     bool seek(uint64 pos);
-    bool read(NewNet::Buffer & buffer);
+    bool stream();
     void sent(uint count);
     void collect(uint bytes);
 
@@ -85,7 +85,7 @@ namespace newsoul
 
     NewNet::WeakRefPtr<Newsoul>         m_Newsoul; // Ref to the newsoul
 
-    std::ifstream *                     m_File; // The file we need to send
+    int                                 m_File; // Descriptor of the file we need to send
     NewNet::WeakRefPtr<UploadSocket>    m_Socket; // Ref to the socket associated
 
     std::string                         m_User; // Name of the user
@@ -169,6 +169,10 @@ namespace newsoul
 
     NewNet::RateLimiter * limiter() {return m_Limiter;}
 
+    /* Returns the rate limiter shared by the uploads to a user. It takes
+       its part of limiter(), split evenly between all users. */
+    NewNet::RefPtr<NewNet::RateLimiter> userLimiter(const std::string & user);
+
     /* A transfer connection was initiated by a remote peer. */
     NewNet::Event<TicketSocket *> transferTicketReceivedEvent;
 
@@ -197,6 +201,8 @@ namespace newsoul
     std::map<std::string, NewNet::WeakRefPtr<Upload> >      m_Initiating;   // List of all the uploads currently being initiated
     std::map<std::string, NewNet::WeakRefPtr<Upload> >      m_Uploading;    // List of user we're currently uploading
     NewNet::RefPtr<NewNet::RateLimiter>                     m_Limiter;      // Rate limiter shared between uploads
+    std::map<std::string, NewNet::WeakRefPtr<NewNet::RateLimiter> >
+                                                            m_UserLimiters; // Rate limiters shared between the uploads to a user
     NewNet::WeakRefPtr<NewNet::Event<const PTransferReply *>::Callback>
                                                             m_TransferReplyCallback; // Callback to the transferreply event
   };
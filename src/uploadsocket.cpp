@@ -18,6 +18,7 @@
 
  */
 
+#include <unistd.h>
 #include "uploadsocket.h"
 #include "ticketsocket.h"
 
@@ -30,6 +31,9 @@ newsoul::UploadSocket::UploadSocket(newsoul::Newsoul * newsoul, newsoul::Upload
 
     m_lastDataSentCount = 0;
 
+    // Bulk transfer, move as much as possible per wake up.
+    setSendSize(262144);
+
     m_Upload->setState(TS_Establishing);
 
     // Connect disconnected event.
@@ -50,15 +54,23 @@ newsoul::UploadSocket::~UploadSocket()
 void
 newsoul::UploadSocket::onDisconnected(ClientSocket * socket)
 {
-	if(m_Upload->state() == TS_RemoteError || m_Upload->state() == TS_LocalError)
-		return;
+    if(! m_Upload)
+        return;
+
+    // We're done with the upload, it's let go of on the main loop
+    NewNet::RefPtr<Upload> upload(m_Upload);
+    m_Upload = 0;
+    toMain([upload]() mutable {
+        if(upload->state() == TS_RemoteError || upload->state() == TS_LocalError)
+            return;
 
-	NNLOG("newsoul.up.debug", "UploadSocket disconnected");
+        NNLOG("newsoul.up.debug", "UploadSocket disconnected");
 
-	if(m_Upload->position() >= m_Upload->size())
-		m_Upload->setState(TS_Finished);
-	else
-		m_Upload->setState(TS_ConnectionClosed);
+        if(upload->position() >= upload->size())
+            upload->setState(TS_Finished);
+        else
+            upload->setState(TS_ConnectionClosed);
+    });
 }
 
 /*
@@ -67,7 +79,7 @@ newsoul::UploadSocket::onDisconnected(ClientSocket * socket)
 void
 newsoul::UploadSocket::onCannotConnect(ClientSocket * socket)
 {
-	if(m_Upload->state() == TS_RemoteError || m_Upload->state() == TS_LocalError)
+	if(! m_Upload || m_Upload->state() == TS_RemoteError || m_Upload->state() == TS_LocalError)
 		return;
 
 	NNLOG("newsoul.up.debug", "UploadSocket connection cannot be established");
@@ -79,7 +91,14 @@ void
 newsoul::UploadSocket::send(const unsigned char * data, size_t n)
 {
     ClientSocket::send(data, n);
-    m_lastDataSentCount = sendBuffer().count();
+    m_lastDataSentCount = sendBuffer().count() + sendFileLeft();
+}
+
+void
+newsoul::UploadSocket::sendFile(int fd, off_t offset, size_t n)
+{
+    ClientSocket::sendFile(fd, offset, n);
+    m_lastDataSentCount = sendBuffer().count() + sendFileLeft();
 }
 
 void
@@ -92,7 +111,7 @@ newsoul::UploadSocket::wait()
 
     // Wait for an incoming connection (via TicketSocket).
     m_Upload->setState(TS_Waiting);
-    newsoul()->uploads()->transferTicketReceivedEvent.connect(this, &UploadSocket::onTransferTicketReceived);
+    m_TicketReceived = newsoul()->uploads()->transferTicketReceivedEvent.connect(this, &UploadSocket::onTransferTicketReceived);
 }
 
 /*
@@ -102,7 +121,20 @@ void
 newsoul::UploadSocket::stop()
 {
     NNLOG("newsoul.up.debug", "Disconnecting upload socket...");
-    disconnect();
+    onLoop([this]() { disconnect(); });
+}
+
+/*
+    Stops streaming from the upload's file and closes it. The socket might be sending from it
+    on another loop right now, so it's closed there
+*/
+void
+newsoul::UploadSocket::closeFile(int fd)
+{
+    onLoop([this, fd]() {
+        sendFile(-1, 0, 0);
+        ::close(fd);
+    });
 }
 
 /*
@@ -144,26 +176,25 @@ void newsoul::UploadSocket::onDataReceived(NewNet::ClientSocket * socket) {
     Called when the data has been sent and we need to send new data
 */
 void newsoul::UploadSocket::onDataSent(NewNet::ClientSocket * socket) {
-    if (m_Upload->state() == TS_Transferring) {
+    // Streaming starts once we have the position, see findPosition()
+    if (mHavePos) {
         if (m_DataTimeout.isValid())
-            newsoul()->reactor()->removeTimeout(m_DataTimeout);
-
-        m_DataTimeout = newsoul()->reactor()->addTimeout(60000, this, &UploadSocket::dataTimeout);
+            reactor()->addTimeout(60000, m_DataTimeout);
+        else
+            m_DataTimeout = reactor()->addTimeout(60000, this, &UploadSocket::dataTimeout);
 
+        // The whole file is queued already, just account for what went out
+        size_t waiting = sendBuffer().count() + sendFileLeft();
         size_t sent = 0;
-        if (m_lastDataSentCount > sendBuffer().count())
-            sent = m_lastDataSentCount - sendBuffer().count();
-
-        m_Upload->sent(sent);
-        m_lastDataSentCount = sendBuffer().count();
-
-        if(sendBuffer().count() < 10240 && (m_Upload->position() + (uint64) sendBuffer().count() < m_Upload->size())) {
-            if(! m_Upload->read(sendBuffer())) {
-                NNLOG("newsoul.up.debug", "read error");
-                m_Upload->setLocalError("File error");
-                stop();
-            }
-        }
+        if (m_lastDataSentCount > waiting)
+            sent = m_lastDataSentCount - waiting;
+
+        NewNet::RefPtr<Upload> upload(m_Upload);
+        toMain([upload, sent]() mutable {
+            if (upload->state() == TS_Transferring)
+                upload->sent(sent);
+        });
+        m_lastDataSentCount = waiting;
     }
 }
 
@@ -174,12 +205,12 @@ void newsoul::UploadSocket::onDataSent(NewNet::ClientSocket * socket) {
 void
 newsoul::UploadSocket::onTransferTicketReceived(TicketSocket * socket)
 {
-    if((m_Upload->state() == TS_Waiting) && (m_Upload->ticket() == socket->ticket()) && (m_Upload->user() == socket->user())) {
+    if(m_Upload && (m_Upload->state() == TS_Waiting) && (m_Upload->ticket() == socket->ticket()) && (m_Upload->user() == socket->user())) {
         // Steal the socket and its data.
         setDescriptor(socket->descriptor());
         setSocketState(SocketConnected);
-        receiveBuffer() = socket->receiveBuffer();
-        sendBuffer() = socket->sendBuffer();
+        receiveBuffer().take(socket->receiveBuffer());
+        sendBuffer().take(socket->sendBuffer());
 
         NNLOG("newsoul.up.debug", "got %u bytes in uploadsocket", receiveBuffer().count());
 
@@ -196,7 +227,7 @@ newsoul::UploadSocket::findPosition() {
         // Getting the position
         uint64 pos = 0;
         for(int i = 0; i < 8; i++) {
-            pos += receiveBuffer().data()[0] << (i*8);
+            pos += receiveBuffer().pullup(1)[0] << (i*8);
             receiveBuffer().seek(1);
         }
         NNLOG("newsoul.up.debug", "Uploading from pos %i", pos);
@@ -213,16 +244,19 @@ newsoul::UploadSocket::findPosition() {
         mHavePos = true;
 
         // Try to send the data
-        if(! m_Upload->read(sendBuffer())) {
+        if(! m_Upload->stream()) {
             NNLOG("newsoul.up.warn", "read error");
             m_Upload->setLocalError("File error");
             stop();
             return;
         }
-        NNLOG("newsoul.up.debug", "have %i in sending buffer", sendBuffer().count());
+        NNLOG("newsoul.up.debug", "have %i waiting to be sent", sendBuffer().count() + sendFileLeft());
 
         // Change the state.
         m_Upload->setState(TS_Transferring);
+
+        // The rest is bulk, it runs on a loop of its own.
+        handOver();
     }
 
     if(mHavePos)
@@ -230,6 +264,29 @@ newsoul::UploadSocket::findPosition() {
         receiveBuffer().clear();
 }
 
+/*
+    The socket moves to another loop, nothing on the main one may call it anymore
+*/
+void
+newsoul::UploadSocket::onHandingOver()
+{
+    UserSocket::onHandingOver();
+
+    if (m_TicketReceived.isValid())
+        m_TicketReceived->disconnect();
+    if (m_DataTimeout.isValid())
+        reactor()->removeTimeout(m_DataTimeout);
+}
+
+/*
+    The socket arrived on its new loop, the data timeout starts over there
+*/
+void
+newsoul::UploadSocket::onHandedOver()
+{
+    m_DataTimeout = reactor()->addTimeout(60000, this, &UploadSocket::dataTimeout);
+}
+
 /*
     Called when we cannot send any data in this socket
 */
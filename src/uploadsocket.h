@@ -37,9 +37,13 @@ namespace newsoul
     void wait();
     void stop();
     void send(const unsigned char * data, size_t n);
+    void sendFile(int fd, off_t offset, size_t n);
     void sendTicket();
+    void closeFile(int fd);
 
   private:
+    void onHandingOver();
+    void onHandedOver();
     void onDisconnected(NewNet::ClientSocket * socket);
     void onCannotConnect(NewNet::ClientSocket * socket);
     void onTransferTicketReceived(TicketSocket * socket);
@@ -50,8 +54,9 @@ namespace newsoul
 
     NewNet::RefPtr<Upload>  m_Upload; // Reference to the upload
 	bool                    mHavePos; // Have we already received the position sent by the downloader?
-	size_t                  m_lastDataSentCount; // What was the last data count in the buffer?
+	size_t                  m_lastDataSentCount; // What was the last count of bytes waiting to be sent?
     NewNet::WeakRefPtr<NewNet::Event<long>::Callback> m_DataTimeout;
+    NewNet::WeakRefPtr<NewNet::Event<TicketSocket *>::Callback> m_TicketReceived;
   };
 }
 
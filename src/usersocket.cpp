@@ -21,23 +21,23 @@
 #include "usersocket.h"
 #include "servermanager.h"
 
-newsoul::UserSocket::UserSocket(newsoul::Newsoul * newsoul, const std::string & type) : NewNet::TcpClientSocket(), m_Newsoul(newsoul), m_Type(type)
+newsoul::UserSocket::UserSocket(newsoul::Newsoul * newsoul, const std::string & type) : NewNet::TcpClientSocket(), m_Newsoul(newsoul), m_Loop(0), m_Type(type)
 {
   disconnectedEvent.connect(this, &UserSocket::onDisconnected);
-  m_Newsoul->server()->cannotConnectNotifyReceivedEvent.connect(this, &UserSocket::onCannotConnectNotify);
+  m_CannotConnectNotify = m_Newsoul->server()->cannotConnectNotifyReceivedEvent.connect(this, &UserSocket::onCannotConnectNotify);
 }
 
-newsoul::UserSocket::UserSocket(newsoul::HandshakeSocket * that, const std::string & type) : NewNet::TcpClientSocket(), m_Newsoul(that->newsoul()), m_Type(type)
+newsoul::UserSocket::UserSocket(newsoul::HandshakeSocket * that, const std::string & type) : NewNet::TcpClientSocket(), m_Newsoul(that->newsoul()), m_Loop(0), m_Type(type)
 {
   disconnectedEvent.connect(this, &UserSocket::onDisconnected);
-  m_Newsoul->server()->cannotConnectNotifyReceivedEvent.connect(this, &UserSocket::onCannotConnectNotify);
+  m_CannotConnectNotify = m_Newsoul->server()->cannotConnectNotifyReceivedEvent.connect(this, &UserSocket::onCannotConnectNotify);
 
   m_Token = that->token();
   m_User = that->user();
 
   setDescriptor(that->descriptor());
   setSocketState(SocketConnected);
-  receiveBuffer() = that->receiveBuffer();
+  receiveBuffer().take(that->receiveBuffer());
 }
 
 newsoul::UserSocket::~UserSocket()
@@ -49,8 +49,9 @@ newsoul::UserSocket::~UserSocket()
 void
 newsoul::UserSocket::onDisconnected(NewNet::ClientSocket *)
 {
-  // Just in case this socket is still registered
-  m_Newsoul->peers()->removePassiveConnectionWaiting(m_Token);
+  // Just in case this socket is still registered (see onHandingOver())
+  if(! m_Loop)
+    m_Newsoul->peers()->removePassiveConnectionWaiting(m_Token);
 
   if(reactor())
     reactor()->remove(this);
@@ -76,7 +77,8 @@ newsoul::UserSocket::initiateActive()
   HInitiate handshake(m_Newsoul->server()->username(), m_Type, m_Token);
   sendMessage(handshake.make_network_packet());
 
-  m_Newsoul->server()->peerAddressReceivedEvent.connect(this, &UserSocket::onServerPeerAddressReceived);
+  if(! m_PeerAddressReceived.isValid())
+    m_PeerAddressReceived = m_Newsoul->server()->peerAddressReceivedEvent.connect(this, &UserSocket::onServerPeerAddressReceived);
   SGetPeerAddress msg(m_User);
   m_Newsoul->server()->sendMessage(msg.make_network_packet());
 }
@@ -102,10 +104,9 @@ newsoul::UserSocket::firewallPierced(newsoul::HandshakeSocket * socket)
 
     setSocketState(SocketConnected);
     setDescriptor(socket->descriptor());
-    receiveBuffer() = socket->receiveBuffer();
+    receiveBuffer().take(socket->receiveBuffer());
     if(! receiveBuffer().empty())
         dataReceivedEvent(this);
-    socket->receiveBuffer().clear();
     connectedEvent(this);
 }
 
@@ -187,5 +188,84 @@ newsoul::UserSocket::sendMessage(const NewNet::Buffer & buffer)
   buf[2] = (buffer.count() >> 16) & 0xff;
   buf[3] = (buffer.count() >> 24) & 0xff;
   send(buf, 4);
-  send(buffer.data(), buffer.count());
+  send(buffer);
+}
+
+void
+newsoul::UserSocket::handOver()
+{
+  // No loop to go to besides the main one
+  if(! reactor() || (m_Newsoul->transfers()->size() == 1))
+    return;
+
+  /* Keep the socket alive until it's moved, the reference travels along
+     and is dropped on the loop it ends up on */
+  ++(refCounter());
+  UserSocket * socket = this;
+  reactor()->post([socket]() {
+    NewNet::ReactorPool * pool = socket->m_Newsoul->transfers();
+    NewNet::Reactor * loop = pool->next();
+
+    // Gone meanwhile, or there's no other loop to go to
+    if(! socket->reactor() || (socket->socketState() != SocketConnected) || (loop == socket->reactor()))
+    {
+      if(--(socket->refCounter()))
+        delete socket;
+      return;
+    }
+
+    NNLOG("newsoul.user.debug", "Handing the connection to %s over to another loop.", socket->m_User.c_str());
+    socket->m_Loop = loop;
+    socket->onHandingOver();
+    pool->assign(socket, loop);
+
+    loop->post([socket]() {
+      socket->onHandedOver();
+      if(--(socket->refCounter()))
+        delete socket;
+    });
+  });
+}
+
+void
+newsoul::UserSocket::onHandingOver()
+{
+  if(m_CannotConnectNotify.isValid())
+    m_CannotConnectNotify->disconnect();
+  if(m_PeerAddressReceived.isValid())
+    m_PeerAddressReceived->disconnect();
+
+  if(m_PassiveConnectTimeout.isValid())
+    m_Newsoul->reactor()->removeTimeout(m_PassiveConnectTimeout);
+  m_PassiveConnectTimeout = 0;
+  m_Newsoul->peers()->removePassiveConnectionWaiting(m_Token);
+}
+
+void
+newsoul::UserSocket::onLoop(const NewNet::Reactor::Task & task)
+{
+  if(! m_Loop)
+  {
+    task();
+    return;
+  }
+
+  /* Keep the socket alive until task ran, the reference is dropped on
+     the loop, like in NewNet::ReactorPool::assign() */
+  ++(refCounter());
+  UserSocket * socket = this;
+  m_Loop->post([socket, task]() {
+    task();
+    if(--(socket->refCounter()))
+      delete socket;
+  });
+}
+
+void
+newsoul::UserSocket::toMain(const NewNet::Reactor::Task & task)
+{
+  if(m_Loop)
+    m_Newsoul->reactor()->post(task);
+  else
+    task();
 }
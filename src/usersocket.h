@@ -52,10 +52,32 @@ namespace newsoul
 
     void firewallPierced(HandshakeSocket * socket);
 
+    /* Run task on the loop the socket runs on. Until the socket is handed
+       over (see handOver()), that's the main loop and task runs right
+       away. The transfers use this to reach their sockets. */
+    void onLoop(const NewNet::Reactor::Task & task);
+
   protected:
     void initiateActive();
     void initiatePassive();
 
+    /* Move the socket to a loop of the transfer pool, once the reactor is
+       done with the current event. Called when a bulk transfer starts,
+       from then on the socket only reaches the rest of newsoul through
+       toMain(). */
+    void handOver();
+
+    /* Run task on the main loop, right away until the socket is handed
+       over. Tasks hold on to what they need, the transfer in particular. */
+    void toMain(const NewNet::Reactor::Task & task);
+
+    /* Let go of everything tying the socket to the main loop, right
+       before it moves. */
+    virtual void onHandingOver();
+
+    /* Called on the new loop once the socket is there. */
+    virtual void onHandedOver() { }
+
     void onServerPeerAddressReceived(const SGetPeerAddress * message);
     void onCannotReverseConnect(NewNet::ClientSocket *);
     void onFirewallPierceTimedOut(long);
@@ -65,6 +87,9 @@ namespace newsoul
   private:
     NewNet::WeakRefPtr<Newsoul> m_Newsoul;
     NewNet::WeakRefPtr<NewNet::Event<long>::Callback> m_PassiveConnectTimeout;
+    NewNet::WeakRefPtr<NewNet::Event<const SCannotConnect *>::Callback> m_CannotConnectNotify;
+    NewNet::WeakRefPtr<NewNet::Event<const SGetPeerAddress *>::Callback> m_PeerAddressReceived;
+    NewNet::Reactor * m_Loop; // Transfer loop the socket was handed over to
 
     std::string m_Type, m_User;
     uint m_Token;
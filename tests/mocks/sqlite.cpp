@@ -28,9 +28,13 @@ void sqlite_profile(void *db, const char *sql, sqlite3_uint64 time) {
     printf("!PROFILE! last insert rowid: %lld\n", rowid);
 }
 
-mocks::SqliteMock::SqliteMock(TSharesDB *sharesdb) {
+mocks::SqliteMock::SqliteMock(TSharesDB *sharesdb, const char *before) {
     //sqlite3_open("/home/kenji/tmp/d.db", &this->db);
     sqlite3_open(":memory:", &this->db);
+    if(before) {
+        //E.g. an older schema, for createDB to migrate.
+        sqlite3_exec(this->db, before, NULL, NULL, NULL);
+    }
     sharesdb->setDB(this->db);
     sharesdb->createDB();
     //sqlite3_trace(this->db, sqlite_trace, this->db);
@@ -156,3 +160,20 @@ bool mocks::SqliteMock::assertFiles(std::initializer_list<const std::string> fil
 
     return exists;
 }
+
+int mocks::SqliteMock::countPaths() {
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(this->db, "SELECT COUNT(*) FROM PATHS;", -1, &stmt, NULL);
+    int count = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : -1;
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+bool mocks::SqliteMock::hasSchema(const char *name) {
+    sqlite3_stmt *stmt;
+    sqlite3_prepare_v2(this->db, "SELECT 1 FROM sqlite_master WHERE name=?;", -1, &stmt, NULL);
+    sqlite3_bind_text(stmt, 1, name, -1, SQLITE_STATIC);
+    bool exists = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+    return exists;
+}
@@ -34,6 +34,7 @@ public:
     using newsoul::SharesDB::addDir;
     using newsoul::SharesDB::pack;
     using newsoul::SharesDB::compress;
+    using newsoul::SharesDB::buildIndex;
 
     void setDB(sqlite3 *db) { this->db = db; }
 };
@@ -46,7 +47,7 @@ namespace mocks {
         bool assertDIR(std::initializer_list<const std::string> paths, int type);
 
     public:
-        SqliteMock(TSharesDB *sharesdb);
+        SqliteMock(TSharesDB *sharesdb, const char *before=NULL);
 
         void insertAttrs(const char *fn, int parentID=0);
         void insertAttrsDifferent(const char *fn);
@@ -57,6 +58,8 @@ namespace mocks {
 
         bool assertDirs(std::initializer_list<const std::string> paths);
         bool assertFiles(std::initializer_list<const std::string> files, bool props);
+        int countPaths();
+        bool hasSchema(const char *name);
     };
 }
 
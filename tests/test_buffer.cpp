@@ -0,0 +1,295 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <string.h>
+#include <CppUTest/TestHarness.h>
+#include "../src/NewNet/nnbuffer.h"
+
+namespace {
+    // Larger than a single block of the pool.
+    const size_t BIG = 40000;
+
+    void append(NewNet::Buffer &buffer, const std::string &s) {
+        buffer.append((const unsigned char *)s.data(), s.size());
+    }
+
+    std::string str(const NewNet::Buffer &buffer) {
+        if(buffer.empty()) {
+            return std::string();
+        }
+        return std::string((const char *)buffer.data(), buffer.count());
+    }
+
+    int segments(const NewNet::Buffer &buffer) {
+        struct iovec iov[64];
+        return buffer.segments(iov, 64, buffer.count());
+    }
+
+    // Wether any byte of a is stored in the same memory as a byte of b.
+    bool overlap(const NewNet::Buffer &a, const NewNet::Buffer &b) {
+        struct iovec ia[64], ib[64];
+        int na = a.segments(ia, 64, a.count());
+        int nb = b.segments(ib, 64, b.count());
+        for(int i = 0; i < na; ++i) {
+            const char *s = (const char *)ia[i].iov_base;
+            for(int j = 0; j < nb; ++j) {
+                const char *t = (const char *)ib[j].iov_base;
+                if((s < t + ib[j].iov_len) && (t < s + ia[i].iov_len)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // A buffer made of n slices of different blocks.
+    void appendSlices(NewNet::Buffer &buffer, int n) {
+        for(int i = 0; i < n; ++i) {
+            NewNet::Buffer piece;
+            append(piece, std::string(1, 'a' + i));
+            buffer.append(piece);
+        }
+    }
+}
+
+TEST_GROUP(buffer) { };
+TEST(buffer, append_to_copy) {
+    NewNet::Buffer original;
+    append(original, "abc");
+
+    NewNet::Buffer copy(original);
+    append(copy, "xyz");
+    append(original, "123");
+
+    CHECK_EQUAL("abc123", str(original));
+    CHECK_EQUAL("abcxyz", str(copy));
+}
+TEST(buffer, append_to_part) {
+    NewNet::Buffer original;
+    append(original, "hello world");
+
+    NewNet::Buffer part(original, 0, 5);
+    append(part, "!");
+
+    CHECK_EQUAL("hello!", str(part));
+    CHECK_EQUAL("hello world", str(original));
+}
+TEST(buffer, seek) {
+    NewNet::Buffer buffer;
+    appendSlices(buffer, 4);
+
+    buffer.seek(1);
+    CHECK_EQUAL("bcd", str(buffer));
+    buffer.seek(3);
+    CHECK(buffer.empty());
+    append(buffer, "e");
+    CHECK_EQUAL("e", str(buffer));
+}
+TEST(buffer, unshare) {
+    NewNet::Buffer original;
+    original.append((const unsigned char *)"hello world", 11);
+    NewNet::Buffer copy(original, 6, 5);
+    const unsigned char *before = copy.pullup(5);
+
+    copy.unshare();
+
+    CHECK_EQUAL(5, copy.count());
+    CHECK(copy.pullup(5) != before);
+    CHECK(memcmp("world", copy.pullup(5), 5) == 0);
+    CHECK(memcmp("hello world", original.pullup(11), 11) == 0);
+
+    // Nothing is shared anymore, so nothing is copied again
+    const unsigned char *after = copy.pullup(5);
+    copy.unshare();
+    CHECK(copy.pullup(5) == after);
+}
+TEST(buffer, unshare_slices) {
+    NewNet::Buffer original;
+    appendSlices(original, 4);
+    append(original, std::string(BIG, 'x'));
+    NewNet::Buffer copy(original);
+    CHECK(overlap(original, copy));
+
+    copy.unshare();
+
+    CHECK_FALSE(overlap(original, copy));
+    CHECK(str(original) == str(copy));
+}
+
+TEST_GROUP(bufferReserve) { };
+TEST(bufferReserve, contiguous) {
+    NewNet::Buffer buffer;
+    append(buffer, "abc");
+    struct iovec iov[1];
+
+    int count = buffer.reserve(BIG, iov, 1);
+
+    CHECK_EQUAL(1, count);
+    CHECK(iov[0].iov_len >= BIG);
+    memset(iov[0].iov_base, 'x', BIG);
+    buffer.commit(BIG);
+    CHECK_EQUAL(3 + BIG, buffer.count());
+    CHECK("abc" + std::string(BIG, 'x') == str(buffer));
+}
+TEST(bufferReserve, several_blocks) {
+    NewNet::Buffer buffer;
+    append(buffer, "abc");
+    struct iovec iov[8];
+
+    int count = buffer.reserve(BIG, iov, 8);
+
+    CHECK(count > 1);
+    size_t total = 0;
+    for(int i = 0; i < count; ++i) {
+        memset(iov[i].iov_base, 'a' + i, iov[i].iov_len);
+        total += iov[i].iov_len;
+    }
+    CHECK(total >= BIG);
+    buffer.commit(total);
+    CHECK_EQUAL(3 + total, buffer.count());
+
+    std::string expected("abc");
+    for(int i = 0; i < count; ++i) {
+        expected += std::string(iov[i].iov_len, 'a' + i);
+    }
+    CHECK(expected == str(buffer));
+}
+TEST(bufferReserve, commit_part) {
+    NewNet::Buffer buffer;
+    struct iovec iov[8];
+
+    buffer.reserve(BIG, iov, 8);
+    memcpy(iov[0].iov_base, "abc", 3);
+    buffer.commit(3);
+
+    CHECK_EQUAL("abc", str(buffer));
+    CHECK_EQUAL(1, segments(buffer));
+}
+TEST(bufferReserve, commit_nothing) {
+    NewNet::Buffer buffer;
+    append(buffer, "abc");
+    struct iovec iov[8];
+
+    buffer.reserve(BIG, iov, 8);
+    buffer.commit(0);
+
+    CHECK_EQUAL("abc", str(buffer));
+    CHECK_EQUAL(1, segments(buffer));
+    append(buffer, "def");
+    CHECK_EQUAL("abcdef", str(buffer));
+}
+TEST(bufferReserve, commit_nothing_empty) {
+    NewNet::Buffer buffer;
+    struct iovec iov[8];
+
+    buffer.reserve(BIG, iov, 8);
+    buffer.commit(0);
+
+    CHECK(buffer.empty());
+    CHECK_EQUAL(0, segments(buffer));
+}
+
+TEST_GROUP(bufferPullup) { };
+TEST(bufferPullup, single_slice) {
+    NewNet::Buffer buffer;
+    append(buffer, "abcdef");
+    struct iovec iov[1];
+    buffer.segments(iov, 1, 6);
+
+    CHECK(buffer.pullup(4) == iov[0].iov_base);
+}
+TEST(bufferPullup, across_slices) {
+    NewNet::Buffer first, second, buffer;
+    append(first, "abc");
+    append(second, "def");
+    buffer.append(first);
+    buffer.append(second);
+    CHECK_EQUAL(2, segments(buffer));
+
+    CHECK(memcmp("abcd", buffer.pullup(4), 4) == 0);
+
+    CHECK_EQUAL(2, segments(buffer));
+    CHECK_EQUAL("abcdef", str(buffer));
+    CHECK_EQUAL("abc", str(first));
+    CHECK_EQUAL("def", str(second));
+}
+TEST(bufferPullup, part_of_slices) {
+    NewNet::Buffer buffer;
+    appendSlices(buffer, 10);
+    CHECK_EQUAL(10, segments(buffer));
+
+    CHECK(memcmp("abcde", buffer.pullup(5), 5) == 0);
+
+    CHECK_EQUAL(6, segments(buffer));
+    CHECK_EQUAL("abcdefghij", str(buffer));
+    buffer.seek(6);
+    CHECK_EQUAL("ghij", str(buffer));
+}
+TEST(bufferPullup, all_slices) {
+    NewNet::Buffer buffer;
+    appendSlices(buffer, 10);
+
+    // Every slice is used up, so the new one needs room in front again
+    CHECK(memcmp("abcdefghij", buffer.pullup(10), 10) == 0);
+
+    CHECK_EQUAL(1, segments(buffer));
+    appendSlices(buffer, 2);
+    CHECK_EQUAL("abcdefghijab", str(buffer));
+}
+
+TEST_GROUP(bufferTake) { };
+TEST(bufferTake, inline_slices) {
+    NewNet::Buffer buffer;
+    append(buffer, "abc");
+    {
+        NewNet::Buffer other;
+        append(other, "xy");
+
+        buffer.take(other);
+
+        CHECK(other.empty());
+        append(other, "z");
+        CHECK_EQUAL("z", str(other));
+    }
+    CHECK_EQUAL("xy", str(buffer));
+    append(buffer, "w");
+    CHECK_EQUAL("xyw", str(buffer));
+}
+TEST(bufferTake, many_slices) {
+    NewNet::Buffer buffer, other;
+    append(buffer, "abc");
+    appendSlices(other, 6);
+
+    buffer.take(other);
+
+    CHECK(other.empty());
+    CHECK_EQUAL("abcdef", str(buffer));
+    appendSlices(other, 2);
+    CHECK_EQUAL("ab", str(other));
+}
+TEST(bufferTake, assign) {
+    NewNet::Buffer buffer, other;
+    append(other, "abc");
+
+    buffer = other;
+    append(buffer, "d");
+
+    CHECK_EQUAL("abcd", str(buffer));
+    CHECK_EQUAL("abc", str(other));
+}
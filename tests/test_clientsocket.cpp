@@ -0,0 +1,106 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <CppUTest/TestHarness.h>
+#include "../src/NewNet/nnclientsocket.h"
+
+namespace {
+    class Listener : public NewNet::Object {
+    public:
+        Listener() : disconnected(0) {}
+        void onDisconnected(NewNet::ClientSocket *) { ++this->disconnected; }
+
+        int disconnected;
+    };
+}
+
+/*
+ * A connected client socket over one end of a socket pair, the test reads
+ * what it sends from the other end. process() is called by hand, as the
+ * reactor would when the socket becomes writable.
+ */
+TEST_GROUP(clientSocket) {
+    NewNet::RefPtr<NewNet::ClientSocket> socket;
+    NewNet::RefPtr<Listener> listener;
+    int peer;
+
+    void setup() {
+        int fds[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        fcntl(fds[1], F_SETFL, O_NONBLOCK);
+        this->peer = fds[1];
+
+        this->listener = new Listener();
+        this->socket = new NewNet::ClientSocket();
+        this->socket->setDescriptor(fds[0]);
+        this->socket->setSocketState(NewNet::Socket::SocketConnected);
+        this->socket->disconnectedEvent.connect(this->listener.ptr(), &Listener::onDisconnected);
+    }
+
+    void teardown() {
+        if(this->socket->socketState() == NewNet::Socket::SocketConnected) {
+            this->socket->disconnect(false);
+        }
+        this->socket = 0;
+        this->listener = 0;
+        close(this->peer);
+    }
+
+    void wakeWritable() {
+        this->socket->setReadyState(NewNet::Socket::StateSend);
+        this->socket->process();
+    }
+
+    std::string received() {
+        char buf[64];
+        ssize_t n = read(this->peer, buf, sizeof(buf));
+        return std::string(buf, n > 0 ? n : 0);
+    }
+};
+TEST(clientSocket, sends) {
+    this->socket->send((const unsigned char *)"data", 4);
+    this->wakeWritable();
+
+    CHECK_FALSE(this->socket->dataWaiting());
+    CHECK_EQUAL("data", this->received());
+}
+TEST(clientSocket, cleared_buffer) {
+    this->socket->send((const unsigned char *)"data", 4);
+    this->socket->sendBuffer().clear();
+    this->wakeWritable();
+
+    CHECK_EQUAL(NewNet::Socket::SocketConnected, this->socket->socketState());
+    CHECK_EQUAL(0, this->listener->disconnected);
+    CHECK_FALSE(this->socket->dataWaiting());
+    CHECK_EQUAL("", this->received());
+}
+TEST(clientSocket, send_after_cleared_buffer) {
+    this->socket->send((const unsigned char *)"data", 4);
+    this->socket->sendBuffer().clear();
+    this->wakeWritable();
+    this->socket->send((const unsigned char *)"more", 4);
+    this->wakeWritable();
+
+    CHECK_EQUAL(0, this->listener->disconnected);
+    CHECK_EQUAL("more", this->received());
+}
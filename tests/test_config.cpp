@@ -16,6 +16,8 @@
  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cstdio>
+#include <fstream>
 #include <sstream>
 #include <CppUTest/TestHarness.h>
 #include "../src/config.h"
@@ -425,3 +427,118 @@ TEST(del, not_found_key) {
 
     CHECK_EQUAL(false, res1);
 }
+
+TEST_GROUP(snapshot) {
+    newsoul::Config *config;
+
+    void setup() {
+        std::istringstream data("{\"users\":{\"banned\":[\"u1\",\"u2\"],\"buddies\":[\"u3\"]},\"uploads\":{\"slots\":3,\"buddiesOnly\":true}}");
+        config = new newsoul::Config(data);
+    }
+
+    void teardown() {
+        delete config;
+    }
+};
+
+TEST(snapshot, compiled) {
+    const newsoul::Config::Snapshot &result = config->snapshot();
+
+    CHECK_EQUAL(2, result.banned.size());
+    CHECK_EQUAL(1, result.banned.count("u2"));
+    CHECK_EQUAL(1, result.buddies.count("u3"));
+    CHECK(result.trusted.empty());
+    CHECK_EQUAL(3, result.upSlots);
+    CHECK_EQUAL(true, result.buddiesOnly);
+    CHECK_EQUAL(false, result.buddiesFirst);
+}
+
+TEST(snapshot, after_add) {
+    config->add({"users", "trusted"}, "u4");
+
+    CHECK_EQUAL(1, config->snapshot().trusted.count("u4"));
+}
+
+TEST(snapshot, after_del) {
+    config->del({"users", "banned"}, "u1");
+
+    CHECK_EQUAL(0, config->snapshot().banned.count("u1"));
+    CHECK_EQUAL(1, config->snapshot().banned.count("u2"));
+}
+
+TEST(snapshot, after_set) {
+    config->set({"uploads", "slots"}, 5);
+
+    CHECK_EQUAL(5, config->snapshot().upSlots);
+}
+
+TEST_GROUP(writeBehind) {
+    const std::string fn = "test_config_write_behind.json";
+    newsoul::Config *config;
+    int scheduled;
+
+    void setup() {
+        std::ofstream f(fn);
+        f << "{\"v1\":1}";
+        f.close();
+        config = new newsoul::Config(fn);
+        scheduled = 0;
+        config->writeBehind([this] { ++scheduled; });
+    }
+
+    void teardown() {
+        delete config;
+        std::remove(fn.c_str());
+    }
+
+    int saved(const std::string &key) {
+        std::ifstream f(fn);
+        newsoul::Config saved(f, false);
+        return saved.getInt({key});
+    }
+};
+
+TEST(writeBehind, coalesced) {
+    config->set({"v1"}, 2);
+    config->set({"v2"}, 3);
+    config->del({}, "v1");
+
+    CHECK_EQUAL(1, scheduled);
+    CHECK_EQUAL(true, config->pending());
+    CHECK_EQUAL(1, saved("v1"));
+}
+
+TEST(writeBehind, flush) {
+    config->set({"v2"}, 3);
+    config->flush();
+
+    CHECK_EQUAL(false, config->pending());
+    CHECK_EQUAL(3, saved("v2"));
+}
+
+TEST(writeBehind, scheduled_again_after_flush) {
+    config->set({"v2"}, 3);
+    config->flush();
+    config->set({"v2"}, 4);
+
+    CHECK_EQUAL(2, scheduled);
+}
+
+TEST(writeBehind, background) {
+    config->writeBehind([this] { ++scheduled; }, true);
+    config->set({"v2"}, 3);
+    config->flush(false);
+    config->flush();
+
+    CHECK_EQUAL(false, config->pending());
+    CHECK_EQUAL(3, saved("v2"));
+}
+
+TEST(writeBehind, turned_off) {
+    config->set({"v2"}, 3);
+    config->writeBehind(std::function<void()>());
+    config->set({"v2"}, 4);
+
+    CHECK_EQUAL(1, scheduled);
+    CHECK_EQUAL(4, saved("v2"));
+}
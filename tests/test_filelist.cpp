@@ -0,0 +1,247 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <CppUTest/TestHarness.h>
+#include "../src/filelist.h"
+
+static newsoul::File makeFile(uint64_t size, const std::string &ext, const std::vector<unsigned int> &attrs) {
+    newsoul::File file;
+    file.size = size;
+    file.ext = ext;
+    file.attrs = attrs;
+    file.mtime = 0;
+    return file;
+}
+
+TEST_GROUP(fileListAddFile) { };
+TEST(fileListAddFile, round_trip) {
+    newsoul::FileList list;
+
+    list.addDir("/dir0", "folder");
+    list.addFile("file.mp3", makeFile(20, "mp3", {192, 10, 0}));
+    list.addFile("file.ogg", 30, "ogg");
+
+    CHECK_EQUAL(1, list.dirs().size());
+    CHECK_EQUAL(2, list.filesCount());
+    const newsoul::FileList::DirEntry &dir = list.dirs()[0];
+    STRCMP_EQUAL("/dir0", list.str(dir.path));
+    STRCMP_EQUAL("folder", list.str(dir.folder));
+    CHECK_EQUAL(2, dir.count);
+
+    const newsoul::FileList::FileEntry *file = list.begin(dir);
+    STRCMP_EQUAL("file.mp3", list.str(file->name));
+    STRCMP_EQUAL("mp3", list.str(file->ext));
+    CHECK_EQUAL(20, file->size);
+    CHECK_EQUAL(3, file->attrsCount);
+    CHECK_EQUAL(192, file->attrs[0]);
+    CHECK_EQUAL(10, file->attrs[1]);
+    CHECK_EQUAL(0, file->attrs[2]);
+
+    ++file;
+    STRCMP_EQUAL("file.ogg", list.str(file->name));
+    STRCMP_EQUAL("ogg", list.str(file->ext));
+    CHECK_EQUAL(30, file->size);
+    CHECK_EQUAL(0, file->attrsCount);
+
+    CHECK(++file == list.end(dir));
+}
+TEST(fileListAddFile, without_dir) {
+    newsoul::FileList list;
+
+    list.addFile("file.ext", 20, "ext");
+
+    CHECK_EQUAL(1, list.dirs().size());
+    STRCMP_EQUAL("", list.str(list.dirs()[0].path));
+    CHECK_EQUAL(1, list.dirs()[0].count);
+}
+TEST(fileListAddFile, large_size) {
+    newsoul::FileList list;
+
+    list.addFile("file.ext", 0x100000000ULL, "ext");
+
+    CHECK(0x100000000ULL == list.begin(list.dirs()[0])->size);
+}
+TEST(fileListAddFile, interned_ext) {
+    newsoul::FileList list;
+
+    list.addDir("/dir0", "folder");
+    list.addFile("file0.ext", 20, "ext");
+    list.addFile("file1.ext", 20, "ext");
+    list.addDir("/dir1", "folder");
+    list.addFile("file", 20, "");
+
+    const newsoul::FileList::FileEntry *file = list.begin(list.dirs()[0]);
+    CHECK_EQUAL(file[0].ext, file[1].ext);
+    CHECK_EQUAL(list.dirs()[0].folder, list.dirs()[1].folder);
+    CHECK_EQUAL(0, list.begin(list.dirs()[1])->ext);
+}
+
+TEST_GROUP(fileListAddAttr) { };
+TEST(fileListAddAttr, cap) {
+    newsoul::FileList list;
+
+    list.addFile("file.ext", 20, "ext");
+    for(unsigned int i = 0; i < newsoul::FileList::MAX_ATTRS + 2; ++i) {
+        list.addAttr(i);
+    }
+
+    const newsoul::FileList::FileEntry *file = list.begin(list.dirs()[0]);
+    CHECK_EQUAL(newsoul::FileList::MAX_ATTRS, file->attrsCount);
+    for(unsigned int i = 0; i < newsoul::FileList::MAX_ATTRS; ++i) {
+        CHECK_EQUAL(i, file->attrs[i]);
+    }
+}
+TEST(fileListAddAttr, cap_from_file) {
+    newsoul::FileList list;
+
+    list.addFile("file.ext", makeFile(20, "ext", {1, 2, 3, 4, 5, 6, 7, 8}));
+
+    const newsoul::FileList::FileEntry *file = list.begin(list.dirs()[0]);
+    CHECK_EQUAL(newsoul::FileList::MAX_ATTRS, file->attrsCount);
+    CHECK_EQUAL(6, file->attrs[newsoul::FileList::MAX_ATTRS - 1]);
+}
+TEST(fileListAddAttr, without_file) {
+    newsoul::FileList list;
+
+    list.addAttr(1);
+
+    CHECK(list.empty());
+}
+
+TEST_GROUP(fileListAddDir) { };
+TEST(fileListAddDir, duplicate_path) {
+    newsoul::FileList list;
+
+    list.addDir("/dir0");
+    list.addFile("file0.ext", 20, "ext");
+    list.addDir("/dir0");
+    list.addFile("file1.ext", 20, "ext");
+
+    CHECK_EQUAL(1, list.dirs().size());
+    CHECK_EQUAL(2, list.dirs()[0].count);
+}
+TEST(fileListAddDir, duplicate_path_other_folder) {
+    newsoul::FileList list;
+
+    list.addDir("/dir0", "folder0");
+    list.addFile("file0.ext", 20, "ext");
+    list.addDir("/dir0", "folder1");
+    list.addFile("file1.ext", 20, "ext");
+
+    CHECK_EQUAL(2, list.dirs().size());
+}
+TEST(fileListAddDir, empty_dirs) {
+    newsoul::FileList list;
+
+    list.addDir("/dir0");
+    list.addDir("/dir1");
+
+    CHECK_EQUAL(2, list.dirs().size());
+    CHECK_EQUAL(0, list.dirs()[0].count);
+    CHECK(list.empty());
+}
+
+TEST_GROUP(fileListAddDirs) { };
+TEST(fileListAddDirs, folders) {
+    newsoul::FileList list;
+    newsoul::Dirs dirs0;
+    dirs0["/dir0"]["file0.ext"] = makeFile(20, "ext", {});
+    dirs0["/dir1"]["file1.ext"] = makeFile(30, "ext", {});
+    dirs0["/dir1"]["file2.ext"] = makeFile(40, "ext", {});
+    newsoul::Dirs dirs1;
+    dirs1["/dir2"]["file3.ext"] = makeFile(50, "ext", {});
+
+    list.addDirs(dirs0, "folder0");
+    list.addDirs(dirs1, "folder1");
+
+    CHECK_EQUAL(3, list.dirs().size());
+    CHECK_EQUAL(4, list.filesCount());
+    STRCMP_EQUAL("/dir0", list.str(list.dirs()[0].path));
+    STRCMP_EQUAL("folder0", list.str(list.dirs()[0].folder));
+    STRCMP_EQUAL("/dir1", list.str(list.dirs()[1].path));
+    STRCMP_EQUAL("folder0", list.str(list.dirs()[1].folder));
+    CHECK_EQUAL(2, list.dirs()[1].count);
+    STRCMP_EQUAL("file2.ext", list.str((list.begin(list.dirs()[1]) + 1)->name));
+    STRCMP_EQUAL("/dir2", list.str(list.dirs()[2].path));
+    STRCMP_EQUAL("folder1", list.str(list.dirs()[2].folder));
+}
+TEST(fileListAddDirs, from_dir) {
+    newsoul::Dir dir;
+    dir["file0.ext"] = makeFile(20, "ext", {1});
+    dir["file1.ext"] = makeFile(30, "ext", {});
+
+    newsoul::FileList list(dir);
+
+    CHECK_EQUAL(1, list.dirs().size());
+    STRCMP_EQUAL("", list.str(list.dirs()[0].path));
+    CHECK_EQUAL(2, list.filesCount());
+    CHECK_EQUAL(1, list.begin(list.dirs()[0])->attrsCount);
+}
+
+TEST_GROUP(fileListRecoded) { };
+TEST(fileListRecoded, names) {
+    newsoul::FileList list;
+    list.addDir("/dir0", "folder");
+    list.addFile("file.mp3", makeFile(20, "mp3", {192, 10}));
+    list.addDir("/dir1", "folder");
+    list.addFile("file.ogg", 30, "ogg");
+
+    newsoul::FileList result = list.recoded([](const std::string &s) {
+        return s.empty() ? s : "_" + s;
+    });
+
+    CHECK_EQUAL(2, result.dirs().size());
+    CHECK_EQUAL(2, result.filesCount());
+    const newsoul::FileList::DirEntry &dir = result.dirs()[0];
+    STRCMP_EQUAL("_/dir0", result.str(dir.path));
+    STRCMP_EQUAL("_folder", result.str(dir.folder));
+    CHECK_EQUAL(dir.folder, result.dirs()[1].folder);
+    const newsoul::FileList::FileEntry *file = result.begin(dir);
+    STRCMP_EQUAL("_file.mp3", result.str(file->name));
+    STRCMP_EQUAL("mp3", result.str(file->ext));
+    CHECK_EQUAL(20, file->size);
+    CHECK_EQUAL(2, file->attrsCount);
+    CHECK_EQUAL(10, file->attrs[1]);
+    STRCMP_EQUAL("_/dir1", result.str(result.dirs()[1].path));
+    STRCMP_EQUAL("_file.ogg", result.str(result.begin(result.dirs()[1])->name));
+}
+TEST(fileListRecoded, leaves_original) {
+    newsoul::FileList list;
+    list.addDir("/dir0");
+    list.addFile("file.ext", 20, "ext");
+
+    list.recoded([](const std::string &) { return std::string("x"); });
+
+    STRCMP_EQUAL("/dir0", list.str(list.dirs()[0].path));
+    STRCMP_EQUAL("file.ext", list.str(list.begin(list.dirs()[0])->name));
+}
+
+TEST_GROUP(fileListClear) { };
+TEST(fileListClear, everything) {
+    newsoul::FileList list;
+    list.addDir("/dir0", "folder");
+    list.addFile("file.ext", 20, "ext");
+
+    list.clear();
+    list.addDir("/dir1", "folder");
+
+    CHECK(list.empty());
+    CHECK_EQUAL(1, list.dirs().size());
+    STRCMP_EQUAL("/dir1", list.str(list.dirs()[0].path));
+    STRCMP_EQUAL("folder", list.str(list.dirs()[0].folder));
+}
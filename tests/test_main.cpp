@@ -19,6 +19,7 @@
 #include <CppUTest/CommandLineTestRunner.h>
 #include <CppUTest/TestRegistry.h>
 #include <CppUTestExt/MockSupportPlugin.h>
+#include "../src/NewNet/nnbuffer.h"
 
 class AttrsComparator : public MockNamedValueComparator {
 public:
@@ -44,10 +45,23 @@ public:
     }
 };
 
+/* Buffers keep released memory blocks for reuse, free them before
+   the leak checker looks. */
+class BufferPoolPlugin : public TestPlugin {
+public:
+    BufferPoolPlugin() : TestPlugin("BufferPool") { }
+
+    void postTestAction(UtestShell &, TestResult &) {
+        NewNet::Buffer::releasePool();
+    }
+};
+
 int main(int argc, char *argv[]) {
     AttrsComparator attrsComparator;
     MockSupportPlugin mockPlugin;
     mockPlugin.installComparator("attrs", attrsComparator);
     TestRegistry::getCurrentRegistry()->installPlugin(&mockPlugin);
+    BufferPoolPlugin bufferPoolPlugin;
+    TestRegistry::getCurrentRegistry()->installPlugin(&bufferPoolPlugin);
     return CommandLineTestRunner::RunAllTests(argc, argv);
 }
@@ -0,0 +1,124 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+#include <CppUTest/TestHarness.h>
+#include "../src/messagedispatcher.h"
+
+namespace {
+    // Stands for a socket, with a single event for message type 1.
+    struct Owner {
+        bool listening;
+        int parsed;
+    };
+
+    class LogRecorder : public NewNet::Object {
+    public:
+        std::vector<std::string> messages;
+
+        void onLog(const NewNet::Log::LogNotify *notice) {
+            this->messages.push_back(notice->message);
+        }
+    };
+
+    typedef newsoul::MessageDispatcher<Owner> Dispatcher;
+
+    Dispatcher *makeDispatcher() {
+        return new Dispatcher("test.messages", "test", {
+            { 1, "TListened", [](Owner *owner, const NewNet::Buffer &) -> bool {
+                if(!owner->listening) {
+                    return false;
+                }
+                ++owner->parsed;
+                return true;
+            }, 0, 0 },
+            { 3, "TIgnored", [](Owner *, const NewNet::Buffer &) -> bool {
+                return false;
+            }, 0, 0 }
+        });
+    }
+}
+
+TEST_GROUP(messageDispatcher) {
+    Dispatcher *dispatcher;
+    Owner owner;
+    NewNet::Buffer data;
+
+    void setup() {
+        this->dispatcher = makeDispatcher();
+        this->owner.listening = true;
+        this->owner.parsed = 0;
+    }
+
+    void teardown() {
+        delete this->dispatcher;
+    }
+};
+TEST(messageDispatcher, known_type) {
+    CHECK_TRUE(this->dispatcher->dispatch(&this->owner, 1, this->data));
+
+    CHECK_EQUAL(1, this->owner.parsed);
+    CHECK_EQUAL(1, this->dispatcher->entry(1)->received);
+    CHECK_EQUAL(0, this->dispatcher->entry(1)->skipped);
+}
+TEST(messageDispatcher, unknown_type) {
+    CHECK_FALSE(this->dispatcher->dispatch(&this->owner, 2, this->data));
+    CHECK_FALSE(this->dispatcher->dispatch(&this->owner, 1000, this->data));
+
+    CHECK(this->dispatcher->entry(2) == 0);
+    CHECK_EQUAL(0, this->owner.parsed);
+    CHECK_EQUAL(0, this->dispatcher->entry(1)->received);
+    CHECK_EQUAL(0, this->dispatcher->entry(3)->received);
+}
+TEST(messageDispatcher, no_listeners) {
+    this->owner.listening = false;
+
+    CHECK_TRUE(this->dispatcher->dispatch(&this->owner, 1, this->data));
+    CHECK_TRUE(this->dispatcher->dispatch(&this->owner, 1, this->data));
+
+    CHECK_EQUAL(0, this->owner.parsed);
+    CHECK_EQUAL(2, this->dispatcher->entry(1)->received);
+    CHECK_EQUAL(2, this->dispatcher->entry(1)->skipped);
+
+    this->owner.listening = true;
+    this->dispatcher->dispatch(&this->owner, 1, this->data);
+
+    CHECK_EQUAL(1, this->owner.parsed);
+    CHECK_EQUAL(3, this->dispatcher->entry(1)->received);
+    CHECK_EQUAL(2, this->dispatcher->entry(1)->skipped);
+}
+TEST(messageDispatcher, report) {
+    NewNet::RefPtr<LogRecorder> recorder = new LogRecorder();
+    NewNet::RefPtr<NewNet::Event<const NewNet::Log::LogNotify *>::Callback> callback =
+        NNLOG.logEvent.connect(recorder.ptr(), &LogRecorder::onLog);
+    NNLOG.enable("test.messages.debug");
+
+    for(unsigned long i = 1; i < Dispatcher::REPORT_INTERVAL; ++i) {
+        this->dispatcher->dispatch(&this->owner, i % 2 ? 1 : 3, this->data);
+    }
+    CHECK(recorder->messages.empty());
+    this->dispatcher->dispatch(&this->owner, 3, this->data);
+
+    NNLOG.disable("test.messages.debug");
+    callback->disconnect();
+    CHECK_EQUAL(3, recorder->messages.size());
+    CHECK_EQUAL("10000 test messages dispatched:", recorder->messages[0]);
+    CHECK_EQUAL("  TListened: 5000 received, 0 skipped", recorder->messages[1]);
+    CHECK_EQUAL("  TIgnored: 5000 received, 5000 skipped", recorder->messages[2]);
+}
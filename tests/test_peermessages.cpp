@@ -0,0 +1,399 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include <CppUTest/TestHarness.h>
+#include "../src/peermessages.h"
+
+/* Tell whether anything is left, inflated or not. */
+class TSharesReply : public PSharesReply {
+public:
+    using PSharesReply::available;
+};
+
+class TSearchReply : public PSearchReply {
+public:
+    using PSearchReply::available;
+};
+
+class TFolderContentsReply : public PFolderContentsReply {
+public:
+    using PFolderContentsReply::available;
+};
+
+namespace {
+    // Raw message payloads, as they are on the wire.
+    void putInt(std::string &s, uint32_t i) {
+        for(int b = 0; b < 4; ++b) {
+            s += (char)((i >> (8 * b)) & 0xff);
+        }
+    }
+
+    void putOff(std::string &s, uint64_t i) {
+        putInt(s, i & 0xffffffff);
+        putInt(s, i >> 32);
+    }
+
+    void putString(std::string &s, const std::string &v) {
+        putInt(s, v.size());
+        s += v;
+    }
+
+    std::string fileName(int dir, int file) {
+        return std::to_string(dir) + "-" + std::to_string(file) + std::string(200, 'x');
+    }
+
+    // Files of dirs of a shares reply, each file with a single attribute.
+    std::string sharesBody(int dirs, int files) {
+        std::string s;
+        putInt(s, dirs);
+        for(int d = 0; d < dirs; ++d) {
+            putString(s, "dir" + std::to_string(d));
+            putInt(s, files);
+            for(int f = 0; f < files; ++f) {
+                s += (char)1;
+                putString(s, fileName(d, f));
+                putOff(s, 5000000000ULL + f);
+                putString(s, "mp3");
+                putInt(s, 1);
+                putInt(s, 0);
+                putInt(s, 320);
+            }
+        }
+        return s;
+    }
+
+    NewNet::Buffer buffer(const std::string &s) {
+        NewNet::Buffer result;
+        result.append((const unsigned char *)s.data(), s.size());
+        return result;
+    }
+
+    std::string deflate(const std::string &s) {
+        uLongf n = compressBound(s.size());
+        std::vector<Bytef> out(n);
+        ::compress(out.data(), &n, (const Bytef *)s.data(), s.size());
+        return std::string((const char *)out.data(), n);
+    }
+
+    // Head of a search reply, files sizes are 32 bit if short is set.
+    std::string searchHead(int files, bool shortSizes) {
+        std::string s;
+        putString(s, "user");
+        putInt(s, 7);
+        putInt(s, files);
+        for(int f = 0; f < files; ++f) {
+            s += (char)1;
+            putString(s, "dir/file" + std::to_string(f));
+            if(shortSizes) {
+                putInt(s, 1000 + f);
+            } else {
+                putOff(s, 5000000000ULL + f);
+            }
+            putString(s, "mp3");
+            putInt(s, 1);
+            putInt(s, 0);
+            putInt(s, 320);
+        }
+        return s;
+    }
+
+    // Tail of a search reply, queue length is 32 bit if short is set.
+    std::string searchTail(bool shortQueue) {
+        std::string s;
+        s += (char)1;
+        putInt(s, 100);
+        if(shortQueue) {
+            putInt(s, 12);
+        } else {
+            putOff(s, 12);
+        }
+        return s;
+    }
+
+    size_t filesCount(const newsoul::FileList &list, const newsoul::FileList::DirEntry &dir) {
+        return list.end(dir) - list.begin(dir);
+    }
+}
+
+/*
+ * Shares and folder contents replies are inflated bit by bit, as they
+ * are unpacked, so these go well past the 64 KiB inflate window.
+ */
+TEST_GROUP(streamDecompress) { };
+TEST(streamDecompress, shares_reply) {
+    std::string body = sharesBody(20, 100);
+    CHECK(body.size() > 4 * 65536);
+    TSharesReply msg;
+
+    msg.parse_network_packet(buffer(deflate(body)));
+
+    const newsoul::FileList &shares = msg.shares;
+    CHECK_EQUAL(20, shares.dirs().size());
+    CHECK_EQUAL(2000, shares.filesCount());
+    const newsoul::FileList::DirEntry &last = shares.dirs().back();
+    STRCMP_EQUAL("dir19", shares.str(last.path));
+    CHECK_EQUAL(100, filesCount(shares, last));
+    const newsoul::FileList::FileEntry *file = shares.end(last) - 1;
+    CHECK(fileName(19, 99) == shares.str(file->name));
+    CHECK_EQUAL(5000000099ULL, file->size);
+    STRCMP_EQUAL("mp3", shares.str(file->ext));
+    CHECK_EQUAL(1, file->attrsCount);
+    CHECK_EQUAL(320, file->attrs[0]);
+    CHECK_EQUAL(0, msg.buffer.count());
+    CHECK_FALSE(msg.available(1));
+}
+TEST(streamDecompress, folder_contents_reply) {
+    newsoul::FileList folders;
+    for(int d = 0; d < 20; ++d) {
+        folders.addDir("folder\\dir" + std::to_string(d), "folder");
+        for(int f = 0; f < 100; ++f) {
+            folders.addFile(fileName(d, f), f, "ogg");
+        }
+    }
+    PFolderContentsReply sent(folders);
+    const NewNet::Buffer &packet = sent.make_network_packet();
+    // Without the message type
+    NewNet::Buffer data(packet, 4, packet.count() - 4);
+    TFolderContentsReply msg;
+
+    msg.parse_network_packet(data);
+
+    CHECK_EQUAL(20, msg.folders.dirs().size());
+    CHECK_EQUAL(2000, msg.folders.filesCount());
+    const newsoul::FileList::DirEntry &last = msg.folders.dirs().back();
+    STRCMP_EQUAL("folder", msg.folders.str(last.folder));
+    STRCMP_EQUAL("folder\\dir19", msg.folders.str(last.path));
+    CHECK(fileName(19, 99) == msg.folders.str((msg.folders.end(last) - 1)->name));
+    CHECK_EQUAL(0, msg.buffer.count());
+    CHECK_FALSE(msg.available(1));
+}
+TEST(streamDecompress, truncated) {
+    std::string deflated = deflate(sharesBody(20, 100));
+    TSharesReply msg;
+
+    msg.parse_network_packet(buffer(deflated.substr(0, deflated.size() / 2)));
+
+    // What was inflated before the data ran out is kept
+    CHECK(msg.shares.filesCount() > 0);
+    CHECK(msg.shares.filesCount() < 2000);
+    const newsoul::FileList::DirEntry &first = msg.shares.dirs().front();
+    CHECK(fileName(0, 0) == msg.shares.str(msg.shares.begin(first)->name));
+    CHECK_EQUAL(0, msg.buffer.count());
+    CHECK_FALSE(msg.available(1));
+}
+TEST(streamDecompress, corrupt) {
+    TSharesReply msg;
+
+    msg.parse_network_packet(buffer(std::string(1000, 'x')));
+
+    CHECK(msg.shares.dirs().empty());
+    CHECK_EQUAL(0, msg.buffer.count());
+    CHECK_FALSE(msg.available(1));
+}
+TEST(streamDecompress, corrupt_inside) {
+    std::string deflated = deflate(sharesBody(20, 100));
+    for(size_t i = deflated.size() / 2; i < deflated.size() / 2 + 100; ++i) {
+        deflated[i] = ~deflated[i];
+    }
+    TSharesReply msg;
+
+    msg.parse_network_packet(buffer(deflated));
+
+    CHECK(msg.shares.filesCount() < 2000);
+    CHECK_EQUAL(0, msg.buffer.count());
+    CHECK_FALSE(msg.available(1));
+}
+TEST(streamDecompress, trailing_data) {
+    // Inside of the compressed stream, and past its end
+    std::string data = deflate(sharesBody(2, 3) + std::string(100000, 'y')) + "junk";
+    TSharesReply msg;
+
+    msg.parse_network_packet(buffer(data));
+
+    CHECK_EQUAL(2, msg.shares.dirs().size());
+    CHECK_EQUAL(6, msg.shares.filesCount());
+    CHECK_EQUAL(0, msg.buffer.count());
+    CHECK_FALSE(msg.available(1));
+}
+
+/*
+ * Search replies are decoded in a single pass, and once more with 32 bit
+ * file sizes if that fails.
+ */
+TEST_GROUP(searchReply) {
+    const newsoul::FileList::FileEntry *file(const PSearchReply &msg, size_t i) {
+        return msg.results.begin(msg.results.dirs().front()) + i;
+    }
+};
+TEST(searchReply, valid) {
+    newsoul::FileList results;
+    results.addDir(std::string());
+    results.addFile("dir/file0", 5000000000ULL, "mp3");
+    results.addAttr(320);
+    PSearchReply sent(7, "user", results, 100, 12, true);
+    const NewNet::Buffer &packet = sent.make_network_packet();
+    NewNet::Buffer data(packet, 4, packet.count() - 4);
+    TSearchReply msg;
+
+    msg.parse_network_packet(data);
+
+    CHECK_EQUAL("user", msg.user);
+    CHECK_EQUAL(7, msg.ticket);
+    CHECK_EQUAL(1, msg.results.filesCount());
+    // Sent with Windows separators
+    STRCMP_EQUAL("dir\\file0", msg.results.str(this->file(msg, 0)->name));
+    CHECK_EQUAL(5000000000ULL, this->file(msg, 0)->size);
+    STRCMP_EQUAL("mp3", msg.results.str(this->file(msg, 0)->ext));
+    CHECK_EQUAL(1, this->file(msg, 0)->attrsCount);
+    CHECK_EQUAL(320, this->file(msg, 0)->attrs[0]);
+    CHECK_TRUE(msg.slotfree);
+    CHECK_EQUAL(100, msg.avgspeed);
+    CHECK_EQUAL(12, msg.queuelen);
+    CHECK_FALSE(msg.shortSizes);
+    CHECK_FALSE(msg.available(1));
+}
+TEST(searchReply, short_sizes) {
+    TSearchReply msg;
+
+    msg.parse_network_packet(buffer(deflate(searchHead(2, true) + searchTail(false))));
+
+    CHECK_TRUE(msg.shortSizes);
+    CHECK_EQUAL(2, msg.results.filesCount());
+    STRCMP_EQUAL("dir/file1", msg.results.str(this->file(msg, 1)->name));
+    CHECK_EQUAL(1001, this->file(msg, 1)->size);
+    STRCMP_EQUAL("mp3", msg.results.str(this->file(msg, 1)->ext));
+    CHECK_EQUAL(320, this->file(msg, 1)->attrs[0]);
+    CHECK_TRUE(msg.slotfree);
+    CHECK_EQUAL(100, msg.avgspeed);
+    CHECK_EQUAL(12, msg.queuelen);
+    CHECK_FALSE(msg.available(1));
+}
+TEST(searchReply, missing_tail) {
+    TSearchReply msg;
+
+    msg.parse_network_packet(buffer(deflate(searchHead(2, false))));
+
+    CHECK_FALSE(msg.shortSizes);
+    CHECK_EQUAL("user", msg.user);
+    CHECK_EQUAL(2, msg.results.filesCount());
+    CHECK_EQUAL(5000000001ULL, this->file(msg, 1)->size);
+    CHECK_FALSE(msg.slotfree);
+    CHECK_EQUAL(0, msg.avgspeed);
+    CHECK_EQUAL(0, msg.queuelen);
+    CHECK_FALSE(msg.available(1));
+}
+TEST(searchReply, truncated) {
+    std::string head = searchHead(3, false);
+    TSearchReply msg;
+
+    // Halfway through the third file
+    msg.parse_network_packet(buffer(deflate(head.substr(0, head.size() - 20))));
+
+    // Files read in full by the first pass are kept
+    CHECK_FALSE(msg.shortSizes);
+    CHECK_EQUAL(2, msg.results.filesCount());
+    STRCMP_EQUAL("dir/file1", msg.results.str(this->file(msg, 1)->name));
+    CHECK_EQUAL(5000000001ULL, this->file(msg, 1)->size);
+    CHECK_FALSE(msg.slotfree);
+    CHECK_EQUAL(0, msg.avgspeed);
+    CHECK_EQUAL(0, msg.queuelen);
+    CHECK_FALSE(msg.available(1));
+}
+TEST(searchReply, short_queue) {
+    TSearchReply msg;
+
+    msg.parse_network_packet(buffer(deflate(searchHead(1, false) + searchTail(true))));
+
+    CHECK_FALSE(msg.shortSizes);
+    CHECK_EQUAL(1, msg.results.filesCount());
+    CHECK_TRUE(msg.slotfree);
+    CHECK_EQUAL(100, msg.avgspeed);
+    CHECK_EQUAL(12, msg.queuelen);
+    CHECK_FALSE(msg.available(1));
+}
+TEST(searchReply, oversized_count) {
+    std::string s;
+    putString(s, "user");
+    putInt(s, 7);
+    putInt(s, 0xffffffff);
+    s += searchTail(false);
+    TSearchReply msg;
+
+    msg.parse_network_packet(buffer(deflate(s)));
+
+    CHECK_EQUAL("user", msg.user);
+    CHECK(msg.results.empty());
+    CHECK_FALSE(msg.available(1));
+}
+
+TEST_GROUP(decoder) { };
+TEST(decoder, vector) {
+    std::string s;
+    putInt(s, 2);
+    putInt(s, 10);
+    putInt(s, 20);
+    std::vector<uint32> v;
+
+    newsoul::codec::Decoder decoder((const uchar *)s.data(), s.size());
+    decoder & v;
+
+    CHECK_TRUE(decoder.ok());
+    CHECK(std::vector<uint32>({10, 20}) == v);
+    CHECK_EQUAL(0, decoder.remaining());
+}
+TEST(decoder, oversized_vector_count) {
+    std::string s;
+    putInt(s, 0xffffffff);
+    putString(s, "only one");
+    std::vector<std::string> v;
+
+    newsoul::codec::Decoder decoder((const uchar *)s.data(), s.size());
+    decoder & v;
+
+    // Not even allocated
+    CHECK_FALSE(decoder.ok());
+    CHECK(v.empty());
+    CHECK_EQUAL(0, v.capacity());
+}
+TEST(decoder, short_vector) {
+    std::string s;
+    putInt(s, 3);
+    putString(s, "first");
+    putString(s, "second");
+    std::vector<std::string> v;
+
+    newsoul::codec::Decoder decoder((const uchar *)s.data(), s.size());
+    decoder & v;
+
+    CHECK_FALSE(decoder.ok());
+    CHECK(std::vector<std::string>({"first", "second"}) == v);
+}
+TEST(decoder, compat64) {
+    std::string s;
+    putInt(s, 12);
+    uint64 value = 1;
+
+    newsoul::codec::Decoder decoder((const uchar *)s.data(), s.size());
+    decoder & newsoul::codec::compat64(value);
+
+    CHECK_TRUE(decoder.ok());
+    CHECK_EQUAL(12, value);
+}
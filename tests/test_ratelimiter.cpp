@@ -0,0 +1,157 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <limits.h>
+#include <CppUTest/TestHarness.h>
+#include "../src/NewNet/nnratelimiter.h"
+
+namespace {
+    // Miliseconds since the epoch, moved by the tests only.
+    long long now;
+
+    void fakeClock(struct timeval &tv) {
+        tv.tv_sec = now / 1000;
+        tv.tv_usec = (now % 1000) * 1000;
+    }
+
+    // Takes everything the limiter allows, returns how much that was.
+    ssize_t drain(NewNet::RateLimiter *limiter) {
+        ssize_t n = limiter->available();
+        if(n > 0) {
+            limiter->transferred(n);
+        }
+        return n;
+    }
+}
+
+TEST_GROUP(rateLimiter) {
+    NewNet::RefPtr<NewNet::RateLimiter> parent;
+    NewNet::RefPtr<NewNet::RateLimiter> first;
+    NewNet::RefPtr<NewNet::RateLimiter> second;
+
+    void setup() {
+        now = 1000000000;
+        this->parent = new NewNet::RateLimiter(0, &fakeClock);
+        this->first = new NewNet::RateLimiter(this->parent);
+        this->second = new NewNet::RateLimiter(this->parent);
+    }
+
+    void teardown() {
+        this->first = 0;
+        this->second = 0;
+        this->parent = 0;
+    }
+};
+TEST(rateLimiter, unlimited) {
+    NewNet::RateLimiter limiter(0, &fakeClock);
+
+    CHECK_EQUAL(SSIZE_MAX, limiter.available());
+    CHECK_EQUAL(0, limiter.nextWindow());
+}
+TEST(rateLimiter, closed) {
+    this->parent->setLimit(0);
+
+    CHECK_EQUAL(0, this->first->available());
+    CHECK_EQUAL(60000, this->first->nextWindow());
+}
+TEST(rateLimiter, burst) {
+    this->parent->setLimit(10000);
+    CHECK_EQUAL(10000, drain(this->parent));
+
+    now += 5000;
+
+    // A quiet period adds no more than a second worth
+    CHECK_EQUAL(10000, this->parent->available());
+}
+TEST(rateLimiter, rate) {
+    this->parent->setLimit(10000);
+    drain(this->parent);
+
+    now += 500;
+
+    CHECK_EQUAL(5000, drain(this->parent));
+}
+TEST(rateLimiter, min_window) {
+    this->parent->setLimit(100000);
+    drain(this->parent);
+
+    // 1000 bytes aren't worth waking up for, 4096 are
+    now += 10;
+    CHECK_EQUAL(0, this->parent->available());
+    CHECK_EQUAL(30, this->parent->nextWindow());
+    now += 31;
+    CHECK(this->parent->available() >= 4096);
+}
+TEST(rateLimiter, min_window_slow) {
+    this->parent->setLimit(1000);
+    drain(this->parent);
+
+    // Below the window a full second of the rate is enough
+    now += 500;
+    CHECK_EQUAL(0, this->parent->available());
+    CHECK_EQUAL(500, this->parent->nextWindow());
+    now += 500;
+    CHECK_EQUAL(1000, this->parent->available());
+}
+TEST(rateLimiter, child_limit) {
+    this->parent->setLimit(100000);
+    this->first->setLimit(10000);
+
+    CHECK_EQUAL(10000, drain(this->first));
+    now += 500;
+    CHECK_EQUAL(5000, drain(this->first));
+}
+TEST(rateLimiter, even_share) {
+    this->parent->setLimit(10000);
+    ssize_t first = 0, second = 0;
+
+    for(int i = 0; i < 100; ++i) {
+        now += 100;
+        first += drain(this->first);
+        second += drain(this->second);
+    }
+
+    // 10 s at the parent's rate, plus its initial burst
+    CHECK(first + second <= 110000);
+    CHECK(first + second >= 90000);
+    CHECK(first >= 0.4 * (first + second));
+    CHECK(second >= 0.4 * (first + second));
+}
+TEST(rateLimiter, idle_child) {
+    this->parent->setLimit(10000);
+    ssize_t shared = 0, alone = 0;
+
+    for(int i = 0; i < 100; ++i) {
+        now += 100;
+        if(i >= 50) {
+            shared += drain(this->first);
+        }
+        drain(this->second);
+    }
+    // The second one stops, after an ACTIVE_PERIOD its share goes back
+    for(int i = 0; i < 100; ++i) {
+        now += 100;
+        if(i >= 50) {
+            alone += drain(this->first);
+        }
+    }
+
+    CHECK(shared <= 30000);
+    CHECK(alone >= 40000);
+    CHECK(alone <= 55000);
+}
@@ -0,0 +1,151 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <CppUTest/TestHarness.h>
+#include "../src/NewNet/nnreactor.h"
+
+namespace {
+    typedef NewNet::Reactor::Timeout Timeout;
+
+    class Recorder : public NewNet::Object {
+    public:
+        std::vector<int> *fired;
+        int id;
+
+        void onTimeout(long) {
+            this->fired->push_back(this->id);
+        }
+    };
+
+    /* Exposes timeout expiry, so it can be driven without a main loop. */
+    class TimerReactor : public NewNet::Reactor {
+    public:
+        bool expire() {
+            struct timeval timeout;
+            bool timeout_set = false;
+            return checkTimeouts(timeout, timeout_set);
+        }
+    };
+
+    void wait(long msec) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(msec));
+    }
+}
+
+TEST_GROUP(timeouts) {
+    NewNet::RefPtr<TimerReactor> reactor;
+    Recorder recorders[3];
+    NewNet::RefPtr<Timeout::Callback> callbacks[3];
+    std::vector<int> fired;
+
+    void setup() {
+        this->reactor = new TimerReactor();
+        for(int i = 0; i < 3; ++i) {
+            this->recorders[i].fired = &this->fired;
+            this->recorders[i].id = i;
+            this->callbacks[i] = Timeout::bind(&this->recorders[i], &Recorder::onTimeout);
+        }
+    }
+
+    void teardown() {
+        for(int i = 0; i < 3; ++i) {
+            this->callbacks[i] = 0;
+        }
+        this->reactor = 0;
+    }
+};
+TEST(timeouts, not_due) {
+    this->reactor->addTimeout(10000, this->callbacks[0]);
+
+    CHECK_FALSE(this->reactor->expire());
+    CHECK(this->fired.empty());
+}
+TEST(timeouts, expiry_order) {
+    // Spans two levels of the wheel, the first one holds 64 ms.
+    this->reactor->addTimeout(120, this->callbacks[0]);
+    this->reactor->addTimeout(10, this->callbacks[1]);
+    this->reactor->addTimeout(70, this->callbacks[2]);
+    wait(150);
+
+    CHECK_TRUE(this->reactor->expire());
+    CHECK(std::vector<int>({1, 2, 0}) == this->fired);
+}
+TEST(timeouts, expires_once) {
+    this->reactor->addTimeout(0, this->callbacks[0]);
+    wait(5);
+
+    CHECK_TRUE(this->reactor->expire());
+    wait(5);
+    CHECK_FALSE(this->reactor->expire());
+    CHECK_EQUAL(1, this->fired.size());
+}
+TEST(timeouts, reschedule_sooner) {
+    this->reactor->addTimeout(10000, this->callbacks[0]);
+    this->reactor->addTimeout(0, this->callbacks[0]);
+    wait(5);
+
+    CHECK_TRUE(this->reactor->expire());
+    CHECK_EQUAL(1, this->fired.size());
+}
+TEST(timeouts, reschedule_later) {
+    this->reactor->addTimeout(0, this->callbacks[0]);
+    this->reactor->addTimeout(10000, this->callbacks[0]);
+    wait(5);
+
+    CHECK_FALSE(this->reactor->expire());
+    CHECK(this->fired.empty());
+}
+TEST(timeouts, reschedule_keeps_order) {
+    this->reactor->addTimeout(10, this->callbacks[0]);
+    this->reactor->addTimeout(20, this->callbacks[1]);
+    this->reactor->addTimeout(30, this->callbacks[0]);
+    wait(50);
+
+    CHECK_TRUE(this->reactor->expire());
+    CHECK(std::vector<int>({1, 0}) == this->fired);
+}
+TEST(timeouts, remove) {
+    this->reactor->addTimeout(0, this->callbacks[0]);
+    this->reactor->addTimeout(0, this->callbacks[1]);
+    this->reactor->removeTimeout(this->callbacks[0]);
+    wait(5);
+
+    CHECK_TRUE(this->reactor->expire());
+    CHECK(std::vector<int>({1}) == this->fired);
+}
+TEST(timeouts, remove_not_pending) {
+    this->reactor->removeTimeout(this->callbacks[0]);
+    this->reactor->addTimeout(0, this->callbacks[0]);
+    wait(5);
+    this->reactor->expire();
+    this->reactor->removeTimeout(this->callbacks[0]);
+
+    CHECK_EQUAL(1, this->fired.size());
+}
+TEST(timeouts, add_after_remove) {
+    this->reactor->addTimeout(0, this->callbacks[0]);
+    this->reactor->removeTimeout(this->callbacks[0]);
+    this->reactor->addTimeout(0, this->callbacks[0]);
+    wait(5);
+
+    CHECK_TRUE(this->reactor->expire());
+    CHECK_EQUAL(1, this->fired.size());
+}
@@ -0,0 +1,118 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <thread>
+#include <vector>
+#include <CppUTest/TestHarness.h>
+#include "../src/NewNet/nnobject.h"
+#include "../src/NewNet/nnrefptr.h"
+#include "../src/NewNet/nnweakrefptr.h"
+
+namespace {
+    class Counted : public NewNet::Object {
+    public:
+        Counted(bool *deleted) : deleted(deleted) {}
+        ~Counted() {
+            *this->deleted = true;
+        }
+
+    private:
+        bool *deleted;
+    };
+}
+
+TEST_GROUP(refptr) {
+    bool deleted;
+
+    void setup() {
+        deleted = false;
+    }
+};
+
+TEST(refptr, weak_cleared_on_delete) {
+    NewNet::RefPtr<Counted> strong = new Counted(&deleted);
+    NewNet::WeakRefPtr<Counted> weak(strong);
+    NewNet::WeakRefPtr<Counted> copy(weak);
+
+    CHECK(weak.isValid());
+    strong = 0;
+
+    CHECK(deleted);
+    CHECK_FALSE(weak.isValid());
+    CHECK(!copy);
+    CHECK(copy.ptr() == 0);
+}
+
+TEST(refptr, lock) {
+    NewNet::RefPtr<Counted> strong = new Counted(&deleted);
+    NewNet::WeakRefPtr<Counted> weak(strong);
+
+    NewNet::RefPtr<Counted> locked = weak.lock();
+    CHECK(locked.ptr() == strong.ptr());
+    CHECK_EQUAL(2, strong->refCounter().count());
+
+    strong = 0;
+    CHECK_FALSE(deleted);
+    locked = 0;
+    CHECK(deleted);
+    CHECK_FALSE(weak.lock().isValid());
+}
+
+TEST(refptr, lock_unreferenced) {
+    Counted counted(&deleted);
+    NewNet::WeakRefPtr<Counted> weak(&counted);
+
+    CHECK_FALSE(weak.lock().isValid());
+    CHECK_FALSE(deleted);
+    CHECK_EQUAL(0, counted.refCounter().count());
+}
+
+TEST(refptr, weak_outlives_object) {
+    Counted *counted = new Counted(&deleted);
+    NewNet::WeakRefPtr<Counted> weak(counted);
+    NewNet::WeakRefPtr<Counted> other;
+    other = weak;
+    delete counted;
+
+    other = 0;
+    CHECK_FALSE(weak.isValid());
+}
+
+#ifdef NN_PTR_ATOMIC
+TEST(refptr, shared_between_threads) {
+    NewNet::RefPtr<Counted> strong = new Counted(&deleted);
+    NewNet::WeakRefPtr<Counted> weak(strong);
+
+    std::vector<std::thread> threads;
+    for(int t = 0; t < 4; ++t) {
+        threads.push_back(std::thread([weak]() {
+            for(int i = 0; i < 10000; ++i) {
+                NewNet::RefPtr<Counted> locked = weak.lock();
+                NewNet::RefPtr<Counted> copy = locked;
+            }
+        }));
+    }
+    for(std::thread &thread : threads) {
+        thread.join();
+    }
+
+    CHECK_EQUAL(1, strong->refCounter().count());
+    strong = 0;
+    CHECK(deleted);
+}
+#endif // NN_PTR_ATOMIC
@@ -0,0 +1,201 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <CppUTest/TestHarness.h>
+#include "../src/NewNet/nnresolver.h"
+
+namespace {
+    class Answers : public NewNet::Object {
+    public:
+        std::vector<std::string> hosts;
+        std::vector<bool> resolved;
+        std::vector<in_addr_t> addresses;
+
+        void onResolved(const NewNet::Resolver::Result *result) {
+            this->hosts.push_back(result->host);
+            this->resolved.push_back(result->resolved);
+            this->addresses.push_back(result->address.s_addr);
+        }
+    };
+
+    long elapsed(std::chrono::steady_clock::time_point since) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - since).count();
+    }
+}
+
+/*
+ * Stand-in name server: "slow" hosts take 200 ms, "unknown" ones fail
+ * for a short while, "volatile" ones mustn't be cached, the rest resolve
+ * right away to 10.0.0.<number of lookups so far>.
+ */
+TEST_GROUP(resolver) {
+    NewNet::Resolver *resolver;
+    Answers answers;
+    std::atomic<int> lookups;
+
+    void setup() {
+        this->lookups = 0;
+        resolver = new NewNet::Resolver([this](const std::string &host, struct in_addr &address, long &ttl) {
+            int n = ++this->lookups;
+            if(host.compare(0, 4, "slow") == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            } else if(host == "unknown") {
+                ttl = 50;
+                return false;
+            } else if(host == "volatile") {
+                ttl = 0;
+            }
+            address.s_addr = htonl(0x0a000000 + n);
+            return true;
+        });
+    }
+
+    void teardown() {
+        delete resolver;
+    }
+
+    /* Runs the resolver's part of the main loop until n answers came. */
+    bool wait(size_t n) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        while(answers.hosts.size() < n && elapsed(start) < 2000) {
+            struct pollfd fd = { resolver->descriptor(), POLLIN, 0 };
+            if(poll(&fd, 1, 10) > 0) {
+                resolver->deliver();
+            }
+        }
+        return answers.hosts.size() >= n;
+    }
+};
+
+TEST(resolver, numeric) {
+    CHECK(resolver->resolve("192.168.1.2", &answers, &Answers::onResolved));
+
+    CHECK_EQUAL(0, lookups);
+    CHECK_EQUAL(1, answers.hosts.size());
+    CHECK(answers.resolved[0]);
+    CHECK_EQUAL(htonl(0xc0a80102), answers.addresses[0]);
+}
+
+TEST(resolver, does_not_block) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    CHECK_FALSE(resolver->resolve("slow.example.com", &answers, &Answers::onResolved));
+
+    CHECK(elapsed(start) < 100);
+    CHECK_EQUAL(0, answers.hosts.size());
+    CHECK_EQUAL(1, resolver->pending());
+    CHECK(wait(1));
+    CHECK_EQUAL("slow.example.com", answers.hosts[0]);
+    CHECK(answers.resolved[0]);
+    CHECK_EQUAL(0, resolver->pending());
+}
+
+TEST(resolver, slow_host_does_not_hold_back_others) {
+    resolver->resolve("slow.example.com", &answers, &Answers::onResolved);
+    resolver->resolve("fast.example.com", &answers, &Answers::onResolved);
+
+    CHECK(wait(2));
+    CHECK_EQUAL("fast.example.com", answers.hosts[0]);
+    CHECK_EQUAL("slow.example.com", answers.hosts[1]);
+}
+
+TEST(resolver, looked_up_once) {
+    resolver->resolve("slow.example.com", &answers, &Answers::onResolved);
+    resolver->resolve("slow.example.com", &answers, &Answers::onResolved);
+
+    CHECK_EQUAL(1, resolver->pending());
+    CHECK(wait(2));
+    CHECK_EQUAL(1, lookups);
+    CHECK_EQUAL(answers.addresses[0], answers.addresses[1]);
+}
+
+TEST(resolver, cached) {
+    resolver->resolve("example.com", &answers, &Answers::onResolved);
+    CHECK(wait(1));
+
+    CHECK(resolver->resolve("example.com", &answers, &Answers::onResolved));
+    CHECK_EQUAL(1, lookups);
+    CHECK_EQUAL(2, answers.hosts.size());
+    CHECK_EQUAL(answers.addresses[0], answers.addresses[1]);
+}
+
+TEST(resolver, cleared) {
+    resolver->resolve("example.com", &answers, &Answers::onResolved);
+    CHECK(wait(1));
+    resolver->clear();
+
+    CHECK_FALSE(resolver->resolve("example.com", &answers, &Answers::onResolved));
+    CHECK(wait(2));
+    CHECK_EQUAL(2, lookups);
+}
+
+TEST(resolver, not_cached_without_ttl) {
+    resolver->resolve("volatile", &answers, &Answers::onResolved);
+    CHECK(wait(1));
+
+    CHECK_FALSE(resolver->resolve("volatile", &answers, &Answers::onResolved));
+    CHECK(wait(2));
+    CHECK_EQUAL(2, lookups);
+}
+
+TEST(resolver, failure_cached_until_expired) {
+    resolver->resolve("unknown", &answers, &Answers::onResolved);
+    CHECK(wait(1));
+    CHECK_FALSE(answers.resolved[0]);
+
+    CHECK(resolver->resolve("unknown", &answers, &Answers::onResolved));
+    CHECK_FALSE(answers.resolved[1]);
+    CHECK_EQUAL(1, lookups);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(80));
+    CHECK_FALSE(resolver->resolve("unknown", &answers, &Answers::onResolved));
+    CHECK(wait(3));
+    CHECK_EQUAL(2, lookups);
+}
+
+TEST(resolver, answers_dropped_with_object) {
+    Answers *gone = new Answers();
+    resolver->resolve("slow.example.com", gone, &Answers::onResolved);
+    resolver->resolve("slow.example.com", &answers, &Answers::onResolved);
+    delete gone;
+
+    CHECK(wait(1));
+    CHECK_EQUAL(1, answers.hosts.size());
+}
+
+TEST(resolver, default_lookup) {
+    NewNet::Resolver system;
+    CHECK_FALSE(system.resolve("localhost", &answers, &Answers::onResolved));
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while(answers.hosts.empty() && elapsed(start) < 5000) {
+        struct pollfd fd = { system.descriptor(), POLLIN, 0 };
+        if(poll(&fd, 1, 10) > 0) {
+            system.deliver();
+        }
+    }
+    CHECK_EQUAL(1, answers.hosts.size());
+    CHECK(answers.resolved[0]);
+    CHECK_EQUAL(htonl(0x7f000001), answers.addresses[0]);
+}
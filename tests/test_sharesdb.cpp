@@ -23,6 +23,7 @@
 #include <initializer_list>
 #include <sys/stat.h>
 #include "mocks/sqlite.h"
+#include "../src/filelist.h"
 
 TEST_GROUP(getAttrs) { };
 TEST(getAttrs, entry_exists) {
@@ -51,6 +52,130 @@ TEST(getAttrs, entry_does_not_exist) {
     CHECK_EQUAL(1, ret);
 }
 
+namespace {
+    //Schema from before CLOSURE was dropped, with two shared
+    //directories, a subdirectory and two files already in it.
+    const char *closureSchema =
+        "CREATE TABLE DIR( "
+        "ID INTEGER PRIMARY KEY, "
+        "path TEXT NOT NULL UNIQUE, "
+        "parentID INTEGER, "
+        "type INTEGER NOT NULL); "
+        "CREATE TABLE CLOSURE( "
+        "parentID INTEGER NOT NULL, "
+        "childID INTEGER NOT NULL, "
+        "depth INTEGER NOT NULL, "
+        "PRIMARY KEY(parentID, childID), "
+        "UNIQUE(parentID, depth, childID), "
+        "UNIQUE(childID, parentID, depth)); "
+        "CREATE TABLE FILE( "
+        "dirID INTEGER PRIMARY KEY, "
+        "size INTEGER, "
+        "ext CHAR(5), "
+        "mtime INTEGER, "
+        "bitrate INTEGER, "
+        "length INTEGER, "
+        "vbr INTEGER, "
+        "FOREIGN KEY(dirID) REFERENCES DIR(ID) "
+        "ON DELETE CASCADE ON UPDATE CASCADE); "
+        "CREATE INDEX DIR_parentID ON DIR(parentID); "
+        "CREATE TRIGGER insert_closure AFTER INSERT ON DIR "
+        "BEGIN "
+        "INSERT INTO CLOSURE(parentID, childID, depth) "
+        "VALUES(new.ID, new.ID, 0);"
+        "INSERT INTO CLOSURE(parentId, childID, depth) "
+        "SELECT parent.parentID, child.childID, parent.depth+child.depth+1 "
+        "FROM CLOSURE parent, CLOSURE child "
+        "WHERE parent.childID=new.parentID and child.parentID=new.ID; "
+        "END; "
+        "CREATE TRIGGER delete_closure AFTER DELETE ON DIR "
+        "BEGIN "
+        "DELETE FROM CLOSURE WHERE childID=old.ID; "
+        "DELETE FROM DIR "
+        "WHERE ID in (SELECT childID FROM CLOSURE WHERE parentID=old.ID); "
+        "END; "
+        "CREATE VIRTUAL TABLE PATHS USING fts4(path); "
+        "CREATE TRIGGER insert_paths AFTER INSERT ON DIR "
+        "WHEN new.type=0 "
+        "BEGIN "
+        "INSERT INTO PATHS(docid, path) VALUES(new.ID, new.path); "
+        "END; "
+        "CREATE TRIGGER delete_paths AFTER DELETE ON DIR "
+        "WHEN old.type=0 "
+        "BEGIN "
+        "DELETE FROM PATHS WHERE docid=old.ID; "
+        "END; "
+
+        "INSERT INTO DIR(ID, path, parentID, type) VALUES(1, '/dir0', 0, 1); "
+        "INSERT INTO DIR(ID, path, parentID, type) VALUES(2, '/dir0/subdir0', 1, 1); "
+        "INSERT INTO DIR(ID, path, parentID, type) VALUES(3, '/dir0/file.ext', 1, 0); "
+        "INSERT INTO DIR(ID, path, parentID, type) VALUES(4, '/dir0/subdir0/file.ext', 2, 0); "
+        "INSERT INTO DIR(ID, path, parentID, type) VALUES(5, '/dir1', 0, 1); "
+        "INSERT INTO FILE VALUES(3, 20, 'ext', 600, 192, 10, 0); "
+        "INSERT INTO FILE VALUES(4, 20, 'ext', 600, 192, 10, 0); ";
+}
+
+TEST_GROUP(createDB) {
+    void setup() {
+        mock().setData("TagLib::isNull", false);
+        mock().ignoreOtherCalls();
+    }
+};
+TEST(createDB, drops_closure) {
+    TSharesDB shares;
+
+    mocks::SqliteMock mockDB(&shares, closureSchema);
+
+    CHECK_FALSE(mockDB.hasSchema("CLOSURE"));
+    CHECK_FALSE(mockDB.hasSchema("insert_closure"));
+    CHECK_FALSE(mockDB.hasSchema("delete_closure"));
+    CHECK(mockDB.hasSchema("insert_paths"));
+    CHECK(mockDB.hasSchema("delete_paths"));
+    CHECK(mockDB.assertDirs({"/dir0", "/dir0/subdir0", "/dir1"}));
+    CHECK(mockDB.assertFiles({"/dir0/file.ext", "/dir0/subdir0/file.ext"}, true));
+}
+TEST(createDB, migrated_contents) {
+    TSharesDB shares;
+
+    mocks::SqliteMock mockDB(&shares, closureSchema);
+
+    newsoul::Dirs result = shares.contents("/dir0");
+
+    newsoul::File fe = {.size=20, .ext="ext", .attrs={192, 10, 0}, .mtime=600};
+    newsoul::Dirs expected({
+        {"/dir0", {{"file.ext", fe}}},
+        {"/dir0/subdir0", {{"file.ext", fe}}}
+    });
+    CHECK(expected == result);
+}
+TEST(createDB, migrated_remove) {
+    TSharesDB shares;
+
+    mocks::SqliteMock mockDB(&shares, closureSchema);
+
+    shares.remove({"/dir0"});
+
+    CHECK_FALSE(mockDB.assertDirs({"/dir0"}));
+    CHECK_FALSE(mockDB.assertDirs({"/dir0/subdir0"}));
+    CHECK_FALSE(mockDB.assertFiles({"/dir0/subdir0/file.ext"}, true));
+    CHECK(mockDB.assertDirs({"/dir1"}));
+    CHECK_EQUAL(0, mockDB.countPaths());
+}
+TEST(createDB, migrated_replace) {
+    TSharesDB shares;
+    struct stat st;
+    st.st_size = 20;
+    st.st_mtime = 600;
+
+    mocks::SqliteMock mockDB(&shares, closureSchema);
+
+    shares.addFile("/dir0", "/dir0/file.ext", st);
+
+    CHECK(mockDB.assertFiles({"/dir0/file.ext"}, true));
+    CHECK(mockDB.assertDirs({"/dir0", "/dir0/subdir0"}));
+    CHECK_EQUAL(2, mockDB.countPaths());
+}
+
 TEST_GROUP(addFile) {
     struct stat st;
 
@@ -106,6 +231,18 @@ TEST(addFile, update) {
 
     CHECK(mockDB.assertFiles({"/dir0/file.ext"}, true));
 }
+TEST(addFile, update_replaces_path) {
+    TSharesDB shares;
+
+    mocks::SqliteMock mockDB(&shares);
+    mockDB.insertAttrsDifferent("/dir0/file.ext");
+    mockDB.insertAttrs("/dir0/other.ext");
+    mock().setData("TagLib::isNull", false);
+
+    shares.addFile("/dir0", "/dir0/file.ext", this->st);
+
+    CHECK_EQUAL(2, mockDB.countPaths());
+}
 
 TEST_GROUP(addDir) { };
 TEST(addDir, new_root) {
@@ -397,6 +534,143 @@ TEST(query, case_insensitive) {
     CHECK(expected == result);
 }
 
+TEST(query, file_list) {
+    TSharesDB shares;
+
+    mocks::SqliteMock mockDB(&shares);
+    mockDB.insertDirs(2);
+    mockDB.insertAttrs("/dir0/file0", 1);
+    mockDB.insertAttrs("/dir1/file1", 2);
+
+    newsoul::FileList result;
+    shares.query("file0", result);
+
+    CHECK_EQUAL(1, result.dirs().size());
+    CHECK_EQUAL(1, result.filesCount());
+    const newsoul::FileList::FileEntry *file = result.begin(result.dirs()[0]);
+    STRCMP_EQUAL("/dir0/file0", result.str(file->name));
+}
+
+TEST_GROUP(queryIndex) { };
+TEST(queryIndex, file_list) {
+    TSharesDB shares;
+
+    mocks::SqliteMock mockDB(&shares);
+    mockDB.insertDirs(2);
+    mockDB.insertAttrs("/dir0/file0", 1);
+    mockDB.insertAttrs("/dir0/file1", 1);
+    mockDB.insertAttrs("/dir1/file0", 2);
+    shares.buildIndex();
+
+    newsoul::FileList result;
+    result.addDir("stale");
+    result.addFile("stale", 1, "ext");
+    shares.query("file0", result);
+
+    CHECK_EQUAL(1, result.dirs().size());
+    const newsoul::FileList::DirEntry &dir = result.dirs()[0];
+    STRCMP_EQUAL("", result.str(dir.path));
+    std::set<std::string> names;
+    for(const auto *file = result.begin(dir); file != result.end(dir); ++file) {
+        names.insert(result.str(file->name));
+        CHECK_EQUAL(20, file->size);
+        STRCMP_EQUAL("ext", result.str(file->ext));
+        CHECK_EQUAL(3, file->attrsCount);
+        CHECK_EQUAL(192, file->attrs[0]);
+        CHECK_EQUAL(10, file->attrs[1]);
+        CHECK_EQUAL(0, file->attrs[2]);
+    }
+    CHECK(std::set<std::string>({"/dir0/file0", "/dir1/file0"}) == names);
+}
+TEST(queryIndex, two_words) {
+    TSharesDB shares;
+
+    mocks::SqliteMock mockDB(&shares);
+    mockDB.insertDirs(2);
+    mockDB.insertAttrs("/dir0/file0", 1);
+    mockDB.insertAttrs("/dir0/file1", 1);
+    mockDB.insertAttrs("/dir1/file0", 2);
+    shares.buildIndex();
+
+    newsoul::Dir result = shares.query("dir0 file0");
+
+    newsoul::File fe = {.size=20, .ext="ext", .attrs={192, 10, 0}, .mtime=600};
+    newsoul::Dir expected({
+        {"/dir0/file0", fe}
+    });
+    CHECK(expected == result);
+}
+TEST(queryIndex, negation) {
+    TSharesDB shares;
+
+    mocks::SqliteMock mockDB(&shares);
+    mockDB.insertDirs(2);
+    mockDB.insertAttrs("/dir0/file0", 1);
+    mockDB.insertAttrs("/dir1/file0", 2);
+    mockDB.insertAttrs("/dir1/file1", 2);
+    shares.buildIndex();
+
+    newsoul::Dir result = shares.query("file0 -dir0");
+
+    newsoul::File fe = {.size=20, .ext="ext", .attrs={192, 10, 0}, .mtime=600};
+    newsoul::Dir expected({
+        {"/dir1/file0", fe}
+    });
+    CHECK(expected == result);
+}
+TEST(queryIndex, asterisk) {
+    TSharesDB shares;
+
+    mocks::SqliteMock mockDB(&shares);
+    mockDB.insertDirs(1);
+    mockDB.insertAttrs("/dir0/file0", 1);
+    mockDB.insertAttrs("/dir0/other0", 1);
+    shares.buildIndex();
+
+    newsoul::Dir result = shares.query("fi*");
+
+    newsoul::File fe = {.size=20, .ext="ext", .attrs={192, 10, 0}, .mtime=600};
+    newsoul::Dir expected({
+        {"/dir0/file0", fe}
+    });
+    CHECK(expected == result);
+}
+TEST(queryIndex, phrase) {
+    TSharesDB shares;
+
+    mocks::SqliteMock mockDB(&shares);
+    mockDB.insertDirs(2);
+    mockDB.insertAttrs("/dir0/space file0", 1);
+    mockDB.insertAttrs("/dir0/space file1", 1);
+    mockDB.insertAttrs("/dir0/spacefile0", 1);
+    mockDB.insertAttrs("/dir1/file0 space", 2);
+    shares.buildIndex();
+
+    newsoul::Dir result = shares.query("\"space file0\"");
+
+    newsoul::File fe = {.size=20, .ext="ext", .attrs={192, 10, 0}, .mtime=600};
+    newsoul::Dir expected({
+        {"/dir0/space file0", fe}
+    });
+    CHECK(expected == result);
+}
+TEST(queryIndex, case_insensitive) {
+    TSharesDB shares;
+
+    mocks::SqliteMock mockDB(&shares);
+    mockDB.insertDirs(1);
+    mockDB.insertAttrs("/dir0/FIle0", 1);
+    shares.buildIndex();
+
+    newsoul::Dir result = shares.query("fiLE0");
+
+    newsoul::File fe = {.size=20, .ext="ext", .attrs={192, 10, 0}, .mtime=600};
+    newsoul::Dir expected({
+        {"/dir0/FIle0", fe}
+    });
+    CHECK(expected == result);
+}
+
 TEST_GROUP(toProperCase) { };
 TEST(toProperCase, entry_exists_upper_case) {
     TSharesDB shares;
@@ -418,6 +692,16 @@ TEST(toProperCase, entry_exists_lower_case) {
 
     CHECK_EQUAL("/dir/file.ext0", result);
 }
+TEST(toProperCase, entry_exists_mixed_case) {
+    TSharesDB shares;
+
+    mocks::SqliteMock mockDB(&shares);
+    mockDB.insertFilesUpperCase(1);
+
+    std::string result = shares.toProperCase("/DIR/file.EXT0");
+
+    CHECK_EQUAL("/Dir/File.ext0", result);
+}
 TEST(toProperCase, entry_does_not_exist) {
     TSharesDB shares;
 
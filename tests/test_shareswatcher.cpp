@@ -0,0 +1,185 @@
+/*
+ This is a part of newsoul @ http://github.com/KenjiTakahashi/newsoul
+ Karol "Kenji Takahashi" Woźniak © 2014
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fstream>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <CppUTest/TestHarness.h>
+#include <CppUTestExt/MockSupport.h>
+#include "mocks/sqlite.h"
+#include "../src/shareswatcher.h"
+
+class TSharesWatcher : public newsoul::SharesWatcher {
+public:
+    TSharesWatcher(newsoul::SharesDB *db, const std::vector<std::string> &roots, std::function<void(void)> updated)
+        : newsoul::SharesWatcher(db, roots, updated) { }
+
+    using newsoul::SharesWatcher::flush;
+
+    /* Reads the events the reactor would wake us up for. */
+    void events() {
+        this->setReadyState(StateReceive);
+        this->process();
+    }
+};
+
+namespace {
+    int removeEntry(const char *path, const struct stat *, int, struct FTW *) {
+        return ::remove(path);
+    }
+
+    void write(const std::string &path, const std::string &data) {
+        std::ofstream(path.c_str()) << data;
+    }
+}
+
+/*
+ * A shared directory with a file and a subdirectory holding another one,
+ * already in the database when watching starts.
+ */
+TEST_GROUP(sharesWatcher) {
+    std::string root;
+    TSharesDB *shares;
+    mocks::SqliteMock *mockDB;
+    NewNet::RefPtr<NewNet::Reactor> reactor;
+    NewNet::RefPtr<TSharesWatcher> watcher;
+    int updates;
+
+    void setup() {
+        mock().setData("TagLib::isNull", true);
+        mock().ignoreOtherCalls();
+
+        char tmpl[] = "/tmp/newsoul-watcher-XXXXXX";
+        this->root = mkdtemp(tmpl);
+        write(this->root + "/file.ext", "data");
+        mkdir((this->root + "/dir").c_str(), 0755);
+        write(this->root + "/dir/file.ext", "data");
+
+        this->shares = new TSharesDB();
+        this->mockDB = new mocks::SqliteMock(this->shares);
+        this->shares->add({this->root});
+
+        this->updates = 0;
+        this->reactor = new NewNet::Reactor();
+        this->watcher = new TSharesWatcher(this->shares, {this->root}, [this]{ ++this->updates; });
+        this->reactor->add(this->watcher);
+    }
+
+    void teardown() {
+        this->watcher->disconnect();
+        this->reactor->remove(this->watcher);
+        this->watcher = 0;
+        this->reactor = 0;
+        delete this->mockDB;
+        delete this->shares;
+        nftw(this->root.c_str(), removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+
+    void apply() {
+        this->watcher->events();
+        this->watcher->flush(0);
+    }
+
+    bool shared(const std::string &path) {
+        return this->shares->isShared(this->root + path);
+    }
+};
+TEST(sharesWatcher, initial) {
+    CHECK(this->shared("/file.ext"));
+    CHECK(this->shared("/dir"));
+    CHECK(this->shared("/dir/file.ext"));
+}
+TEST(sharesWatcher, create_file) {
+    write(this->root + "/new.ext", "data");
+    write(this->root + "/dir/new.ext", "data");
+    this->apply();
+
+    CHECK(this->shared("/new.ext"));
+    CHECK(this->shared("/dir/new.ext"));
+    CHECK_EQUAL(1, this->updates);
+}
+TEST(sharesWatcher, modify_file) {
+    write(this->root + "/file.ext", "more data");
+    this->apply();
+
+    newsoul::File file;
+    CHECK_EQUAL(0, this->shares->getAttrs(this->root + "/file.ext", &file));
+    CHECK_EQUAL(9, file.size);
+}
+TEST(sharesWatcher, delete_file) {
+    ::remove((this->root + "/dir/file.ext").c_str());
+    this->apply();
+
+    CHECK_FALSE(this->shared("/dir/file.ext"));
+    CHECK(this->shared("/dir"));
+    CHECK(this->shared("/file.ext"));
+}
+TEST(sharesWatcher, rename_file) {
+    rename((this->root + "/file.ext").c_str(), (this->root + "/dir/moved.ext").c_str());
+    this->apply();
+
+    CHECK_FALSE(this->shared("/file.ext"));
+    CHECK(this->shared("/dir/moved.ext"));
+}
+TEST(sharesWatcher, recreate_file) {
+    ::remove((this->root + "/file.ext").c_str());
+    write(this->root + "/file.ext", "new");
+    this->apply();
+
+    newsoul::File file;
+    CHECK_EQUAL(0, this->shares->getAttrs(this->root + "/file.ext", &file));
+    CHECK_EQUAL(3, file.size);
+}
+TEST(sharesWatcher, create_dir) {
+    mkdir((this->root + "/new").c_str(), 0755);
+    this->apply();
+    CHECK(this->shared("/new"));
+
+    // Only seen if the new directory is watched as well
+    write(this->root + "/new/file.ext", "data");
+    this->apply();
+
+    CHECK(this->shared("/new/file.ext"));
+    CHECK_EQUAL(2, this->updates);
+}
+TEST(sharesWatcher, delete_dir) {
+    ::remove((this->root + "/dir/file.ext").c_str());
+    rmdir((this->root + "/dir").c_str());
+    this->apply();
+
+    CHECK_FALSE(this->shared("/dir"));
+    CHECK_FALSE(this->shared("/dir/file.ext"));
+    CHECK(this->shared("/file.ext"));
+}
+TEST(sharesWatcher, rename_dir) {
+    rename((this->root + "/dir").c_str(), (this->root + "/moved").c_str());
+    this->apply();
+
+    CHECK_FALSE(this->shared("/dir"));
+    CHECK_FALSE(this->shared("/dir/file.ext"));
+    CHECK(this->shared("/moved"));
+    CHECK(this->shared("/moved/file.ext"));
+
+    write(this->root + "/moved/new.ext", "data");
+    this->apply();
+
+    CHECK(this->shared("/moved/new.ext"));
+}